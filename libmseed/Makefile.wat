@@ -35,7 +35,8 @@ OBJS=	fileutils.obj	&
 	unpack.obj	&
 	unpackdata.obj  &
 	selection.obj	&
-	logging.obj
+	logging.obj	&
+	streamid.obj
 
 all: lib
 
@@ -46,20 +47,21 @@ dll:	$(OBJS) .SYMBOLIC
 	wlink $(lflags) name libmseed file {$(OBJS)}
 
 # Source dependencies:
-fileutils.obj:	fileutils.c libmseed.h
-genutils.obj:	genutils.c libmseed.h
+fileutils.obj:	fileutils.c libmseed.h lmthread.h
+genutils.obj:	genutils.c libmseed.h lmhash.h lmthread.h
 gswap.obj:	gswap.c libmseed.h
-lmplatform.obj:	lmplatform.c libmseed.h
+lmplatform.obj:	lmplatform.c libmseed.h lmthread.h
 lookup.obj:	lookup.c libmseed.h
 msrutils.obj:	msrutils.c libmseed.h
-pack.obj:	pack.c libmseed.h packdata.h
+pack.obj:	pack.c libmseed.h lmthread.h packdata.h
 packdata.obj:	packdata.c libmseed.h packdata.h
-traceutils.obj:	traceutils.c libmseed.h
-tracelist.obj:	tracelist.c libmseed.h
+traceutils.obj:	traceutils.c libmseed.h lmthread.h
+tracelist.obj:	tracelist.c libmseed.h lmthread.h
 parseutils.obj:	parseutils.c libmseed.h
-unpack.obj:	unpack.c libmseed.h unpackdata.h
+unpack.obj:	unpack.c libmseed.h lmthread.h unpackdata.h
 unpackdata.obj:	unpackdata.c libmseed.h unpackdata.h
-logging.obj:	logging.c libmseed.h
+logging.obj:	logging.c libmseed.h lmthread.h
+streamid.obj:	streamid.c libmseed.h lmhash.h lmthread.h
 
 # How to compile sources:
 .c.obj:
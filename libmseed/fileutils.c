@@ -5,7 +5,7 @@
  * Written by Chad Trabant
  *   IRIS Data Management Center
  *
- * modified: 2015.108
+ * modified: 2026.292
  ***************************************************************************/
 
 #include <errno.h>
@@ -17,9 +17,52 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "lmthread.h"
 
 static int ms_fread (char *buf, int size, int num, FILE *stream);
 
+/* Size of the file chunks read by parallel reader threads, a multiple
+ * of MAXRECLEN so that chunks start at valid record offsets */
+#define PARREAD_CHUNKSIZE (4 * MAXRECLEN)
+
+/* Chunk of a file read by a parallel reader thread */
+typedef struct ParReadChunk_s
+{
+  off_t start;        /* File offset of the chunk */
+  off_t end;          /* File offset after the chunk */
+  off_t first;        /* Offset of the first record, or where scanning stopped */
+  off_t next;         /* Offset following the last record */
+  MSRecord **records; /* Records starting in the chunk, in file order */
+  int recordcount;
+  int recordsize;     /* Allocated length of records */
+  int state;          /* 0 = waiting, 1 = reading, 2 = done, -1 = error */
+} ParReadChunk;
+
+/* Shared state of a parallel reader */
+typedef struct ParRead_s
+{
+  const char *msfile;
+  int reclen;
+  Selections *selections;
+  flag skipnotdata;
+  flag dataflag;
+  flag verbose;
+  off_t filesize;
+  ParReadChunk *chunks;
+  int chunkcount;
+  int nextchunk; /* Next chunk to be read */
+  int consumed;  /* Number of chunks added to the trace list */
+  int window;    /* Maximum number of chunks read ahead of consumed */
+  int stop;      /* Reader threads should stop */
+  lmp_mutex_t lock;
+  lmp_cond_t cond;
+} ParRead;
+
+static void parread_worker (void *arg);
+static int parread_chunk (ParRead *pr, ParReadChunk *chunk, FILE *fp, char *buffer);
+static int parread_fill (FILE *fp, char *buffer, int *buflen, int want);
+static void parread_freechunk (ParReadChunk *chunk);
+
 /* Pack type parameters for the 8 defined types:
  * [type] : [hdrlen] [sizelen] [chksumlen]
  */
@@ -83,15 +126,17 @@ int8_t packtypes[9][3] = {
  *
  *********************************************************************/
 
-/* Initialize the global file reading parameters */
-MSFileParam gMSFileParam = {NULL, "", NULL, 0, 0, 0, 0, 0, 0, 0};
+/* Initialize the global file reading parameters, one set per thread */
+static LMP_TLS MSFileParam gMSFileParam = {NULL, "", NULL, 0, 0, 0, 0, 0, 0, 0};
 
 /**********************************************************************
  * ms_readmsr:
  *
  * This routine is a simple wrapper for ms_readmsr_main() that uses
- * the global file reading parameters.  This routine is not thread
- * safe and cannot be used to read more than one file at a time.
+ * the global file reading parameters.  The global parameters are
+ * specific to each thread, this routine can be used to read one file
+ * at a time in each thread and the file must be closed by the same
+ * thread.
  *
  * See the comments with ms_readmsr_main() for return values and
  * further description of arguments.
@@ -204,7 +249,10 @@ ms_shift_msfp (MSFileParam *msfp, int shift)
  *
  * If a Selections list is supplied it will be used to determine when
  * a section of data in a packed file may be skipped, packed files are
- * internal to the IRIS DMC.
+ * internal to the IRIS DMC.  Records that do not match the Selections
+ * are skipped by testing their headers with ms_recskipselect() before
+ * parsing, records that cannot be tested that way are returned and
+ * should be matched by the caller.
  *
  * After reading all the records in a file the controlling program
  * should call it one last time with msfile set to NULL.  This will
@@ -541,11 +589,28 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
     if (MSFPBUFLEN (msfp) >= MINRECLEN)
     {
       int parselen = MSFPBUFLEN (msfp);
+      int skiplen;
 
       /* Limit the parse length to offset of pack header if present in the buffer */
       if (msfp->packhdroffset && msfp->packhdroffset < (msfp->filepos + MSFPBUFLEN (msfp)))
         parselen = msfp->packhdroffset - msfp->filepos;
 
+      /* Skip records not matching the selections using only their headers */
+      if (selections && (skiplen = ms_recskipselect (MSFPREADPTR (msfp), parselen, reclen, selections)) > 0)
+      {
+        if (verbose > 1)
+          ms_log (1, "Skipped %d byte record not matching selections at byte offset %" PRId64 "\n",
+                  skiplen, msfp->filepos);
+
+        /* Update reading offset, file position and record count */
+        msfp->readoffset += skiplen;
+        msfp->filepos += skiplen;
+        msfp->recordcount++;
+
+        parseval = 0;
+        continue;
+      }
+
       parseval = msr_parse (MSFPREADPTR (msfp), parselen, ppmsr, reclen, dataflag, verbose);
 
       /* Record detected and parsed */
@@ -800,7 +865,7 @@ ms_readtraces_selection (MSTraceGroup **ppmstg, const char *msfile,
 
   /* Loop over the input file */
   while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, NULL, NULL,
-                                     skipnotdata, dataflag, NULL, verbose)) == MS_NOERROR)
+                                     skipnotdata, dataflag, selections, verbose)) == MS_NOERROR)
   {
     /* Test against selections if supplied */
     if (selections)
@@ -923,7 +988,7 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
 
   /* Loop over the input file */
   while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, NULL, NULL,
-                                     skipnotdata, dataflag, NULL, verbose)) == MS_NOERROR)
+                                     skipnotdata, dataflag, selections, verbose)) == MS_NOERROR)
   {
     /* Test against selections if supplied */
     if (selections)
@@ -953,6 +1018,449 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
   return retcode;
 } /* End of ms_readtracelist_selection() */
 
+/*********************************************************************
+ * ms_readtracelist_parallel:
+ *
+ * This routine reads all Mini-SEED records in the specified file and
+ * populates a trace list like ms_readtracelist_selection(), parsing
+ * and decoding the records in the specified number of threads.  The
+ * trace list is identical to reading the file sequentially.
+ *
+ * The file is divided into chunks of PARREAD_CHUNKSIZE bytes which are
+ * read by the threads in file order.  The first record of each chunk
+ * after the first is found by scanning for a valid record header with
+ * ms_detect() at MINRECLEN steps from the start of the chunk.  The
+ * records of each chunk are added to the trace list by the calling
+ * thread in file order once the chunk is read, and only if the chunk
+ * continues exactly where the records of the previous chunk ended,
+ * possibly after non-data skipped as requested with skipnotdata.
+ * This is always the case for files of fixed length records.  When a
+ * chunk does not continue the previous chunk, or cannot be read, the
+ * rest of the file is read sequentially from the end of the previous
+ * chunk, so errors are reported as ms_readtracelist_selection() does.
+ *
+ * Standard input, packed files, small files and a threads value less
+ * than 2 are read sequentially.
+ *
+ * Returns MS_NOERROR and populates an MSTraceList struct at *ppmstl
+ * on successful read, otherwise returns a libmseed error code (listed
+ * in libmseed.h).
+ *********************************************************************/
+int
+ms_readtracelist_parallel (MSTraceList **ppmstl, const char *msfile,
+                           int reclen, double timetol, double sampratetol,
+                           Selections *selections, flag dataquality,
+                           flag skipnotdata, flag dataflag, int threads,
+                           flag verbose)
+{
+  ParRead pr;
+  ParReadChunk *chunk;
+  lmp_thread_t *tids = NULL;
+  MSRecord *msr      = NULL;
+  MSFileParam *msfp  = NULL;
+  FILE *fp;
+  struct stat sbuf;
+  char signature[3];
+  off_t fpos;
+  off_t offset = 0;
+  int retcode  = MS_NOERROR;
+  int created  = 0;
+  int idx;
+  int ridx;
+
+  if (!ppmstl || !msfile)
+    return MS_GENERROR;
+
+  if (threads < 2 || !strcmp (msfile, "-") || stat (msfile, &sbuf) ||
+      sbuf.st_size < 2 * PARREAD_CHUNKSIZE)
+    return ms_readtracelist_selection (ppmstl, msfile, reclen, timetol, sampratetol,
+                                       selections, dataquality, skipnotdata,
+                                       dataflag, verbose);
+
+  /* Packed files are read sequentially */
+  if ((fp = fopen (msfile, "rb")) != NULL)
+  {
+    if (fread (signature, 1, 3, fp) == 3 &&
+        (!memcmp ("PED", signature, 3) || !memcmp ("PSD", signature, 3) ||
+         !memcmp ("PLC", signature, 3) || !memcmp ("PQI", signature, 3) ||
+         !memcmp ("PLS", signature, 3)))
+      threads = 0;
+
+    fclose (fp);
+  }
+
+  if (!fp || !threads)
+    return ms_readtracelist_selection (ppmstl, msfile, reclen, timetol, sampratetol,
+                                       selections, dataquality, skipnotdata,
+                                       dataflag, verbose);
+
+  /* Initialize MSTraceList if needed */
+  if (!*ppmstl)
+  {
+    *ppmstl = mstl_init (*ppmstl);
+
+    if (!*ppmstl)
+      return MS_GENERROR;
+  }
+
+  memset (&pr, 0, sizeof (ParRead));
+  pr.msfile      = msfile;
+  pr.reclen      = reclen;
+  pr.selections  = selections;
+  pr.skipnotdata = skipnotdata;
+  pr.dataflag    = dataflag;
+  pr.verbose     = verbose;
+  pr.filesize    = sbuf.st_size;
+  pr.chunkcount  = (int)((pr.filesize + PARREAD_CHUNKSIZE - 1) / PARREAD_CHUNKSIZE);
+  pr.window      = 2 * threads;
+
+  if (!(pr.chunks = (ParReadChunk *)calloc (pr.chunkcount, sizeof (ParReadChunk))) ||
+      !(tids = (lmp_thread_t *)malloc (threads * sizeof (lmp_thread_t))))
+  {
+    ms_log (2, "ms_readtracelist_parallel(): Cannot allocate memory\n");
+    if (pr.chunks)
+      free (pr.chunks);
+    return MS_GENERROR;
+  }
+
+  for (idx = 0; idx < pr.chunkcount; idx++)
+  {
+    pr.chunks[idx].start = (off_t)idx * PARREAD_CHUNKSIZE;
+    pr.chunks[idx].end   = pr.chunks[idx].start + PARREAD_CHUNKSIZE;
+
+    if (pr.chunks[idx].end > pr.filesize)
+      pr.chunks[idx].end = pr.filesize;
+  }
+
+  lmp_mutex_init (&pr.lock);
+  lmp_cond_init (&pr.cond);
+
+  for (created = 0; created < threads; created++)
+    if (lmp_thread_create (&tids[created], parread_worker, &pr))
+      break;
+
+  if (verbose > 0)
+    ms_log (1, "Reading %s with %d threads in %d chunks\n", msfile, created, pr.chunkcount);
+
+  /* Add the records of each chunk in file order */
+  for (idx = 0; created > 0 && idx < pr.chunkcount; idx++)
+  {
+    chunk = &pr.chunks[idx];
+
+    lmp_mutex_lock (&pr.lock);
+    while (chunk->state == 0 || chunk->state == 1)
+      lmp_cond_wait (&pr.cond, &pr.lock);
+    lmp_mutex_unlock (&pr.lock);
+
+    /* The chunk continues the records if its first record follows the
+     * last record of the previous chunk, or if non-data is skipped and
+     * the previous chunk ended in the non-data scanned by this chunk */
+    if (chunk->state < 0 ||
+        (chunk->first != offset &&
+         !(skipnotdata && offset >= chunk->start && offset <= chunk->first &&
+           (offset - chunk->start) % MINRECLEN == 0)))
+    {
+      if (verbose > 1)
+        ms_log (1, "Chunk at byte offset %" PRId64 " does not continue records, reading sequentially from %" PRId64 "\n",
+                (int64_t)chunk->start, (int64_t)offset);
+      break;
+    }
+
+    for (ridx = 0; ridx < chunk->recordcount; ridx++)
+      mstl_addmsr (*ppmstl, chunk->records[ridx], dataquality, 1, timetol, sampratetol);
+
+    parread_freechunk (chunk);
+    offset = chunk->next;
+
+    lmp_mutex_lock (&pr.lock);
+    pr.consumed = idx + 1;
+    lmp_cond_broadcast (&pr.cond);
+    lmp_mutex_unlock (&pr.lock);
+  }
+
+  /* Stop and join the reader threads */
+  lmp_mutex_lock (&pr.lock);
+  pr.stop = 1;
+  lmp_cond_broadcast (&pr.cond);
+  lmp_mutex_unlock (&pr.lock);
+
+  for (ridx = 0; ridx < created; ridx++)
+    lmp_thread_join (tids[ridx]);
+
+  for (ridx = 0; ridx < pr.chunkcount; ridx++)
+    parread_freechunk (&pr.chunks[ridx]);
+
+  lmp_cond_destroy (&pr.cond);
+  lmp_mutex_destroy (&pr.lock);
+  free (pr.chunks);
+  free (tids);
+
+  /* Read the rest of the file sequentially if not all chunks were added */
+  if (idx < pr.chunkcount)
+  {
+    fpos = -offset;
+
+    while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, &fpos, NULL,
+                                       skipnotdata, dataflag, selections, verbose)) == MS_NOERROR)
+    {
+      /* Test against selections if supplied */
+      if (selections)
+      {
+        char srcname[50];
+        hptime_t endtime;
+
+        msr_srcname (msr, srcname, 1);
+        endtime = msr_endtime (msr);
+
+        if (ms_matchselect (selections, srcname, msr->starttime, endtime, NULL) == NULL)
+        {
+          continue;
+        }
+      }
+
+      /* Add to trace list */
+      mstl_addmsr (*ppmstl, msr, dataquality, 1, timetol, sampratetol);
+    }
+
+    /* Reset return code to MS_NOERROR on successful read by ms_readmsr() */
+    if (retcode == MS_ENDOFFILE)
+      retcode = MS_NOERROR;
+
+    ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
+  }
+
+  return retcode;
+} /* End of ms_readtracelist_parallel() */
+
+/*********************************************************************
+ * parread_worker:
+ *
+ * Reader thread routine, read the next chunk of the file until all
+ * chunks are read or the reader is stopped.  Chunks are not read more
+ * than the window ahead of the chunks added to the trace list.
+ *********************************************************************/
+static void
+parread_worker (void *arg)
+{
+  ParRead *pr  = (ParRead *)arg;
+  char *buffer = NULL;
+  FILE *fp;
+  int idx;
+  int retval;
+
+  fp = fopen (pr->msfile, "rb");
+
+  if (fp)
+    buffer = (char *)malloc (PARREAD_CHUNKSIZE + MAXRECLEN);
+
+  for (;;)
+  {
+    lmp_mutex_lock (&pr->lock);
+
+    while (!pr->stop && pr->nextchunk < pr->chunkcount &&
+           pr->nextchunk >= pr->consumed + pr->window)
+      lmp_cond_wait (&pr->cond, &pr->lock);
+
+    if (pr->stop || pr->nextchunk >= pr->chunkcount)
+    {
+      lmp_mutex_unlock (&pr->lock);
+      break;
+    }
+
+    idx                   = pr->nextchunk++;
+    pr->chunks[idx].state = 1;
+
+    lmp_mutex_unlock (&pr->lock);
+
+    retval = (fp && buffer) ? parread_chunk (pr, &pr->chunks[idx], fp, buffer) : -1;
+
+    lmp_mutex_lock (&pr->lock);
+    pr->chunks[idx].state = (retval) ? -1 : 2;
+    lmp_cond_broadcast (&pr->cond);
+    lmp_mutex_unlock (&pr->lock);
+  }
+
+  if (buffer)
+    free (buffer);
+
+  if (fp)
+    fclose (fp);
+} /* End of parread_worker() */
+
+/*********************************************************************
+ * parread_chunk:
+ *
+ * Read a chunk of the file and parse the records starting in it.
+ * Unless the chunk starts the file the first record is found by
+ * scanning for a valid record header at MINRECLEN steps, after that
+ * records are parsed consecutively as ms_readmsr_main() does.
+ *
+ * The buffer must hold PARREAD_CHUNKSIZE + MAXRECLEN bytes.
+ *
+ * Returns 0 on success and -1 on error, including records that
+ * cannot be parsed and are not skipped.
+ *********************************************************************/
+static int
+parread_chunk (ParRead *pr, ParReadChunk *chunk, FILE *fp, char *buffer)
+{
+  MSRecord *msr = NULL;
+  MSRecord **records;
+  off_t offset;
+  int chunklen = (int)(chunk->end - chunk->start);
+  int buflen   = 0;
+  int parseval;
+  int remaining;
+  int skiplen;
+
+  chunk->first = -1;
+
+  if (lmp_fseeko (fp, chunk->start, SEEK_SET))
+    return -1;
+
+  /* Read the chunk and enough to complete common record lengths */
+  if (parread_fill (fp, buffer, &buflen, chunklen + 8192))
+    return -1;
+
+  for (offset = chunk->start; offset < chunk->end;)
+  {
+    remaining = buflen - (int)(offset - chunk->start);
+
+    if (remaining < MINRECLEN)
+      break;
+
+    /* Scan for the first record header of chunks after the first */
+    if (chunk->first < 0 && chunk->start > 0 &&
+        ms_detect (buffer + (offset - chunk->start), remaining) < 0)
+    {
+      offset += MINRECLEN;
+      continue;
+    }
+
+    if (chunk->first < 0)
+      chunk->first = offset;
+
+    /* Skip records not matching the selections using only their headers */
+    if (pr->selections &&
+        (skiplen = ms_recskipselect (buffer + (offset - chunk->start), remaining,
+                                     pr->reclen, pr->selections)) > 0)
+    {
+      offset += skiplen;
+      continue;
+    }
+
+    if (!msr && !(msr = msr_init (NULL)))
+      return -1;
+
+    parseval = msr_parse (buffer + (offset - chunk->start), remaining, &msr,
+                          pr->reclen, pr->dataflag, pr->verbose);
+
+    /* Complete a record crossing the end of the buffer */
+    if (parseval > 0 && buflen < chunklen + MAXRECLEN &&
+        chunk->start + buflen < pr->filesize)
+    {
+      if (parread_fill (fp, buffer, &buflen, chunklen + MAXRECLEN))
+        break;
+
+      continue;
+    }
+
+    if (parseval == 0)
+    {
+      offset += msr->reclen;
+
+      /* Test against selections if supplied */
+      if (pr->selections)
+      {
+        char srcname[50];
+
+        msr_srcname (msr, srcname, 1);
+
+        if (ms_matchselect (pr->selections, srcname, msr->starttime, msr_endtime (msr), NULL) == NULL)
+          continue;
+      }
+
+      if (chunk->recordcount >= chunk->recordsize)
+      {
+        records = (MSRecord **)realloc (chunk->records, (chunk->recordsize + 256) * sizeof (MSRecord *));
+
+        if (!records)
+          break;
+
+        chunk->records = records;
+        chunk->recordsize += 256;
+      }
+
+      chunk->records[chunk->recordcount++] = msr;
+      msr                                  = NULL;
+    }
+    else if (parseval < 0 && pr->skipnotdata)
+    {
+      offset += MINRECLEN;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if (msr)
+    msr_free (&msr);
+
+  if (chunk->first < 0)
+    chunk->first = offset;
+
+  chunk->next = offset;
+
+  return (offset < chunk->end && buflen - (offset - chunk->start) >= MINRECLEN) ? -1 : 0;
+} /* End of parread_chunk() */
+
+/*********************************************************************
+ * parread_fill:
+ *
+ * Read from the current file position into the buffer until it holds
+ * want bytes or the end of the file is reached.
+ *
+ * Returns 0 on success and -1 on read errors.
+ *********************************************************************/
+static int
+parread_fill (FILE *fp, char *buffer, int *buflen, int want)
+{
+  int readcount;
+
+  while (*buflen < want)
+  {
+    readcount = (int)fread (buffer + *buflen, 1, want - *buflen, fp);
+
+    if (readcount <= 0)
+      return (ferror (fp)) ? -1 : 0;
+
+    *buflen += readcount;
+  }
+
+  return 0;
+} /* End of parread_fill() */
+
+/*********************************************************************
+ * parread_freechunk:
+ *
+ * Free the records of a chunk.
+ *********************************************************************/
+static void
+parread_freechunk (ParReadChunk *chunk)
+{
+  int idx;
+
+  for (idx = 0; idx < chunk->recordcount; idx++)
+    msr_free (&chunk->records[idx]);
+
+  if (chunk->records)
+    free (chunk->records);
+
+  chunk->records     = NULL;
+  chunk->recordcount = 0;
+  chunk->recordsize  = 0;
+} /* End of parread_freechunk() */
+
 /*********************************************************************
  * ms_fread:
  *
@@ -7,7 +7,7 @@
  * ORFEUS/EC-Project MEREDIAN
  * IRIS Data Management Center
  *
- * modified: 2017.053
+ * modified: 2026.292
  ***************************************************************************/
 
 #include <errno.h>
@@ -17,6 +17,8 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "lmhash.h"
+#include "lmthread.h"
 
 static hptime_t ms_time2hptime_int (int year, int day, int hour,
                                     int min, int sec, int usec);
@@ -29,6 +31,9 @@ static struct tm *ms_gmtime_r (int64_t *timep, struct tm *result);
 /* Global variable to hold a leap second list */
 LeapSecond *leapsecondlist = NULL;
 
+/* Lock serializing additions to the leap second list */
+static lmp_mutex_t leapsecondlock = LMP_MUTEX_INITIALIZER;
+
 /***************************************************************************
  * ms_recsrcname:
  *
@@ -1167,6 +1172,10 @@ ms_readleapseconds (char *envvarname)
  * second list format.  The list is usually available from:
  * https://www.ietf.org/timezones/data/leap-seconds.list
  *
+ * The leap seconds of the file are added to the global list in one
+ * step.  The list is read without locking by the time calculations,
+ * load leap seconds before starting threads that use them.
+ *
  * Returns positive number of leap seconds read on success and -1 on error.
  ***************************************************************************/
 int
@@ -1174,6 +1183,7 @@ ms_readleapsecondfile (char *filename)
 {
   FILE *fp           = NULL;
   LeapSecond *ls     = NULL;
+  LeapSecond *lslist = NULL;
   LeapSecond *lastls = NULL;
   int64_t expires;
   char readline[200];
@@ -1240,6 +1250,12 @@ ms_readleapsecondfile (char *filename)
       if ((ls = malloc (sizeof (LeapSecond))) == NULL)
       {
         ms_log (2, "Cannot allocate LeapSecond, out of memory?\n");
+        fclose (fp);
+        while ((ls = lslist))
+        {
+          lslist = ls->next;
+          free (ls);
+        }
         return -1;
       }
 
@@ -1248,17 +1264,14 @@ ms_readleapsecondfile (char *filename)
       ls->TAIdelta   = TAIdelta;
       ls->next       = NULL;
 
-      /* Add leap second to global list */
-      if (!leapsecondlist)
-      {
-        leapsecondlist = ls;
-        lastls         = ls;
-      }
+      /* Add leap second to the list read from this file */
+      if (!lslist)
+        lslist = ls;
       else
-      {
         lastls->next = ls;
-        lastls       = ls;
-      }
+
+      lastls = ls;
+      count++;
     }
     else
     {
@@ -1273,6 +1286,26 @@ ms_readleapsecondfile (char *filename)
 
   fclose (fp);
 
+  /* Add the complete list to the end of the global list, concurrent
+     readers of the global list see either none or all of the entries */
+  if (lslist)
+  {
+    lmp_mutex_lock (&leapsecondlock);
+
+    if (!leapsecondlist)
+    {
+      leapsecondlist = lslist;
+    }
+    else
+    {
+      for (ls = leapsecondlist; ls->next; ls = ls->next)
+        ;
+      ls->next = lslist;
+    }
+
+    lmp_mutex_unlock (&leapsecondlock);
+  }
+
   return count;
 } /* End of ms_readleapsecondfile() */
 
@@ -1729,3 +1762,20 @@ ms_gmtime_r (int64_t *timep, struct tm *result)
 
   return result;
 } /* End of ms_gmtime_r() */
+
+/***************************************************************************
+ * lmp_fnv32:
+ *
+ * Continue a 32-bit FNV-1a hash, starting at LMP_FNV32_INIT, with the
+ * characters of a string.
+ *
+ * Returns the hash.
+ ***************************************************************************/
+uint32_t
+lmp_fnv32 (uint32_t hash, const char *string)
+{
+  for (; *string; string++)
+    hash = (hash ^ (uint8_t)*string) * 16777619U;
+
+  return hash;
+} /* End of lmp_fnv32() */
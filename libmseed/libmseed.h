@@ -28,8 +28,8 @@
 extern "C" {
 #endif
 
-#define LIBMSEED_VERSION "2.19.3"
-#define LIBMSEED_RELEASE "2017.075"
+#define LIBMSEED_VERSION "2.20.0"
+#define LIBMSEED_RELEASE "2026.292"
 
 /* C99 standard headers */
 #include <stdlib.h>
@@ -482,6 +482,7 @@ typedef struct MSRecord_s {
   char            location[11];      /* Location designation, NULL terminated */
   char            channel[11];       /* Channel designation, NULL terminated */
   char            dataquality;       /* Data quality indicator */
+  int32_t         streamid;          /* Interned stream ID of the codes, 0 if not set */
   hptime_t        starttime;         /* Record start time, corrected (first sample) */
   double          samprate;          /* Nominal sample rate (Hz) */
   int64_t         samplecnt;         /* Number of samples in record */
@@ -506,6 +507,7 @@ typedef struct MSTrace_s {
   char            channel[11];       /* Channel designation, NULL terminated */
   char            dataquality;       /* Data quality indicator */
   char            type;              /* MSTrace type code */
+  int32_t         streamid;          /* Interned stream ID of the codes, 0 if not set */
   hptime_t        starttime;         /* Time of first sample */
   hptime_t        endtime;           /* Time of last sample */
   double          samprate;          /* Nominal sample rate (Hz) */
@@ -550,6 +552,7 @@ typedef struct MSTraceID_s {
   char            dataquality;       /* Data quality indicator */
   char            srcname[45];       /* Source name (Net_Sta_Loc_Chan_Qual), NULL terminated */
   char            type;              /* Trace type code */
+  int32_t         streamid;          /* Interned stream ID of the codes */
   hptime_t        earliest;          /* Time of earliest sample */
   hptime_t        latest;            /* Time of latest sample */
   void           *prvtptr;           /* Private pointer for general use, unused by libmseed */
@@ -557,6 +560,7 @@ typedef struct MSTraceID_s {
   struct MSTraceSeg_s *first;        /* Pointer to first of list of segments */
   struct MSTraceSeg_s *last;         /* Pointer to last of list of segments */
   struct MSTraceID_s *next;          /* Pointer to next trace */
+  struct MSTraceSegIndex_s *segindex; /* Lookup index of segments, private to libmseed */
 }
 MSTraceID;
 
@@ -565,6 +569,7 @@ typedef struct MSTraceList_s {
   int32_t             numtraces;     /* Number of traces in list */
   struct MSTraceID_s *traces;        /* Pointer to list of traces */
   struct MSTraceID_s *last;          /* Pointer to last used trace in list */
+  struct MSTraceIDIndex_s *idindex;  /* Lookup index of trace IDs, private to libmseed */
 }
 MSTraceList;
 
@@ -635,6 +640,7 @@ extern hptime_t      msr_starttime (MSRecord *msr);
 extern hptime_t      msr_starttime_uc (MSRecord *msr);
 extern hptime_t      msr_endtime (MSRecord *msr);
 extern char*         msr_srcname (MSRecord *msr, char *srcname, flag quality);
+extern int32_t       msr_streamid (MSRecord *msr);
 extern void          msr_print (MSRecord *msr, flag details);
 extern double        msr_host_latency (MSRecord *msr);
 
@@ -664,6 +670,7 @@ extern int           mst_groupheal (MSTraceGroup *mstg, double timetol, double s
 extern int           mst_groupsort (MSTraceGroup *mstg, flag quality);
 extern int           mst_convertsamples (MSTrace *mst, char type, flag truncate);
 extern char *        mst_srcname (MSTrace *mst, char *srcname, flag quality);
+extern int32_t       mst_streamid (MSTrace *mst);
 extern void          mst_printtracelist (MSTraceGroup *mstg, flag timeformat,
 					 flag details, flag gaps);
 extern void          mst_printsynclist ( MSTraceGroup *mstg, char *dccid, flag subsecond );
@@ -681,6 +688,7 @@ extern int           mst_packgroup (MSTraceGroup *mstg, void (*record_handler) (
 /* MSTraceList related functions */
 extern MSTraceList * mstl_init ( MSTraceList *mstl );
 extern void          mstl_free ( MSTraceList **ppmstl, flag freeprvtptr );
+extern void          mstl_resetindex ( MSTraceList *mstl, MSTraceID *id );
 extern MSTraceSeg *  mstl_addmsr ( MSTraceList *mstl, MSRecord *msr, flag dataquality,
 				   flag autoheal, double timetol, double sampratetol );
 extern int           mstl_convertsamples ( MSTraceSeg *seg, char type, flag truncate );
@@ -723,6 +731,9 @@ extern int      ms_readtracelist_timewin (MSTraceList **ppmstl, const char *msfi
 					  hptime_t starttime, hptime_t endtime, flag dataquality, flag skipnotdata, flag dataflag, flag verbose);
 extern int      ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile, int reclen, double timetol, double sampratetol,
 					    Selections *selections, flag dataquality, flag skipnotdata, flag dataflag, flag verbose);
+extern int      ms_readtracelist_parallel (MSTraceList **ppmstl, const char *msfile, int reclen, double timetol, double sampratetol,
+					   Selections *selections, flag dataquality, flag skipnotdata, flag dataflag,
+					   int threads, flag verbose);
 
 extern int      msr_writemseed ( MSRecord *msr, const char *msfile, flag overwrite, int reclen,
 				 flag encoding, flag byteorder, flag verbose );
@@ -731,6 +742,14 @@ extern int      mst_writemseed ( MSTrace *mst, const char *msfile, flag overwrit
 extern int      mst_writemseedgroup ( MSTraceGroup *mstg, const char *msfile, flag overwrite,
 				      int reclen, flag encoding, flag byteorder, flag verbose );
 
+/* Interned stream identifiers */
+extern int32_t  ms_streamid (const char *network, const char *station,
+			     const char *location, const char *channel);
+extern int32_t  ms_findstreamid (const char *network, const char *station,
+				 const char *location, const char *channel);
+extern const char* ms_streamid_srcname (int32_t streamid);
+extern void     ms_freestreamids (void);
+
 /* General use functions */
 extern char*    ms_recsrcname (char *record, char *srcname, flag quality);
 extern int      ms_splitsrcname (char *srcname, char *net, char *sta, char *loc, char *chan, char *qual);
@@ -785,11 +804,17 @@ extern void   ms_loginit (void (*log_print)(char*), const char *logprefix,
 extern MSLogParam *ms_loginit_l (MSLogParam *logp,
 			         void (*log_print)(char*), const char *logprefix,
 			         void (*diag_print)(char*), const char *errprefix);
+extern int    ms_loglevel (int minlevel);
+extern int    ms_logenabled (int level);
+extern int    ms_logstartwriter (int buffersize);
+extern void   ms_logstopwriter (void);
+extern void   ms_logflush (void);
 
 /* Selection functions */
 extern Selections *ms_matchselect (Selections *selections, char *srcname,
 				   hptime_t starttime, hptime_t endtime, SelectTime **ppselecttime);
 extern Selections *msr_matchselect (Selections *selections, MSRecord *msr, SelectTime **ppselecttime);
+extern int      ms_recskipselect (char *record, int recbuflen, int reclen, Selections *selections);
 extern int      ms_addselect (Selections **ppselections, char *srcname,
 			      hptime_t starttime, hptime_t endtime);
 extern int      ms_addselect_comp (Selections **ppselections, char *net, char* sta, char *loc,
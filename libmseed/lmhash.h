@@ -0,0 +1,28 @@
+/***************************************************************************
+ * lmhash.h:
+ *
+ * Interface declarations for the libmseed hashing routines, internal
+ * to the library.
+ *
+ * modified: 2026.292
+ ***************************************************************************/
+
+#ifndef LMHASH_H
+#define LMHASH_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "libmseed.h"
+
+/* Offset basis of the 32-bit FNV-1a hash, the initial hash value */
+#define LMP_FNV32_INIT 2166136261U
+
+extern uint32_t lmp_fnv32 (uint32_t hash, const char *string);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LMHASH_H */
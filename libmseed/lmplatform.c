@@ -3,13 +3,38 @@
  *
  * Platform portability routines.
  *
- * modified: 2010.304
+ * modified: 2026.292
  ***************************************************************************/
 
 /* Define _LARGEFILE_SOURCE to get ftello/fseeko on some systems (Linux) */
 #define _LARGEFILE_SOURCE 1
 
 #include "libmseed.h"
+#include "lmthread.h"
+
+/* Routine and argument of a new thread */
+struct lmp_threadcall {
+  void (*routine) (void *);
+  void *arg;
+};
+
+#if defined(LMP_WIN)
+/* Routine and argument of a one-time initialization */
+struct lmp_oncecall {
+  void (*routine) (void *);
+  void *arg;
+};
+
+static BOOL CALLBACK lmp_oncecallback (PINIT_ONCE once, PVOID param, PVOID *context);
+static DWORD WINAPI lmp_threadstart (LPVOID param);
+#else
+static void lmp_oncecallback (void);
+static void *lmp_threadstart (void *param);
+
+/* Routine and argument of a one-time initialization in this thread */
+static LMP_TLS void (*lmp_onceroutine) (void *) = NULL;
+static LMP_TLS void *lmp_oncearg                = NULL;
+#endif
 
 /***************************************************************************
  * lmp_ftello:
@@ -46,3 +71,161 @@ lmp_fseeko (FILE *stream, off_t offset, int whence)
 
 #endif
 } /* End of lmp_fseeko() */
+
+/***************************************************************************
+ * lmp_once:
+ *
+ * Call a routine with the specified argument exactly once for a
+ * lmp_once_t control, initialized with LMP_ONCE_INIT, no matter how
+ * many threads call this routine concurrently.  Threads that call
+ * this routine while the initialization is in progress wait for it
+ * to complete.  The routine is called in the thread that runs the
+ * initialization, an argument pointing to thread specific data is
+ * only used by that thread.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+lmp_once (lmp_once_t *once, void (*routine) (void *), void *arg)
+{
+#if defined(LMP_WIN)
+  struct lmp_oncecall call;
+
+  call.routine = routine;
+  call.arg     = arg;
+
+  return (InitOnceExecuteOnce (once, lmp_oncecallback, &call, NULL)) ? 0 : -1;
+
+#else
+  lmp_onceroutine = routine;
+  lmp_oncearg     = arg;
+
+  return (pthread_once (once, lmp_oncecallback)) ? -1 : 0;
+
+#endif
+} /* End of lmp_once() */
+
+/***************************************************************************
+ * lmp_thread_create:
+ *
+ * Start a new thread running a routine with the specified argument.
+ * The thread must be joined with lmp_thread_join().
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+lmp_thread_create (lmp_thread_t *thread, void (*routine) (void *), void *arg)
+{
+  struct lmp_threadcall *call;
+
+  if (!(call = (struct lmp_threadcall *)malloc (sizeof (struct lmp_threadcall))))
+    return -1;
+
+  call->routine = routine;
+  call->arg     = arg;
+
+#if defined(LMP_WIN)
+  if (!(*thread = CreateThread (NULL, 0, lmp_threadstart, call, 0, NULL)))
+  {
+    free (call);
+    return -1;
+  }
+
+#else
+  if (pthread_create (thread, NULL, lmp_threadstart, call))
+  {
+    free (call);
+    return -1;
+  }
+
+#endif
+
+  return 0;
+} /* End of lmp_thread_create() */
+
+/***************************************************************************
+ * lmp_thread_join:
+ *
+ * Wait for a thread started with lmp_thread_create() to finish.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+lmp_thread_join (lmp_thread_t thread)
+{
+#if defined(LMP_WIN)
+  if (WaitForSingleObject (thread, INFINITE) != WAIT_OBJECT_0)
+    return -1;
+
+  CloseHandle (thread);
+
+  return 0;
+
+#else
+  return (pthread_join (thread, NULL)) ? -1 : 0;
+
+#endif
+} /* End of lmp_thread_join() */
+
+#if defined(LMP_WIN)
+/***************************************************************************
+ * lmp_oncecallback:
+ *
+ * Call the routine of a one-time initialization.
+ ***************************************************************************/
+static BOOL CALLBACK
+lmp_oncecallback (PINIT_ONCE once, PVOID param, PVOID *context)
+{
+  struct lmp_oncecall *call = (struct lmp_oncecall *)param;
+
+  call->routine (call->arg);
+
+  return TRUE;
+} /* End of lmp_oncecallback() */
+
+/***************************************************************************
+ * lmp_threadstart:
+ *
+ * Run the routine of a thread started with lmp_thread_create().
+ ***************************************************************************/
+static DWORD WINAPI
+lmp_threadstart (LPVOID param)
+{
+  struct lmp_threadcall call = *(struct lmp_threadcall *)param;
+
+  free (param);
+  call.routine (call.arg);
+
+  return 0;
+} /* End of lmp_threadstart() */
+
+#else
+/***************************************************************************
+ * lmp_oncecallback:
+ *
+ * Call the routine of a one-time initialization with the argument
+ * stored by lmp_once() in the calling thread.
+ ***************************************************************************/
+static void
+lmp_oncecallback (void)
+{
+  lmp_onceroutine (lmp_oncearg);
+} /* End of lmp_oncecallback() */
+
+/***************************************************************************
+ * lmp_threadstart:
+ *
+ * Run the routine of a thread started with lmp_thread_create().
+ ***************************************************************************/
+static void *
+lmp_threadstart (void *param)
+{
+  struct lmp_threadcall call = *(struct lmp_threadcall *)param;
+
+  free (param);
+  call.routine (call.arg);
+
+  return NULL;
+} /* End of lmp_threadstart() */
+
+#endif
@@ -0,0 +1,91 @@
+/***************************************************************************
+ * lmthread.h:
+ *
+ * Interface declarations for the libmseed thread portability routines,
+ * internal to the library.
+ *
+ * modified: 2026.292
+ ***************************************************************************/
+
+#ifndef LMTHREAD_H
+#define LMTHREAD_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+
+#include "libmseed.h"
+
+#if defined(LMP_WIN)
+  /* Mutual exclusion with slim reader/writer locks */
+  typedef SRWLOCK lmp_mutex_t;
+  #define LMP_MUTEX_INITIALIZER SRWLOCK_INIT
+  #define lmp_mutex_lock(M) AcquireSRWLockExclusive (M)
+  #define lmp_mutex_unlock(M) ReleaseSRWLockExclusive (M)
+  #define lmp_mutex_init(M) InitializeSRWLock (M)
+  #define lmp_mutex_destroy(M)
+
+  /* Condition variables used with the locks */
+  typedef CONDITION_VARIABLE lmp_cond_t;
+  #define LMP_COND_INITIALIZER CONDITION_VARIABLE_INIT
+  #define lmp_cond_wait(C, M) SleepConditionVariableSRW ((C), (M), INFINITE, 0)
+  #define lmp_cond_signal(C) WakeConditionVariable (C)
+  #define lmp_cond_broadcast(C) WakeAllConditionVariable (C)
+  #define lmp_cond_init(C) InitializeConditionVariable (C)
+  #define lmp_cond_destroy(C)
+
+  /* Threads */
+  typedef HANDLE lmp_thread_t;
+
+  /* One-time initialization */
+  typedef INIT_ONCE lmp_once_t;
+  #define LMP_ONCE_INIT INIT_ONCE_STATIC_INIT
+
+  /* Thread local storage */
+  #define LMP_TLS __declspec(thread)
+
+  #define lmp_localtime_r(T, TM) (localtime_s ((TM), (T)) ? NULL : (TM))
+#else
+  #include <pthread.h>
+
+  /* Mutual exclusion with POSIX mutexes */
+  typedef pthread_mutex_t lmp_mutex_t;
+  #define LMP_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+  #define lmp_mutex_lock(M) pthread_mutex_lock (M)
+  #define lmp_mutex_unlock(M) pthread_mutex_unlock (M)
+  #define lmp_mutex_init(M) pthread_mutex_init ((M), NULL)
+  #define lmp_mutex_destroy(M) pthread_mutex_destroy (M)
+
+  /* Condition variables used with the mutexes */
+  typedef pthread_cond_t lmp_cond_t;
+  #define LMP_COND_INITIALIZER PTHREAD_COND_INITIALIZER
+  #define lmp_cond_wait(C, M) pthread_cond_wait ((C), (M))
+  #define lmp_cond_signal(C) pthread_cond_signal (C)
+  #define lmp_cond_broadcast(C) pthread_cond_broadcast (C)
+  #define lmp_cond_init(C) pthread_cond_init ((C), NULL)
+  #define lmp_cond_destroy(C) pthread_cond_destroy (C)
+
+  /* Threads */
+  typedef pthread_t lmp_thread_t;
+
+  /* One-time initialization */
+  typedef pthread_once_t lmp_once_t;
+  #define LMP_ONCE_INIT PTHREAD_ONCE_INIT
+
+  /* Thread local storage */
+  #define LMP_TLS __thread
+
+  #define lmp_localtime_r(T, TM) localtime_r ((T), (TM))
+#endif
+
+extern int lmp_once (lmp_once_t *once, void (*routine) (void *), void *arg);
+extern int lmp_thread_create (lmp_thread_t *thread, void (*routine) (void *), void *arg);
+extern int lmp_thread_join (lmp_thread_t thread);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LMTHREAD_H */
@@ -6,7 +6,7 @@
  * Chad Trabant
  * IRIS Data Management Center
  *
- * modified: 2014.197
+ * modified: 2026.292
  ***************************************************************************/
 
 #include <stdarg.h>
@@ -15,6 +15,53 @@
 #include <string.h>
 
 #include "libmseed.h"
+#include "lmthread.h"
+
+/* Size of the per-thread log buffers if not specified */
+#define LOG_BUFFERSIZE 65536
+
+/* Round a length up to the alignment of buffered log entries */
+#define LOG_ALIGN(L) (((L) + sizeof (void *) - 1) & ~(sizeof (void *) - 1))
+
+/* Header of a buffered log message, followed by the message string */
+typedef struct LogEntry_s
+{
+  void (*print) (char *); /* Print function, NULL to print to a stream */
+  int tostderr;           /* Print to stderr instead of stdout */
+  int length;             /* Length of the entry including the header */
+} LogEntry;
+
+/* Per-thread buffer of log messages */
+typedef struct LogBuffer_s
+{
+  char *data;                  /* Buffered log entries */
+  size_t used;                 /* Bytes used in the buffer */
+  struct LogBuffer_s *next;    /* Next buffer in the writer queue or free list */
+  struct LogBuffer_s *allnext; /* Next of all allocated buffers */
+} LogBuffer;
+
+static lmp_mutex_t loglock      = LMP_MUTEX_INITIALIZER;
+static lmp_cond_t logcond       = LMP_COND_INITIALIZER;
+static lmp_thread_t logthread;
+static int logwriting           = 0;    /* Writer thread is running */
+static int logstopping          = 0;    /* Writer thread should stop */
+static int loggeneration        = 0;    /* Incremented for each writer */
+static int logminlevel          = 0;    /* Lowest level of messages emitted */
+static size_t logbuffersize     = 0;    /* Size of per-thread buffers */
+static LogBuffer *logqueue      = NULL; /* Buffers waiting for the writer */
+static LogBuffer *logqueuetail  = NULL;
+static LogBuffer *logfreelist   = NULL; /* Buffers available for reuse */
+static LogBuffer *logbuffers    = NULL; /* All allocated buffers */
+
+/* Log buffer of this thread and the writer generation it belongs to */
+static LMP_TLS LogBuffer *logthreadbuffer = NULL;
+static LMP_TLS int logthreadgeneration    = 0;
+
+static char *log_reserve (void);
+static void log_commit (char *message, void (*print) (char *), int tostderr, int level);
+static void log_queue (LogBuffer *buffer);
+static void log_writer (void *arg);
+static void log_printbuffer (LogBuffer *buffer);
 
 void ms_loginit_main (MSLogParam *logp,
                       void (*log_print) (char *), const char *logprefix,
@@ -146,6 +193,164 @@ ms_loginit_main (MSLogParam *logp,
   return;
 } /* End of ms_loginit_main() */
 
+/***************************************************************************
+ * ms_loglevel:
+ *
+ * Set the lowest level of messages emitted by ms_log() and ms_log_l(),
+ * messages with a lower level are discarded without being formatted.
+ * The default level of 0 emits all messages, a level of 2 emits only
+ * error messages.  Use ms_logenabled() to skip preparing messages that
+ * would be discarded.
+ *
+ * This function should be called before starting threads that log.
+ *
+ * Returns the previous level.
+ ***************************************************************************/
+int
+ms_loglevel (int minlevel)
+{
+  int previous = logminlevel;
+
+  logminlevel = minlevel;
+
+  return previous;
+} /* End of ms_loglevel() */
+
+/***************************************************************************
+ * ms_logenabled:
+ *
+ * Returns 1 if messages of the specified level are emitted and 0 if
+ * they are discarded.
+ ***************************************************************************/
+int
+ms_logenabled (int level)
+{
+  return (level >= 0 && level >= logminlevel);
+} /* End of ms_logenabled() */
+
+/***************************************************************************
+ * ms_logstartwriter:
+ *
+ * Start a writer thread that prints log messages asynchronously.  While
+ * the writer is running ms_log() and ms_log_l() format messages into a
+ * buffer of the calling thread without locking.  A full buffer, or a
+ * buffer holding an error message, is handed to the writer thread which
+ * passes the messages to the print functions in the order they were
+ * logged by each thread.  Messages of different threads are printed in
+ * the order their buffers were handed to the writer.
+ *
+ * The print functions are only called from the writer thread and need
+ * not be thread safe.  Threads can hand their buffered messages to the
+ * writer with ms_logflush().
+ *
+ * The buffersize is the size of each per-thread buffer, if it is 0 or
+ * less a default of 64 KiB is used.
+ *
+ * This function should be called before starting threads that log.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+ms_logstartwriter (int buffersize)
+{
+  if (logwriting)
+    return 0;
+
+  if (buffersize <= 0)
+    logbuffersize = LOG_BUFFERSIZE;
+  else
+    logbuffersize = buffersize;
+
+  if (logbuffersize < LOG_ALIGN (sizeof (LogEntry) + MAX_LOG_MSG_LENGTH))
+    logbuffersize = LOG_ALIGN (sizeof (LogEntry) + MAX_LOG_MSG_LENGTH);
+
+  logstopping = 0;
+  loggeneration++;
+
+  if (lmp_thread_create (&logthread, log_writer, NULL))
+  {
+    ms_log (2, "ms_logstartwriter(): Cannot start log writer thread\n");
+    return -1;
+  }
+
+  logwriting = 1;
+
+  return 0;
+} /* End of ms_logstartwriter() */
+
+/***************************************************************************
+ * ms_logstopwriter:
+ *
+ * Print all buffered log messages, stop the writer thread started with
+ * ms_logstartwriter() and free the log buffers.  Messages are printed
+ * directly again afterwards.
+ *
+ * No other thread may log during this call, threads that log should
+ * be finished before the writer is stopped.
+ ***************************************************************************/
+void
+ms_logstopwriter (void)
+{
+  LogBuffer *buffer;
+
+  if (!logwriting)
+    return;
+
+  lmp_mutex_lock (&loglock);
+
+  if (logthreadbuffer && logthreadgeneration == loggeneration &&
+      logthreadbuffer->used)
+    log_queue (logthreadbuffer);
+
+  logstopping = 1;
+  lmp_cond_signal (&logcond);
+
+  lmp_mutex_unlock (&loglock);
+
+  lmp_thread_join (logthread);
+
+  logwriting = 0;
+
+  /* Print messages left in the buffers of other threads and free all buffers */
+  while ((buffer = logbuffers))
+  {
+    logbuffers = buffer->allnext;
+
+    if (buffer->used)
+      log_printbuffer (buffer);
+
+    free (buffer);
+  }
+
+  logqueue     = NULL;
+  logqueuetail = NULL;
+  logfreelist  = NULL;
+
+  logthreadbuffer = NULL;
+} /* End of ms_logstopwriter() */
+
+/***************************************************************************
+ * ms_logflush:
+ *
+ * Hand the log messages buffered by the calling thread to the writer
+ * thread started with ms_logstartwriter().  Threads should call this
+ * routine before they finish or wait for a long time.  Nothing is done
+ * if the writer is not running.
+ ***************************************************************************/
+void
+ms_logflush (void)
+{
+  if (!logwriting || !logthreadbuffer || logthreadgeneration != loggeneration ||
+      !logthreadbuffer->used)
+    return;
+
+  lmp_mutex_lock (&loglock);
+  log_queue (logthreadbuffer);
+  lmp_mutex_unlock (&loglock);
+
+  logthreadbuffer = NULL;
+} /* End of ms_logflush() */
+
 /***************************************************************************
  * ms_log:
  *
@@ -226,16 +431,25 @@ ms_log_l (MSLogParam *logp, int level, ...)
  * All messages will be truncated to the MAX_LOG_MSG_LENGTH, this includes
  * any set prefix.
  *
+ * Messages with a level below the level set with ms_loglevel() are
+ * discarded without being formatted.  While a writer thread started
+ * with ms_logstartwriter() is running messages are formatted into a
+ * buffer of the calling thread and printed by the writer thread.
+ *
  * Returns the number of characters formatted on success, and a
  * a negative value on error.
  ***************************************************************************/
 int
 ms_log_main (MSLogParam *logp, int level, va_list *varlist)
 {
-  static char message[MAX_LOG_MSG_LENGTH];
+  char localmessage[MAX_LOG_MSG_LENGTH];
+  char *message;
   int retvalue = 0;
   int presize;
+  int tostderr;
   const char *format;
+  const char *prefix;
+  void (*print) (char *);
 
   if (!logp)
   {
@@ -243,86 +457,223 @@ ms_log_main (MSLogParam *logp, int level, va_list *varlist)
     return -1;
   }
 
-  message[0] = '\0';
+  if (level < 0 || level < logminlevel)
+    return 0;
 
   format = va_arg (*varlist, const char *);
 
   if (level >= 2) /* Error message */
   {
-    if (logp->errprefix != NULL)
-    {
-      strncpy (message, logp->errprefix, MAX_LOG_MSG_LENGTH);
-      message[MAX_LOG_MSG_LENGTH - 1] = '\0';
-    }
-    else
-    {
-      strncpy (message, "Error: ", MAX_LOG_MSG_LENGTH);
-    }
+    prefix   = (logp->errprefix != NULL) ? logp->errprefix : "Error: ";
+    print    = logp->diag_print;
+    tostderr = 1;
+  }
+  else if (level == 1) /* Diagnostic message */
+  {
+    prefix   = logp->logprefix;
+    print    = logp->diag_print;
+    tostderr = 1;
+  }
+  else /* Normal log message */
+  {
+    prefix   = logp->logprefix;
+    print    = logp->log_print;
+    tostderr = 0;
+  }
 
-    presize  = strlen (message);
-    retvalue = vsnprintf (&message[presize],
-                          MAX_LOG_MSG_LENGTH - presize,
-                          format, *varlist);
+  /* Format into the buffer of this thread if the writer is running */
+  if (!logwriting || !(message = log_reserve ()))
+    message = localmessage;
 
+  message[0] = '\0';
+
+  if (prefix != NULL)
+  {
+    strncpy (message, prefix, MAX_LOG_MSG_LENGTH);
     message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+  }
 
-    if (logp->diag_print != NULL)
-    {
-      logp->diag_print (message);
-    }
-    else
-    {
-      fprintf (stderr, "%s", message);
-    }
+  presize  = strlen (message);
+  retvalue = vsnprintf (&message[presize],
+                        MAX_LOG_MSG_LENGTH - presize,
+                        format, *varlist);
+
+  message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+
+  if (message != localmessage)
+  {
+    log_commit (message, print, tostderr, level);
   }
-  else if (level == 1) /* Diagnostic message */
+  else if (print != NULL)
   {
-    if (logp->logprefix != NULL)
-    {
-      strncpy (message, logp->logprefix, MAX_LOG_MSG_LENGTH);
-      message[MAX_LOG_MSG_LENGTH - 1] = '\0';
-    }
+    print (message);
+  }
+  else
+  {
+    fprintf ((tostderr) ? stderr : stdout, "%s", message);
+  }
 
-    presize  = strlen (message);
-    retvalue = vsnprintf (&message[presize],
-                          MAX_LOG_MSG_LENGTH - presize,
-                          format, *varlist);
+  return retvalue;
+} /* End of ms_log_main() */
 
-    message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+/***************************************************************************
+ * log_reserve:
+ *
+ * Reserve space for a message in the log buffer of the calling thread,
+ * handing a buffer without enough space to the writer thread and
+ * taking a new buffer as needed.
+ *
+ * Returns a pointer to MAX_LOG_MSG_LENGTH bytes for the message on
+ * success and NULL on error.
+ ***************************************************************************/
+static char *
+log_reserve (void)
+{
+  LogBuffer *buffer = logthreadbuffer;
+  size_t needed     = LOG_ALIGN (sizeof (LogEntry) + MAX_LOG_MSG_LENGTH);
 
-    if (logp->diag_print != NULL)
-    {
-      logp->diag_print (message);
-    }
-    else
-    {
-      fprintf (stderr, "%s", message);
-    }
+  if (buffer && logthreadgeneration == loggeneration &&
+      buffer->used + needed <= logbuffersize)
+    return buffer->data + buffer->used + sizeof (LogEntry);
+
+  lmp_mutex_lock (&loglock);
+
+  if (buffer && logthreadgeneration == loggeneration)
+    log_queue (buffer);
+
+  if ((buffer = logfreelist))
+  {
+    logfreelist = buffer->next;
   }
-  else if (level == 0) /* Normal log message */
+  else if ((buffer = (LogBuffer *)malloc (sizeof (LogBuffer) + logbuffersize)))
   {
-    if (logp->logprefix != NULL)
-    {
-      strncpy (message, logp->logprefix, MAX_LOG_MSG_LENGTH);
-      message[MAX_LOG_MSG_LENGTH - 1] = '\0';
-    }
+    buffer->data    = (char *)(buffer + 1);
+    buffer->allnext = logbuffers;
+    logbuffers      = buffer;
+  }
 
-    presize  = strlen (message);
-    retvalue = vsnprintf (&message[presize],
-                          MAX_LOG_MSG_LENGTH - presize,
-                          format, *varlist);
+  lmp_mutex_unlock (&loglock);
 
-    message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+  logthreadbuffer     = buffer;
+  logthreadgeneration = loggeneration;
+
+  if (!buffer)
+    return NULL;
+
+  buffer->used = 0;
+  buffer->next = NULL;
+
+  return buffer->data + sizeof (LogEntry);
+} /* End of log_reserve() */
+
+/***************************************************************************
+ * log_commit:
+ *
+ * Complete a message formatted into the space returned by
+ * log_reserve().  Error messages are handed to the writer thread
+ * immediately.
+ ***************************************************************************/
+static void
+log_commit (char *message, void (*print) (char *), int tostderr, int level)
+{
+  LogBuffer *buffer = logthreadbuffer;
+  LogEntry *entry   = (LogEntry *)(buffer->data + buffer->used);
+
+  entry->print    = print;
+  entry->tostderr = tostderr;
+  entry->length   = LOG_ALIGN (sizeof (LogEntry) + strlen (message) + 1);
+
+  buffer->used += entry->length;
+
+  if (level >= 2)
+    ms_logflush ();
+} /* End of log_commit() */
+
+/***************************************************************************
+ * log_queue:
+ *
+ * Append a buffer to the writer queue and wake the writer thread, the
+ * caller must hold the log lock.
+ ***************************************************************************/
+static void
+log_queue (LogBuffer *buffer)
+{
+  buffer->next = NULL;
+
+  if (logqueuetail)
+    logqueuetail->next = buffer;
+  else
+    logqueue = buffer;
+
+  logqueuetail = buffer;
+
+  lmp_cond_signal (&logcond);
+} /* End of log_queue() */
+
+/***************************************************************************
+ * log_writer:
+ *
+ * Writer thread routine, print the messages of queued buffers and
+ * return the buffers to the free list until stopped.
+ ***************************************************************************/
+static void
+log_writer (void *arg)
+{
+  LogBuffer *queue;
+  LogBuffer *buffer;
+
+  lmp_mutex_lock (&loglock);
 
-    if (logp->log_print != NULL)
+  for (;;)
+  {
+    while (!logqueue && !logstopping)
+      lmp_cond_wait (&logcond, &loglock);
+
+    if (!logqueue)
+      break;
+
+    queue        = logqueue;
+    logqueue     = NULL;
+    logqueuetail = NULL;
+
+    lmp_mutex_unlock (&loglock);
+
+    for (buffer = queue; buffer; buffer = buffer->next)
+      log_printbuffer (buffer);
+
+    lmp_mutex_lock (&loglock);
+
+    while ((buffer = queue))
     {
-      logp->log_print (message);
+      queue        = buffer->next;
+      buffer->next = logfreelist;
+      logfreelist  = buffer;
     }
+  }
+
+  lmp_mutex_unlock (&loglock);
+} /* End of log_writer() */
+
+/***************************************************************************
+ * log_printbuffer:
+ *
+ * Print the messages in a log buffer and mark it empty.
+ ***************************************************************************/
+static void
+log_printbuffer (LogBuffer *buffer)
+{
+  LogEntry *entry;
+  size_t offset;
+
+  for (offset = 0; offset < buffer->used; offset += entry->length)
+  {
+    entry = (LogEntry *)(buffer->data + offset);
+
+    if (entry->print != NULL)
+      entry->print ((char *)(entry + 1));
     else
-    {
-      fprintf (stdout, "%s", message);
-    }
+      fprintf ((entry->tostderr) ? stderr : stdout, "%s", (char *)(entry + 1));
   }
 
-  return retvalue;
-} /* End of ms_log_main() */
+  buffer->used = 0;
+} /* End of log_printbuffer() */
@@ -16,26 +16,36 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "lmthread.h"
 #include "packdata.h"
 
 /* Function(s) internal to this file */
 static int msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
                                 flag swapflag, flag normalize,
                                 struct blkt_1001_s **blkt1001,
-                                char *srcname, flag verbose);
+                                const char *srcname, flag verbose);
 static int msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
                               struct blkt_1001_s *blkt1001,
-                              char *srcname, flag verbose);
+                              const char *srcname, flag verbose);
 static int msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
                           int32_t *lastintsample, flag comphistory,
                           char sampletype, flag encoding, flag swapflag,
-                          char *srcname, flag verbose);
+                          const char *srcname, flag verbose);
+static void pack_environment (void *verbose);
+
+/* Records up to this length are packed in stack space, avoiding an
+ * allocation for each call, longer records in allocated memory */
+#define PACKSTACKRECLEN 8192
 
 /* Header and data byte order flags controlled by environment variables */
 /* -2 = not checked, -1 = checked but not set, or 0 = LE and 1 = BE */
 flag packheaderbyteorder = -2;
 flag packdatabyteorder   = -2;
 
+/* Environment variables are read once, by the first call to pack */
+static lmp_once_t packenvonce = LMP_ONCE_INIT;
+static int packenverror       = 0;
+
 /***************************************************************************
  * msr_pack:
  *
@@ -75,9 +85,11 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   uint16_t *HPdataoffset;
   struct blkt_1001_s *HPblkt1001 = NULL;
 
+  int64_t stackrec[PACKSTACKRECLEN / sizeof (int64_t)];
+  char *heaprec = NULL;
   char *rawrec;
-  char *envvariable;
-  char srcname[50];
+  char srcbuf[50];
+  const char *srcname;
 
   flag headerswapflag = 0;
   flag dataswapflag   = 0;
@@ -113,71 +125,24 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     memset (msr->ststate, 0, sizeof (StreamState));
   }
 
-  /* Generate source name for MSRecord */
-  if (msr_srcname (msr, srcname, 1) == NULL)
+  /* Use the source name of the stream ID, only generating it if unknown */
+  if (!(srcname = ms_streamid_srcname (msr_streamid (msr))))
   {
-    ms_log (2, "msr_unpack_data(): Cannot generate srcname\n");
-    return MS_GENERROR;
+    if (msr_srcname (msr, srcbuf, 0) == NULL)
+    {
+      ms_log (2, "msr_pack(): Cannot generate srcname\n");
+      return MS_GENERROR;
+    }
+
+    srcname = srcbuf;
   }
 
   /* Track original segment start time for new start time calculation */
   segstarttime = msr->starttime;
 
-  /* Read possible environmental variables that force byteorder */
-  if (packheaderbyteorder == -2)
-  {
-    if ((envvariable = getenv ("PACK_HEADER_BYTEORDER")))
-    {
-      if (*envvariable != '0' && *envvariable != '1')
-      {
-        ms_log (2, "Environment variable PACK_HEADER_BYTEORDER must be set to '0' or '1'\n");
-        return -1;
-      }
-      else if (*envvariable == '0')
-      {
-        packheaderbyteorder = 0;
-        if (verbose > 2)
-          ms_log (1, "PACK_HEADER_BYTEORDER=0, packing little-endian header\n");
-      }
-      else
-      {
-        packheaderbyteorder = 1;
-        if (verbose > 2)
-          ms_log (1, "PACK_HEADER_BYTEORDER=1, packing big-endian header\n");
-      }
-    }
-    else
-    {
-      packheaderbyteorder = -1;
-    }
-  }
-  if (packdatabyteorder == -2)
-  {
-    if ((envvariable = getenv ("PACK_DATA_BYTEORDER")))
-    {
-      if (*envvariable != '0' && *envvariable != '1')
-      {
-        ms_log (2, "Environment variable PACK_DATA_BYTEORDER must be set to '0' or '1'\n");
-        return -1;
-      }
-      else if (*envvariable == '0')
-      {
-        packdatabyteorder = 0;
-        if (verbose > 2)
-          ms_log (1, "PACK_DATA_BYTEORDER=0, packing little-endian data samples\n");
-      }
-      else
-      {
-        packdatabyteorder = 1;
-        if (verbose > 2)
-          ms_log (1, "PACK_DATA_BYTEORDER=1, packing big-endian data samples\n");
-      }
-    }
-    else
-    {
-      packdatabyteorder = -1;
-    }
-  }
+  /* Read possible environmental variables that force byteorder, once */
+  if (lmp_once (&packenvonce, pack_environment, &verbose) || packenverror)
+    return -1;
 
   /* Set default indicator, record length, byte order and encoding if needed */
   if (msr->dataquality == 0)
@@ -224,13 +189,20 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     return -1;
   }
 
-  /* Allocate space for data record */
-  rawrec = (char *)malloc (msr->reclen);
-
-  if (rawrec == NULL)
+  /* Use stack space for the data record if large enough, otherwise allocate */
+  if (msr->reclen <= (int)sizeof (stackrec))
   {
-    ms_log (2, "msr_pack(%s): Cannot allocate memory\n", srcname);
-    return -1;
+    rawrec = (char *)stackrec;
+  }
+  else
+  {
+    rawrec = heaprec = (char *)malloc (msr->reclen);
+
+    if (rawrec == NULL)
+    {
+      ms_log (2, "msr_pack(%s): Cannot allocate memory\n", srcname);
+      return -1;
+    }
   }
 
   /* Set header pointers to known offsets into FSDH */
@@ -277,7 +249,7 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     if (!msr_addblockette (msr, (char *)&blkt1000, sizeof (struct blkt_1000_s), 1000, 0))
     {
       ms_log (2, "msr_pack(%s): Error adding 1000 Blockette\n", srcname);
-      free (rawrec);
+      free (heaprec);
       return -1;
     }
   }
@@ -288,7 +260,7 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   if (headerlen == -1)
   {
     ms_log (2, "msr_pack(%s): Error packing header\n", srcname);
-    free (rawrec);
+    free (heaprec);
     return -1;
   }
 
@@ -346,7 +318,7 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     if (packsamples < 0)
     {
       ms_log (2, "msr_pack(%s): Error packing data samples\n", srcname);
-      free (rawrec);
+      free (heaprec);
       return -1;
     }
 
@@ -389,7 +361,7 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   if (verbose > 2)
     ms_log (1, "%s: Packed %d total samples\n", srcname, totalpackedsamples);
 
-  free (rawrec);
+  free (heaprec);
 
   return recordcnt;
 } /* End of msr_pack() */
@@ -409,7 +381,6 @@ int
 msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
 {
   char srcname[50];
-  char *envvariable;
   flag headerswapflag = 0;
   int headerlen;
   int maxheaderlen;
@@ -424,34 +395,9 @@ msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
     return MS_GENERROR;
   }
 
-  /* Read possible environmental variables that force byteorder */
-  if (packheaderbyteorder == -2)
-  {
-    if ((envvariable = getenv ("PACK_HEADER_BYTEORDER")))
-    {
-      if (*envvariable != '0' && *envvariable != '1')
-      {
-        ms_log (2, "Environment variable PACK_HEADER_BYTEORDER must be set to '0' or '1'\n");
-        return -1;
-      }
-      else if (*envvariable == '0')
-      {
-        packheaderbyteorder = 0;
-        if (verbose > 2)
-          ms_log (1, "PACK_HEADER_BYTEORDER=0, packing little-endian header\n");
-      }
-      else
-      {
-        packheaderbyteorder = 1;
-        if (verbose > 2)
-          ms_log (1, "PACK_HEADER_BYTEORDER=1, packing big-endian header\n");
-      }
-    }
-    else
-    {
-      packheaderbyteorder = -1;
-    }
-  }
+  /* Read possible environmental variables that force byteorder, once */
+  if (lmp_once (&packenvonce, pack_environment, &verbose) || packenverror)
+    return -1;
 
   if (msr->reclen < MINRECLEN || msr->reclen > MAXRECLEN)
   {
@@ -512,7 +458,7 @@ static int
 msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
                      flag swapflag, flag normalize,
                      struct blkt_1001_s **blkt1001,
-                     char *srcname, flag verbose)
+                     const char *srcname, flag verbose)
 {
   struct blkt_link_s *cur_blkt;
   struct fsdh_s *fsdh;
@@ -842,7 +788,7 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
  ***************************************************************************/
 static int
 msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
-                   struct blkt_1001_s *blkt1001, char *srcname, flag verbose)
+                   struct blkt_1001_s *blkt1001, const char *srcname, flag verbose)
 {
   struct fsdh_s *fsdh;
   hptime_t hptimems;
@@ -904,16 +850,12 @@ msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
 static int
 msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
                int32_t *lastintsample, flag comphistory, char sampletype,
-               flag encoding, flag swapflag, char *srcname, flag verbose)
+               flag encoding, flag swapflag, const char *srcname, flag verbose)
 {
   int nsamples;
   int32_t *intbuff;
   int32_t d0;
 
-  /* Check for encode debugging environment variable */
-  if (getenv ("ENCODE_DEBUG"))
-    encodedebug = 1;
-
   /* Decide if this is a format that we can encode */
   switch (encoding)
   {
@@ -1048,3 +990,78 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
 
   return nsamples;
 } /* End of msr_pack_data() */
+
+/***************************************************************************
+ * pack_environment:
+ *
+ * Read the environment variables that force the byte order of packed
+ * records and enable encoding diagnostics, setting packenverror if a
+ * variable is set to an invalid value.  Called once through lmp_once()
+ * with a pointer to the verbose flag of the caller, the byte order
+ * flags are only read from the environment if not set by the program.
+ ***************************************************************************/
+static void
+pack_environment (void *verbose)
+{
+  char *envvariable;
+
+  if (packheaderbyteorder == -2)
+  {
+    if ((envvariable = getenv ("PACK_HEADER_BYTEORDER")))
+    {
+      if (*envvariable != '0' && *envvariable != '1')
+      {
+        ms_log (2, "Environment variable PACK_HEADER_BYTEORDER must be set to '0' or '1'\n");
+        packenverror = 1;
+      }
+      else if (*envvariable == '0')
+      {
+        packheaderbyteorder = 0;
+        if (*((flag *)verbose) > 2)
+          ms_log (1, "PACK_HEADER_BYTEORDER=0, packing little-endian header\n");
+      }
+      else
+      {
+        packheaderbyteorder = 1;
+        if (*((flag *)verbose) > 2)
+          ms_log (1, "PACK_HEADER_BYTEORDER=1, packing big-endian header\n");
+      }
+    }
+    else
+    {
+      packheaderbyteorder = -1;
+    }
+  }
+  if (packdatabyteorder == -2)
+  {
+    if ((envvariable = getenv ("PACK_DATA_BYTEORDER")))
+    {
+      if (*envvariable != '0' && *envvariable != '1')
+      {
+        ms_log (2, "Environment variable PACK_DATA_BYTEORDER must be set to '0' or '1'\n");
+        packenverror = 1;
+      }
+      else if (*envvariable == '0')
+      {
+        packdatabyteorder = 0;
+        if (*((flag *)verbose) > 2)
+          ms_log (1, "PACK_DATA_BYTEORDER=0, packing little-endian data samples\n");
+      }
+      else
+      {
+        packdatabyteorder = 1;
+        if (*((flag *)verbose) > 2)
+          ms_log (1, "PACK_DATA_BYTEORDER=1, packing big-endian data samples\n");
+      }
+    }
+    else
+    {
+      packdatabyteorder = -1;
+    }
+  }
+
+
+  /* Check for encode debugging environment variable */
+  if (getenv ("ENCODE_DEBUG"))
+    encodedebug = 1;
+} /* End of pack_environment() */
@@ -33,7 +33,7 @@ extern int msr_encode_float64 (double *input, int samplecount, double *output,
 extern int msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
                               int outputlength, int32_t diff0, int swapflag);
 extern int msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
-                              int outputlength, int32_t diff0, char *srcname,
+                              int outputlength, int32_t diff0, const char *srcname,
                               int swapflag);
 
 #ifdef __cplusplus
@@ -148,6 +148,7 @@ msr_parse_selection (char *recbuf, int recbuflen, int64_t *offset,
 {
   int retval = MS_GENERROR;
   int unpackretval;
+  int skiplen;
   flag dataswapflag  = 0;
   flag bigendianhost = ms_bigendianhost ();
 
@@ -162,6 +163,15 @@ msr_parse_selection (char *recbuf, int recbuflen, int64_t *offset,
 
   while (*offset < recbuflen)
   {
+    /* Skip records not matching the selections using only their headers */
+    if (selections &&
+        (skiplen = ms_recskipselect (recbuf + *offset, (int)(recbuflen - *offset), reclen, selections)) > 0)
+    {
+      *offset += skiplen;
+      retval = MS_GENERROR;
+      continue;
+    }
+
     retval = msr_parse (recbuf + *offset, (int)(recbuflen - *offset), ppmsr, reclen, 0, verbose);
 
     if (retval)
@@ -6,7 +6,7 @@
  * Written by Chad Trabant unless otherwise noted
  *   IRIS Data Management Center
  *
- * modified: 2014.197
+ * modified: 2026.292
  ***************************************************************************/
 
 #include <errno.h>
@@ -16,8 +16,90 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "lmhash.h"
+#include "lmthread.h"
+
+/* Number of hash table slots of a new selection index, a power of 2 */
+#define SELECT_HASHMIN 64
+
+/* Earliest and latest times used for open time window boundaries */
+#define SELECT_TIMEMIN (-9223372036854775807LL - 1)
+#define SELECT_TIMEMAX 9223372036854775807LL
+
+/* Operations of a compiled globbing pattern */
+#define GLOBOP_CHAR 0 /* Match the character in value */
+#define GLOBOP_ANY 1  /* Match any single character */
+#define GLOBOP_SET 2  /* Match a character in the set numbered value */
+#define GLOBOP_STAR 3 /* Match zero or more characters */
+#define GLOBOP_FAIL 4 /* Never match, the set is not terminated */
+
+typedef struct SelectGlobOp_s {
+  uint8_t op;
+  uint8_t value;
+} SelectGlobOp;
+
+/* Compiled globbing pattern */
+typedef struct SelectGlob_s {
+  int opcount;
+  SelectGlobOp *ops;
+  uint8_t (*sets)[32];          /* Bitmaps of characters in sets */
+} SelectGlob;
+
+/* Time window of an indexed selection entry */
+typedef struct SelectWindow_s {
+  hptime_t starttime;           /* Start time or SELECT_TIMEMIN if open */
+  hptime_t endtime;             /* End time or SELECT_TIMEMAX if open */
+  hptime_t maxend;              /* Latest end time of this and earlier windows */
+  int32_t seq;                  /* Order added, later windows are earlier in list */
+  SelectTime *selecttime;
+} SelectWindow;
+
+/* Indexed selection entry */
+typedef struct SelectEntry_s {
+  Selections *selection;
+  SelectGlob *glob;             /* Compiled pattern, NULL if srcname is literal */
+  SelectWindow *windows;        /* Time windows sorted by start time */
+  int32_t windowcount;
+  int32_t windowsize;
+} SelectEntry;
+
+/* Lookup index of a Selections list, registered for the first entry */
+typedef struct SelectIndex_s {
+  Selections *head;             /* First entry of the indexed list */
+  Selections *headnext;         /* Next entry of the first entry */
+  SelectTime *headwindows;      /* Time windows of the first entry */
+  char headsrcname[100];        /* Source name of the first entry */
+  SelectEntry *entries;         /* Entries in order added, later entries are earlier in list */
+  int32_t count;
+  int32_t size;
+  int32_t *globs;               /* Entries with globbing patterns in order added */
+  int32_t globcount;
+  int32_t *slots;               /* Hash table of entries by srcname, entry + 1 or 0 if empty */
+  uint32_t slotcount;           /* Number of hash table slots, a power of 2 */
+  int32_t windowseq;            /* Number of time windows added */
+  struct SelectIndex_s *next;   /* Next registered index */
+} SelectIndex;
+
+/* Lookup indexes of the lists built with ms_addselect(), the Selections
+ * structure has no room for them and lists built by callers must not
+ * be mistaken for indexed lists */
+static SelectIndex *selectindexes = NULL;
+static lmp_mutex_t selectlock     = LMP_MUTEX_INITIALIZER;
 
 static int ms_globmatch (char *string, char *pattern);
+static int ms_matchtimewindow (SelectTime *selecttime, hptime_t starttime, hptime_t endtime);
+static Selections *selectindex_match (SelectIndex *index, char *srcname, hptime_t starttime,
+                                      hptime_t endtime, SelectTime **ppselecttime);
+static SelectTime *selectentry_matchtime (SelectEntry *entry, hptime_t starttime, hptime_t endtime);
+static int32_t selectindex_find (SelectIndex *index, char *srcname);
+static int selectindex_add (SelectIndex *index, Selections *selection, SelectTime *selecttime);
+static int selectindex_hash (SelectIndex *index, int32_t entry);
+static void selectindex_register (SelectIndex *index, Selections *head);
+static SelectIndex *selectindex_lookup (Selections *head, flag remove);
+static void selectindex_free (SelectIndex *index);
+static SelectGlob *globcompile (char *pattern);
+static int globmatch_compiled (SelectGlob *glob, char *string);
+static int globsetmember (char *set, char x);
 
 /***************************************************************************
  * ms_matchselect:
@@ -36,6 +118,11 @@ ms_matchselect (Selections *selections, char *srcname, hptime_t starttime,
   Selections *findsl  = NULL;
   SelectTime *findst  = NULL;
   SelectTime *matchst = NULL;
+  SelectIndex *index  = NULL;
+
+  /* Use the lookup index of lists built with ms_addselect() */
+  if (selections && (index = selectindex_lookup (selections, 0)))
+    return selectindex_match (index, srcname, starttime, endtime, ppselecttime);
 
   if (selections)
   {
@@ -47,21 +134,13 @@ ms_matchselect (Selections *selections, char *srcname, hptime_t starttime,
         findst = findsl->timewindows;
         while (findst)
         {
-          if (starttime != HPTERROR && findst->starttime != HPTERROR &&
-              (starttime < findst->starttime && !(starttime <= findst->starttime && endtime >= findst->starttime)))
+          if (ms_matchtimewindow (findst, starttime, endtime))
           {
-            findst = findst->next;
-            continue;
-          }
-          else if (endtime != HPTERROR && findst->endtime != HPTERROR &&
-                   (endtime > findst->endtime && !(starttime <= findst->endtime && endtime >= findst->endtime)))
-          {
-            findst = findst->next;
-            continue;
+            matchst = findst;
+            break;
           }
 
-          matchst = findst;
-          break;
+          findst = findst->next;
         }
       }
 
@@ -78,6 +157,28 @@ ms_matchselect (Selections *selections, char *srcname, hptime_t starttime,
   return (matchst) ? findsl : NULL;
 } /* End of ms_matchselect() */
 
+/***************************************************************************
+ * ms_matchtimewindow:
+ *
+ * Test if a time range overlaps a selection time window, the NULL
+ * value (matching any times) for all times is HPTERROR.
+ *
+ * Return 1 if the time range matches and 0 otherwise.
+ ***************************************************************************/
+static int
+ms_matchtimewindow (SelectTime *selecttime, hptime_t starttime, hptime_t endtime)
+{
+  if (starttime != HPTERROR && selecttime->starttime != HPTERROR &&
+      (starttime < selecttime->starttime && !(starttime <= selecttime->starttime && endtime >= selecttime->starttime)))
+    return 0;
+
+  if (endtime != HPTERROR && selecttime->endtime != HPTERROR &&
+      (endtime > selecttime->endtime && !(starttime <= selecttime->endtime && endtime >= selecttime->endtime)))
+    return 0;
+
+  return 1;
+} /* End of ms_matchtimewindow() */
+
 /***************************************************************************
  * msr_matchselect:
  *
@@ -116,8 +217,12 @@ int
 ms_addselect (Selections **ppselections, char *srcname,
               hptime_t starttime, hptime_t endtime)
 {
-  Selections *newsl = NULL;
-  SelectTime *newst = NULL;
+  Selections *newsl  = NULL;
+  SelectTime *newst  = NULL;
+  Selections *addsl  = NULL;
+  Selections *headsl = NULL;
+  SelectIndex *index = NULL;
+  int32_t entry;
 
   if (!ppselections || !srcname)
     return -1;
@@ -148,22 +253,38 @@ ms_addselect (Selections **ppselections, char *srcname,
     /* Add new Selections struct as first in list */
     *ppselections      = newsl;
     newsl->timewindows = newst;
+    addsl              = newsl;
+
+    /* Create the lookup index of the new list */
+    if (!(index = (SelectIndex *)calloc (1, sizeof (SelectIndex))))
+      ms_log (1, "Cannot allocate selection index, searching list\n");
   }
   else
   {
     Selections *findsl  = *ppselections;
     Selections *matchsl = 0;
 
+    headsl = *ppselections;
+    index  = selectindex_lookup (headsl, 1);
+
     /* Search for matching Selectlink entry */
-    while (findsl)
+    if (index)
+    {
+      if ((entry = selectindex_find (index, srcname)) >= 0)
+        matchsl = index->entries[entry].selection;
+    }
+    else
     {
-      if (!strcmp (findsl->srcname, srcname))
+      while (findsl)
       {
-        matchsl = findsl;
-        break;
-      }
+        if (!strcmp (findsl->srcname, srcname))
+        {
+          matchsl = findsl;
+          break;
+        }
 
-      findsl = findsl->next;
+        findsl = findsl->next;
+      }
     }
 
     if (matchsl)
@@ -171,6 +292,7 @@ ms_addselect (Selections **ppselections, char *srcname,
       /* Add time window selection to beginning of window list */
       newst->next          = matchsl->timewindows;
       matchsl->timewindows = newst;
+      addsl                = matchsl;
     }
     else
     {
@@ -188,9 +310,21 @@ ms_addselect (Selections **ppselections, char *srcname,
       newsl->next        = *ppselections;
       *ppselections      = newsl;
       newsl->timewindows = newst;
+      addsl              = newsl;
     }
   }
 
+  /* Update and register the lookup index, the list is searched without it */
+  if (index && selectindex_add (index, addsl, newst))
+  {
+    ms_log (1, "Cannot update selection index, searching list\n");
+    selectindex_free (index);
+    index = NULL;
+  }
+
+  if (index)
+    selectindex_register (index, *ppselections);
+
   return 0;
 } /* End of ms_addselect() */
 
@@ -478,9 +612,13 @@ ms_freeselections (Selections *selections)
   Selections *selectnext;
   SelectTime *selecttime;
   SelectTime *selecttimenext;
+  SelectIndex *index;
 
   if (selections)
   {
+    if ((index = selectindex_lookup (selections, 1)))
+      selectindex_free (index);
+
     select = selections;
 
     while (select)
@@ -549,6 +687,376 @@ ms_printselections (Selections *selections)
   }
 } /* End of ms_printselections() */
 
+/***************************************************************************
+ * selectindex_match:
+ *
+ * Find the selection entry and time window matching a srcname and
+ * time range using the lookup index of a Selections list.  The entry
+ * and time window returned are the first matching in list order, the
+ * same as found by searching the list.
+ *
+ * Return Selections pointer to matching entry on successful match and
+ * NULL for no match.
+ ***************************************************************************/
+static Selections *
+selectindex_match (SelectIndex *index, char *srcname, hptime_t starttime,
+                   hptime_t endtime, SelectTime **ppselecttime)
+{
+  SelectEntry *entry;
+  SelectTime *selecttime;
+  SelectTime *matchst = NULL;
+  int32_t matchentry  = -1;
+  int32_t idx;
+
+  /* Literal source names match by the hash table */
+  if ((idx = selectindex_find (index, srcname)) >= 0 && !index->entries[idx].glob)
+  {
+    if ((matchst = selectentry_matchtime (&index->entries[idx], starttime, endtime)))
+      matchentry = idx;
+  }
+
+  /* Test patterns earlier in the list than a literal match, latest added first */
+  for (idx = index->globcount - 1; idx >= 0 && index->globs[idx] > matchentry; idx--)
+  {
+    entry = &index->entries[index->globs[idx]];
+
+    if (globmatch_compiled (entry->glob, srcname) &&
+        (selecttime = selectentry_matchtime (entry, starttime, endtime)))
+    {
+      matchst    = selecttime;
+      matchentry = index->globs[idx];
+      break;
+    }
+  }
+
+  if (ppselecttime)
+    *ppselecttime = matchst;
+
+  return (matchst) ? index->entries[matchentry].selection : NULL;
+} /* End of selectindex_match() */
+
+/***************************************************************************
+ * selectentry_matchtime:
+ *
+ * Find the first time window in list order of an indexed selection
+ * entry that matches a time range.  Only windows starting before the
+ * later of the start and end times and ending after the earlier of
+ * them can match, these are found by binary search of the windows
+ * sorted by start time and the latest end time of earlier windows.
+ *
+ * Return SelectTime pointer to matching window or NULL for no match.
+ ***************************************************************************/
+static SelectTime *
+selectentry_matchtime (SelectEntry *entry, hptime_t starttime, hptime_t endtime)
+{
+  SelectWindow *windows = entry->windows;
+  SelectWindow *match   = NULL;
+  hptime_t latest;
+  hptime_t earliest;
+  int32_t low;
+  int32_t high;
+  int32_t mid;
+
+  if (starttime == HPTERROR)
+    latest = SELECT_TIMEMAX;
+  else
+    latest = (endtime > starttime) ? endtime : starttime;
+
+  if (endtime == HPTERROR)
+    earliest = SELECT_TIMEMIN;
+  else
+    earliest = (starttime < endtime) ? starttime : endtime;
+
+  /* Find the number of windows starting before latest */
+  low  = 0;
+  high = entry->windowcount;
+  while (low < high)
+  {
+    mid = low + (high - low) / 2;
+
+    if (windows[mid].starttime <= latest)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  /* Test windows that may match, stopping when no earlier window ends after earliest */
+  for (mid = low - 1; mid >= 0 && windows[mid].maxend >= earliest; mid--)
+  {
+    if (windows[mid].endtime < earliest || (match && match->seq > windows[mid].seq))
+      continue;
+
+    if (ms_matchtimewindow (windows[mid].selecttime, starttime, endtime))
+      match = &windows[mid];
+  }
+
+  return (match) ? match->selecttime : NULL;
+} /* End of selectentry_matchtime() */
+
+/***************************************************************************
+ * selectindex_find:
+ *
+ * Find the entry of a Selections list lookup index with the specified
+ * srcname, literal or pattern.
+ *
+ * Return the entry number or -1 if not found.
+ ***************************************************************************/
+static int32_t
+selectindex_find (SelectIndex *index, char *srcname)
+{
+  uint32_t hash;
+  uint32_t slot;
+
+  if (!index->slotcount)
+    return -1;
+
+  hash = lmp_fnv32 (LMP_FNV32_INIT, srcname);
+
+  for (slot = hash & (index->slotcount - 1); index->slots[slot];
+       slot = (slot + 1) & (index->slotcount - 1))
+  {
+    if (!strcmp (index->entries[index->slots[slot] - 1].selection->srcname, srcname))
+      return index->slots[slot] - 1;
+  }
+
+  return -1;
+} /* End of selectindex_find() */
+
+/***************************************************************************
+ * selectindex_add:
+ *
+ * Add a time window of a Selections entry to a lookup index, creating
+ * the index entry if the entry was added to the list.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+selectindex_add (SelectIndex *index, Selections *selection, SelectTime *selecttime)
+{
+  SelectEntry *entry;
+  SelectWindow *windows;
+  SelectWindow window;
+  int32_t *globs;
+  int32_t idx;
+
+  if ((idx = selectindex_find (index, selection->srcname)) < 0)
+  {
+    if (index->count >= index->size)
+    {
+      if (!(entry = (SelectEntry *)realloc (index->entries, (index->size + 64) * 2 * sizeof (SelectEntry))))
+        return -1;
+
+      index->entries = entry;
+      index->size    = (index->size + 64) * 2;
+    }
+
+    idx   = index->count;
+    entry = &index->entries[idx];
+    memset (entry, 0, sizeof (SelectEntry));
+    entry->selection = selection;
+
+    /* Compile patterns, srcnames without globbing characters are literal */
+    if (strpbrk (selection->srcname, "*?[\\"))
+    {
+      if (!(entry->glob = globcompile (selection->srcname)))
+        return -1;
+
+      if (!(globs = (int32_t *)realloc (index->globs, (index->globcount + 1) * sizeof (int32_t))))
+      {
+        free (entry->glob->ops);
+        free (entry->glob->sets);
+        free (entry->glob);
+        return -1;
+      }
+
+      index->globs                     = globs;
+      index->globs[index->globcount++] = idx;
+    }
+
+    index->count++;
+
+    if (selectindex_hash (index, idx))
+      return -1;
+  }
+
+  entry = &index->entries[idx];
+
+  if (entry->windowcount >= entry->windowsize)
+  {
+    if (!(windows = (SelectWindow *)realloc (entry->windows, (entry->windowsize + 2) * 2 * sizeof (SelectWindow))))
+      return -1;
+
+    entry->windows    = windows;
+    entry->windowsize = (entry->windowsize + 2) * 2;
+  }
+
+  window.starttime  = (selecttime->starttime == HPTERROR) ? SELECT_TIMEMIN : selecttime->starttime;
+  window.endtime    = (selecttime->endtime == HPTERROR) ? SELECT_TIMEMAX : selecttime->endtime;
+  window.seq        = index->windowseq++;
+  window.selecttime = selecttime;
+
+  /* Insert in start time order after windows with the same start time */
+  for (idx = entry->windowcount; idx > 0 && entry->windows[idx - 1].starttime > window.starttime; idx--)
+    entry->windows[idx] = entry->windows[idx - 1];
+
+  entry->windows[idx] = window;
+  entry->windowcount++;
+
+  /* Update latest end times from the inserted window */
+  for (; idx < entry->windowcount; idx++)
+  {
+    entry->windows[idx].maxend = entry->windows[idx].endtime;
+
+    if (idx > 0 && entry->windows[idx - 1].maxend > entry->windows[idx].maxend)
+      entry->windows[idx].maxend = entry->windows[idx - 1].maxend;
+  }
+
+  return 0;
+} /* End of selectindex_add() */
+
+/***************************************************************************
+ * selectindex_hash:
+ *
+ * Add an entry to the hash table of a lookup index, growing the table
+ * when it is half full.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+selectindex_hash (SelectIndex *index, int32_t entry)
+{
+  uint32_t slotcount;
+  uint32_t hash;
+  uint32_t slot;
+  int32_t *slots;
+  int32_t idx;
+
+  /* Rebuild the table with all entries when growing */
+  if ((uint32_t)index->count * 2 > index->slotcount)
+  {
+    slotcount = (index->slotcount) ? index->slotcount * 2 : SELECT_HASHMIN;
+
+    if (!(slots = (int32_t *)calloc (slotcount, sizeof (int32_t))))
+      return -1;
+
+    free (index->slots);
+    index->slots     = slots;
+    index->slotcount = slotcount;
+    idx              = 0;
+  }
+  else
+  {
+    idx = entry;
+  }
+
+  for (; idx <= entry; idx++)
+  {
+    hash = lmp_fnv32 (LMP_FNV32_INIT, index->entries[idx].selection->srcname);
+
+    for (slot = hash & (index->slotcount - 1); index->slots[slot];
+         slot = (slot + 1) & (index->slotcount - 1))
+      ;
+
+    index->slots[slot] = idx + 1;
+  }
+
+  return 0;
+} /* End of selectindex_hash() */
+
+/***************************************************************************
+ * selectindex_register:
+ *
+ * Register a lookup index for a Selections list with the specified
+ * first entry, replacing any index registered for the same entry.
+ ***************************************************************************/
+static void
+selectindex_register (SelectIndex *index, Selections *head)
+{
+  SelectIndex *stale;
+
+  if ((stale = selectindex_lookup (head, 1)))
+    selectindex_free (stale);
+
+  index->head        = head;
+  index->headnext    = head->next;
+  index->headwindows = head->timewindows;
+  memcpy (index->headsrcname, head->srcname, sizeof (index->headsrcname));
+
+  lmp_mutex_lock (&selectlock);
+  index->next   = selectindexes;
+  selectindexes = index;
+  lmp_mutex_unlock (&selectlock);
+} /* End of selectindex_register() */
+
+/***************************************************************************
+ * selectindex_lookup:
+ *
+ * Find the lookup index registered for a Selections list with the
+ * specified first entry.  An index is only returned if the first
+ * entry is unchanged since the index was updated, a list built by the
+ * caller at the address of a freed list is not mistaken for it.  If
+ * remove is true a registered index is removed from the registry,
+ * even if it does not match, and returned only if it matches.
+ *
+ * Returns the index or NULL if the list has no matching index.
+ ***************************************************************************/
+static SelectIndex *
+selectindex_lookup (Selections *head, flag remove)
+{
+  SelectIndex **pindex;
+  SelectIndex *index;
+
+  lmp_mutex_lock (&selectlock);
+
+  for (pindex = &selectindexes; (index = *pindex); pindex = &index->next)
+    if (index->head == head)
+      break;
+
+  if (index && remove)
+    *pindex = index->next;
+
+  lmp_mutex_unlock (&selectlock);
+
+  if (index && (index->headnext != head->next || index->headwindows != head->timewindows ||
+                strncmp (index->headsrcname, head->srcname, sizeof (index->headsrcname))))
+  {
+    if (remove)
+      selectindex_free (index);
+
+    index = NULL;
+  }
+
+  return index;
+} /* End of selectindex_lookup() */
+
+/***************************************************************************
+ * selectindex_free:
+ *
+ * Free all memory associated with a Selections list lookup index.
+ ***************************************************************************/
+static void
+selectindex_free (SelectIndex *index)
+{
+  int32_t idx;
+
+  for (idx = 0; idx < index->count; idx++)
+  {
+    if (index->entries[idx].glob)
+    {
+      free (index->entries[idx].glob->ops);
+      free (index->entries[idx].glob->sets);
+      free (index->entries[idx].glob);
+    }
+
+    free (index->entries[idx].windows);
+  }
+
+  free (index->entries);
+  free (index->globs);
+  free (index->slots);
+  free (index);
+} /* End of selectindex_free() */
+
 /***********************************************************************
  * robust glob pattern matcher
  * ozan s. yigit/dec 1994
@@ -714,3 +1222,223 @@ ms_globmatch (char *string, char *pattern)
 
   return !*string;
 } /* End of ms_globmatch() */
+
+/***********************************************************************
+ * globcompile:
+ *
+ * Compile a globbing pattern into a list of operations that match a
+ * single character each or any number of characters, with character
+ * sets as bitmaps of member characters.  The sets are parsed exactly
+ * as ms_globmatch() does.
+ *
+ * Return compiled pattern or NULL on error.
+ **********************************************************************/
+static SelectGlob *
+globcompile (char *pattern)
+{
+  SelectGlob *glob;
+  char *set;
+  int negate;
+  int setcount = 0;
+  int length;
+  int c;
+  int x;
+
+  length = strlen (pattern);
+
+  if (!(glob = (SelectGlob *)calloc (1, sizeof (SelectGlob))) ||
+      !(glob->ops = (SelectGlobOp *)malloc ((length + 1) * sizeof (SelectGlobOp))) ||
+      !(glob->sets = (uint8_t (*)[32])calloc (length / 3 + 1, 32)))
+  {
+    if (glob)
+    {
+      free (glob->ops);
+      free (glob);
+    }
+    return NULL;
+  }
+
+  while ((c = *pattern++))
+  {
+    switch (c)
+    {
+    case '*':
+      if (!glob->opcount || glob->ops[glob->opcount - 1].op != GLOBOP_STAR)
+        glob->ops[glob->opcount++].op = GLOBOP_STAR;
+      break;
+
+    case '?':
+      glob->ops[glob->opcount++].op = GLOBOP_ANY;
+      break;
+
+    case '[':
+      negate = (*pattern == GLOBMATCH_NEGATE) ? GLOBMATCH_TRUE : GLOBMATCH_FALSE;
+      set    = (negate) ? pattern + 1 : pattern;
+
+      /* Find the end of the set as parsed by ms_globmatch() */
+      pattern = set;
+      while ((c = *pattern++))
+      {
+        if (!*pattern || (*pattern == '-' && !*++pattern))
+        {
+          pattern = NULL;
+          break;
+        }
+
+        if (*pattern == ']')
+          break;
+      }
+
+      if (!pattern || !c)
+      {
+        /* A set without end never matches */
+        glob->ops[glob->opcount++].op = GLOBOP_FAIL;
+        return glob;
+      }
+
+      pattern++;
+
+      for (x = 1; x < 256; x++)
+        if (globsetmember (set, (char)x) != negate)
+          glob->sets[setcount][x / 8] |= (uint8_t) (1 << (x % 8));
+
+      glob->ops[glob->opcount].op      = GLOBOP_SET;
+      glob->ops[glob->opcount++].value = (uint8_t)setcount++;
+      break;
+
+    case '\\':
+      if (*pattern)
+        c = *pattern++;
+    default:
+      glob->ops[glob->opcount].op      = GLOBOP_CHAR;
+      glob->ops[glob->opcount++].value = (uint8_t)c;
+      break;
+    }
+  }
+
+  return glob;
+} /* End of globcompile() */
+
+/***********************************************************************
+ * globsetmember:
+ *
+ * Check if a character is a member of a globbing character set, set
+ * is the specification following the opening bracket and negation.
+ * This follows the set matching of ms_globmatch().
+ *
+ * Return 0 if the character is not in the set and non-zero otherwise.
+ **********************************************************************/
+static int
+globsetmember (char *set, char x)
+{
+  int match = GLOBMATCH_FALSE;
+  int c;
+
+  while (!match && (c = *set++))
+  {
+    if (!*set)
+      return GLOBMATCH_FALSE;
+
+    if (*set == '-') /* c-c */
+    {
+      if (!*++set)
+        return GLOBMATCH_FALSE;
+      if (*set != ']')
+      {
+        if (x == c || x == *set || (x > c && x < *set))
+          match = GLOBMATCH_TRUE;
+      }
+      else
+      { /* c-] */
+        if (x >= c)
+          match = GLOBMATCH_TRUE;
+        break;
+      }
+    }
+    else /* cc or c] */
+    {
+      if (c == x)
+        match = GLOBMATCH_TRUE;
+      if (*set != ']')
+      {
+        if (*set == x)
+          match = GLOBMATCH_TRUE;
+      }
+      else
+        break;
+    }
+  }
+
+  return match;
+} /* End of globsetmember() */
+
+/***********************************************************************
+ * globmatch_compiled:
+ *
+ * Check if a string matches a compiled globbing pattern.  Only the
+ * position of the last star is kept for backtracking, sufficient as
+ * all other operations match a single character.
+ *
+ * Return 0 if string does not match pattern and non-zero otherwise.
+ **********************************************************************/
+static int
+globmatch_compiled (SelectGlob *glob, char *string)
+{
+  SelectGlobOp *ops = glob->ops;
+  uint8_t *str      = (uint8_t *)string;
+  uint8_t *starstr  = NULL;
+  int starop        = -1;
+  int op            = 0;
+
+  while (*str)
+  {
+    if (op < glob->opcount)
+    {
+      switch (ops[op].op)
+      {
+      case GLOBOP_STAR:
+        starop  = ++op;
+        starstr = str;
+        continue;
+
+      case GLOBOP_ANY:
+        op++;
+        str++;
+        continue;
+
+      case GLOBOP_SET:
+        if (glob->sets[ops[op].value][*str / 8] & (1 << (*str % 8)))
+        {
+          op++;
+          str++;
+          continue;
+        }
+        break;
+
+      case GLOBOP_CHAR:
+        if (ops[op].value == *str)
+        {
+          op++;
+          str++;
+          continue;
+        }
+        break;
+
+      default:
+        return GLOBMATCH_FALSE;
+      }
+    }
+
+    /* Mismatch, let the last star match one more character */
+    if (starop < 0)
+      return GLOBMATCH_FALSE;
+
+    op  = starop;
+    str = ++starstr;
+  }
+
+  while (op < glob->opcount && ops[op].op == GLOBOP_STAR)
+    op++;
+
+  return (op == glob->opcount) ? GLOBMATCH_TRUE : GLOBMATCH_FALSE;
+} /* End of globmatch_compiled() */
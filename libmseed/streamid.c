@@ -0,0 +1,363 @@
+/***************************************************************************
+ * streamid.c:
+ *
+ * Routines to intern stream identifiers.
+ *
+ * The network, station, location and channel codes of a stream are
+ * mapped once to a small positive integer, the stream ID, which can
+ * then be used to match records and traces with an integer compare.
+ * The source name string of each stream ID is generated only once
+ * and kept for logging.  Stream IDs are assigned in order starting
+ * at 1, 0 is never a valid stream ID.  The table is protected by a
+ * lock and stream IDs can be interned from multiple threads.
+ *
+ * modified: 2026.292
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+#include "lmhash.h"
+#include "lmthread.h"
+
+/* Initial number of hash table buckets, doubled as needed */
+#define SID_INITSIZE 256
+
+/* Interned stream identifier */
+typedef struct StreamID_s {
+  char network[11];
+  char station[11];
+  char location[11];
+  char channel[11];
+  char srcname[45];
+  int32_t streamid;
+  uint32_t hash;
+  struct StreamID_s *next;
+} StreamID;
+
+static StreamID **sidbuckets = NULL; /* Hash table of stream IDs */
+static uint32_t sidsize      = 0;    /* Number of hash table buckets */
+static StreamID **sidlist    = NULL; /* Stream IDs indexed by ID - 1 */
+static int32_t sidcount      = 0;    /* Number of stream IDs */
+static int32_t sidlistsize   = 0;    /* Allocated length of sidlist */
+static lmp_mutex_t sidlock   = LMP_MUTEX_INITIALIZER;
+
+static uint32_t sid_hash (const char *network, const char *station,
+                          const char *location, const char *channel);
+static int32_t sid_find (const char *network, const char *station,
+                         const char *location, const char *channel,
+                         uint32_t hash);
+static int sid_grow (void);
+static int32_t sid_add (const char *network, const char *station,
+                        const char *location, const char *channel,
+                        uint32_t hash);
+
+/***************************************************************************
+ * ms_streamid:
+ *
+ * Map the specified network, station, location and channel codes to
+ * a stream ID, assigning a new ID for codes not seen before.  Codes
+ * longer than 10 characters are not supported.
+ *
+ * Returns the stream ID on success and 0 on error.
+ ***************************************************************************/
+int32_t
+ms_streamid (const char *network, const char *station,
+             const char *location, const char *channel)
+{
+  int32_t streamid;
+  uint32_t hash;
+
+  if (!network || !station || !location || !channel)
+    return 0;
+
+  if (strlen (network) > 10 || strlen (station) > 10 ||
+      strlen (location) > 10 || strlen (channel) > 10)
+    return 0;
+
+  hash = sid_hash (network, station, location, channel);
+
+  lmp_mutex_lock (&sidlock);
+
+  if (!(streamid = sid_find (network, station, location, channel, hash)))
+    streamid = sid_add (network, station, location, channel, hash);
+
+  lmp_mutex_unlock (&sidlock);
+
+  return streamid;
+} /* End of ms_streamid() */
+
+/***************************************************************************
+ * ms_findstreamid:
+ *
+ * Look up the stream ID of the specified network, station, location
+ * and channel codes without interning them.
+ *
+ * Returns the stream ID if the codes have been interned and 0
+ * otherwise.
+ ***************************************************************************/
+int32_t
+ms_findstreamid (const char *network, const char *station,
+                 const char *location, const char *channel)
+{
+  int32_t streamid;
+  uint32_t hash;
+
+  if (!network || !station || !location || !channel)
+    return 0;
+
+  hash = sid_hash (network, station, location, channel);
+
+  lmp_mutex_lock (&sidlock);
+
+  streamid = sid_find (network, station, location, channel, hash);
+
+  lmp_mutex_unlock (&sidlock);
+
+  return streamid;
+} /* End of ms_findstreamid() */
+
+/***************************************************************************
+ * ms_streamid_srcname:
+ *
+ * Returns the source name, in the format 'NET_STA_LOC_CHAN', of the
+ * specified stream ID or NULL if the stream ID is not known.  The
+ * string is valid until ms_freestreamids() is called.
+ ***************************************************************************/
+const char *
+ms_streamid_srcname (int32_t streamid)
+{
+  const char *srcname = NULL;
+
+  lmp_mutex_lock (&sidlock);
+
+  if (streamid > 0 && streamid <= sidcount)
+    srcname = sidlist[streamid - 1]->srcname;
+
+  lmp_mutex_unlock (&sidlock);
+
+  return srcname;
+} /* End of ms_streamid_srcname() */
+
+/***************************************************************************
+ * ms_freestreamids:
+ *
+ * Free all interned stream IDs.  Stream IDs stored in MSRecord,
+ * MSTrace and MSTraceID structures are invalid afterwards and must
+ * not be used, no other thread may use stream IDs during the call.
+ ***************************************************************************/
+void
+ms_freestreamids (void)
+{
+  int32_t idx;
+
+  lmp_mutex_lock (&sidlock);
+
+  for (idx = 0; idx < sidcount; idx++)
+    free (sidlist[idx]);
+
+  if (sidlist)
+    free (sidlist);
+
+  if (sidbuckets)
+    free (sidbuckets);
+
+  sidbuckets  = NULL;
+  sidsize     = 0;
+  sidlist     = NULL;
+  sidcount    = 0;
+  sidlistsize = 0;
+
+  lmp_mutex_unlock (&sidlock);
+} /* End of ms_freestreamids() */
+
+/***************************************************************************
+ * msr_streamid:
+ *
+ * Returns the stream ID of a MSRecord, interning the codes and storing
+ * the ID in the MSRecord if not already set, or 0 on error.  The
+ * stored ID is reset by msr_init(), callers that change the codes of
+ * an MSRecord otherwise must reset msr->streamid to 0.
+ ***************************************************************************/
+int32_t
+msr_streamid (MSRecord *msr)
+{
+  if (!msr)
+    return 0;
+
+  if (!msr->streamid)
+    msr->streamid = ms_streamid (msr->network, msr->station,
+                                 msr->location, msr->channel);
+
+  return msr->streamid;
+} /* End of msr_streamid() */
+
+/***************************************************************************
+ * mst_streamid:
+ *
+ * Returns the stream ID of a MSTrace, interning the codes and storing
+ * the ID in the MSTrace if not already set, or 0 on error.  Callers
+ * that change the codes of an MSTrace must reset mst->streamid to 0.
+ ***************************************************************************/
+int32_t
+mst_streamid (MSTrace *mst)
+{
+  if (!mst)
+    return 0;
+
+  if (!mst->streamid)
+    mst->streamid = ms_streamid (mst->network, mst->station,
+                                 mst->location, mst->channel);
+
+  return mst->streamid;
+} /* End of mst_streamid() */
+
+/***************************************************************************
+ * sid_find:
+ *
+ * Find the stream ID of the specified codes, the caller must hold the
+ * table lock.
+ *
+ * Returns the stream ID if found and 0 otherwise.
+ ***************************************************************************/
+static int32_t
+sid_find (const char *network, const char *station,
+          const char *location, const char *channel, uint32_t hash)
+{
+  StreamID *sid;
+
+  if (!sidbuckets)
+    return 0;
+
+  for (sid = sidbuckets[hash & (sidsize - 1)]; sid; sid = sid->next)
+  {
+    if (sid->hash == hash &&
+        !strcmp (sid->channel, channel) && !strcmp (sid->station, station) &&
+        !strcmp (sid->location, location) && !strcmp (sid->network, network))
+      return sid->streamid;
+  }
+
+  return 0;
+} /* End of sid_find() */
+
+/***************************************************************************
+ * sid_add:
+ *
+ * Add a new stream ID for the specified codes, the caller must hold
+ * the table lock.
+ *
+ * Returns the stream ID on success and 0 on error.
+ ***************************************************************************/
+static int32_t
+sid_add (const char *network, const char *station,
+         const char *location, const char *channel, uint32_t hash)
+{
+  StreamID *sid;
+  StreamID **list;
+
+  if ((uint32_t)sidcount >= sidsize - sidsize / 4 && sid_grow ())
+    return 0;
+
+  if (sidcount >= sidlistsize)
+  {
+    list = (StreamID **)realloc (sidlist, (sidlistsize + SID_INITSIZE) * sizeof (StreamID *));
+
+    if (!list)
+    {
+      ms_log (2, "ms_streamid(): Cannot allocate memory\n");
+      return 0;
+    }
+
+    sidlist = list;
+    sidlistsize += SID_INITSIZE;
+  }
+
+  if (!(sid = (StreamID *)malloc (sizeof (StreamID))))
+  {
+    ms_log (2, "ms_streamid(): Cannot allocate memory\n");
+    return 0;
+  }
+
+  strcpy (sid->network, network);
+  strcpy (sid->station, station);
+  strcpy (sid->location, location);
+  strcpy (sid->channel, channel);
+  snprintf (sid->srcname, sizeof (sid->srcname), "%s_%s_%s_%s",
+            network, station, location, channel);
+  sid->hash = hash;
+
+  sidlist[sidcount] = sid;
+  sid->streamid     = ++sidcount;
+
+  sid->next                         = sidbuckets[hash & (sidsize - 1)];
+  sidbuckets[hash & (sidsize - 1)] = sid;
+
+  return sid->streamid;
+} /* End of sid_add() */
+
+/***************************************************************************
+ * sid_hash:
+ *
+ * Returns the 32-bit FNV-1a hash of the codes of a stream.
+ ***************************************************************************/
+static uint32_t
+sid_hash (const char *network, const char *station,
+          const char *location, const char *channel)
+{
+  const char *codes[4];
+  uint32_t hash = LMP_FNV32_INIT;
+  int idx;
+
+  codes[0] = network;
+  codes[1] = station;
+  codes[2] = location;
+  codes[3] = channel;
+
+  /* Separate the codes so that shifted characters differ */
+  for (idx = 0; idx < 4; idx++)
+    hash = lmp_fnv32 (lmp_fnv32 (hash, codes[idx]), "_");
+
+  return hash;
+} /* End of sid_hash() */
+
+/***************************************************************************
+ * sid_grow:
+ *
+ * Double the number of hash table buckets, or allocate the initial
+ * table, and redistribute the stream IDs.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+sid_grow (void)
+{
+  StreamID **buckets;
+  uint32_t size;
+  int32_t idx;
+  StreamID *sid;
+
+  size = (sidsize) ? sidsize * 2 : SID_INITSIZE;
+
+  if (!(buckets = (StreamID **)calloc (size, sizeof (StreamID *))))
+  {
+    ms_log (2, "ms_streamid(): Cannot allocate memory\n");
+    return -1;
+  }
+
+  for (idx = 0; idx < sidcount; idx++)
+  {
+    sid                        = sidlist[idx];
+    sid->next                  = buckets[sid->hash & (size - 1)];
+    buckets[sid->hash & (size - 1)] = sid;
+  }
+
+  if (sidbuckets)
+    free (sidbuckets);
+
+  sidbuckets = buckets;
+  sidsize    = size;
+
+  return 0;
+} /* End of sid_grow() */
@@ -0,0 +1,155 @@
+/***************************************************************************
+ * lmtestlog.c
+ *
+ * A program for libmseed logging tests.
+ *
+ * Logs messages from several threads through the asynchronous log
+ * writer and reports, for each thread, the number of messages printed
+ * and whether they were printed in the order they were logged.
+ *
+ * modified 2026.292
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#if !defined(LMP_WIN)
+  #include <pthread.h>
+#endif
+
+#define VERSION "[libmseed " LIBMSEED_VERSION " example]"
+#define PACKAGE "lmtestlog"
+
+#define THREADS 4
+#define MESSAGES 2000
+
+/* Messages printed for each thread, the main thread is the last */
+static int printed[THREADS + 1];
+static int nextmessage[THREADS + 1];
+static int outoforder[THREADS + 1];
+static int errors     = 0;
+static int unexpected = 0;
+
+static void *thread_work (void *arg);
+static void print_record (char *message);
+
+int
+main (int argc, char **argv)
+{
+  int ids[THREADS];
+  int idx;
+#if !defined(LMP_WIN)
+  pthread_t tids[THREADS];
+#endif
+
+  ms_loginit (print_record, NULL, print_record, "ERROR: ");
+
+  /* Discard normal log messages, keep diagnostic and error messages */
+  ms_loglevel (1);
+
+  if (ms_logenabled (0) || !ms_logenabled (1) || !ms_logenabled (2))
+    printf ("Unexpected log levels enabled\n");
+
+  /* Small buffers to hand many buffers to the writer */
+  if (ms_logstartwriter (1024))
+  {
+    fprintf (stderr, "Cannot start log writer\n");
+    return 1;
+  }
+
+  for (idx = 0; idx < THREADS; idx++)
+    ids[idx] = idx;
+
+#if !defined(LMP_WIN)
+  for (idx = 0; idx < THREADS; idx++)
+  {
+    if (pthread_create (&tids[idx], NULL, thread_work, &ids[idx]))
+    {
+      fprintf (stderr, "Could not create thread %d\n", idx);
+      return 1;
+    }
+  }
+#endif
+
+  for (idx = 0; idx < MESSAGES; idx++)
+  {
+    ms_log (1, "Thread %d message %d\n", THREADS, idx);
+    ms_log (0, "Discarded message %d\n", idx);
+  }
+
+#if !defined(LMP_WIN)
+  for (idx = 0; idx < THREADS; idx++)
+    pthread_join (tids[idx], NULL);
+#else
+  for (idx = 0; idx < THREADS; idx++)
+    thread_work (&ids[idx]);
+#endif
+
+  ms_logstopwriter ();
+
+  for (idx = 0; idx <= THREADS; idx++)
+    printf ("Thread %d: printed %d messages, %d out of order\n",
+            idx, printed[idx], outoforder[idx]);
+
+  printf ("Printed %d error messages, %d unexpected messages\n", errors, unexpected);
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * thread_work:
+ *
+ * Log a sequence of diagnostic messages and an error message.
+ ***************************************************************************/
+static void *
+thread_work (void *arg)
+{
+  int id = *(int *)arg;
+  int idx;
+
+  for (idx = 0; idx < MESSAGES; idx++)
+  {
+    ms_log (1, "Thread %d message %d\n", id, idx);
+    ms_log (0, "Discarded message %d\n", idx);
+  }
+
+  ms_log (2, "Thread %d error\n", id);
+
+  ms_logflush ();
+
+  return NULL;
+} /* End of thread_work() */
+
+/***************************************************************************
+ * print_record:
+ *
+ * Count a printed message and check that the messages of each thread
+ * are printed in order.  Only called from the log writer thread.
+ ***************************************************************************/
+static void
+print_record (char *message)
+{
+  int id;
+  int number;
+
+  if (sscanf (message, "Thread %d message %d", &id, &number) == 2 &&
+      id >= 0 && id <= THREADS)
+  {
+    if (number != nextmessage[id])
+      outoforder[id]++;
+
+    nextmessage[id] = number + 1;
+    printed[id]++;
+  }
+  else if (sscanf (message, "ERROR: Thread %d error", &id) == 1)
+  {
+    errors++;
+  }
+  else
+  {
+    unexpected++;
+  }
+} /* End of print_record() */
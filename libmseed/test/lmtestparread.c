@@ -0,0 +1,260 @@
+/***************************************************************************
+ * lmtestparread.c
+ *
+ * A program for libmseed parallel reading tests.
+ *
+ * Writes test files of Mini-SEED records for several channels, reads
+ * each file sequentially with ms_readtracelist() and in parallel with
+ * ms_readtracelist_parallel() and reports whether the trace lists are
+ * identical.  The files are written as:
+ *
+ *   fixed : 512-byte records
+ *   mixed : 512 and 4096-byte records, records cross chunk boundaries
+ *   junk  : 512-byte records with non-data across a chunk boundary
+ *
+ * The junk file is read again without skipping non-data, both readers
+ * must then stop at the same error.
+ *
+ * modified 2026.292
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#define VERSION "[libmseed " LIBMSEED_VERSION " example]"
+#define PACKAGE "lmtestparread"
+
+#define CHANNELS 3
+#define BLOCKS 7000
+#define THREADS 4
+
+static int write_file (const char *outfile, const char *mode);
+static void record_handler (char *record, int reclen, void *handlerdata);
+static int compare_lists (MSTraceList *mstl1, MSTraceList *mstl2,
+                          int *idcount, int *segcount, int64_t *samplecount);
+static void print_stderr (char *message);
+
+int
+main (int argc, char **argv)
+{
+  const char *modes[4] = {"fixed", "mixed", "junk", "junk"};
+  flag skipnotdata[4]  = {1, 1, 1, 0};
+  MSTraceList *seqmstl = NULL;
+  MSTraceList *parmstl = NULL;
+  int64_t samplecount;
+  int segcount;
+  int idcount;
+  int seqret;
+  int parret;
+  int idx;
+
+  if (argc != 2)
+  {
+    fprintf (stderr, "%s %s\n", PACKAGE, VERSION);
+    fprintf (stderr, "Usage: %s tempfile\n", PACKAGE);
+    return 1;
+  }
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  /* Discard the expected errors of reading the junk file without skipping */
+  ms_loglevel (3);
+
+  for (idx = 0; idx < 4; idx++)
+  {
+    if ((idx == 0 || strcmp (modes[idx], modes[idx - 1])) &&
+        write_file (argv[1], modes[idx]))
+    {
+      fprintf (stderr, "Cannot write %s\n", argv[1]);
+      return 1;
+    }
+
+    seqret = ms_readtracelist (&seqmstl, argv[1], 0, -1.0, -1.0, 1,
+                               skipnotdata[idx], 1, 0);
+    parret = ms_readtracelist_parallel (&parmstl, argv[1], 0, -1.0, -1.0, NULL, 1,
+                                        skipnotdata[idx], 1, THREADS, 0);
+
+    printf ("%s%s: sequential %s, parallel %s, ", modes[idx],
+            (skipnotdata[idx]) ? "" : " (no skipping)",
+            ms_errorstr (seqret), ms_errorstr (parret));
+
+    if (compare_lists (seqmstl, parmstl, &idcount, &segcount, &samplecount))
+      printf ("trace lists differ\n");
+    else
+      printf ("%d IDs, %d segments, %" PRId64 " samples, trace lists identical\n",
+              idcount, segcount, samplecount);
+
+    mstl_free (&seqmstl, 0);
+    mstl_free (&parmstl, 0);
+  }
+
+  remove (argv[1]);
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * write_file:
+ *
+ * Write interleaved records of the test channels to a file, the third
+ * channel has a gap every 500 blocks.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+write_file (const char *outfile, const char *mode)
+{
+  MSRecord *msr = NULL;
+  FILE *ofp;
+  int32_t samples[2000];
+  char junk[768];
+  int64_t packedsamples;
+  int blocksamples;
+  int block;
+  int chan;
+  int idx;
+
+  if (!(ofp = fopen (outfile, "wb")))
+    return -1;
+
+  memset (junk, 'X', sizeof (junk));
+
+  for (block = 0; block < BLOCKS; block++)
+  {
+    for (chan = 0; chan < CHANNELS; chan++)
+    {
+      if (chan == 2 && block % 500 == 499)
+        continue;
+
+      /* Non-data across the first chunk boundary */
+      if (!strcmp (mode, "junk") && ftell (ofp) == 4 * MAXRECLEN - 512)
+        fwrite (junk, 1, sizeof (junk), ofp);
+
+      msr = msr_init (msr);
+
+      strcpy (msr->network, "XX");
+      strcpy (msr->station, "TEST");
+      sprintf (msr->channel, "HH%c", "ZNE"[chan]);
+      msr->dataquality = 'D';
+      msr->samprate    = 100.0;
+      msr->reclen      = 512;
+      msr->encoding    = DE_STEIM2;
+      msr->byteorder   = 1;
+      blocksamples     = 200;
+
+      if (!strcmp (mode, "mixed") && chan == 0)
+      {
+        msr->reclen  = 4096;
+        blocksamples = 2000;
+      }
+
+      msr->starttime = ms_timestr2hptime ("2026-01-01T00:00:00") +
+                       (hptime_t)block * blocksamples * (HPTMODULUS / 100);
+
+      for (idx = 0; idx < blocksamples; idx++)
+        samples[idx] = (int32_t) (((block * blocksamples + idx) * 7919 + chan * 104729) % 201) - 100;
+
+      msr->datasamples = samples;
+      msr->numsamples  = blocksamples;
+      msr->samplecnt   = blocksamples;
+      msr->sampletype  = 'i';
+
+      if (msr_pack (msr, record_handler, ofp, &packedsamples, 1, 0) < 0)
+      {
+        msr->datasamples = NULL;
+        msr_free (&msr);
+        fclose (ofp);
+        return -1;
+      }
+
+      msr->datasamples = NULL;
+    }
+  }
+
+  msr_free (&msr);
+  fclose (ofp);
+
+  return 0;
+} /* End of write_file() */
+
+/***************************************************************************
+ * record_handler:
+ *
+ * Write a packed record to the output file.
+ ***************************************************************************/
+static void
+record_handler (char *record, int reclen, void *handlerdata)
+{
+  fwrite (record, reclen, 1, (FILE *)handlerdata);
+} /* End of record_handler() */
+
+/***************************************************************************
+ * compare_lists:
+ *
+ * Compare the IDs, segments and samples of two trace lists and count
+ * the IDs, segments and samples of the first.
+ *
+ * Returns 0 if the trace lists are identical and -1 otherwise.
+ ***************************************************************************/
+static int
+compare_lists (MSTraceList *mstl1, MSTraceList *mstl2,
+               int *idcount, int *segcount, int64_t *samplecount)
+{
+  MSTraceID *id1;
+  MSTraceID *id2;
+  MSTraceSeg *seg1;
+  MSTraceSeg *seg2;
+
+  *idcount     = 0;
+  *segcount    = 0;
+  *samplecount = 0;
+
+  if (!mstl1 || !mstl2 || mstl1->numtraces != mstl2->numtraces)
+    return -1;
+
+  for (id1 = mstl1->traces, id2 = mstl2->traces; id1 && id2;
+       id1 = id1->next, id2 = id2->next)
+  {
+    if (strcmp (id1->srcname, id2->srcname) || id1->numsegments != id2->numsegments ||
+        id1->earliest != id2->earliest || id1->latest != id2->latest)
+      return -1;
+
+    for (seg1 = id1->first, seg2 = id2->first; seg1 && seg2;
+         seg1 = seg1->next, seg2 = seg2->next)
+    {
+      if (seg1->starttime != seg2->starttime || seg1->endtime != seg2->endtime ||
+          seg1->samprate != seg2->samprate || seg1->samplecnt != seg2->samplecnt ||
+          seg1->numsamples != seg2->numsamples || seg1->sampletype != seg2->sampletype ||
+          memcmp (seg1->datasamples, seg2->datasamples,
+                  seg1->numsamples * ms_samplesize (seg1->sampletype)))
+        return -1;
+
+      (*segcount)++;
+      *samplecount += seg1->numsamples;
+    }
+
+    if (seg1 || seg2)
+      return -1;
+
+    (*idcount)++;
+  }
+
+  return (id1 || id2) ? -1 : 0;
+} /* End of compare_lists() */
+
+/***************************************************************************
+ * print_stderr:
+ *
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+  return;
+} /* End of print_stderr() */
@@ -0,0 +1,261 @@
+/***************************************************************************
+ * lmtestselect.c
+ *
+ * A program for libmseed selection list tests.
+ *
+ * Builds selection lists of literal source names and globbing patterns
+ * with ms_addselect(), which maintains a lookup index of each list,
+ * and copies of the lists without an index, built in memory that is
+ * not cleared as callers may build lists.  Source names and time ranges
+ * are matched against both and the matching entries and time windows
+ * are compared, the copies being matched by searching the list.
+ *
+ * modified 2026.292
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#define VERSION "[libmseed " LIBMSEED_VERSION " example]"
+#define PACKAGE "lmtestselect"
+
+#define STATIONS 2000
+#define QUERIES 20000
+
+static uint32_t seed = 12345;
+
+static Selections *copy_list (Selections *selections);
+static int compare_matches (Selections *selections, Selections *copy,
+                            char *srcname, hptime_t starttime, hptime_t endtime,
+                            int *matches);
+static uint32_t next_random (uint32_t range);
+static void print_stderr (char *message);
+
+int
+main (int argc, char **argv)
+{
+  /* Patterns exercising the globbing syntax including malformed sets */
+  char *patterns[] = {"XX_S0*_*_BH?_?", "XX_S1[0-4]*", "XX_S[^0-8]*_BHZ_D", "*_[]Z]_D",
+                      "XX_S00[a-]*", "XX_S0[z-a]??_*", "XX_S\\0*", "*Z_[DQ]", "XX_S1[",
+                      "XX_S2[^", "**_S3*1*_*", "[", "\\", "XX_S00?1__BH[-ZN]_Q", NULL};
+  char *strings[] = {"XX_S0001__BHZ_D", "XX_S1234__BHN_Q", "XX_S9000__BHZ_D", "XX_S0a01__BHZ_D",
+                     "XX_S00z1__BHE_D", "XX_S0z__BHZ_D", "XX_S0]__Z_D", "XX_S3101__BHZ_D",
+                     "XX_S1[__BHZ_D", "XX_S2[^__BHZ_D", "[", "\\", "XX_S0001__BH-_Q",
+                     "XX_S0001__BHN_Q", "XX_S0001__BHZ_Q", "", NULL};
+  Selections *selections = NULL;
+  Selections *copy       = NULL;
+  Selections *match;
+  hptime_t basetime;
+  hptime_t starttime;
+  hptime_t endtime;
+  char srcname[50];
+  int differences = 0;
+  int matches     = 0;
+  int windows     = 0;
+  int entries     = 0;
+  int station;
+  int idx;
+  int jdx;
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  basetime = ms_timestr2hptime ("2026-01-01T00:00:00");
+
+  /* Patterns alone, matched against strings without time ranges */
+  for (idx = 0; patterns[idx]; idx++)
+  {
+    ms_addselect (&selections, patterns[idx], HPTERROR, HPTERROR);
+    copy = copy_list (selections);
+
+    for (jdx = 0; strings[jdx]; jdx++)
+      differences += compare_matches (selections, copy, strings[jdx], HPTERROR, HPTERROR, &matches);
+
+    ms_freeselections (selections);
+    ms_freeselections (copy);
+    selections = NULL;
+  }
+
+  printf ("Patterns: %d matches, %d differences\n", matches, differences);
+
+  /* Literal entries with several time windows per station and patterns among them */
+  for (station = 0; station < STATIONS; station++)
+  {
+    for (idx = 0; idx < 3; idx++)
+    {
+      starttime = basetime + (hptime_t)next_random (86400 * 30) * HPTMODULUS;
+      endtime   = starttime + (hptime_t) (next_random (86400) + 1) * HPTMODULUS;
+
+      /* Some windows are open at the start or end */
+      if (next_random (10) == 0)
+        starttime = HPTERROR;
+      if (next_random (10) == 0)
+        endtime = HPTERROR;
+
+      snprintf (srcname, sizeof (srcname), "XX_S%04d__BHZ_D", station);
+
+      if (ms_addselect (&selections, srcname, starttime, endtime))
+        return 1;
+
+      windows++;
+    }
+
+    if (station % 400 == 0)
+    {
+      ms_addselect (&selections, patterns[(station / 400) % 14], basetime,
+                    basetime + (hptime_t)86400 * HPTMODULUS);
+      windows++;
+    }
+  }
+
+  for (match = selections; match; match = match->next)
+    entries++;
+
+  copy = copy_list (selections);
+
+  matches     = 0;
+  differences = 0;
+
+  for (idx = 0; idx < QUERIES; idx++)
+  {
+    snprintf (srcname, sizeof (srcname), "XX_S%04d__BH%c_%c", next_random (STATIONS + 100),
+              "ZNE"[next_random (3)], "DQ"[next_random (2)]);
+
+    starttime = basetime + (hptime_t)next_random (86400 * 31) * HPTMODULUS;
+    endtime   = starttime + (hptime_t)next_random (3600) * HPTMODULUS;
+
+    if (next_random (20) == 0)
+      starttime = HPTERROR;
+    if (next_random (20) == 0)
+      endtime = HPTERROR;
+
+    differences += compare_matches (selections, copy, srcname, starttime, endtime, &matches);
+  }
+
+  printf ("Selections: %d entries, %d windows, %d queries, %d matches, %d differences\n",
+          entries, windows, QUERIES, matches, differences);
+
+  ms_freeselections (selections);
+  ms_freeselections (copy);
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * copy_list:
+ *
+ * Copy a selection list entry by entry keeping the order of entries
+ * and time windows, the copy has no lookup index.  Entries are filled
+ * with garbage before their fields are set.
+ *
+ * Returns the copy or NULL on error.
+ ***************************************************************************/
+static Selections *
+copy_list (Selections *selections)
+{
+  Selections *copy = NULL;
+  Selections **lastsl = &copy;
+  SelectTime **lastst;
+  SelectTime *selecttime;
+
+  for (; selections; selections = selections->next)
+  {
+    if (!(*lastsl = (Selections *)malloc (sizeof (Selections))))
+      return NULL;
+
+    memset (*lastsl, 0xA5, sizeof (Selections));
+    strcpy ((*lastsl)->srcname, selections->srcname);
+    (*lastsl)->next = NULL;
+
+    lastst = &(*lastsl)->timewindows;
+    for (selecttime = selections->timewindows; selecttime; selecttime = selecttime->next)
+    {
+      if (!(*lastst = (SelectTime *)calloc (1, sizeof (SelectTime))))
+        return NULL;
+
+      (*lastst)->starttime = selecttime->starttime;
+      (*lastst)->endtime   = selecttime->endtime;
+      lastst               = &(*lastst)->next;
+    }
+
+    *lastst = NULL;
+
+    lastsl = &(*lastsl)->next;
+  }
+
+  return copy;
+} /* End of copy_list() */
+
+/***************************************************************************
+ * compare_matches:
+ *
+ * Match a source name and time range against a list and its copy and
+ * compare the matching entries and time windows by their positions in
+ * the lists.
+ *
+ * Returns 1 if the matches differ and 0 otherwise.
+ ***************************************************************************/
+static int
+compare_matches (Selections *selections, Selections *copy, char *srcname,
+                 hptime_t starttime, hptime_t endtime, int *matches)
+{
+  Selections *match;
+  Selections *copymatch;
+  SelectTime *selecttime;
+  SelectTime *copytime;
+  SelectTime *findst;
+  int position     = 0;
+  int copyposition = 0;
+
+  match     = ms_matchselect (selections, srcname, starttime, endtime, &selecttime);
+  copymatch = ms_matchselect (copy, srcname, starttime, endtime, &copytime);
+
+  if (!match || !copymatch)
+    return (match || copymatch || selecttime || copytime) ? 1 : 0;
+
+  (*matches)++;
+
+  for (; selections != match; selections = selections->next)
+    position++;
+  for (; copy != copymatch; copy = copy->next)
+    copyposition++;
+
+  if (position != copyposition)
+    return 1;
+
+  for (findst = match->timewindows, position = 0; findst != selecttime; findst = findst->next)
+    position++;
+  for (findst = copymatch->timewindows, copyposition = 0; findst != copytime; findst = findst->next)
+    copyposition++;
+
+  return (position != copyposition) ? 1 : 0;
+} /* End of compare_matches() */
+
+/***************************************************************************
+ * next_random:
+ *
+ * Return a pseudo-random number less than range, the same sequence on
+ * all platforms.
+ ***************************************************************************/
+static uint32_t
+next_random (uint32_t range)
+{
+  seed = seed * 1103515245U + 12345U;
+
+  return (seed >> 8) % range;
+} /* End of next_random() */
+
+/***************************************************************************
+ * print_stderr:
+ *
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+  return;
+} /* End of print_stderr() */
@@ -0,0 +1,426 @@
+/***************************************************************************
+ * lmtestselread.c
+ *
+ * A program for libmseed selection reading tests.
+ *
+ * Writes a test file of Mini-SEED records for several channels with
+ * big and little endian headers, Blockettes 100 and 1001 and two
+ * record lengths.  Each record is tested with ms_recskipselect() and
+ * the result compared to msr_matchselect() of the parsed record.  The
+ * file is then read with ms_readtracelist_selection(),
+ * ms_readtracelist_parallel() and msr_parse_selection(), which skip
+ * records by their headers, and compared to reading all records and
+ * matching them after parsing.
+ *
+ * modified 2026.292
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#define VERSION "[libmseed " LIBMSEED_VERSION " example]"
+#define PACKAGE "lmtestselread"
+
+#define CHANNELS 4
+#define BLOCKS 2000
+#define THREADS 4
+
+static int write_file (const char *outfile, hptime_t basetime);
+static void record_handler (char *record, int reclen, void *handlerdata);
+static int read_matching (MSTraceList **ppmstl, const char *msfile,
+                          Selections *selections);
+static char *load_file (const char *msfile, int64_t *length);
+static int compare_lists (MSTraceList *mstl1, MSTraceList *mstl2,
+                          int *idcount, int *segcount, int64_t *samplecount);
+static void print_stderr (char *message);
+
+int
+main (int argc, char **argv)
+{
+  Selections *selections = NULL;
+  MSTraceList *expmstl   = NULL;
+  MSTraceList *mstl      = NULL;
+  MSRecord *msr          = NULL;
+  hptime_t basetime;
+  int64_t samplecount;
+  int64_t expsamples = 0;
+  int64_t parsamples = 0;
+  int64_t length;
+  int64_t offset;
+  char *buffer;
+  int differences = 0;
+  int records     = 0;
+  int matches     = 0;
+  int parsed      = 0;
+  int segcount;
+  int idcount;
+  int skiplen;
+  int retcode;
+
+  if (argc != 2)
+  {
+    fprintf (stderr, "%s %s\n", PACKAGE, VERSION);
+    fprintf (stderr, "Usage: %s tempfile\n", PACKAGE);
+    return 1;
+  }
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  basetime = ms_timestr2hptime ("2026-01-01T00:00:00");
+
+  if (write_file (argv[1], basetime))
+  {
+    fprintf (stderr, "Cannot write %s\n", argv[1]);
+    return 1;
+  }
+
+  /* Windows within records and at record boundaries including microseconds */
+  ms_addselect (&selections, "XX_TEST__HHZ_D", basetime + (hptime_t)600 * HPTMODULUS,
+                basetime + (hptime_t)1800 * HPTMODULUS);
+  ms_addselect (&selections, "XX_TEST__HHN_?", basetime + (hptime_t)1005 * (HPTMODULUS / 10),
+                basetime + (hptime_t)101 * HPTMODULUS);
+  ms_addselect (&selections, "XX_TEST__HHN_?", basetime + (hptime_t)3000 * HPTMODULUS, HPTERROR);
+  ms_addselect (&selections, "XX_TEST_ 1_HH?_D", basetime + (hptime_t)100 * HPTMODULUS + 450030,
+                basetime + (hptime_t)500 * HPTMODULUS + 36);
+  ms_addselect (&selections, "XX_TEST__HH[ZE]_Q", basetime + (hptime_t)2000 * HPTMODULUS,
+                basetime + (hptime_t)2100 * HPTMODULUS);
+
+  /* Skip test of each record compared to matching the parsed record */
+  if (!(buffer = load_file (argv[1], &length)))
+  {
+    fprintf (stderr, "Cannot read %s\n", argv[1]);
+    return 1;
+  }
+
+  for (offset = 0; offset < length; offset += msr->reclen)
+  {
+    if (msr_parse (buffer + offset, (int)(length - offset), &msr, -1, 0, 0))
+      break;
+
+    skiplen = ms_recskipselect (buffer + offset, (int)(length - offset), -1, selections);
+
+    if (msr_matchselect (selections, msr, NULL))
+    {
+      matches++;
+      expsamples += msr->samplecnt;
+
+      if (skiplen != 0)
+        differences++;
+    }
+    else if (skiplen != msr->reclen)
+    {
+      differences++;
+    }
+
+    records++;
+  }
+
+  printf ("Records: %d, %d matching, %d skip differences\n", records, matches, differences);
+
+  /* Records returned by parsing a buffer with selections */
+  offset = 0;
+  while (msr_parse_selection (buffer, (int)length, &offset, &msr, -1, selections, 0, 0) == MS_NOERROR)
+  {
+    parsed++;
+    parsamples += msr->samplecnt;
+    offset += msr->reclen;
+  }
+
+  printf ("Parsed: %d records, %" PRId64 " samples, %s\n", parsed, parsamples,
+          (parsed == matches && parsamples == expsamples) ? "as expected" : "not as expected");
+
+  msr_free (&msr);
+  free (buffer);
+
+  /* Trace lists read with selections compared to matching all records */
+  if (read_matching (&expmstl, argv[1], selections))
+  {
+    fprintf (stderr, "Cannot read %s\n", argv[1]);
+    return 1;
+  }
+
+  retcode = ms_readtracelist_selection (&mstl, argv[1], -1, -1.0, -1.0, selections, 1, 1, 1, 0);
+
+  printf ("Sequential: %s, ", ms_errorstr (retcode));
+  if (compare_lists (expmstl, mstl, &idcount, &segcount, &samplecount))
+    printf ("trace lists differ\n");
+  else
+    printf ("%d IDs, %d segments, %" PRId64 " samples, trace lists identical\n",
+            idcount, segcount, samplecount);
+
+  mstl_free (&mstl, 0);
+
+  retcode = ms_readtracelist_parallel (&mstl, argv[1], -1, -1.0, -1.0, selections, 1, 1, 1,
+                                       THREADS, 0);
+
+  printf ("Parallel: %s, ", ms_errorstr (retcode));
+  if (compare_lists (expmstl, mstl, &idcount, &segcount, &samplecount))
+    printf ("trace lists differ\n");
+  else
+    printf ("%d IDs, %d segments, %" PRId64 " samples, trace lists identical\n",
+            idcount, segcount, samplecount);
+
+  mstl_free (&mstl, 0);
+  mstl_free (&expmstl, 0);
+  ms_freeselections (selections);
+
+  remove (argv[1]);
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * write_file:
+ *
+ * Write interleaved records of the test channels to a file:
+ *
+ *   HHZ D : 512-byte records, big endian
+ *   HHN D : 512-byte records, little endian
+ *   HHE D : 512-byte records, location " 1", Blockettes 100 and 1001
+ *           with start times at microseconds, block 49 has a sample
+ *           rate the fixed header can only approximate
+ *   HHZ Q : 4096-byte records, little endian, every tenth block
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+write_file (const char *outfile, hptime_t basetime)
+{
+  MSRecord *msr = NULL;
+  struct blkt_100_s blkt100;
+  struct blkt_1001_s blkt1001;
+  FILE *ofp;
+  int32_t samples[2000];
+  int64_t packedsamples;
+  int blocksamples;
+  int block;
+  int chan;
+  int idx;
+
+  if (!(ofp = fopen (outfile, "wb")))
+    return -1;
+
+  for (block = 0; block < BLOCKS; block++)
+  {
+    for (chan = 0; chan < CHANNELS; chan++)
+    {
+      if (chan == 3 && block % 10)
+        continue;
+
+      msr = msr_init (msr);
+
+      strcpy (msr->network, "XX");
+      strcpy (msr->station, "TEST");
+      sprintf (msr->channel, "HH%c", "ZNEZ"[chan]);
+      msr->dataquality = (chan == 3) ? 'Q' : 'D';
+      msr->reclen      = 512;
+      msr->encoding    = DE_STEIM2;
+      msr->byteorder   = (chan == 1 || chan == 3) ? 0 : 1;
+      msr->samprate    = 100.0;
+      blocksamples     = 200;
+
+      if (chan == 1)
+      {
+        msr->samprate = 40.0;
+        blocksamples  = 80;
+      }
+      else if (chan == 2)
+      {
+        strcpy (msr->location, " 1");
+        msr->samprate = (block == 49) ? 20.0001 : 25.0;
+        blocksamples  = 50;
+
+        memset (&blkt100, 0, sizeof (blkt100));
+        blkt100.samprate = (float)msr->samprate;
+        memset (&blkt1001, 0, sizeof (blkt1001));
+
+        if (!msr_addblockette (msr, (char *)&blkt100, sizeof (blkt100), 100, 0) ||
+            !msr_addblockette (msr, (char *)&blkt1001, sizeof (blkt1001), 1001, 0))
+        {
+          msr_free (&msr);
+          fclose (ofp);
+          return -1;
+        }
+      }
+      else if (chan == 3)
+      {
+        msr->reclen  = 4096;
+        blocksamples = 2000;
+      }
+
+      /* Every record spans two seconds except the 4096-byte records spanning twenty */
+      msr->starttime = basetime + (hptime_t)block * 2 * HPTMODULUS;
+      if (chan == 2)
+        msr->starttime += 37;
+
+      for (idx = 0; idx < blocksamples; idx++)
+        samples[idx] = (int32_t) (((int64_t) (block * blocksamples + idx) * 7919 + chan * 104729) % 201) - 100;
+
+      msr->datasamples = samples;
+      msr->numsamples  = blocksamples;
+      msr->samplecnt   = blocksamples;
+      msr->sampletype  = 'i';
+
+      if (msr_pack (msr, record_handler, ofp, &packedsamples, 1, 0) < 0)
+      {
+        msr->datasamples = NULL;
+        msr_free (&msr);
+        fclose (ofp);
+        return -1;
+      }
+
+      msr->datasamples = NULL;
+    }
+  }
+
+  msr_free (&msr);
+  fclose (ofp);
+
+  return 0;
+} /* End of write_file() */
+
+/***************************************************************************
+ * record_handler:
+ *
+ * Write a packed record to the output file.
+ ***************************************************************************/
+static void
+record_handler (char *record, int reclen, void *handlerdata)
+{
+  fwrite (record, reclen, 1, (FILE *)handlerdata);
+} /* End of record_handler() */
+
+/***************************************************************************
+ * read_matching:
+ *
+ * Read all records of a file without selections and add the records
+ * matching the selections after parsing to a trace list.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+read_matching (MSTraceList **ppmstl, const char *msfile, Selections *selections)
+{
+  MSFileParam *msfp = NULL;
+  MSRecord *msr     = NULL;
+  int retcode;
+
+  if (!(*ppmstl = mstl_init (NULL)))
+    return -1;
+
+  while ((retcode = ms_readmsr_r (&msfp, &msr, msfile, -1, NULL, NULL, 1, 1, 0)) == MS_NOERROR)
+  {
+    if (msr_matchselect (selections, msr, NULL) &&
+        !mstl_addmsr (*ppmstl, msr, 1, 1, -1.0, -1.0))
+      retcode = MS_GENERROR;
+
+    if (retcode != MS_NOERROR)
+      break;
+  }
+
+  ms_readmsr_r (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+  return (retcode == MS_ENDOFFILE) ? 0 : -1;
+} /* End of read_matching() */
+
+/***************************************************************************
+ * load_file:
+ *
+ * Read a whole file into an allocated buffer.
+ *
+ * Returns the buffer on success and NULL on error.
+ ***************************************************************************/
+static char *
+load_file (const char *msfile, int64_t *length)
+{
+  FILE *fp;
+  char *buffer;
+
+  if (!(fp = fopen (msfile, "rb")))
+    return NULL;
+
+  fseek (fp, 0, SEEK_END);
+  *length = ftell (fp);
+  fseek (fp, 0, SEEK_SET);
+
+  if (*length <= 0 || !(buffer = (char *)malloc ((size_t)*length)) ||
+      fread (buffer, (size_t)*length, 1, fp) != 1)
+  {
+    fclose (fp);
+    return NULL;
+  }
+
+  fclose (fp);
+
+  return buffer;
+} /* End of load_file() */
+
+/***************************************************************************
+ * compare_lists:
+ *
+ * Compare the IDs, segments and samples of two trace lists and count
+ * the IDs, segments and samples of the first.
+ *
+ * Returns 0 if the trace lists are identical and -1 otherwise.
+ ***************************************************************************/
+static int
+compare_lists (MSTraceList *mstl1, MSTraceList *mstl2,
+               int *idcount, int *segcount, int64_t *samplecount)
+{
+  MSTraceID *id1;
+  MSTraceID *id2;
+  MSTraceSeg *seg1;
+  MSTraceSeg *seg2;
+
+  *idcount     = 0;
+  *segcount    = 0;
+  *samplecount = 0;
+
+  if (!mstl1 || !mstl2 || mstl1->numtraces != mstl2->numtraces)
+    return -1;
+
+  for (id1 = mstl1->traces, id2 = mstl2->traces; id1 && id2;
+       id1 = id1->next, id2 = id2->next)
+  {
+    if (strcmp (id1->srcname, id2->srcname) || id1->numsegments != id2->numsegments ||
+        id1->earliest != id2->earliest || id1->latest != id2->latest)
+      return -1;
+
+    for (seg1 = id1->first, seg2 = id2->first; seg1 && seg2;
+         seg1 = seg1->next, seg2 = seg2->next)
+    {
+      if (seg1->starttime != seg2->starttime || seg1->endtime != seg2->endtime ||
+          seg1->samprate != seg2->samprate || seg1->samplecnt != seg2->samplecnt ||
+          seg1->numsamples != seg2->numsamples || seg1->sampletype != seg2->sampletype ||
+          memcmp (seg1->datasamples, seg2->datasamples,
+                  seg1->numsamples * ms_samplesize (seg1->sampletype)))
+        return -1;
+
+      (*segcount)++;
+      *samplecount += seg1->numsamples;
+    }
+
+    if (seg1 || seg2)
+      return -1;
+
+    (*idcount)++;
+  }
+
+  return (id1 || id2) ? -1 : 0;
+} /* End of compare_lists() */
+
+/***************************************************************************
+ * print_stderr:
+ *
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+  return;
+} /* End of print_stderr() */
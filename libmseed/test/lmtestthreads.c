@@ -0,0 +1,289 @@
+/***************************************************************************
+ * lmtestthreads.c
+ *
+ * A program for libmseed concurrency tests.
+ *
+ * Runs the same packing, unpacking, reading, stream ID and logging work
+ * in several threads at the same time and reports the results of each
+ * thread, which must be identical to running the work in one thread.
+ *
+ * modified 2026.292
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libmseed.h>
+
+#if !defined(LMP_WIN)
+  #include <pthread.h>
+#endif
+
+#define VERSION "[libmseed " LIBMSEED_VERSION " example]"
+#define PACKAGE "lmtestthreads"
+
+#define THREADS 8
+#define ITERATIONS 50
+#define SAMPLES 10000
+
+/* Work and results of a thread */
+typedef struct ThreadTest_s {
+  int id;
+  char *infile;
+  int32_t samples[SAMPLES];
+  char *records;     /* Packed records */
+  int recordcount;   /* Count of packed records */
+  int reclen;        /* Length of packed records */
+  int packerrors;    /* Count of packing errors */
+  int unpackerrors;  /* Count of unpacking errors and sample mismatches */
+  int readrecords;   /* Count of records read from the input file */
+  int64_t readsamples; /* Count of samples read from the input file */
+  int streamiderrors; /* Count of stream ID mismatches */
+  int logerrors;     /* Count of log messages formatted incorrectly */
+} ThreadTest;
+
+static void *thread_work (void *arg);
+static void record_handler (char *record, int reclen, void *handlerdata);
+static void print_stderr (char *message);
+static void print_discard (char *message);
+
+int
+main (int argc, char **argv)
+{
+  ThreadTest *tests;
+  int idx;
+#if !defined(LMP_WIN)
+  pthread_t tids[THREADS];
+#endif
+
+  if (argc != 2)
+  {
+    fprintf (stderr, "%s %s\n", PACKAGE, VERSION);
+    fprintf (stderr, "Usage: %s inputfile\n", PACKAGE);
+    return 1;
+  }
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  if (!(tests = (ThreadTest *)calloc (THREADS, sizeof (ThreadTest))))
+  {
+    fprintf (stderr, "Could not allocate tests, out of memory?\n");
+    return 1;
+  }
+
+  for (idx = 0; idx < THREADS; idx++)
+  {
+    tests[idx].id     = idx;
+    tests[idx].infile = argv[1];
+  }
+
+#if !defined(LMP_WIN)
+  for (idx = 0; idx < THREADS; idx++)
+  {
+    if (pthread_create (&tids[idx], NULL, thread_work, &tests[idx]))
+    {
+      fprintf (stderr, "Could not create thread %d\n", idx);
+      return 1;
+    }
+  }
+
+  for (idx = 0; idx < THREADS; idx++)
+    pthread_join (tids[idx], NULL);
+#else
+  for (idx = 0; idx < THREADS; idx++)
+    thread_work (&tests[idx]);
+#endif
+
+  for (idx = 0; idx < THREADS; idx++)
+  {
+    printf ("Thread %d: packed %d records, %d pack errors, %d unpack errors, "
+            "read %d records with %" PRId64 " samples, %d stream ID errors, %d log errors\n",
+            tests[idx].id, tests[idx].recordcount, tests[idx].packerrors,
+            tests[idx].unpackerrors, tests[idx].readrecords, tests[idx].readsamples,
+            tests[idx].streamiderrors, tests[idx].logerrors);
+
+    if (tests[idx].records)
+      free (tests[idx].records);
+  }
+
+  free (tests);
+  ms_freestreamids ();
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * thread_work:
+ *
+ * Repeatedly pack a trace of samples into Steim-2 records, unpack the
+ * records and compare the samples, read a file with ms_readmsr(),
+ * intern stream IDs and format log messages.
+ ***************************************************************************/
+static void *
+thread_work (void *arg)
+{
+  ThreadTest *test  = (ThreadTest *)arg;
+  MSRecord *msr     = NULL;
+  MSRecord *readmsr = NULL;
+  MSLogParam *logp  = NULL;
+  char station[11];
+  char expected[50];
+  const char *srcname;
+  int64_t packedsamples;
+  int32_t streamid;
+  int iteration;
+  int offset;
+  int idx;
+  int retcode;
+
+  for (idx = 0; idx < SAMPLES; idx++)
+    test->samples[idx] = (int32_t) ((idx * 7919 + test->id * 104729) % 200001) - 100000;
+
+  snprintf (station, sizeof (station), "T%d", test->id);
+
+  for (iteration = 0; iteration < ITERATIONS; iteration++)
+  {
+    /* Pack the samples */
+    if (!(msr = msr_init (msr)))
+    {
+      test->packerrors++;
+      break;
+    }
+
+    strcpy (msr->network, "XX");
+    strcpy (msr->station, station);
+    strcpy (msr->channel, "BHZ");
+    msr->dataquality = 'D';
+    msr->starttime   = ms_timestr2hptime ("2026-01-01T00:00:00");
+    msr->samprate    = 100.0;
+    msr->reclen      = 512;
+    msr->encoding    = DE_STEIM2;
+    msr->byteorder   = 1;
+    msr->datasamples = test->samples;
+    msr->numsamples  = SAMPLES;
+    msr->samplecnt   = SAMPLES;
+    msr->sampletype  = 'i';
+
+    test->recordcount = 0;
+    test->reclen      = msr->reclen;
+
+    if (msr_pack (msr, record_handler, test, &packedsamples, 1, 0) < 0 ||
+        packedsamples != SAMPLES)
+      test->packerrors++;
+
+    msr->datasamples = NULL;
+
+    /* Unpack the records and compare the samples */
+    offset = 0;
+    for (idx = 0; idx < test->recordcount; idx++)
+    {
+      if (msr_unpack (test->records + idx * test->reclen, test->reclen, &msr, 1, 0) != MS_NOERROR ||
+          offset + msr->numsamples > SAMPLES ||
+          memcmp (msr->datasamples, test->samples + offset, msr->numsamples * sizeof (int32_t)))
+      {
+        test->unpackerrors++;
+        break;
+      }
+
+      offset += msr->numsamples;
+    }
+
+    if (offset != SAMPLES)
+      test->unpackerrors++;
+
+    /* Read a file with the thread specific global file parameters */
+    test->readrecords = 0;
+    test->readsamples = 0;
+    while ((retcode = ms_readmsr (&readmsr, test->infile, 0, NULL, NULL, 1, 1, 0)) == MS_NOERROR)
+    {
+      test->readrecords++;
+      test->readsamples += readmsr->numsamples;
+    }
+
+    if (retcode != MS_ENDOFFILE)
+      test->readrecords = -1;
+
+    ms_readmsr (&readmsr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+    /* Intern stream IDs, including codes interned by other threads */
+    for (idx = 0; idx < THREADS; idx++)
+    {
+      snprintf (station, sizeof (station), "T%d", (test->id + idx) % THREADS);
+      snprintf (expected, sizeof (expected), "XX_%s__BHZ", station);
+
+      streamid = ms_streamid ("XX", station, "", "BHZ");
+      srcname  = ms_streamid_srcname (streamid);
+
+      if (!streamid || !srcname || strcmp (srcname, expected) ||
+          streamid != ms_streamid ("XX", station, "", "BHZ"))
+        test->streamiderrors++;
+    }
+
+    snprintf (station, sizeof (station), "T%d", test->id);
+
+    if (msr_streamid (msr) != ms_streamid ("XX", station, "", "BHZ"))
+      test->streamiderrors++;
+
+    /* Format log messages with thread specific logging parameters */
+    if (!(logp = ms_loginit_l (logp, print_discard, NULL, print_discard, NULL)) ||
+        ms_log_l (logp, 0, "Thread %d iteration %d\n", test->id, iteration) !=
+            snprintf (expected, sizeof (expected), "Thread %d iteration %d\n", test->id, iteration))
+      test->logerrors++;
+  }
+
+  msr_free (&msr);
+
+  if (logp)
+    free (logp);
+
+  return NULL;
+} /* End of thread_work() */
+
+/***************************************************************************
+ * record_handler:
+ *
+ * Collect packed records in the buffer of a thread.
+ ***************************************************************************/
+static void
+record_handler (char *record, int reclen, void *handlerdata)
+{
+  ThreadTest *test = (ThreadTest *)handlerdata;
+  char *records;
+
+  if (!(records = (char *)realloc (test->records, (test->recordcount + 1) * reclen)))
+  {
+    test->packerrors++;
+    return;
+  }
+
+  memcpy (records + test->recordcount * reclen, record, reclen);
+  test->records = records;
+  test->recordcount++;
+} /* End of record_handler() */
+
+/***************************************************************************
+ * print_stderr:
+ *
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+  return;
+} /* End of print_stderr() */
+
+/***************************************************************************
+ * print_discard:
+ *
+ * Discard a messsage.
+ ***************************************************************************/
+static void
+print_discard (char *message)
+{
+  return;
+} /* End of print_discard() */
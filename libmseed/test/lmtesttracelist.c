@@ -0,0 +1,359 @@
+/***************************************************************************
+ * lmtesttracelist.c
+ *
+ * A program for libmseed trace list tests.
+ *
+ * Adds the coverage of records for many trace IDs to trace lists in a
+ * scrambled order and checks that the trace IDs are kept in sort
+ * order, that each record was added to the trace ID it belongs to and
+ * that trace IDs removed from the list directly are handled.
+ *
+ * Also adds every other record of a long stream in a scrambled order
+ * and then the records between them, checking that the many segments
+ * are kept in time order and healed into a single segment.  Before
+ * healing segments are replaced directly, the last one without and
+ * one in the middle with resetting the lookup indexes.
+ *
+ * modified 2026.292
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#define VERSION "[libmseed " LIBMSEED_VERSION " example]"
+#define PACKAGE "lmtesttracelist"
+
+#define STATIONS 1000
+#define CHANNELS 3
+#define RECORDS 4
+#define SAMPLES 100
+#define FRAGMENTS 4000
+
+static int add_records (MSTraceList *mstl, MSRecord *msr, flag dataquality,
+                        int onlystation);
+static int check_list (MSTraceList *mstl, int expected, int *segerrors);
+static int add_fragments (MSTraceList *mstl, MSRecord *msr, int odd);
+static int check_fragments (MSTraceList *mstl, int expected);
+static int replace_segment (MSTraceID *id, MSTraceSeg *seg);
+static void print_stderr (char *message);
+
+int
+main (int argc, char **argv)
+{
+  MSTraceList *mstl = NULL;
+  MSRecord *msr     = NULL;
+  MSTraceID *id;
+  MSTraceID *previd = NULL;
+  MSTraceSeg *seg;
+  int adderrors;
+  int segerrors;
+  int sorted;
+  int segments;
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  if (!(msr = msr_init (NULL)) || !(mstl = mstl_init (NULL)))
+  {
+    fprintf (stderr, "Cannot allocate structures\n");
+    return 1;
+  }
+
+  /* Trace IDs by stream */
+  adderrors = add_records (mstl, msr, 0, -1);
+  sorted    = check_list (mstl, STATIONS * CHANNELS, &segerrors);
+  printf ("Streams: %d add errors, %d trace IDs, %s, %d segment errors\n",
+          adderrors, mstl->numtraces, (sorted) ? "sorted" : "not sorted", segerrors);
+
+  /* Remove the trace IDs of a station from the list directly and add them again */
+  for (id = mstl->traces; id;)
+  {
+    if (strcmp (id->station, "S0500"))
+    {
+      previd = id;
+      id     = id->next;
+      continue;
+    }
+
+    if (previd)
+      previd->next = id->next;
+    else
+      mstl->traces = id->next;
+
+    while ((seg = id->first))
+    {
+      id->first = seg->next;
+      free (seg);
+    }
+
+    free (id);
+    mstl->numtraces--;
+    mstl->last = NULL;
+    id         = (previd) ? previd->next : mstl->traces;
+  }
+
+  printf ("Removed: %d trace IDs\n", mstl->numtraces);
+
+  adderrors = add_records (mstl, msr, 0, 500);
+  sorted    = check_list (mstl, STATIONS * CHANNELS, &segerrors);
+  printf ("Re-added: %d add errors, %d trace IDs, %s, %d segment errors\n",
+          adderrors, mstl->numtraces, (sorted) ? "sorted" : "not sorted", segerrors);
+
+  /* Trace IDs by stream and quality */
+  mstl      = mstl_init (mstl);
+  adderrors = add_records (mstl, msr, 1, -1);
+  sorted    = check_list (mstl, STATIONS * CHANNELS * 2, &segerrors);
+  printf ("Qualities: %d add errors, %d trace IDs, %s, %d segment errors\n",
+          adderrors, mstl->numtraces, (sorted) ? "sorted" : "not sorted", segerrors);
+
+  /* Fragmented stream healed by the records in the gaps */
+  mstl      = mstl_init (mstl);
+  adderrors = add_fragments (mstl, msr, 0);
+  segments  = check_fragments (mstl, FRAGMENTS / 2);
+  printf ("Fragments: %d add errors, %d segments%s\n", adderrors,
+          (mstl->traces) ? mstl->traces->numsegments : 0,
+          (segments == FRAGMENTS / 2) ? ", in time order" : ", not in time order");
+
+  /* Replace segments directly, the last is detected by the index */
+  if (mstl->traces && mstl->traces->numsegments > 2)
+  {
+    id       = mstl->traces;
+    segments = replace_segment (id, id->last);
+
+    for (seg = id->first, sorted = 0; sorted < id->numsegments / 2; sorted++)
+      seg = seg->next;
+
+    segments += replace_segment (id, seg);
+    mstl_resetindex (mstl, id);
+
+    printf ("Replaced: %d segments\n", segments);
+  }
+
+  adderrors = add_fragments (mstl, msr, 1);
+  segments  = check_fragments (mstl, 1);
+  printf ("Healed: %d add errors, %d segments%s\n", adderrors,
+          (mstl->traces) ? mstl->traces->numsegments : 0,
+          (segments == 1) ? ", covering all records" : ", not covering all records");
+
+  mstl_free (&mstl, 0);
+  msr_free (&msr);
+  ms_freestreamids ();
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * add_records:
+ *
+ * Add contiguous records for each test stream to a trace list, the
+ * streams are visited in a scrambled order.  If dataquality is true
+ * the records of each stream are added with two data qualities.  If
+ * onlystation is not negative only the records of that station are
+ * added.
+ *
+ * Returns the number of records that could not be added.
+ ***************************************************************************/
+static int
+add_records (MSTraceList *mstl, MSRecord *msr, flag dataquality, int onlystation)
+{
+  int streams = STATIONS * CHANNELS;
+  int errors  = 0;
+  int record;
+  int stream;
+  int idx;
+  int qual;
+
+  for (record = 0; record < RECORDS; record++)
+  {
+    for (idx = 0; idx < streams; idx++)
+    {
+      /* Scramble the order, 7919 is prime and does not divide streams */
+      stream = (int)(((int64_t)idx * 7919) % streams);
+
+      if (onlystation >= 0 && stream / CHANNELS != onlystation)
+        continue;
+
+      for (qual = 0; qual <= dataquality; qual++)
+      {
+        msr = msr_init (msr);
+
+        strcpy (msr->network, "XX");
+        sprintf (msr->station, "S%04d", stream / CHANNELS);
+        sprintf (msr->channel, "BH%c", "ZNE"[stream % CHANNELS]);
+        msr->dataquality = (qual) ? 'Q' : 'D';
+        msr->samprate    = 1.0;
+        msr->samplecnt   = SAMPLES;
+        msr->starttime   = ms_timestr2hptime ("2026-01-01T00:00:00") +
+                         (hptime_t)record * SAMPLES * HPTMODULUS;
+
+        if (!mstl_addmsr (mstl, msr, dataquality, 1, -1.0, -1.0))
+          errors++;
+      }
+    }
+  }
+
+  return errors;
+} /* End of add_records() */
+
+/***************************************************************************
+ * check_list:
+ *
+ * Check that a trace list contains the expected number of trace IDs
+ * in sort order and count the trace IDs that do not have a single
+ * segment covering all records.
+ *
+ * Returns 1 if the trace IDs are sorted and 0 otherwise.
+ ***************************************************************************/
+static int
+check_list (MSTraceList *mstl, int expected, int *segerrors)
+{
+  MSTraceID *id;
+  MSTraceID *previd = NULL;
+  int count         = 0;
+  int sorted        = 1;
+
+  *segerrors = 0;
+
+  for (id = mstl->traces; id; id = id->next)
+  {
+    if (previd && strcmp (previd->srcname, id->srcname) >= 0)
+      sorted = 0;
+
+    if (id->numsegments != 1 || !id->first || id->first != id->last ||
+        id->first->samplecnt != RECORDS * SAMPLES)
+      (*segerrors)++;
+
+    previd = id;
+    count++;
+  }
+
+  if (count != expected || count != mstl->numtraces)
+    sorted = 0;
+
+  return sorted;
+} /* End of check_list() */
+
+/***************************************************************************
+ * add_fragments:
+ *
+ * Add the even or odd numbered records of a long stream to a trace
+ * list in a scrambled order.
+ *
+ * Returns the number of records that could not be added.
+ ***************************************************************************/
+static int
+add_fragments (MSTraceList *mstl, MSRecord *msr, int odd)
+{
+  int records = FRAGMENTS / 2;
+  int errors  = 0;
+  int record;
+  int idx;
+
+  for (idx = 0; idx < records; idx++)
+  {
+    /* Scramble the order, 7919 is prime and does not divide records */
+    record = (int)(((int64_t)idx * 7919) % records) * 2 + odd;
+
+    msr = msr_init (msr);
+
+    strcpy (msr->network, "XX");
+    strcpy (msr->station, "FRAG");
+    strcpy (msr->channel, "BHZ");
+    msr->dataquality = 'D';
+    msr->samprate    = 1.0;
+    msr->samplecnt   = SAMPLES;
+    msr->starttime   = ms_timestr2hptime ("2026-01-01T00:00:00") +
+                     (hptime_t)record * SAMPLES * HPTMODULUS;
+
+    if (!mstl_addmsr (mstl, msr, 0, 1, -1.0, -1.0))
+      errors++;
+  }
+
+  return errors;
+} /* End of add_fragments() */
+
+/***************************************************************************
+ * check_fragments:
+ *
+ * Check that the segments of the fragmented stream are in time order,
+ * are linked consistently, match the segment count of the trace ID
+ * and together cover the expected number of records.
+ *
+ * Returns the number of segments if consistent and -1 otherwise.
+ ***************************************************************************/
+static int
+check_fragments (MSTraceList *mstl, int expected)
+{
+  MSTraceID *id = mstl->traces;
+  MSTraceSeg *seg;
+  int64_t samplecnt = 0;
+  int count         = 0;
+
+  if (!id || id->next || mstl->numtraces != 1)
+    return -1;
+
+  for (seg = id->first; seg; seg = seg->next)
+  {
+    if (seg->prev && (seg->prev->next != seg || seg->prev->endtime >= seg->starttime))
+      return -1;
+
+    if (!seg->next && id->last != seg)
+      return -1;
+
+    samplecnt += seg->samplecnt;
+    count++;
+  }
+
+  if (count != id->numsegments || count != expected ||
+      samplecnt != (int64_t)SAMPLES * FRAGMENTS / ((expected == 1) ? 1 : 2))
+    return -1;
+
+  return count;
+} /* End of check_fragments() */
+
+/***************************************************************************
+ * replace_segment:
+ *
+ * Replace a segment of a trace ID with a copy and free the original.
+ *
+ * Returns 1 if the segment was replaced and 0 otherwise.
+ ***************************************************************************/
+static int
+replace_segment (MSTraceID *id, MSTraceSeg *seg)
+{
+  MSTraceSeg *copy;
+
+  if (!(copy = (MSTraceSeg *)malloc (sizeof (MSTraceSeg))))
+    return 0;
+
+  memcpy (copy, seg, sizeof (MSTraceSeg));
+
+  if (seg->prev)
+    seg->prev->next = copy;
+  else
+    id->first = copy;
+
+  if (seg->next)
+    seg->next->prev = copy;
+  else
+    id->last = copy;
+
+  free (seg);
+
+  return 1;
+} /* End of replace_segment() */
+
+/***************************************************************************
+ * print_stderr:
+ *
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+  return;
+} /* End of print_stderr() */
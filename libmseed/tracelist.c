@@ -5,7 +5,7 @@
  *
  * Written by Chad Trabant, IRIS Data Management Center
  *
- * modified: 2015.108
+ * modified: 2026.292
  ***************************************************************************/
 
 #include <stdio.h>
@@ -14,11 +14,81 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "lmthread.h"
 
 MSTraceSeg *mstl_msr2seg (MSRecord *msr, hptime_t endtime);
 MSTraceSeg *mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence);
 MSTraceSeg *mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2);
 
+/* Number of trace IDs at which a lookup index is maintained */
+#define MSTL_IDINDEXMIN 16
+
+/* Lookup index of the trace IDs of a MSTraceList */
+typedef struct MSTraceIDIndex_s {
+  MSTraceID **sorted;   /* Trace IDs in list (source name) order */
+  int32_t count;        /* Number of trace IDs indexed */
+  int32_t size;         /* Allocated length of sorted */
+  MSTraceID **slots;    /* Hash table of trace IDs by stream ID, linear probing */
+  uint32_t slotcount;   /* Number of hash table slots, a power of 2 */
+} MSTraceIDIndex;
+
+static MSTraceIDIndex *mstl_idindex (MSTraceList *mstl);
+static void mstl_freeidindex (MSTraceList *mstl);
+static int idindex_hash (MSTraceIDIndex *index, MSTraceID *id);
+static MSTraceID *idindex_findstreamid (MSTraceIDIndex *index, int32_t streamid,
+                                        char quality, flag dataquality);
+static MSTraceID *idindex_findsrcname (MSTraceIDIndex *index, const char *srcname,
+                                       int32_t *position);
+static int idindex_insert (MSTraceIDIndex *index, MSTraceID *id, int32_t position);
+
+/* Number of segments of a trace ID at which a lookup index is maintained */
+#define MSTL_SEGINDEXMIN 64
+
+/* Node of a segment index, a treap in segment list order augmented with
+ * the latest end time in each subtree.  The times of the segment when
+ * it was indexed are kept as the key. */
+typedef struct MSTraceSegNode_s {
+  MSTraceSeg *seg;
+  hptime_t starttime;           /* Start time of the segment when indexed */
+  hptime_t endtime;             /* End time of the segment when indexed */
+  hptime_t maxend;              /* Latest end time in this subtree */
+  uint32_t priority;            /* Random heap priority */
+  struct MSTraceSegNode_s *left;
+  struct MSTraceSegNode_s *right;
+} MSTraceSegNode;
+
+/* Lookup index of the segments of a MSTraceID */
+typedef struct MSTraceSegIndex_s {
+  MSTraceSegNode *root;
+  int32_t count;                /* Number of segments indexed */
+  MSTraceSeg *first;            /* First segment of the list when last updated */
+  MSTraceSeg *last;             /* Last segment of the list when last updated */
+  uint32_t seed;                /* State of the priority generator */
+} MSTraceSegIndex;
+
+static MSTraceSegIndex *mstl_segindex (MSTraceID *id);
+static void mstl_freesegindex (MSTraceID *id);
+static int segindex_insert (MSTraceSegIndex *index, MSTraceSeg *seg, MSTraceSegNode *node);
+static MSTraceSegNode *segindex_remove (MSTraceSegIndex *index, MSTraceSeg *seg,
+                                        hptime_t starttime, hptime_t endtime);
+static void segindex_search (MSTraceSegIndex *index, MSRecord *msr, hptime_t endtime,
+                             hptime_t hpdelta, hptime_t hptimetol, double sampratetol,
+                             flag autoheal, MSTraceSeg **segbefore, MSTraceSeg **segafter,
+                             MSTraceSeg **followseg);
+static int segnode_cmp (hptime_t starttime1, hptime_t endtime1, MSTraceSeg *seg1,
+                        hptime_t starttime2, hptime_t endtime2, MSTraceSeg *seg2);
+static void segnode_update (MSTraceSegNode *node);
+static MSTraceSegNode *segnode_insert (MSTraceSegNode *root, MSTraceSegNode *node);
+static MSTraceSegNode *segnode_remove (MSTraceSegNode *root, MSTraceSeg *seg,
+                                       hptime_t starttime, hptime_t endtime,
+                                       MSTraceSegNode **node);
+static MSTraceSegNode *segnode_merge (MSTraceSegNode *left, MSTraceSegNode *right);
+static MSTraceSeg *segnode_before (MSTraceSegNode *node, hptime_t endlow, hptime_t endhigh,
+                                   double samprate, double sampratetol);
+static MSTraceSeg *segnode_after (MSTraceSegNode *node, hptime_t startlow, hptime_t starthigh,
+                                  double samprate, double sampratetol);
+static int segrate_tolerable (MSTraceSeg *seg, double samprate, double sampratetol);
+
 /***************************************************************************
  * mstl_init:
  *
@@ -99,10 +169,14 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
       if (freeprvtptr && id->prvtptr)
         free (id->prvtptr);
 
+      mstl_freesegindex (id);
+
       free (id);
       id = nextid;
     }
 
+    mstl_freeidindex (*ppmstl);
+
     free (*ppmstl);
 
     *ppmstl = NULL;
@@ -111,6 +185,35 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
   return;
 } /* End of mstl_free() */
 
+/***************************************************************************
+ * mstl_resetindex:
+ *
+ * Free the private lookup indexes of a MSTraceList, they are rebuilt
+ * from the lists when needed by mstl_addmsr().  If id is not NULL only
+ * the segment index of that MSTraceID is freed, otherwise the trace ID
+ * index and the segment indexes of all trace IDs are freed.
+ *
+ * Programs that remove, replace or change the times of trace IDs or
+ * segments directly must call this routine before adding more data.
+ ***************************************************************************/
+void
+mstl_resetindex (MSTraceList *mstl, MSTraceID *id)
+{
+  if (id)
+  {
+    mstl_freesegindex (id);
+    return;
+  }
+
+  if (!mstl)
+    return;
+
+  for (id = mstl->traces; id; id = id->next)
+    mstl_freesegindex (id);
+
+  mstl_freeidindex (mstl);
+} /* End of mstl_resetindex() */
+
 /***************************************************************************
  * mstl_addmsr:
  *
@@ -130,16 +233,33 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
  * descending alphanumeric order.  MSTraceIDs are always maintained
  * with MSTraceSegs in data time time order.
  *
+ * Once a MSTraceList contains MSTL_IDINDEXMIN trace IDs they are
+ * found, and new trace IDs are placed in sort order, through an index
+ * of the trace IDs by stream ID and source name instead of searching
+ * the list.  The index is rebuilt when the number of trace IDs differs
+ * from the number indexed, callers that remove trace IDs from the list
+ * directly must keep mstl->numtraces accurate.
+ *
+ * Likewise once a MSTraceID contains MSTL_SEGINDEXMIN segments the
+ * segments a record fits with are found through an interval index of
+ * the segments.  The index is rebuilt when the number of segments
+ * differs from the number indexed, callers that modify the segments
+ * of a trace ID directly must keep id->numsegments accurate and must
+ * not change the times of segments.
+ *
  * Return a pointer to the MSTraceSeg updated or 0 on error.
  ***************************************************************************/
 MSTraceSeg *
 mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
              flag autoheal, double timetol, double sampratetol)
 {
-  MSTraceID *id       = 0;
-  MSTraceID *searchid = 0;
-  MSTraceID *ltid     = 0;
+  MSTraceIDIndex *index = 0;
+  MSTraceID *id         = 0;
+  MSTraceID *searchid   = 0;
+  MSTraceID *ltid       = 0;
 
+  MSTraceSegIndex *segindex = 0;
+  MSTraceSeg *modseg    = 0;
   MSTraceSeg *seg       = 0;
   MSTraceSeg *searchseg = 0;
   MSTraceSeg *segbefore = 0;
@@ -147,6 +267,8 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   MSTraceSeg *followseg = 0;
 
   hptime_t endtime;
+  hptime_t modstart = 0;
+  hptime_t modend   = 0;
   hptime_t pregap;
   hptime_t postgap;
   hptime_t lastgap;
@@ -157,6 +279,8 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
 
   char srcname[45];
   char *s1, *s2;
+  int32_t streamid;
+  int32_t position = 0;
   flag whence;
   flag lastratecheck;
   flag firstratecheck;
@@ -175,16 +299,54 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     return 0;
   }
 
-  /* Generate source name string */
-  if (!msr_srcname (msr, srcname, dataquality))
+  /* Use the trace ID index for longer lists */
+  if (mstl->numtraces >= MSTL_IDINDEXMIN)
+    index = mstl_idindex (mstl);
+
+  /* Search for matching trace ID by stream ID starting with last
+     accessed ID and then through the index or the trace ID list. */
+  if ((streamid = msr_streamid (msr)))
+  {
+    if (mstl->last && mstl->last->streamid == streamid &&
+        (!dataquality || mstl->last->dataquality == msr->dataquality))
+    {
+      id = mstl->last;
+    }
+    else if (index)
+    {
+      id = idindex_findstreamid (index, streamid, msr->dataquality, dataquality);
+    }
+    else
+    {
+      for (searchid = mstl->traces; searchid; searchid = searchid->next)
+      {
+        if (searchid->streamid == streamid &&
+            (!dataquality || searchid->dataquality == msr->dataquality))
+        {
+          id = searchid;
+          break;
+        }
+      }
+    }
+  }
+
+  /* Generate source name string, only needed for a new trace ID */
+  if (!id && !msr_srcname (msr, srcname, dataquality))
   {
     ms_log (2, "mstl_addmsr(): Error generating srcname for MSRecord\n");
     return 0;
   }
 
-  /* Search for matching trace ID starting with last accessed ID and
-     then looping through the trace ID list. */
-  if (mstl->last)
+  /* Search the index for a matching source name and the position
+     for insertion of a new trace ID in sort order. */
+  if (!id && index)
+  {
+    if (!(id = idindex_findsrcname (index, srcname, &position)) && position > 0)
+      ltid = index->sorted[position - 1];
+  }
+  /* Search for matching trace ID by source name, tracking the position
+     for insertion of a new trace ID in sort order. */
+  else if (!id && mstl->last)
   {
     s1 = mstl->last->srcname;
     s2 = srcname;
@@ -268,6 +430,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     strcpy (id->channel, msr->channel);
     id->dataquality = msr->dataquality;
     strcpy (id->srcname, srcname);
+    id->streamid    = streamid;
 
     id->earliest    = msr->starttime;
     id->latest      = endtime;
@@ -292,6 +455,10 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     }
 
     mstl->numtraces++;
+
+    /* Add new MSTraceID to the index, rebuilt later if this fails */
+    if (index && idindex_insert (index, id, position))
+      mstl_freeidindex (mstl);
   }
   /* Add data coverage to the matching MSTraceID */
   else
@@ -328,6 +495,10 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       firstratecheck = (ms_dabs (msr->samprate - id->first->samprate) > sampratetol) ? 0 : 1;
     }
 
+    /* Use the segment index for trace IDs with many segments */
+    if (id->segindex || id->numsegments >= MSTL_SEGINDEXMIN)
+      segindex = mstl_segindex (id);
+
     /* Search first for the simple scenarios in order of likelihood:
      * - Record fits at end of last segment
      * - Record fits after all coverage
@@ -340,6 +511,10 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage fits at end of last segment */
     if (lastgap <= hptimetol && lastgap >= nhptimetol && lastratecheck)
     {
+      modseg   = id->last;
+      modstart = modseg->starttime;
+      modend   = modseg->endtime;
+
       if (!mstl_addmsrtoseg (id->last, msr, endtime, 1))
         return 0;
 
@@ -381,6 +556,10 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage fits at beginning of first segment */
     else if (firstgap <= hptimetol && firstgap >= nhptimetol && firstratecheck)
     {
+      modseg   = id->first;
+      modstart = modseg->starttime;
+      modend   = modseg->endtime;
+
       if (!mstl_addmsrtoseg (id->first, msr, endtime, 2))
         return 0;
 
@@ -396,6 +575,15 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       segbefore = 0; /* Find segment that record fits before */
       segafter  = 0; /* Find segment that record fits after */
       followseg = 0; /* Track segment that record follows in time order */
+
+      /* Search the segment index instead of the list if available */
+      if (segindex)
+      {
+        segindex_search (segindex, msr, endtime, hpdelta, hptimetol, sampratetol,
+                         autoheal, &segbefore, &segafter, &followseg);
+        searchseg = 0;
+      }
+
       while (searchseg)
       {
         if (msr->starttime > searchseg->starttime)
@@ -453,6 +641,14 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       /* Add MSRecord coverage to end of segment before */
       if (segbefore)
       {
+        modseg   = segbefore;
+        modstart = modseg->starttime;
+        modend   = modseg->endtime;
+
+        /* Remove segafter from the index before segbefore is modified */
+        if (segindex && autoheal && segafter && segbefore != segafter)
+          free (segindex_remove (segindex, segafter, segafter->starttime, segafter->endtime));
+
         if (!mstl_addmsrtoseg (segbefore, msr, endtime, 1))
         {
           return 0;
@@ -477,6 +673,8 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
           if (segafter->next)
             segafter->next->prev = segafter->prev;
 
+          id->numsegments--;
+
           /* Free data samples, private data and segment structure */
           if (segafter->datasamples)
             free (segafter->datasamples);
@@ -492,6 +690,10 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       /* Add MSRecord coverage to beginning of segment after */
       else if (segafter)
       {
+        modseg   = segafter;
+        modstart = modseg->starttime;
+        modend   = modseg->endtime;
+
         if (!mstl_addmsrtoseg (segafter, msr, endtime, 2))
         {
           return 0;
@@ -540,7 +742,21 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       if (endtime > id->latest)
         id->latest = endtime;
     } /* End of searching segment list */
-  }   /* End of adding coverage to matching ID */
+
+    /* Update the segment index with the modified or new segment, rebuilt later if this fails */
+    if (segindex)
+    {
+      if (modseg)
+      {
+        if (segindex_insert (segindex, modseg, segindex_remove (segindex, modseg, modstart, modend)))
+          mstl_freesegindex (id);
+      }
+      else if (segindex_insert (segindex, seg, NULL))
+      {
+        mstl_freesegindex (id);
+      }
+    }
+  } /* End of adding coverage to matching ID */
 
   /* Sort modified segment into place, logic above should limit these to few shifts if any */
   while (seg->next && (seg->starttime > seg->next->starttime ||
@@ -592,6 +808,13 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       id->last = segbefore;
   }
 
+  /* Record the ends of the segment list as indexed */
+  if (id->segindex)
+  {
+    id->segindex->first = id->first;
+    id->segindex->last  = id->last;
+  }
+
   /* Set MSTraceID as last accessed */
   mstl->last = id;
 
@@ -789,6 +1012,693 @@ mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
   return seg1;
 } /* End of mstl_addsegtoseg() */
 
+/***************************************************************************
+ * mstl_idindex:
+ *
+ * Return the trace ID index of a MSTraceList, building it from the
+ * list of trace IDs if it does not exist or the number of trace IDs
+ * differs from the number indexed.
+ *
+ * Returns a pointer to the index or NULL on error.
+ ***************************************************************************/
+static MSTraceIDIndex *
+mstl_idindex (MSTraceList *mstl)
+{
+  MSTraceIDIndex *index = mstl->idindex;
+  MSTraceID *id;
+
+  if (index && index->count == mstl->numtraces)
+    return index;
+
+  mstl_freeidindex (mstl);
+
+  if (!(index = (MSTraceIDIndex *)calloc (1, sizeof (MSTraceIDIndex))))
+  {
+    ms_log (2, "mstl_addmsr(): Cannot allocate memory\n");
+    return NULL;
+  }
+
+  index->size = mstl->numtraces * 2;
+
+  if (!(index->sorted = (MSTraceID **)malloc (index->size * sizeof (MSTraceID *))))
+  {
+    ms_log (2, "mstl_addmsr(): Cannot allocate memory\n");
+    free (index);
+    return NULL;
+  }
+
+  for (id = mstl->traces; id && index->count < mstl->numtraces; id = id->next)
+    index->sorted[index->count++] = id;
+
+  mstl->idindex = index;
+
+  if (id || index->count != mstl->numtraces || idindex_hash (index, NULL))
+  {
+    mstl_freeidindex (mstl);
+    return NULL;
+  }
+
+  return index;
+} /* End of mstl_idindex() */
+
+/***************************************************************************
+ * mstl_freeidindex:
+ *
+ * Free the trace ID index of a MSTraceList.
+ ***************************************************************************/
+static void
+mstl_freeidindex (MSTraceList *mstl)
+{
+  if (!mstl->idindex)
+    return;
+
+  if (mstl->idindex->sorted)
+    free (mstl->idindex->sorted);
+
+  if (mstl->idindex->slots)
+    free (mstl->idindex->slots);
+
+  free (mstl->idindex);
+  mstl->idindex = NULL;
+} /* End of mstl_freeidindex() */
+
+/***************************************************************************
+ * idindex_hash:
+ *
+ * Add a trace ID to the stream ID hash table of an index, doubling
+ * the table and rehashing all indexed trace IDs when it is half full.
+ * If id is NULL the table is rebuilt from the indexed trace IDs.  Trace
+ * IDs without a stream ID are only found by source name.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+idindex_hash (MSTraceIDIndex *index, MSTraceID *id)
+{
+  MSTraceID **slots;
+  uint32_t slotcount;
+  uint32_t slot;
+  int32_t idx;
+
+  if (!id || (uint32_t)index->count * 2 > index->slotcount)
+  {
+    for (slotcount = 64; slotcount < (uint32_t)index->count * 4; slotcount *= 2)
+      ;
+
+    if (!(slots = (MSTraceID **)calloc (slotcount, sizeof (MSTraceID *))))
+    {
+      ms_log (2, "mstl_addmsr(): Cannot allocate memory\n");
+      return -1;
+    }
+
+    if (index->slots)
+      free (index->slots);
+
+    index->slots     = slots;
+    index->slotcount = slotcount;
+
+    /* Rehash all indexed trace IDs, including a new one already sorted */
+    for (idx = 0; idx < index->count; idx++)
+    {
+      if (!index->sorted[idx]->streamid)
+        continue;
+
+      slot = ((uint32_t)index->sorted[idx]->streamid * 2654435761U) & (slotcount - 1);
+      while (index->slots[slot])
+        slot = (slot + 1) & (slotcount - 1);
+
+      index->slots[slot] = index->sorted[idx];
+    }
+
+    return 0;
+  }
+
+  if (!id->streamid)
+    return 0;
+
+  slot = ((uint32_t)id->streamid * 2654435761U) & (index->slotcount - 1);
+  while (index->slots[slot])
+    slot = (slot + 1) & (index->slotcount - 1);
+
+  index->slots[slot] = id;
+
+  return 0;
+} /* End of idindex_hash() */
+
+/***************************************************************************
+ * idindex_findstreamid:
+ *
+ * Search the index for a trace ID with the specified stream ID and,
+ * if the dataquality flag is true, data quality.  If more than one
+ * trace ID matches the first in list order is returned, as when
+ * searching the list.
+ *
+ * Returns a pointer to the trace ID or NULL if not found.
+ ***************************************************************************/
+static MSTraceID *
+idindex_findstreamid (MSTraceIDIndex *index, int32_t streamid,
+                      char quality, flag dataquality)
+{
+  MSTraceID *found = NULL;
+  MSTraceID *id;
+  uint32_t slot;
+
+  slot = ((uint32_t)streamid * 2654435761U) & (index->slotcount - 1);
+
+  while ((id = index->slots[slot]))
+  {
+    if (id->streamid == streamid && (!dataquality || id->dataquality == quality) &&
+        (!found || strcmp (id->srcname, found->srcname) < 0))
+      found = id;
+
+    slot = (slot + 1) & (index->slotcount - 1);
+  }
+
+  return found;
+} /* End of idindex_findstreamid() */
+
+/***************************************************************************
+ * idindex_findsrcname:
+ *
+ * Search the index for a trace ID with the specified source name with
+ * a binary search of the trace IDs in list order.  The position where
+ * a trace ID with the source name belongs in the list is returned in
+ * position.
+ *
+ * Returns a pointer to the trace ID or NULL if not found.
+ ***************************************************************************/
+static MSTraceID *
+idindex_findsrcname (MSTraceIDIndex *index, const char *srcname, int32_t *position)
+{
+  int32_t low  = 0;
+  int32_t high = index->count;
+  int32_t mid;
+  int cmp;
+
+  while (low < high)
+  {
+    mid = low + (high - low) / 2;
+    cmp = strcmp (index->sorted[mid]->srcname, srcname);
+
+    if (cmp == 0)
+    {
+      *position = mid;
+      return index->sorted[mid];
+    }
+
+    if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  *position = low;
+
+  return NULL;
+} /* End of idindex_findsrcname() */
+
+/***************************************************************************
+ * idindex_insert:
+ *
+ * Insert a trace ID into the index at the specified list position.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+idindex_insert (MSTraceIDIndex *index, MSTraceID *id, int32_t position)
+{
+  MSTraceID **sorted;
+
+  if (index->count >= index->size)
+  {
+    if (!(sorted = (MSTraceID **)realloc (index->sorted, index->size * 2 * sizeof (MSTraceID *))))
+    {
+      ms_log (2, "mstl_addmsr(): Cannot allocate memory\n");
+      return -1;
+    }
+
+    index->sorted = sorted;
+    index->size *= 2;
+  }
+
+  memmove (index->sorted + position + 1, index->sorted + position,
+           (index->count - position) * sizeof (MSTraceID *));
+
+  index->sorted[position] = id;
+  index->count++;
+
+  return idindex_hash (index, id);
+} /* End of idindex_insert() */
+
+/***************************************************************************
+ * mstl_segindex:
+ *
+ * Return the segment index of a MSTraceID, building it from the list
+ * of segments if it does not exist, the number of segments differs
+ * from the number indexed or the first or last segment differs from
+ * the ends of the list when the index was last updated.  If the list
+ * contains a different number of segments than id->numsegments the
+ * count is corrected.
+ *
+ * Returns a pointer to the index or NULL on error.
+ ***************************************************************************/
+static MSTraceSegIndex *
+mstl_segindex (MSTraceID *id)
+{
+  MSTraceSegIndex *index = id->segindex;
+  MSTraceSeg *seg;
+
+  if (index && index->count == id->numsegments &&
+      index->first == id->first && index->last == id->last)
+    return index;
+
+  mstl_freesegindex (id);
+
+  if (!(index = (MSTraceSegIndex *)calloc (1, sizeof (MSTraceSegIndex))))
+  {
+    ms_log (2, "mstl_addmsr(): Cannot allocate memory\n");
+    return NULL;
+  }
+
+  index->seed  = 2463534242U;
+  id->segindex = index;
+
+  for (seg = id->first; seg; seg = seg->next)
+  {
+    if (segindex_insert (index, seg, NULL))
+    {
+      mstl_freesegindex (id);
+      return NULL;
+    }
+  }
+
+  id->numsegments = index->count;
+  index->first    = id->first;
+  index->last     = id->last;
+
+  return index;
+} /* End of mstl_segindex() */
+
+/***************************************************************************
+ * mstl_freesegindex:
+ *
+ * Free the segment index of a MSTraceID.
+ ***************************************************************************/
+static void
+mstl_freesegindex (MSTraceID *id)
+{
+  MSTraceSegNode *node;
+  MSTraceSegNode *next;
+
+  if (!id->segindex)
+    return;
+
+  /* Free nodes without recursion, rotating left children up until a
+     node has none and can be freed */
+  node = id->segindex->root;
+  while (node)
+  {
+    if ((next = node->left))
+    {
+      node->left  = next->right;
+      next->right = node;
+    }
+    else
+    {
+      next = node->right;
+      free (node);
+    }
+
+    node = next;
+  }
+
+  free (id->segindex);
+  id->segindex = NULL;
+} /* End of mstl_freesegindex() */
+
+/***************************************************************************
+ * segindex_insert:
+ *
+ * Insert a segment into a segment index keyed by its current times,
+ * using the specified node or allocating a new node if NULL.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+segindex_insert (MSTraceSegIndex *index, MSTraceSeg *seg, MSTraceSegNode *node)
+{
+  if (!node && !(node = (MSTraceSegNode *)malloc (sizeof (MSTraceSegNode))))
+  {
+    ms_log (2, "mstl_addmsr(): Cannot allocate memory\n");
+    return -1;
+  }
+
+  /* Xorshift generator for node priorities */
+  index->seed ^= index->seed << 13;
+  index->seed ^= index->seed >> 17;
+  index->seed ^= index->seed << 5;
+
+  node->seg       = seg;
+  node->starttime = seg->starttime;
+  node->endtime   = seg->endtime;
+  node->priority  = index->seed;
+  node->left      = NULL;
+  node->right     = NULL;
+
+  index->root = segnode_insert (index->root, node);
+  index->count++;
+
+  return 0;
+} /* End of segindex_insert() */
+
+/***************************************************************************
+ * segindex_remove:
+ *
+ * Remove a segment from a segment index, the segment is found by the
+ * times it had when it was indexed.
+ *
+ * Returns the removed node or NULL if the segment was not found.
+ ***************************************************************************/
+static MSTraceSegNode *
+segindex_remove (MSTraceSegIndex *index, MSTraceSeg *seg,
+                 hptime_t starttime, hptime_t endtime)
+{
+  MSTraceSegNode *node = NULL;
+
+  index->root = segnode_remove (index->root, seg, starttime, endtime, &node);
+
+  if (node)
+    index->count--;
+
+  return node;
+} /* End of segindex_remove() */
+
+/***************************************************************************
+ * segindex_search:
+ *
+ * Search a segment index for the segments a record fits with, as the
+ * search of the segment list in mstl_addmsr() would find them:
+ *
+ * segbefore : first segment in list order that the record fits after
+ * segafter  : first segment in list order that the record fits before
+ * followseg : last segment in list order starting before the record
+ *
+ * Without autohealing only the first of segbefore and segafter in list
+ * order is returned, and followseg is only searched if neither is
+ * found.
+ ***************************************************************************/
+static void
+segindex_search (MSTraceSegIndex *index, MSRecord *msr, hptime_t endtime,
+                 hptime_t hpdelta, hptime_t hptimetol, double sampratetol,
+                 flag autoheal, MSTraceSeg **segbefore, MSTraceSeg **segafter,
+                 MSTraceSeg **followseg)
+{
+  MSTraceSegNode *node;
+
+  *segbefore = segnode_before (index->root,
+                               msr->starttime - hpdelta - hptimetol,
+                               msr->starttime - hpdelta + hptimetol,
+                               msr->samprate, sampratetol);
+
+  *segafter = segnode_after (index->root,
+                             endtime + hpdelta - hptimetol,
+                             endtime + hpdelta + hptimetol,
+                             msr->samprate, sampratetol);
+
+  /* Only the first segment found in list order is used if not autohealing */
+  if (!autoheal && *segbefore && *segafter)
+  {
+    if (segnode_cmp ((*segbefore)->starttime, (*segbefore)->endtime, *segbefore,
+                     (*segafter)->starttime, (*segafter)->endtime, *segafter) < 0)
+      *segafter = 0;
+    else
+      *segbefore = 0;
+  }
+
+  if (*segbefore || *segafter)
+    return;
+
+  /* Find the last segment starting before the record */
+  for (node = index->root; node;)
+  {
+    if (node->starttime < msr->starttime)
+    {
+      *followseg = node->seg;
+      node       = node->right;
+    }
+    else
+    {
+      node = node->left;
+    }
+  }
+} /* End of segindex_search() */
+
+/***************************************************************************
+ * segnode_cmp:
+ *
+ * Compare the keys of two segments in segment list order, earlier
+ * start times first and for equal start times later end times first.
+ * Segments with the same times are ordered by address.
+ *
+ * Returns a negative, zero or positive value if the first segment is
+ * before, the same as or after the second.
+ ***************************************************************************/
+static int
+segnode_cmp (hptime_t starttime1, hptime_t endtime1, MSTraceSeg *seg1,
+             hptime_t starttime2, hptime_t endtime2, MSTraceSeg *seg2)
+{
+  if (starttime1 != starttime2)
+    return (starttime1 < starttime2) ? -1 : 1;
+
+  if (endtime1 != endtime2)
+    return (endtime1 > endtime2) ? -1 : 1;
+
+  if (seg1 != seg2)
+    return ((uintptr_t)seg1 < (uintptr_t)seg2) ? -1 : 1;
+
+  return 0;
+} /* End of segnode_cmp() */
+
+/***************************************************************************
+ * segnode_update:
+ *
+ * Set the latest end time of the subtree of a node from its children.
+ ***************************************************************************/
+static void
+segnode_update (MSTraceSegNode *node)
+{
+  if (!node)
+    return;
+
+  node->maxend = node->endtime;
+
+  if (node->left && node->left->maxend > node->maxend)
+    node->maxend = node->left->maxend;
+
+  if (node->right && node->right->maxend > node->maxend)
+    node->maxend = node->right->maxend;
+} /* End of segnode_update() */
+
+/***************************************************************************
+ * segnode_insert:
+ *
+ * Insert a node into the subtree at root, rotating it up while its
+ * priority is higher than its parent's.
+ *
+ * Returns the new root of the subtree.
+ ***************************************************************************/
+static MSTraceSegNode *
+segnode_insert (MSTraceSegNode *root, MSTraceSegNode *node)
+{
+  MSTraceSegNode *child;
+
+  if (!root)
+  {
+    segnode_update (node);
+    return node;
+  }
+
+  if (segnode_cmp (node->starttime, node->endtime, node->seg,
+                   root->starttime, root->endtime, root->seg) < 0)
+  {
+    root->left = segnode_insert (root->left, node);
+
+    if (root->left->priority > root->priority)
+    {
+      child        = root->left;
+      root->left   = child->right;
+      child->right = root;
+      segnode_update (root);
+      root = child;
+    }
+  }
+  else
+  {
+    root->right = segnode_insert (root->right, node);
+
+    if (root->right->priority > root->priority)
+    {
+      child       = root->right;
+      root->right = child->left;
+      child->left = root;
+      segnode_update (root);
+      root = child;
+    }
+  }
+
+  segnode_update (root);
+
+  return root;
+} /* End of segnode_insert() */
+
+/***************************************************************************
+ * segnode_remove:
+ *
+ * Remove the node of a segment with the specified times from the
+ * subtree at root, the removed node is returned in node.
+ *
+ * Returns the new root of the subtree.
+ ***************************************************************************/
+static MSTraceSegNode *
+segnode_remove (MSTraceSegNode *root, MSTraceSeg *seg,
+                hptime_t starttime, hptime_t endtime, MSTraceSegNode **node)
+{
+  int cmp;
+
+  if (!root)
+    return NULL;
+
+  cmp = segnode_cmp (starttime, endtime, seg, root->starttime, root->endtime, root->seg);
+
+  if (cmp == 0)
+  {
+    *node = root;
+    return segnode_merge (root->left, root->right);
+  }
+
+  if (cmp < 0)
+    root->left = segnode_remove (root->left, seg, starttime, endtime, node);
+  else
+    root->right = segnode_remove (root->right, seg, starttime, endtime, node);
+
+  segnode_update (root);
+
+  return root;
+} /* End of segnode_remove() */
+
+/***************************************************************************
+ * segnode_merge:
+ *
+ * Merge two subtrees where all nodes of left are before those of right.
+ *
+ * Returns the root of the merged subtree.
+ ***************************************************************************/
+static MSTraceSegNode *
+segnode_merge (MSTraceSegNode *left, MSTraceSegNode *right)
+{
+  if (!left)
+    return right;
+
+  if (!right)
+    return left;
+
+  if (left->priority > right->priority)
+  {
+    left->right = segnode_merge (left->right, right);
+    segnode_update (left);
+    return left;
+  }
+
+  right->left = segnode_merge (left, right->left);
+  segnode_update (right);
+  return right;
+} /* End of segnode_merge() */
+
+/***************************************************************************
+ * segnode_before:
+ *
+ * Search a subtree in list order for the first segment with an end
+ * time between endlow and endhigh and a tolerable sample rate.
+ * Subtrees ending before endlow are skipped using the latest end time
+ * of each subtree and segments starting after endhigh cannot match.
+ *
+ * Returns the segment or NULL if not found.
+ ***************************************************************************/
+static MSTraceSeg *
+segnode_before (MSTraceSegNode *node, hptime_t endlow, hptime_t endhigh,
+                double samprate, double sampratetol)
+{
+  MSTraceSeg *seg;
+
+  if (!node || node->maxend < endlow)
+    return NULL;
+
+  if ((seg = segnode_before (node->left, endlow, endhigh, samprate, sampratetol)))
+    return seg;
+
+  if (node->starttime > endhigh)
+    return NULL;
+
+  if (node->endtime >= endlow && node->endtime <= endhigh &&
+      segrate_tolerable (node->seg, samprate, sampratetol))
+    return node->seg;
+
+  return segnode_before (node->right, endlow, endhigh, samprate, sampratetol);
+} /* End of segnode_before() */
+
+/***************************************************************************
+ * segnode_after:
+ *
+ * Search a subtree in list order for the first segment with a start
+ * time between startlow and starthigh and a tolerable sample rate.
+ *
+ * Returns the segment or NULL if not found.
+ ***************************************************************************/
+static MSTraceSeg *
+segnode_after (MSTraceSegNode *node, hptime_t startlow, hptime_t starthigh,
+               double samprate, double sampratetol)
+{
+  MSTraceSeg *seg;
+
+  while (node)
+  {
+    if (node->starttime < startlow)
+    {
+      node = node->right;
+      continue;
+    }
+
+    if ((seg = segnode_after (node->left, startlow, starthigh, samprate, sampratetol)))
+      return seg;
+
+    if (node->starttime > starthigh)
+      return NULL;
+
+    if (segrate_tolerable (node->seg, samprate, sampratetol))
+      return node->seg;
+
+    node = node->right;
+  }
+
+  return NULL;
+} /* End of segnode_after() */
+
+/***************************************************************************
+ * segrate_tolerable:
+ *
+ * Returns 1 if the sample rate of a segment is within the sample rate
+ * tolerance of the specified rate and 0 otherwise, a tolerance of -1.0
+ * uses the default tolerance as in mstl_addmsr().
+ ***************************************************************************/
+static int
+segrate_tolerable (MSTraceSeg *seg, double samprate, double sampratetol)
+{
+  if (sampratetol == -1.0)
+    return (MS_ISRATETOLERABLE (samprate, seg->samprate)) ? 1 : 0;
+
+  return (ms_dabs (samprate - seg->samprate) > sampratetol) ? 0 : 1;
+} /* End of segrate_tolerable() */
+
 /***************************************************************************
  * mstl_convertsamples:
  *
@@ -1093,6 +2003,7 @@ mstl_printsynclist (MSTraceList *mstl, char *dccid, flag subsecond)
   char endtime[30];
   char yearday[10];
   time_t now;
+  struct tm tms;
   struct tm *nt;
 
   if (!mstl)
@@ -1102,7 +2013,11 @@ mstl_printsynclist (MSTraceList *mstl, char *dccid, flag subsecond)
 
   /* Generate current time stamp */
   now = time (NULL);
-  nt  = localtime (&now);
+  if (!(nt = lmp_localtime_r (&now, &tms)))
+  {
+    ms_log (2, "Cannot convert current time\n");
+    return;
+  }
   nt->tm_year += 1900;
   nt->tm_yday += 1;
   snprintf (yearday, sizeof (yearday), "%04d,%03d", nt->tm_year, nt->tm_yday);
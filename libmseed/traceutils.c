@@ -5,7 +5,7 @@
  *
  * Written by Chad Trabant, IRIS Data Management Center
  *
- * modified: 2015.108
+ * modified: 2026.292
  ***************************************************************************/
 
 #include <stdio.h>
@@ -14,8 +14,16 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "lmthread.h"
 
 static int mst_groupsort_cmp (MSTrace *mst1, MSTrace *mst2, flag quality);
+static MSTrace *mst_findadjacent_id (MSTraceGroup *mstg, flag *whence, char dataquality,
+                                     int32_t streamid, char *network, char *station,
+                                     char *location, char *channel,
+                                     double samprate, double sampratetol,
+                                     hptime_t starttime, hptime_t endtime, double timetol);
+static int mst_matchcodes (MSTrace *mst, int32_t streamid, char *network,
+                           char *station, char *location, char *channel);
 
 /***************************************************************************
  * mst_init:
@@ -169,11 +177,13 @@ MSTrace *
 mst_findmatch (MSTrace *startmst, char dataquality,
                char *network, char *station, char *location, char *channel)
 {
-  int idx;
+  int32_t streamid;
 
   if (!startmst)
     return 0;
 
+  streamid = ms_findstreamid (network, station, location, channel);
+
   while (startmst)
   {
     if (dataquality && dataquality != startmst->dataquality)
@@ -182,54 +192,7 @@ mst_findmatch (MSTrace *startmst, char dataquality,
       continue;
     }
 
-    /* Compare network */
-    idx = 0;
-    while (network[idx] == startmst->network[idx])
-    {
-      if (network[idx] == '\0')
-        break;
-      idx++;
-    }
-    if (network[idx] != '\0' || startmst->network[idx] != '\0')
-    {
-      startmst = startmst->next;
-      continue;
-    }
-    /* Compare station */
-    idx = 0;
-    while (station[idx] == startmst->station[idx])
-    {
-      if (station[idx] == '\0')
-        break;
-      idx++;
-    }
-    if (station[idx] != '\0' || startmst->station[idx] != '\0')
-    {
-      startmst = startmst->next;
-      continue;
-    }
-    /* Compare location */
-    idx = 0;
-    while (location[idx] == startmst->location[idx])
-    {
-      if (location[idx] == '\0')
-        break;
-      idx++;
-    }
-    if (location[idx] != '\0' || startmst->location[idx] != '\0')
-    {
-      startmst = startmst->next;
-      continue;
-    }
-    /* Compare channel */
-    idx = 0;
-    while (channel[idx] == startmst->channel[idx])
-    {
-      if (channel[idx] == '\0')
-        break;
-      idx++;
-    }
-    if (channel[idx] != '\0' || startmst->channel[idx] != '\0')
+    if (!mst_matchcodes (startmst, streamid, network, station, location, channel))
     {
       startmst = startmst->next;
       continue;
@@ -270,6 +233,31 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
                   char *network, char *station, char *location, char *channel,
                   double samprate, double sampratetol,
                   hptime_t starttime, hptime_t endtime, double timetol)
+{
+  if (!mstg)
+    return 0;
+
+  return mst_findadjacent_id (mstg, whence, dataquality,
+                              ms_findstreamid (network, station, location, channel),
+                              network, station, location, channel,
+                              samprate, sampratetol, starttime, endtime, timetol);
+} /* End of mst_findadjacent() */
+
+/***************************************************************************
+ * mst_findadjacent_id:
+ *
+ * Find an adjacent MSTrace as mst_findadjacent() for codes with the
+ * specified stream ID, 0 if the codes have not been interned.
+ *
+ * Return a pointer a matching MSTrace and set the 'whence' flag
+ * otherwise 0 if no match found.
+ ***************************************************************************/
+static MSTrace *
+mst_findadjacent_id (MSTraceGroup *mstg, flag *whence, char dataquality,
+                     int32_t streamid, char *network, char *station,
+                     char *location, char *channel,
+                     double samprate, double sampratetol,
+                     hptime_t starttime, hptime_t endtime, double timetol)
 {
   MSTrace *mst = 0;
   hptime_t pregap;
@@ -277,10 +265,6 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
   hptime_t hpdelta;
   hptime_t hptimetol  = 0;
   hptime_t nhptimetol = 0;
-  int idx;
-
-  if (!mstg)
-    return 0;
 
   *whence = 0;
 
@@ -299,6 +283,14 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
 
   while (mst)
   {
+    /* Compare data qualities and codes */
+    if ((dataquality && dataquality != mst->dataquality) ||
+        !mst_matchcodes (mst, streamid, network, station, location, channel))
+    {
+      mst = mst->next;
+      continue;
+    }
+
     /* post/pregap are negative when the record overlaps the trace
        * segment and positive when there is a time gap. */
     postgap = starttime - mst->endtime - hpdelta;
@@ -353,72 +345,32 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
       }
     }
 
-    /* Compare data qualities */
-    if (dataquality && dataquality != mst->dataquality)
-    {
-      mst = mst->next;
-      continue;
-    }
-
-    /* Compare network */
-    idx = 0;
-    while (network[idx] == mst->network[idx])
-    {
-      if (network[idx] == '\0')
-        break;
-      idx++;
-    }
-    if (network[idx] != '\0' || mst->network[idx] != '\0')
-    {
-      mst = mst->next;
-      continue;
-    }
-    /* Compare station */
-    idx = 0;
-    while (station[idx] == mst->station[idx])
-    {
-      if (station[idx] == '\0')
-        break;
-      idx++;
-    }
-    if (station[idx] != '\0' || mst->station[idx] != '\0')
-    {
-      mst = mst->next;
-      continue;
-    }
-    /* Compare location */
-    idx = 0;
-    while (location[idx] == mst->location[idx])
-    {
-      if (location[idx] == '\0')
-        break;
-      idx++;
-    }
-    if (location[idx] != '\0' || mst->location[idx] != '\0')
-    {
-      mst = mst->next;
-      continue;
-    }
-    /* Compare channel */
-    idx = 0;
-    while (channel[idx] == mst->channel[idx])
-    {
-      if (channel[idx] == '\0')
-        break;
-      idx++;
-    }
-    if (channel[idx] != '\0' || mst->channel[idx] != '\0')
-    {
-      mst = mst->next;
-      continue;
-    }
-
     /* A match was found if we made it this far */
     break;
   }
 
   return mst;
-} /* End of mst_findadjacent() */
+} /* End of mst_findadjacent_id() */
+
+/***************************************************************************
+ * mst_matchcodes:
+ *
+ * Check if the codes of a MSTrace match the given name identifiers,
+ * comparing the interned stream IDs when both are set and otherwise
+ * comparing the codes directly.  The codes are never interned here.
+ *
+ * Return 1 if the codes match otherwise 0.
+ ***************************************************************************/
+static int
+mst_matchcodes (MSTrace *mst, int32_t streamid, char *network,
+                char *station, char *location, char *channel)
+{
+  if (streamid && mst->streamid)
+    return (mst->streamid == streamid);
+
+  return (!strcmp (network, mst->network) && !strcmp (station, mst->station) &&
+          !strcmp (location, mst->location) && !strcmp (channel, mst->channel));
+} /* End of mst_matchcodes() */
 
 /***************************************************************************
  * mst_addmsr:
@@ -658,11 +610,11 @@ mst_addmsrtogroup (MSTraceGroup *mstg, MSRecord *msr, flag dataquality,
     return 0;
   }
 
-  /* Find matching, time adjacent MSTrace */
-  mst = mst_findadjacent (mstg, &whence, dq,
-                          msr->network, msr->station, msr->location, msr->channel,
-                          msr->samprate, sampratetol,
-                          msr->starttime, endtime, timetol);
+  /* Find matching, time adjacent MSTrace by the stream ID of the record */
+  mst = mst_findadjacent_id (mstg, &whence, dq, msr_streamid (msr),
+                             msr->network, msr->station, msr->location, msr->channel,
+                             msr->samprate, sampratetol,
+                             msr->starttime, endtime, timetol);
 
   /* If a match was found update it otherwise create a new MSTrace and
      add to end of MSTrace chain */
@@ -687,6 +639,7 @@ mst_addmsrtogroup (MSTraceGroup *mstg, MSRecord *msr, flag dataquality,
     strncpy (mst->station, msr->station, sizeof (mst->station));
     strncpy (mst->location, msr->location, sizeof (mst->location));
     strncpy (mst->channel, msr->channel, sizeof (mst->channel));
+    mst->streamid = msr_streamid (msr);
 
     mst->starttime  = msr->starttime;
     mst->samprate   = msr->samprate;
@@ -811,10 +764,9 @@ mst_groupheal (MSTraceGroup *mstg, double timetol, double sampratetol)
       }
 
       /* Check if this trace matches the curtrace */
-      if (strcmp (searchtrace->network, curtrace->network) ||
-          strcmp (searchtrace->station, curtrace->station) ||
-          strcmp (searchtrace->location, curtrace->location) ||
-          strcmp (searchtrace->channel, curtrace->channel))
+      if (!mst_matchcodes (searchtrace, curtrace->streamid,
+                           curtrace->network, curtrace->station,
+                           curtrace->location, curtrace->channel))
       {
         prevtrace = searchtrace;
         continue;
@@ -1447,6 +1399,7 @@ mst_printsynclist (MSTraceGroup *mstg, char *dccid, flag subsecond)
   char etime[30];
   char yearday[10];
   time_t now;
+  struct tm tms;
   struct tm *nt;
 
   if (!mstg)
@@ -1456,7 +1409,11 @@ mst_printsynclist (MSTraceGroup *mstg, char *dccid, flag subsecond)
 
   /* Generate current time stamp */
   now = time (NULL);
-  nt  = localtime (&now);
+  if (!(nt = lmp_localtime_r (&now, &tms)))
+  {
+    ms_log (2, "Cannot convert current time\n");
+    return;
+  }
   nt->tm_year += 1900;
   nt->tm_yday += 1;
   snprintf (yearday, sizeof (yearday), "%04d,%03d", nt->tm_year, nt->tm_yday);
@@ -1753,13 +1710,7 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
                (char *)mst->datasamples + (trpackedsamples * samplesize),
                (size_t)bufsize);
 
-      mst->datasamples = realloc (mst->datasamples, (size_t)bufsize);
-
-      if (mst->datasamples == NULL)
-      {
-        ms_log (2, "mst_pack(): Cannot (re)allocate datasamples buffer\n");
-        return -1;
-      }
+      /* The buffer is kept at its size, the caller likely adds to it */
     }
     else
     {
@@ -22,10 +22,11 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "lmthread.h"
 #include "unpackdata.h"
 
 /* Function(s) internal to this file */
-static int check_environment (int verbose);
+static void check_environment (void *verbose);
 
 /* Header and data byte order flags controlled by environment variables */
 /* -2 = not checked, -1 = checked but not set, or 0 = LE and 1 = BE */
@@ -37,6 +38,10 @@ flag unpackdatabyteorder   = -2;
 int unpackencodingformat   = -2;
 int unpackencodingfallback = -2;
 
+/* Environment variables are read once, by the first call to unpack */
+static lmp_once_t unpackenvonce = LMP_ONCE_INIT;
+static int unpackenverror       = 0;
+
 /***************************************************************************
  * msr_unpack:
  *
@@ -120,13 +125,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   msr->record = record;
   msr->reclen = reclen;
 
-  /* Check environment variables if necessary */
-  if (unpackheaderbyteorder == -2 ||
-      unpackdatabyteorder == -2 ||
-      unpackencodingformat == -2 ||
-      unpackencodingfallback == -2)
-    if (check_environment (verbose))
-      return MS_GENERROR;
+  /* Check environment variables, once */
+  if (lmp_once (&unpackenvonce, check_environment, &verbose) || unpackenverror)
+    return MS_GENERROR;
 
   /* Allocate and copy fixed section of data header */
   msr->fsdh = realloc (msr->fsdh, sizeof (struct fsdh_s));
@@ -706,6 +707,131 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   return MS_NOERROR;
 } /* End of msr_unpack() */
 
+/***************************************************************************
+ * ms_recskipselect:
+ *
+ * Test if a record in a buffer can be skipped because it does not
+ * match a Selections list, using only the fixed section of the data
+ * header and Blockettes 100 and 1001 for the time range and Blockette
+ * 1000 for the record length.  Nothing is allocated and no data are
+ * decoded, the source name and time range tested are the same as
+ * msr_matchselect() would test after msr_unpack().
+ *
+ * If reclen is <= 0 the record length is detected as by msr_parse().
+ * Records that are not complete in the buffer, have an undetermined
+ * length or an unrecognized header are not skipped and should be
+ * parsed to handle them.
+ *
+ * Returns the record length if the record does not match and 0
+ * otherwise.
+ ***************************************************************************/
+int
+ms_recskipselect (char *record, int recbuflen, int reclen, Selections *selections)
+{
+  MSRecord msr;
+  struct fsdh_s fsdh;
+  struct blkt_100_s blkt_100;
+  struct blkt_1001_s blkt_1001;
+  flag headerswapflag = 0;
+  flag verbose        = 0;
+  uint16_t blkt_type;
+  uint16_t next_blkt;
+  uint32_t blkt_offset;
+  uint32_t blkt_length;
+
+  if (!record || !selections)
+    return 0;
+
+  if (reclen <= 0)
+    reclen = ms_detect (record, recbuflen);
+
+  if (reclen < MINRECLEN || reclen > MAXRECLEN || reclen > recbuflen ||
+      !MS_ISVALIDHEADER (record))
+    return 0;
+
+  /* Header byte order may be forced by environment variables */
+  if (lmp_once (&unpackenvonce, check_environment, &verbose) || unpackenverror)
+    return 0;
+
+  memcpy (&fsdh, record, sizeof (struct fsdh_s));
+
+  /* Check to see if byte swapping is needed by testing the year and day */
+  if (!MS_ISVALIDYEARDAY (fsdh.start_time.year, fsdh.start_time.day))
+    headerswapflag = 1;
+
+  if (unpackheaderbyteorder >= 0)
+    headerswapflag = (ms_bigendianhost () != unpackheaderbyteorder) ? 1 : 0;
+
+  if (headerswapflag)
+  {
+    MS_SWAPBTIME (&fsdh.start_time);
+    ms_gswap2a (&fsdh.numsamples);
+    ms_gswap2a (&fsdh.samprate_fact);
+    ms_gswap2a (&fsdh.samprate_mult);
+    ms_gswap4a (&fsdh.time_correct);
+    ms_gswap2a (&fsdh.blockette_offset);
+  }
+
+  /* Populate the header fields used for matching as msr_unpack() does */
+  memset (&msr, 0, sizeof (MSRecord));
+  msr.fsdh        = &fsdh;
+  msr.dataquality = fsdh.dataquality;
+  ms_strncpcleantail (msr.network, fsdh.network, 2);
+  ms_strncpcleantail (msr.station, fsdh.station, 5);
+  ms_strncpcleantail (msr.location, fsdh.location, 2);
+  ms_strncpcleantail (msr.channel, fsdh.channel, 3);
+  msr.samplecnt = fsdh.numsamples;
+
+  /* Traverse the blockettes as msr_unpack() does, the last Blockette 100 and 1001 are used */
+  blkt_offset = fsdh.blockette_offset;
+
+  while ((blkt_offset != 0) &&
+         ((int)blkt_offset < reclen) &&
+         (blkt_offset < MAXRECLEN))
+  {
+    memcpy (&blkt_type, record + blkt_offset, 2);
+    memcpy (&next_blkt, record + blkt_offset + 2, 2);
+
+    if (headerswapflag)
+    {
+      ms_gswap2 (&blkt_type);
+      ms_gswap2 (&next_blkt);
+    }
+
+    blkt_length = ms_blktlen (blkt_type, record + blkt_offset, headerswapflag);
+
+    if (blkt_length == 0 || (int)(blkt_offset + blkt_length) > reclen)
+      break;
+
+    if (blkt_type == 100)
+    {
+      memcpy (&blkt_100, record + blkt_offset + 4, sizeof (struct blkt_100_s));
+
+      if (headerswapflag)
+        ms_gswap4 (&blkt_100.samprate);
+
+      msr.Blkt100 = &blkt_100;
+    }
+    else if (blkt_type == 1001)
+    {
+      memcpy (&blkt_1001, record + blkt_offset + 4, sizeof (struct blkt_1001_s));
+
+      msr.Blkt1001 = &blkt_1001;
+    }
+
+    /* The next blockette must follow the current and be within the record */
+    if (next_blkt && (next_blkt < (blkt_offset + blkt_length) || next_blkt > reclen))
+      break;
+
+    blkt_offset = next_blkt;
+  }
+
+  msr.starttime = msr_starttime (&msr);
+  msr.samprate  = msr_samprate (&msr);
+
+  return (msr_matchselect (selections, &msr, NULL)) ? 0 : reclen;
+} /* End of ms_recskipselect() */
+
 /************************************************************************
  *  msr_unpack_data:
  *
@@ -730,9 +856,9 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
   if (!msr)
     return MS_GENERROR;
 
-  /* Check for decode debugging environment variable */
-  if (getenv ("DECODE_DEBUG"))
-    decodedebug = 1;
+  /* Check environment variables, once */
+  if (lmp_once (&unpackenvonce, check_environment, &verbose) || unpackenverror)
+    return MS_GENERROR;
 
   /* Generate source name for MSRecord */
   if (msr_srcname (msr, srcname, 1) == NULL)
@@ -966,12 +1092,13 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 /************************************************************************
  *  check_environment:
  *
- *  Check environment variables and set global variables appropriately.
- *
- *  Return 0 on success and -1 on error.
+ *  Check environment variables and set global variables appropriately,
+ *  setting unpackenverror if a variable is set to an invalid value.
+ *  Called once through lmp_once() with a pointer to the verbose flag
+ *  of the caller.
  ************************************************************************/
-static int
-check_environment (int verbose)
+static void
+check_environment (void *verbose)
 {
   char *envvariable;
 
@@ -983,18 +1110,19 @@ check_environment (int verbose)
       if (*envvariable != '0' && *envvariable != '1')
       {
         ms_log (2, "Environment variable UNPACK_HEADER_BYTEORDER must be set to '0' or '1'\n");
-        return -1;
+        unpackenverror = 1;
+        return;
       }
       else if (*envvariable == '0')
       {
         unpackheaderbyteorder = 0;
-        if (verbose > 2)
+        if (*((flag *)verbose) > 2)
           ms_log (1, "UNPACK_HEADER_BYTEORDER=0, unpacking little-endian header\n");
       }
       else
       {
         unpackheaderbyteorder = 1;
-        if (verbose > 2)
+        if (*((flag *)verbose) > 2)
           ms_log (1, "UNPACK_HEADER_BYTEORDER=1, unpacking big-endian header\n");
       }
     }
@@ -1011,18 +1139,19 @@ check_environment (int verbose)
       if (*envvariable != '0' && *envvariable != '1')
       {
         ms_log (2, "Environment variable UNPACK_DATA_BYTEORDER must be set to '0' or '1'\n");
-        return -1;
+        unpackenverror = 1;
+        return;
       }
       else if (*envvariable == '0')
       {
         unpackdatabyteorder = 0;
-        if (verbose > 2)
+        if (*((flag *)verbose) > 2)
           ms_log (1, "UNPACK_DATA_BYTEORDER=0, unpacking little-endian data samples\n");
       }
       else
       {
         unpackdatabyteorder = 1;
-        if (verbose > 2)
+        if (*((flag *)verbose) > 2)
           ms_log (1, "UNPACK_DATA_BYTEORDER=1, unpacking big-endian data samples\n");
       }
     }
@@ -1042,9 +1171,10 @@ check_environment (int verbose)
       if (unpackencodingformat < 0 || unpackencodingformat > 33)
       {
         ms_log (2, "Environment variable UNPACK_DATA_FORMAT set to invalid value: '%d'\n", unpackencodingformat);
-        return -1;
+        unpackenverror = 1;
+        return;
       }
-      else if (verbose > 2)
+      else if (*((flag *)verbose) > 2)
         ms_log (1, "UNPACK_DATA_FORMAT, unpacking data in encoding format %d\n", unpackencodingformat);
     }
     else
@@ -1064,9 +1194,10 @@ check_environment (int verbose)
       {
         ms_log (2, "Environment variable UNPACK_DATA_FORMAT_FALLBACK set to invalid value: '%d'\n",
                 unpackencodingfallback);
-        return -1;
+        unpackenverror = 1;
+        return;
       }
-      else if (verbose > 2)
+      else if (*((flag *)verbose) > 2)
         ms_log (1, "UNPACK_DATA_FORMAT_FALLBACK, fallback data unpacking encoding format %d\n",
                 unpackencodingfallback);
     }
@@ -1076,5 +1207,7 @@ check_environment (int verbose)
     }
   }
 
-  return 0;
+  /* Check for decode debugging environment variable */
+  if (getenv ("DECODE_DEBUG"))
+    decodedebug = 1;
 } /* End of check_environment() */
@@ -19,12 +19,21 @@ INCS = -I..\libmseed
 
 all: $(BIN)
 
-$(BIN):	mars2mseed.obj marsio.obj
-	wlink $(lflags) name $(BIN) file {mars2mseed.obj marsio.obj}
+$(BIN):	mars2mseed.obj marsio.obj parpack.obj bufstore.obj watchdir.obj archive.obj dedup.obj reorder.obj manifest.obj verify.obj hash.obj
+	wlink $(lflags) name $(BIN) file {mars2mseed.obj marsio.obj parpack.obj bufstore.obj watchdir.obj archive.obj dedup.obj reorder.obj manifest.obj verify.obj hash.obj}
 
 # Source dependencies:
 mars2mseed.obj:	mars2mseed.c marsio.h
 marsio.obj:	marsio.c marsio.h
+parpack.obj:	parpack.c parpack.h
+bufstore.obj:	bufstore.c bufstore.h
+watchdir.obj:	watchdir.c watchdir.h
+archive.obj:	archive.c archive.h hash.h
+dedup.obj:	dedup.c dedup.h hash.h
+reorder.obj:	reorder.c reorder.h
+manifest.obj:	manifest.c manifest.h hash.h
+verify.obj:	verify.c verify.h
+hash.obj:	hash.c hash.h
 
 # How to compile sources:
 .c.obj:
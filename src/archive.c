@@ -0,0 +1,600 @@
+/***************************************************************************
+ * archive.c
+ *
+ * Write Mini-SEED records to an SDS (SeisComP Data Structure) archive:
+ *
+ *   BASEDIR/YEAR/NET/STA/CHAN.D/NET.STA.LOC.CHAN.D.YEAR.DAY
+ *
+ * Each record is appended to the file of the channel and day of its
+ * start time, directories are created as needed.  Records are expected
+ * not to span day boundaries, callers should split traces at midnight.
+ *
+ * Open files are kept in a cache, looked up through a hash table of
+ * their paths and closed in least recently used order when the number
+ * of open files reaches the limit.  Files positioned at a resumed
+ * record are not closed before they are written to.
+ *
+ * In append mode the last record of an existing day file can be taken
+ * back into a trace that continues it, see archive_resume(), and the
+ * sequence numbers of the records written to a file continue from the
+ * last record kept in the file.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libmseed.h>
+
+#include "archive.h"
+#include "hash.h"
+#include "verify.h"
+
+#if defined(LMP_WIN)
+  #include <direct.h>
+  #define mkdir(P,M) _mkdir(P)
+  #if !defined(S_ISDIR)
+    #define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
+  #endif
+#endif
+
+/* Number of hash table buckets for open files */
+#define ARCHIVE_HASHSIZE 1024
+
+/* Open archive file */
+struct archfile {
+  char     *path;
+  FILE     *fp;
+  uint32_t  hash;
+  int       seqnum;            /* Sequence number of the last record */
+  flag      pinned;            /* Positioned at a resumed record, not yet written */
+  struct archfile *hnext;      /* Next in hash bucket */
+  struct archfile *prev;       /* More recently used */
+  struct archfile *next;       /* Less recently used */
+};
+
+static char *archbase = 0;
+static int   archmaxopen = 0;
+static int   archopen = 0;
+static int   archreclen = 4096;
+static flag  archappend = 0;
+static flag  archverify = 0;
+static flag  archverbose = 0;
+static MSRecord *archmsr = 0;
+static struct archfile *archhash[ARCHIVE_HASHSIZE];
+static struct archfile *archmru = 0;
+static struct archfile *archlru = 0;
+
+static void archpath (char *path, size_t size, const char *net, const char *sta,
+		      const char *loc, const char *chan, hptime_t time);
+static int readrecord (FILE *fp, off_t offset, char *record);
+static FILE *getfile (const char *path, off_t offset);
+static void closefile (struct archfile *af);
+static int makedirs (char *path);
+
+
+/***************************************************************************
+ * archive_init:
+ *
+ * Initialize writing to the SDS archive at basedir, keeping at most
+ * maxopen files open.  The record length is used to find the last
+ * record of existing files when appending, -1 means the default of
+ * 4096 bytes.  If verify is true the samples of resumed records are
+ * kept for verification as they are written again.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+archive_init (const char *basedir, int maxopen, int reclen, flag append,
+	      flag verify, flag verbose)
+{
+  if ( ! basedir || maxopen < 1 )
+    return -1;
+
+  if ( ! (archbase = strdup (basedir)) )
+    {
+      ms_log (2, "Cannot allocate memory for archive path\n");
+      return -1;
+    }
+
+  /* Remove trailing path separators */
+  while ( strlen (archbase) > 1 && archbase[strlen(archbase)-1] == '/' )
+    archbase[strlen(archbase)-1] = '\0';
+
+  archmaxopen = maxopen;
+  archreclen = ( reclen > 0 ) ? reclen : 4096;
+  archappend = append;
+  archverify = verify;
+  archverbose = verbose;
+  memset (archhash, 0, sizeof(archhash));
+
+  return 0;
+}  /* End of archive_init() */
+
+
+/***************************************************************************
+ * archive_write:
+ *
+ * Append a record to the archive file of its channel and day.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+archive_write (char *record, int reclen)
+{
+  struct archfile *af;
+  char path[1024];
+  char net[11], sta[11], loc[11], chan[11];
+  char seqnum[7];
+  FILE *fp;
+
+  if ( ! archbase )
+    return -1;
+
+  if ( msr_unpack (record, reclen, &archmsr, 0, 0) != MS_NOERROR )
+    {
+      ms_log (2, "Cannot parse record header for archive\n");
+      return -1;
+    }
+
+  ms_strncpclean (net, archmsr->network, 2);
+  ms_strncpclean (sta, archmsr->station, 5);
+  ms_strncpclean (loc, archmsr->location, 2);
+  ms_strncpclean (chan, archmsr->channel, 3);
+
+  archpath (path, sizeof(path), net, sta, loc, chan, archmsr->starttime);
+
+  if ( ! (fp = getfile (path, -1)) )
+    return -1;
+
+  /* Continue the sequence numbers of the file, getfile() made it the first */
+  if ( archappend )
+    {
+      af = archmru;
+      af->seqnum = ( af->seqnum < 0 || af->seqnum >= 999999 ) ? 1 : af->seqnum + 1;
+      
+      if ( snprintf (seqnum, sizeof(seqnum), "%06d", af->seqnum) != 6 )
+	{
+	  ms_log (2, "Cannot format sequence number %d for %s\n", af->seqnum, path);
+	  return -1;
+	}
+      
+      memcpy (record, seqnum, 6);
+    }
+
+  if ( fwrite (record, reclen, 1, fp) != 1 )
+    {
+      ms_log (2, "Cannot write to archive file %s: %s\n", path, strerror(errno));
+      return -1;
+    }
+
+  /* The resumed record is replaced, the file may be closed again */
+  archmru->pinned = 0;
+
+  return 0;
+}  /* End of archive_write() */
+
+
+/***************************************************************************
+ * archive_resume:
+ *
+ * Take the last record of the archive day file that a trace continues
+ * back into the trace, so that it is packed again together with the
+ * new samples instead of leaving a partially filled record behind.
+ * The record must be of the same channel, sample rate, record length,
+ * encoding and byte order as packed and the trace must start at the
+ * expected next sample time.  The samples of the record are prepended
+ * to the trace and the file is reopened positioned at the record, the
+ * first record written for the trace then replaces it.  The file is
+ * kept open until then, the record is kept in the file until it is
+ * overwritten, so it is not lost if nothing is written.  If the record
+ * before it in the file also belongs to the channel its last sample is
+ * used as the compression history.
+ *
+ * The stream state of the trace is allocated if needed, a trace with
+ * a stream state is not resumed again.
+ *
+ * Returns 1 if a record was taken back, 0 if not and -1 on error.
+ ***************************************************************************/
+int
+archive_resume (MSTrace *mst, flag encoding, flag byteorder)
+{
+  MSRecord *msr = 0;
+  struct archfile *af;
+  char path[1024];
+  char *record = 0;
+  FILE *fp = 0;
+  off_t size;
+  hptime_t period;
+  hptime_t expected;
+  int32_t lastsample = 0;
+  flag history = 0;
+  int retval = 0;
+
+  if ( ! archbase || ! mst || mst->ststate )
+    return 0;
+
+  if ( ! (mst->ststate = (StreamState *) calloc (1, sizeof(StreamState))) )
+    {
+      ms_log (2, "Cannot allocate memory for stream state\n");
+      return -1;
+    }
+
+  if ( mst->sampletype != 'i' || mst->samprate <= 0.0 || mst->numsamples <= 0 )
+    return 0;
+
+  if ( encoding < 0 )
+    encoding = DE_STEIM2;
+  if ( byteorder < 0 )
+    byteorder = 1;
+
+  archpath (path, sizeof(path), mst->network, mst->station, mst->location,
+	    mst->channel, mst->starttime);
+
+  /* Close a cached handle so all records are in the file, a handle that
+   * is still positioned at a resumed record must write there first */
+  for ( af = archmru; af; af = af->next )
+    if ( ! strcmp (af->path, path) )
+      {
+	if ( af->pinned )
+	  return 0;
+
+	closefile (af);
+	break;
+      }
+
+  if ( ! (fp = fopen (path, "r+b")) )
+    return 0;
+
+  if ( ! (record = (char *) malloc (archreclen)) )
+    {
+      ms_log (2, "Cannot allocate memory for archive record\n");
+      fclose (fp);
+      return -1;
+    }
+
+  if ( lmp_fseeko (fp, 0, SEEK_END) || (size = lmp_ftello (fp)) < archreclen ||
+       ! readrecord (fp, size - archreclen, record) ||
+       msr_unpack (record, archreclen, &msr, 1, 0) != MS_NOERROR )
+    goto cleanup;
+
+  period = (hptime_t) (HPTMODULUS / mst->samprate + 0.5);
+  expected = msr_endtime (msr) + period;
+
+  if ( strcmp (msr->network, mst->network) || strcmp (msr->station, mst->station) ||
+       strcmp (msr->location, mst->location) || strcmp (msr->channel, mst->channel) ||
+       msr->sampletype != 'i' || msr->encoding != encoding ||
+       msr->byteorder != byteorder || msr->numsamples <= 0 ||
+       ! MS_ISRATETOLERABLE (msr_samprate (msr), mst->samprate) ||
+       ms_dabs ((double) (mst->starttime - expected)) > period / 2 )
+    goto cleanup;
+
+  if ( mst_addspan (mst, msr->starttime, mst->endtime, msr->datasamples,
+		    msr->numsamples, 'i', 2) )
+    {
+      retval = -1;
+      goto cleanup;
+    }
+
+  /* The resumed samples are written again, verify them like input blocks */
+  if ( archverify &&
+       verify_block (msr, (int32_t *) msr->datasamples, path, (int64_t) (size - archreclen)) )
+    ms_log (1, "Warning: cannot keep samples of %s for verification\n", path);
+
+  expected = msr->starttime;
+
+  /* Use the last sample of a preceding record of the channel as history */
+  if ( size >= 2 * archreclen && readrecord (fp, size - 2 * archreclen, record) &&
+       msr_unpack (record, archreclen, &msr, 1, 0) == MS_NOERROR &&
+       msr->sampletype == 'i' && msr->numsamples > 0 &&
+       ! strcmp (msr->network, mst->network) && ! strcmp (msr->station, mst->station) &&
+       ! strcmp (msr->location, mst->location) && ! strcmp (msr->channel, mst->channel) &&
+       ms_dabs ((double) (msr_endtime (msr) + period - expected)) <= period / 2 )
+    {
+      lastsample = ((int32_t *) msr->datasamples)[msr->numsamples - 1];
+      history = 1;
+    }
+
+  mst->ststate->lastintsample = lastsample;
+  mst->ststate->comphistory = history;
+
+  if ( archverbose >= 2 )
+    ms_log (1, "Resuming last record of %s\n", path);
+
+  retval = 1;
+
+ cleanup:
+  if ( msr )
+    msr_free (&msr);
+  if ( record )
+    free (record);
+  if ( fp )
+    fclose (fp);
+
+  /* Write the following records over the resumed record */
+  if ( retval == 1 && ! getfile (path, size - archreclen) )
+    retval = -1;
+
+  return retval;
+}  /* End of archive_resume() */
+
+
+/***************************************************************************
+ * archive_flush:
+ *
+ * Flush all open archive files.
+ ***************************************************************************/
+void
+archive_flush (void)
+{
+  struct archfile *af;
+
+  for ( af = archmru; af; af = af->next )
+    fflush (af->fp);
+}  /* End of archive_flush() */
+
+
+/***************************************************************************
+ * archive_close:
+ *
+ * Close all open archive files and release resources.
+ ***************************************************************************/
+void
+archive_close (void)
+{
+  while ( archlru )
+    closefile (archlru);
+
+  if ( archmsr )
+    msr_free (&archmsr);
+
+  if ( archbase )
+    free (archbase);
+  archbase = 0;
+}  /* End of archive_close() */
+
+
+/***************************************************************************
+ * archpath:
+ *
+ * Build the path of the archive day file for a channel and time.
+ ***************************************************************************/
+static void
+archpath (char *path, size_t size, const char *net, const char *sta,
+	  const char *loc, const char *chan, hptime_t time)
+{
+  BTime btime;
+
+  ms_hptime2btime (time, &btime);
+
+  snprintf (path, size, "%s/%04d/%s/%s/%s.D/%s.%s.%s.%s.D.%04d.%03d",
+	    archbase, btime.year, net, sta, chan,
+	    net, sta, loc, chan, btime.year, btime.day);
+}  /* End of archpath() */
+
+
+/***************************************************************************
+ * readrecord:
+ *
+ * Read a record of the archive record length at offset.
+ *
+ * Returns 1 if a record was read and 0 otherwise.
+ ***************************************************************************/
+static int
+readrecord (FILE *fp, off_t offset, char *record)
+{
+  if ( lmp_fseeko (fp, offset, SEEK_SET) ||
+       fread (record, archreclen, 1, fp) != 1 )
+    return 0;
+
+  return ( ms_detect (record, archreclen) == archreclen ) ? 1 : 0;
+}  /* End of readrecord() */
+
+
+/***************************************************************************
+ * getfile:
+ *
+ * Find an open archive file or open it for appending, creating the
+ * directories as needed.  If offset is not negative an existing file
+ * is opened for writing at that offset instead, the file must not be
+ * open, and it is pinned until written to.  The file becomes the most
+ * recently used and the least recently used file that is not pinned is
+ * closed if the limit is reached.  If all open files are pinned the
+ * limit is exceeded until they are written to.
+ *
+ * Returns the stream on success and NULL on failure.
+ ***************************************************************************/
+static FILE *
+getfile (const char *path, off_t offset)
+{
+  struct archfile *af;
+  struct archfile *lru;
+  uint32_t hash = fnv32_string (FNV32_INIT, path);
+  char dirpath[1024];
+  char *sep;
+
+  for ( af = archhash[hash % ARCHIVE_HASHSIZE]; af; af = af->hnext )
+    if ( af->hash == hash && ! strcmp (af->path, path) )
+      break;
+
+  if ( af )
+    {
+      /* Move to the front of the use list */
+      if ( af != archmru )
+	{
+	  af->prev->next = af->next;
+	  if ( af->next )
+	    af->next->prev = af->prev;
+	  else
+	    archlru = af->prev;
+
+	  af->prev = 0;
+	  af->next = archmru;
+	  archmru->prev = af;
+	  archmru = af;
+	}
+
+      return af->fp;
+    }
+
+  if ( archopen >= archmaxopen )
+    {
+      for ( lru = archlru; lru && lru->pinned; lru = lru->prev );
+
+      closefile (lru);
+    }
+
+  if ( ! (af = (struct archfile *) calloc (1, sizeof(struct archfile))) ||
+       ! (af->path = strdup (path)) )
+    {
+      ms_log (2, "Cannot allocate memory for archive file\n");
+      free (af);
+      return NULL;
+    }
+
+  /* Open the file at the offset or for appending, creating the directories */
+  if ( offset >= 0 )
+    {
+      if ( (af->fp = fopen (path, "r+b")) && lmp_fseeko (af->fp, offset, SEEK_SET) )
+	{
+	  fclose (af->fp);
+	  af->fp = 0;
+	}
+    }
+  else if ( ! (af->fp = fopen (path, "ab")) )
+    {
+      strncpy (dirpath, path, sizeof(dirpath) - 1);
+      dirpath[sizeof(dirpath) - 1] = '\0';
+
+      if ( (sep = strrchr (dirpath, '/')) )
+	*sep = '\0';
+
+      if ( makedirs (dirpath) == 0 )
+	af->fp = fopen (path, "ab");
+    }
+
+  if ( ! af->fp )
+    {
+      ms_log (2, "Cannot open archive file %s: %s\n", path, strerror(errno));
+      free (af->path);
+      free (af);
+      return NULL;
+    }
+
+  /* Find the sequence number of the last record to continue from */
+  if ( archappend && (offset >= 0 || lmp_fseeko (af->fp, 0, SEEK_END) == 0) )
+    {
+      FILE *rfp;
+      char *record;
+      off_t size = ( offset >= 0 ) ? offset : lmp_ftello (af->fp);
+
+      if ( size >= archreclen && (rfp = fopen (path, "rb")) )
+	{
+	  if ( (record = (char *) malloc (archreclen)) )
+	    {
+	      if ( readrecord (rfp, size - archreclen, record) )
+		af->seqnum = (int) strtol (record, NULL, 10) % 1000000;
+	      free (record);
+	    }
+	  fclose (rfp);
+	}
+    }
+
+  if ( archverbose >= 2 )
+    ms_log (1, "Opened archive file %s\n", path);
+
+  af->hash = hash;
+  af->pinned = ( offset >= 0 ) ? 1 : 0;
+  af->hnext = archhash[hash % ARCHIVE_HASHSIZE];
+  archhash[hash % ARCHIVE_HASHSIZE] = af;
+
+  af->next = archmru;
+  if ( archmru )
+    archmru->prev = af;
+  archmru = af;
+  if ( ! archlru )
+    archlru = af;
+
+  archopen++;
+
+  return af->fp;
+}  /* End of getfile() */
+
+
+/***************************************************************************
+ * closefile:
+ *
+ * Close an archive file and remove it from the cache.
+ ***************************************************************************/
+static void
+closefile (struct archfile *af)
+{
+  struct archfile **paf;
+
+  if ( ! af )
+    return;
+
+  for ( paf = &archhash[af->hash % ARCHIVE_HASHSIZE]; *paf; paf = &(*paf)->hnext )
+    if ( *paf == af )
+      {
+	*paf = af->hnext;
+	break;
+      }
+
+  if ( af->prev )
+    af->prev->next = af->next;
+  else
+    archmru = af->next;
+
+  if ( af->next )
+    af->next->prev = af->prev;
+  else
+    archlru = af->prev;
+
+  if ( fclose (af->fp) )
+    ms_log (2, "Cannot close archive file %s: %s\n", af->path, strerror(errno));
+  else if ( archverbose >= 2 )
+    ms_log (1, "Closed archive file %s\n", af->path);
+
+  free (af->path);
+  free (af);
+  archopen--;
+}  /* End of closefile() */
+
+
+/***************************************************************************
+ * makedirs:
+ *
+ * Create a directory and any missing parent directories.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+makedirs (char *path)
+{
+  struct stat st;
+  char *sep;
+
+  if ( stat (path, &st) == 0 )
+    return ( S_ISDIR(st.st_mode) ) ? 0 : -1;
+
+  /* Create each parent directory in turn */
+  for ( sep = strchr (path + 1, '/'); sep; sep = strchr (sep + 1, '/') )
+    {
+      *sep = '\0';
+      if ( mkdir (path, 0777) && errno != EEXIST )
+	{
+	  *sep = '/';
+	  return -1;
+	}
+      *sep = '/';
+    }
+
+  if ( mkdir (path, 0777) && errno != EEXIST )
+    return -1;
+
+  return 0;
+}  /* End of makedirs() */
@@ -0,0 +1,27 @@
+/***************************************************************************
+ * archive.h
+ *
+ * Interface declarations for writing records to an SDS archive.
+ ***************************************************************************/
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  archive_init (const char *basedir, int maxopen, int reclen,
+			  flag append, flag verify, flag verbose);
+extern int  archive_write (char *record, int reclen);
+extern int  archive_resume (MSTrace *mst, flag encoding, flag byteorder);
+extern void archive_flush (void);
+extern void archive_close (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,758 @@
+/***************************************************************************
+ * bufstore.c
+ *
+ * Memory-bounded and compressed buffering of the traces in a MSTraceGroup.
+ *
+ * Records are added to the group as with mst_addmsrtogroup() while the
+ * size of the buffered samples is tracked.  When the buffered samples
+ * exceed the limit the samples of the largest traces are spilled to a
+ * temporary file in a compact form: differences between successive
+ * samples stored as zigzag variable length integers.  Samples
+ * prepended to a trace since it was last spilled are kept apart from
+ * those appended, so the spilled pieces of a trace are always in time
+ * order.
+ *
+ * At packing time the pieces of a trace are read back in order and
+ * streamed through mst_pack() with a per-trace template, carrying the
+ * sequence numbers and compression history from piece to piece.  MARS
+ * sample periods are whole milliseconds so the record start times are
+ * the same as when packing the complete trace, the output is identical
+ * to buffering all data in memory.
+ *
+ * Optionally the buffered samples are also kept compressed in memory:
+ * once a trace buffer holds a full piece its samples are encoded into
+ * pieces held in memory, in the same form as spilled pieces.  With a
+ * limit, these pieces are moved to the temporary file when their trace
+ * is spilled.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libmseed.h>
+
+#include "bufstore.h"
+
+/* Maximum number of samples in a stored piece */
+#define BUFSTORE_PIECESAMPLES 65536
+
+/* Maximum length of an encoded sample difference */
+#define BUFSTORE_MAXCODELEN 5
+
+/* Stored piece of a trace */
+struct bufpiece {
+  uint8_t *data;         /* Encoded samples if held in memory, otherwise spilled */
+  off_t    offset;       /* Offset of the encoded samples in the spill file */
+  size_t   length;       /* Length of the encoded samples in bytes */
+  int64_t  numsamples;   /* Count of samples in the piece */
+  struct bufpiece *next;
+};
+
+/* Buffering state of a trace, attached to MSTrace.prvtptr */
+struct buftrace {
+  struct bufpiece *first;  /* Stored pieces in time order */
+  struct bufpiece *last;
+  int64_t  prepended;    /* Count of samples prepended to the buffer since last stored */
+  int64_t  membytes;     /* Bytes of encoded pieces held in memory */
+};
+
+static int64_t  maxbytes       = 0;
+static int64_t  bufferbytes    = 0;
+static int64_t  storedsamples  = 0;
+static flag     storecompress  = 0;
+static flag     storeverbose   = 0;
+static FILE    *spillfp        = NULL;
+static off_t    spilloffset    = 0;
+
+static uint8_t  codebuf[BUFSTORE_PIECESAMPLES * BUFSTORE_MAXCODELEN];
+static int32_t  samplebuf[BUFSTORE_PIECESAMPLES];
+
+static int storetrace (MSTrace *mst, flag spill);
+static struct bufpiece *storepiece (int32_t *samples, int64_t count, flag spill);
+static int spillpieces (struct buftrace *bt);
+static int64_t packstored (MSTrace *mst, void (*record_handler) (char *, int, void *),
+			    void *handlerdata, int reclen, flag encoding, flag byteorder,
+			    int64_t *packedsamples, flag verbose);
+static int feedsamples (MSTrace *mst, int32_t *samples, int64_t count, MSRecord *mstemplate,
+			void (*record_handler) (char *, int, void *), void *handlerdata,
+			int reclen, flag encoding, flag byteorder,
+			int64_t *records, int64_t *packedsamples, flag verbose);
+static void freepieces (struct buftrace *bt);
+static size_t encode_samples (int32_t *samples, int64_t count, uint8_t *code);
+static int decode_samples (uint8_t *code, size_t length, int32_t *samples, int64_t count);
+
+
+/***************************************************************************
+ * bufstore_init:
+ *
+ * Set the limit in bytes for buffered data samples, 0 means no limit,
+ * and if buffered samples are compressed in memory.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+bufstore_init (int64_t limit, flag compress, flag verbose)
+{
+  if ( limit < 0 )
+    return -1;
+
+  maxbytes = limit;
+  storecompress = compress;
+  storeverbose = verbose;
+
+  return 0;
+}  /* End of bufstore_init() */
+
+
+/***************************************************************************
+ * bufstore_addmsr:
+ *
+ * Add the samples of a MSRecord to a MSTraceGroup the same as
+ * mst_addmsrtogroup(), compress the trace buffer if it holds a full
+ * piece and compression is enabled, and spill the largest traces to
+ * the temporary file until the buffered data is below half of the
+ * limit if the limit is exceeded.
+ *
+ * Returns a pointer to the MSTrace updated or 0 on error.
+ ***************************************************************************/
+MSTrace *
+bufstore_addmsr (MSTraceGroup *mstg, MSRecord *msr)
+{
+  MSTrace *mst;
+  MSTrace *adjacent = NULL;
+  MSTrace *largest;
+  struct buftrace *bt;
+  hptime_t endtime;
+  int64_t before = 0;
+  int64_t tracebytes;
+  int64_t largestbytes;
+  flag whence = 0;
+
+  if ( ! mstg || ! msr )
+    return NULL;
+
+  /* Determine where the samples will be added */
+  if ( (endtime = msr_endtime (msr)) != HPTERROR )
+    adjacent = mst_findadjacent (mstg, &whence, 0, msr->network, msr->station,
+				 msr->location, msr->channel, msr->samprate, -1.0,
+				 msr->starttime, endtime, -1.0);
+
+  if ( adjacent )
+    before = adjacent->numsamples;
+
+  if ( ! (mst = mst_addmsrtogroup (mstg, msr, 0, -1.0, -1.0)) )
+    return NULL;
+
+  if ( mst != adjacent )
+    before = 0;
+
+  if ( ! mst->prvtptr )
+    {
+      if ( ! (mst->prvtptr = calloc (1, sizeof(struct buftrace))) )
+	{
+	  ms_log (2, "bufstore_addmsr(): Cannot allocate memory\n");
+	  return NULL;
+	}
+    }
+
+  bt = (struct buftrace *) mst->prvtptr;
+
+  if ( mst == adjacent && whence == 2 )
+    bt->prepended += mst->numsamples - before;
+
+  bufferbytes += (mst->numsamples - before) * ms_samplesize (mst->sampletype);
+
+  if ( storecompress && mst->sampletype == 'i' && mst->numsamples >= BUFSTORE_PIECESAMPLES )
+    if ( storetrace (mst, 0) )
+      return NULL;
+
+  if ( maxbytes <= 0 || bufferbytes <= maxbytes )
+    return mst;
+
+  while ( bufferbytes > maxbytes / 2 )
+    {
+      largest = NULL;
+      largestbytes = 0;
+      for ( adjacent = mstg->traces; adjacent; adjacent = adjacent->next )
+	{
+	  if ( adjacent->sampletype != 'i' || ! adjacent->prvtptr )
+	    continue;
+
+	  tracebytes = adjacent->numsamples * ms_samplesize (adjacent->sampletype) +
+	    ((struct buftrace *) adjacent->prvtptr)->membytes;
+
+	  if ( tracebytes > largestbytes )
+	    {
+	      largest = adjacent;
+	      largestbytes = tracebytes;
+	    }
+	}
+
+      if ( ! largest )
+	break;
+
+      if ( storetrace (largest, 1) || spillpieces ((struct buftrace *) largest->prvtptr) )
+	return NULL;
+    }
+
+  return mst;
+}  /* End of bufstore_addmsr() */
+
+
+/***************************************************************************
+ * bufstore_stored:
+ *
+ * Returns the number of samples stored in pieces, compressed in memory
+ * or spilled to the temporary file.
+ ***************************************************************************/
+int64_t
+bufstore_stored (void)
+{
+  return storedsamples;
+}  /* End of bufstore_stored() */
+
+
+/***************************************************************************
+ * bufstore_pack:
+ *
+ * Pack and flush all traces in a MSTraceGroup, merging the stored
+ * pieces of each trace back with the samples still in the buffer.
+ *
+ * Returns the number of records created on success and -1 if any trace
+ * could not be packed.
+ ***************************************************************************/
+int64_t
+bufstore_pack (MSTraceGroup *mstg, void (*record_handler) (char *, int, void *),
+	       void *handlerdata, int reclen, flag encoding, flag byteorder,
+	       int64_t *packedsamples, flag verbose)
+{
+  struct buftrace *bt;
+  MSTrace *mst;
+  int64_t totalrecords = 0;
+  int64_t trpackedrecords;
+  int64_t trpackedsamples;
+  int failed = 0;
+
+  if ( packedsamples )
+    *packedsamples = 0;
+
+  if ( ! mstg )
+    return -1;
+
+  for ( mst = mstg->traces; mst; mst = mst->next )
+    {
+      bt = (struct buftrace *) mst->prvtptr;
+      trpackedsamples = 0;
+
+      if ( bt && bt->first )
+	trpackedrecords = packstored (mst, record_handler, handlerdata, reclen, encoding,
+				       byteorder, &trpackedsamples, verbose);
+      else if ( mst->numsamples > 0 )
+	trpackedrecords = mst_pack (mst, record_handler, handlerdata, reclen, encoding,
+				    byteorder, &trpackedsamples, 1, verbose, NULL);
+      else
+	continue;
+
+      if ( trpackedrecords < 0 )
+	failed++;
+      else
+	totalrecords += trpackedrecords;
+
+      if ( packedsamples )
+	*packedsamples += trpackedsamples;
+    }
+
+  return ( failed ) ? -1 : totalrecords;
+}  /* End of bufstore_pack() */
+
+
+/***************************************************************************
+ * bufstore_close:
+ *
+ * Release the stored pieces of all traces in a MSTraceGroup and close
+ * the temporary file, which is removed by the system.
+ ***************************************************************************/
+void
+bufstore_close (MSTraceGroup *mstg)
+{
+  MSTrace *mst;
+
+  if ( mstg )
+    for ( mst = mstg->traces; mst; mst = mst->next )
+      if ( mst->prvtptr )
+	freepieces ((struct buftrace *) mst->prvtptr);
+
+  if ( spillfp )
+    fclose (spillfp);
+
+  spillfp = NULL;
+  spilloffset = 0;
+  storedsamples = 0;
+  bufferbytes = 0;
+}  /* End of bufstore_close() */
+
+
+/***************************************************************************
+ * storetrace:
+ *
+ * Store all samples in the buffer of a trace as encoded pieces, either
+ * spilled to the temporary file or held in memory.  Prepended samples
+ * are placed before any previously stored pieces and appended samples
+ * after them.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+storetrace (MSTrace *mst, flag spill)
+{
+  struct buftrace *bt = (struct buftrace *) mst->prvtptr;
+  struct bufpiece *front = NULL;
+  struct bufpiece *frontlast = NULL;
+  struct bufpiece *back = NULL;
+  struct bufpiece *backlast = NULL;
+  struct bufpiece *piece;
+  int32_t *samples = (int32_t *) mst->datasamples;
+  char srcname[50];
+  int64_t count;
+  int64_t idx;
+
+  if ( spill && ! spillfp && ! (spillfp = tmpfile ()) )
+    {
+      ms_log (2, "Cannot create temporary file for spilling (%s)\n", strerror(errno));
+      return -1;
+    }
+
+  for ( idx = 0; idx < mst->numsamples; idx += count )
+    {
+      /* Pieces never span the boundary of prepended samples */
+      count = ( idx < bt->prepended ) ? bt->prepended - idx : mst->numsamples - idx;
+      if ( count > BUFSTORE_PIECESAMPLES )
+	count = BUFSTORE_PIECESAMPLES;
+
+      if ( ! (piece = storepiece (samples + idx, count, spill)) )
+	{
+	  for ( ; front; front = piece )
+	    {
+	      piece = front->next;
+	      if ( front->data )
+		free (front->data);
+	      free (front);
+	    }
+	  for ( ; back; back = piece )
+	    {
+	      piece = back->next;
+	      if ( back->data )
+		free (back->data);
+	      free (back);
+	    }
+	  return -1;
+	}
+
+      if ( piece->data )
+	{
+	  bt->membytes += piece->length;
+	  bufferbytes += piece->length;
+	}
+
+      if ( idx < bt->prepended )
+	{
+	  if ( frontlast )
+	    frontlast->next = piece;
+	  else
+	    front = piece;
+	  frontlast = piece;
+	}
+      else
+	{
+	  if ( backlast )
+	    backlast->next = piece;
+	  else
+	    back = piece;
+	  backlast = piece;
+	}
+    }
+
+  /* Link the new pieces around those already stored */
+  if ( front )
+    {
+      frontlast->next = bt->first;
+      bt->first = front;
+      if ( ! bt->last )
+	bt->last = frontlast;
+    }
+
+  if ( back )
+    {
+      if ( bt->last )
+	bt->last->next = back;
+      else
+	bt->first = back;
+      bt->last = backlast;
+    }
+
+  if ( storeverbose > 1 )
+    ms_log (1, "%s %"PRId64" samples of %s\n", ( spill ) ? "Spilled" : "Compressed",
+	    mst->numsamples, mst_srcname (mst, srcname, 1));
+
+  storedsamples += mst->numsamples;
+  bufferbytes -= mst->numsamples * ms_samplesize (mst->sampletype);
+
+  free (mst->datasamples);
+  mst->datasamples = NULL;
+  mst->samplecnt -= mst->numsamples;
+  mst->numsamples = 0;
+  bt->prepended = 0;
+
+  return 0;
+}  /* End of storetrace() */
+
+
+/***************************************************************************
+ * storepiece:
+ *
+ * Encode samples and either write them to the end of the temporary
+ * file or keep them in memory.
+ *
+ * Returns a new piece on success and NULL on error.
+ ***************************************************************************/
+static struct bufpiece *
+storepiece (int32_t *samples, int64_t count, flag spill)
+{
+  struct bufpiece *piece;
+
+  if ( ! (piece = (struct bufpiece *) calloc (1, sizeof(struct bufpiece))) )
+    {
+      ms_log (2, "storepiece(): Cannot allocate memory\n");
+      return NULL;
+    }
+
+  piece->length = encode_samples (samples, count, codebuf);
+  piece->numsamples = count;
+
+  if ( ! spill )
+    {
+      if ( ! (piece->data = (uint8_t *) malloc (piece->length)) )
+	{
+	  ms_log (2, "storepiece(): Cannot allocate memory\n");
+	  free (piece);
+	  return NULL;
+	}
+
+      memcpy (piece->data, codebuf, piece->length);
+
+      return piece;
+    }
+
+  piece->offset = spilloffset;
+
+  if ( lmp_fseeko (spillfp, spilloffset, SEEK_SET) ||
+       fwrite (codebuf, piece->length, 1, spillfp) != 1 )
+    {
+      ms_log (2, "Cannot write to temporary file (%s)\n", strerror(errno));
+      free (piece);
+      return NULL;
+    }
+
+  spilloffset += piece->length;
+
+  return piece;
+}  /* End of storepiece() */
+
+
+/***************************************************************************
+ * spillpieces:
+ *
+ * Move the pieces of a trace held in memory to the temporary file.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+spillpieces (struct buftrace *bt)
+{
+  struct bufpiece *piece;
+
+  if ( bt->membytes <= 0 )
+    return 0;
+
+  if ( ! spillfp && ! (spillfp = tmpfile ()) )
+    {
+      ms_log (2, "Cannot create temporary file for spilling (%s)\n", strerror(errno));
+      return -1;
+    }
+
+  for ( piece = bt->first; piece; piece = piece->next )
+    {
+      if ( ! piece->data )
+	continue;
+
+      if ( lmp_fseeko (spillfp, spilloffset, SEEK_SET) ||
+	   fwrite (piece->data, piece->length, 1, spillfp) != 1 )
+	{
+	  ms_log (2, "Cannot write to temporary file (%s)\n", strerror(errno));
+	  return -1;
+	}
+
+      piece->offset = spilloffset;
+      spilloffset += piece->length;
+
+      free (piece->data);
+      piece->data = NULL;
+
+      bt->membytes -= piece->length;
+      bufferbytes -= piece->length;
+    }
+
+  return 0;
+}  /* End of spillpieces() */
+
+
+/***************************************************************************
+ * packstored:
+ *
+ * Pack and flush a trace with stored pieces by streaming, in time
+ * order, the prepended samples in the buffer, the stored pieces and
+ * the appended samples in the buffer through mst_pack().
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+static int64_t
+packstored (MSTrace *mst, void (*record_handler) (char *, int, void *),
+	     void *handlerdata, int reclen, flag encoding, flag byteorder,
+	     int64_t *packedsamples, flag verbose)
+{
+  struct buftrace *bt = (struct buftrace *) mst->prvtptr;
+  struct bufpiece *piece;
+  MSRecord *mstemplate;
+  int32_t *memsamples = (int32_t *) mst->datasamples;
+  int64_t memcount = mst->numsamples;
+  int64_t records = 0;
+  int64_t trpackedsamples = 0;
+  int64_t flushsamples = 0;
+  int flushrecords;
+  int retval = 0;
+
+  if ( ! (mstemplate = msr_init (NULL)) )
+    {
+      ms_log (2, "packstored(): Cannot initialize MSRecord\n");
+      return -1;
+    }
+
+  mstemplate->dataquality = 'D';
+  strcpy (mstemplate->network, mst->network);
+  strcpy (mstemplate->station, mst->station);
+  strcpy (mstemplate->location, mst->location);
+  strcpy (mstemplate->channel, mst->channel);
+
+  mst->datasamples = NULL;
+  mst->numsamples = 0;
+  mst->samplecnt = 0;
+
+  if ( bt->prepended > 0 )
+    retval = feedsamples (mst, memsamples, bt->prepended, mstemplate, record_handler,
+			  handlerdata, reclen, encoding, byteorder, &records,
+			  &trpackedsamples, verbose);
+
+  for ( piece = bt->first; piece && ! retval; piece = piece->next )
+    {
+      if ( piece->data )
+	{
+	  if ( decode_samples (piece->data, piece->length, samplebuf, piece->numsamples) )
+	    {
+	      ms_log (2, "Cannot decode samples held in memory\n");
+	      retval = -1;
+	      break;
+	    }
+	}
+      else if ( lmp_fseeko (spillfp, piece->offset, SEEK_SET) ||
+		fread (codebuf, piece->length, 1, spillfp) != 1 ||
+		decode_samples (codebuf, piece->length, samplebuf, piece->numsamples) )
+	{
+	  ms_log (2, "Cannot read samples from temporary file\n");
+	  retval = -1;
+	  break;
+	}
+
+      retval = feedsamples (mst, samplebuf, piece->numsamples, mstemplate, record_handler,
+			    handlerdata, reclen, encoding, byteorder, &records,
+			    &trpackedsamples, verbose);
+    }
+
+  if ( ! retval && memcount > bt->prepended )
+    retval = feedsamples (mst, memsamples + bt->prepended, memcount - bt->prepended,
+			  mstemplate, record_handler, handlerdata, reclen, encoding,
+			  byteorder, &records, &trpackedsamples, verbose);
+
+  /* Flush the remaining samples */
+  if ( ! retval && mst->numsamples > 0 )
+    {
+      flushrecords = mst_pack (mst, record_handler, handlerdata, reclen, encoding, byteorder,
+			       &flushsamples, 1, verbose, mstemplate);
+
+      if ( flushrecords < 0 )
+	{
+	  retval = -1;
+	}
+      else
+	{
+	  records += flushrecords;
+	  trpackedsamples += flushsamples;
+	}
+    }
+
+  if ( memsamples )
+    free (memsamples);
+
+  freepieces (bt);
+  msr_free (&mstemplate);
+
+  *packedsamples = trpackedsamples;
+
+  return ( retval ) ? -1 : records;
+}  /* End of packstored() */
+
+
+/***************************************************************************
+ * feedsamples:
+ *
+ * Append samples to a trace and pack all complete records without
+ * flushing.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+feedsamples (MSTrace *mst, int32_t *samples, int64_t count, MSRecord *mstemplate,
+	     void (*record_handler) (char *, int, void *), void *handlerdata,
+	     int reclen, flag encoding, flag byteorder,
+	     int64_t *records, int64_t *packedsamples, flag verbose)
+{
+  int32_t *newsamples;
+  int64_t trpackedsamples = 0;
+  int trpackedrecords;
+
+  if ( ! (newsamples = (int32_t *) realloc (mst->datasamples, (mst->numsamples + count) * sizeof(int32_t))) )
+    {
+      ms_log (2, "feedsamples(): Cannot allocate memory\n");
+      return -1;
+    }
+
+  memcpy (newsamples + mst->numsamples, samples, count * sizeof(int32_t));
+  mst->datasamples = newsamples;
+  mst->numsamples += count;
+  mst->samplecnt += count;
+
+  trpackedrecords = mst_pack (mst, record_handler, handlerdata, reclen, encoding, byteorder,
+			      &trpackedsamples, 0, verbose, mstemplate);
+
+  if ( trpackedrecords < 0 )
+    return -1;
+
+  *records += trpackedrecords;
+  *packedsamples += trpackedsamples;
+
+  return 0;
+}  /* End of feedsamples() */
+
+
+/***************************************************************************
+ * freepieces:
+ *
+ * Free the stored pieces of a trace.
+ ***************************************************************************/
+static void
+freepieces (struct buftrace *bt)
+{
+  struct bufpiece *next;
+
+  while ( bt->first )
+    {
+      next = bt->first->next;
+      if ( bt->first->data )
+	free (bt->first->data);
+      free (bt->first);
+      bt->first = next;
+    }
+
+  bt->last = NULL;
+  bt->membytes = 0;
+}  /* End of freepieces() */
+
+
+/***************************************************************************
+ * encode_samples:
+ *
+ * Encode samples as differences from the previous sample, the first
+ * from zero, zigzag mapped and stored as little-endian base 128
+ * variable length integers of 1 to 5 bytes.
+ *
+ * Returns the number of bytes written to code.
+ ***************************************************************************/
+static size_t
+encode_samples (int32_t *samples, int64_t count, uint8_t *code)
+{
+  uint32_t previous = 0;
+  uint32_t delta;
+  uint32_t zigzag;
+  size_t length = 0;
+  int64_t idx;
+
+  for ( idx = 0; idx < count; idx++ )
+    {
+      delta = (uint32_t) samples[idx] - previous;
+      previous = (uint32_t) samples[idx];
+      zigzag = (delta << 1) ^ (0 - (delta >> 31));
+
+      while ( zigzag >= 0x80 )
+	{
+	  code[length++] = (uint8_t) (zigzag | 0x80);
+	  zigzag >>= 7;
+	}
+
+      code[length++] = (uint8_t) zigzag;
+    }
+
+  return length;
+}  /* End of encode_samples() */
+
+
+/***************************************************************************
+ * decode_samples:
+ *
+ * Decode samples encoded by encode_samples().
+ *
+ * Returns 0 on success and -1 if the code does not contain exactly
+ * the expected number of samples.
+ ***************************************************************************/
+static int
+decode_samples (uint8_t *code, size_t length, int32_t *samples, int64_t count)
+{
+  uint32_t previous = 0;
+  uint32_t zigzag;
+  size_t offset = 0;
+  int64_t idx;
+  uint8_t byte;
+  int shift;
+
+  for ( idx = 0; idx < count; idx++ )
+    {
+      zigzag = 0;
+      shift = 0;
+
+      do
+	{
+	  if ( offset >= length || shift > 28 )
+	    return -1;
+
+	  byte = code[offset++];
+	  zigzag |= (uint32_t) (byte & 0x7F) << shift;
+	  shift += 7;
+	}
+      while ( byte & 0x80 );
+
+      previous += (zigzag >> 1) ^ (0 - (zigzag & 1));
+      samples[idx] = (int32_t) previous;
+    }
+
+  return ( offset == length ) ? 0 : -1;
+}  /* End of decode_samples() */
@@ -0,0 +1,31 @@
+/***************************************************************************
+ * bufstore.h
+ *
+ * Interface declarations for memory-bounded and compressed buffering
+ * of traces.
+ ***************************************************************************/
+
+#ifndef BUFSTORE_H
+#define BUFSTORE_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int      bufstore_init (int64_t maxbytes, flag compress, flag verbose);
+extern MSTrace *bufstore_addmsr (MSTraceGroup *mstg, MSRecord *msr);
+extern int64_t  bufstore_stored (void);
+extern int64_t  bufstore_pack (MSTraceGroup *mstg,
+			       void (*record_handler) (char *, int, void *),
+			       void *handlerdata, int reclen, flag encoding,
+			       flag byteorder, int64_t *packedsamples,
+			       flag verbose);
+extern void     bufstore_close (MSTraceGroup *mstg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUFSTORE_H */
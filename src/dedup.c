@@ -0,0 +1,125 @@
+/***************************************************************************
+ * dedup.c
+ *
+ * Detect duplicate MARS blocks across all input files.
+ *
+ * Each block is identified by its station, channel and time together
+ * with a 64-bit FNV-1a hash of its contents.  The identities of all
+ * blocks seen are kept in a hash table so that a block repeated in the
+ * same or a later input file can be skipped before it is decoded.  A
+ * block with the identity of an earlier block but different contents
+ * is reported as a conflict.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#include "dedup.h"
+#include "hash.h"
+
+/* Initial number of hash table buckets, doubled as needed */
+#define DEDUP_INITSIZE 4096
+
+/* Identity of a block seen */
+struct blockid {
+  struct hashlink link;   /* Keyed by station, channel and time */
+  char     station[8];
+  int      channel;
+  int32_t  time;
+  uint64_t hash;          /* Hash of the block contents */
+};
+
+static struct hashtable deduptable;
+
+static uint32_t keyhash (const char *station, int channel, int32_t time);
+
+
+/***************************************************************************
+ * dedup_check:
+ *
+ * Check if a block has been seen before and remember it if not.
+ *
+ * Returns DEDUP_DUPLICATE if an identical block was seen before,
+ * DEDUP_CONFLICT if a block with the same station, channel and time
+ * but different contents was seen before and DEDUP_NEW otherwise.  On
+ * allocation failure blocks are treated as new.
+ ***************************************************************************/
+int
+dedup_check (const char *station, int channel, int32_t time,
+	     const void *block, size_t length)
+{
+  struct hashlink *link;
+  struct blockid *bid;
+  char sta[8];
+  uint64_t hash;
+  uint32_t key;
+  int conflict = 0;
+
+  strncpy (sta, station, sizeof(sta) - 1);
+  sta[sizeof(sta) - 1] = '\0';
+
+  hash = fnv64 (FNV64_INIT, block, length);
+  key = keyhash (sta, channel, time);
+
+  for ( link = hash_bucket (&deduptable, key); link; link = link->next )
+    {
+      bid = (struct blockid *) link;
+
+      if ( bid->time != time || bid->channel != channel || strcmp (bid->station, sta) )
+	continue;
+
+      if ( bid->hash == hash )
+	return DEDUP_DUPLICATE;
+
+      conflict = 1;
+    }
+
+  if ( hash_reserve (&deduptable, DEDUP_INITSIZE) )
+    return ( conflict ) ? DEDUP_CONFLICT : DEDUP_NEW;
+
+  if ( ! (bid = (struct blockid *) malloc (sizeof(struct blockid))) )
+    {
+      ms_log (2, "Cannot allocate memory for block identity\n");
+      return ( conflict ) ? DEDUP_CONFLICT : DEDUP_NEW;
+    }
+
+  memcpy (bid->station, sta, sizeof(sta));
+  bid->channel = channel;
+  bid->time = time;
+  bid->hash = hash;
+
+  hash_add (&deduptable, &bid->link, key);
+
+  return ( conflict ) ? DEDUP_CONFLICT : DEDUP_NEW;
+}  /* End of dedup_check() */
+
+
+/***************************************************************************
+ * dedup_free:
+ *
+ * Free all remembered block identities.
+ ***************************************************************************/
+void
+dedup_free (void)
+{
+  hash_free (&deduptable, free);
+}  /* End of dedup_free() */
+
+
+/***************************************************************************
+ * keyhash:
+ *
+ * Returns the hash of a block identity.
+ ***************************************************************************/
+static uint32_t
+keyhash (const char *station, int channel, int32_t time)
+{
+  uint32_t hash = fnv32_string (FNV32_INIT, station);
+
+  hash = fnv32 (hash, &channel, sizeof(channel));
+
+  return fnv32 (hash, &time, sizeof(time));
+}  /* End of keyhash() */
@@ -0,0 +1,29 @@
+/***************************************************************************
+ * dedup.h
+ *
+ * Interface declarations for detecting duplicate MARS blocks.
+ ***************************************************************************/
+
+#ifndef DEDUP_H
+#define DEDUP_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Results of dedup_check() */
+#define DEDUP_NEW        0
+#define DEDUP_DUPLICATE  1
+#define DEDUP_CONFLICT   2
+
+extern int  dedup_check (const char *station, int channel, int32_t time,
+			 const void *block, size_t length);
+extern void dedup_free (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEDUP_H */
@@ -0,0 +1,208 @@
+/***************************************************************************
+ * hash.c
+ *
+ * FNV-1a hashing and chained hash tables.
+ *
+ * The 32-bit FNV-1a hash keys the hash tables and the 64-bit hash
+ * identifies the contents of blocks and files.  Entries of a hash
+ * table start with a struct hashlink, the table doubles its number of
+ * buckets when it becomes three quarters full.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libmseed.h>
+
+#include "hash.h"
+
+static int grow (struct hashtable *table, size_t size);
+
+/* Bucket index of a hash for a power of 2 table size */
+#define BUCKETINDEX(H,S) ((size_t) ((H) ^ ((H) >> 16)) & ((S) - 1))
+
+
+/***************************************************************************
+ * fnv32:
+ *
+ * Continue a 32-bit FNV-1a hash, starting at FNV32_INIT, with data.
+ *
+ * Returns the hash.
+ ***************************************************************************/
+uint32_t
+fnv32 (uint32_t hash, const void *data, size_t length)
+{
+  const uint8_t *bytes = (const uint8_t *) data;
+
+  while ( length-- )
+    {
+      hash ^= *bytes++;
+      hash *= 16777619U;
+    }
+
+  return hash;
+}  /* End of fnv32() */
+
+
+/***************************************************************************
+ * fnv32_string:
+ *
+ * Continue a 32-bit FNV-1a hash with the characters of a string.
+ *
+ * Returns the hash.
+ ***************************************************************************/
+uint32_t
+fnv32_string (uint32_t hash, const char *string)
+{
+  while ( *string )
+    {
+      hash ^= (uint8_t) *string++;
+      hash *= 16777619U;
+    }
+
+  return hash;
+}  /* End of fnv32_string() */
+
+
+/***************************************************************************
+ * fnv64:
+ *
+ * Continue a 64-bit FNV-1a hash, starting at FNV64_INIT, with data.
+ *
+ * Returns the hash.
+ ***************************************************************************/
+uint64_t
+fnv64 (uint64_t hash, const void *data, size_t length)
+{
+  const uint8_t *bytes = (const uint8_t *) data;
+
+  while ( length-- )
+    {
+      hash ^= *bytes++;
+      hash *= 1099511628211ULL;
+    }
+
+  return hash;
+}  /* End of fnv64() */
+
+
+/***************************************************************************
+ * hash_bucket:
+ *
+ * Returns the first entry in the bucket of a hash, NULL if the bucket
+ * is empty or the table has no buckets yet.
+ ***************************************************************************/
+struct hashlink *
+hash_bucket (struct hashtable *table, uint32_t hash)
+{
+  if ( ! table->buckets )
+    return NULL;
+
+  return table->buckets[BUCKETINDEX (hash, table->size)];
+}  /* End of hash_bucket() */
+
+
+/***************************************************************************
+ * hash_reserve:
+ *
+ * Make room for one more entry in a hash table, allocating initsize
+ * buckets for an empty table or doubling the buckets of a table that
+ * is three quarters full.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+hash_reserve (struct hashtable *table, size_t initsize)
+{
+  if ( table->count < table->size - table->size / 4 )
+    return 0;
+
+  return grow (table, ( table->size ) ? table->size * 2 : initsize);
+}  /* End of hash_reserve() */
+
+
+/***************************************************************************
+ * hash_add:
+ *
+ * Add an entry to a hash table that has room for it.
+ ***************************************************************************/
+void
+hash_add (struct hashtable *table, struct hashlink *link, uint32_t hash)
+{
+  size_t idx = BUCKETINDEX (hash, table->size);
+
+  link->hash = hash;
+  link->next = table->buckets[idx];
+  table->buckets[idx] = link;
+  table->count++;
+}  /* End of hash_add() */
+
+
+/***************************************************************************
+ * hash_free:
+ *
+ * Free all entries of a hash table with freeentry, if not NULL, and
+ * the buckets, leaving an empty table.
+ ***************************************************************************/
+void
+hash_free (struct hashtable *table, void (*freeentry) (void *))
+{
+  struct hashlink *link;
+  size_t idx;
+
+  for ( idx = 0; idx < table->size; idx++ )
+    while ( (link = table->buckets[idx]) )
+      {
+	table->buckets[idx] = link->next;
+	if ( freeentry )
+	  freeentry (link);
+      }
+
+  if ( table->buckets )
+    free (table->buckets);
+
+  table->buckets = 0;
+  table->size = 0;
+  table->count = 0;
+}  /* End of hash_free() */
+
+
+/***************************************************************************
+ * grow:
+ *
+ * Allocate a number of buckets, a power of 2, for a hash table and
+ * redistribute the entries.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+grow (struct hashtable *table, size_t size)
+{
+  struct hashlink **buckets;
+  struct hashlink *link;
+  size_t idx;
+  size_t newidx;
+
+  if ( ! (buckets = (struct hashlink **) calloc (size, sizeof(struct hashlink *))) )
+    {
+      ms_log (2, "Cannot allocate memory for hash table\n");
+      return -1;
+    }
+
+  for ( idx = 0; idx < table->size; idx++ )
+    while ( (link = table->buckets[idx]) )
+      {
+	table->buckets[idx] = link->next;
+	newidx = BUCKETINDEX (link->hash, size);
+	link->next = buckets[newidx];
+	buckets[newidx] = link;
+      }
+
+  if ( table->buckets )
+    free (table->buckets);
+
+  table->buckets = buckets;
+  table->size = size;
+
+  return 0;
+}  /* End of grow() */
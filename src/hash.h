@@ -0,0 +1,46 @@
+/***************************************************************************
+ * hash.h
+ *
+ * Interface declarations for FNV-1a hashing and chained hash tables.
+ ***************************************************************************/
+
+#ifndef HASH_H
+#define HASH_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Offset bases of the FNV-1a hashes, the initial hash values */
+#define FNV32_INIT 2166136261U
+#define FNV64_INIT 14695981039346656037ULL
+
+/* Link of an entry in a hash table, the first member of the entry */
+struct hashlink {
+  struct hashlink *next;
+  uint32_t hash;
+};
+
+/* Chained hash table, the number of buckets is a power of 2 */
+struct hashtable {
+  struct hashlink **buckets;
+  size_t size;
+  size_t count;
+};
+
+extern uint32_t fnv32 (uint32_t hash, const void *data, size_t length);
+extern uint32_t fnv32_string (uint32_t hash, const char *string);
+extern uint64_t fnv64 (uint64_t hash, const void *data, size_t length);
+
+extern struct hashlink *hash_bucket (struct hashtable *table, uint32_t hash);
+extern int  hash_reserve (struct hashtable *table, size_t initsize);
+extern void hash_add (struct hashtable *table, struct hashlink *link, uint32_t hash);
+extern void hash_free (struct hashtable *table, void (*freeentry) (void *));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HASH_H */
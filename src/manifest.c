@@ -0,0 +1,403 @@
+/***************************************************************************
+ * manifest.c
+ *
+ * Manifest of converted input files for incremental batch conversion.
+ *
+ * For each converted input file the manifest records the size,
+ * modification time and a 64-bit FNV-1a checksum of the contents
+ * together with the output produced.  An input file with the same
+ * size and modification time as recorded is unchanged; if only the
+ * modification time differs the checksum decides.  The manifest is a
+ * text file with one tab separated line per input file:
+ *
+ *   size  mtime  checksum  output  input
+ *
+ * and is rewritten through a temporary file so that an interrupted
+ * run leaves the previous manifest intact.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libmseed.h>
+
+#include "manifest.h"
+#include "hash.h"
+
+/* Initial number of hash table buckets, doubled as needed */
+#define MANIFEST_INITSIZE 1024
+
+/* Recorded state of an input file */
+struct manifestentry {
+  struct hashlink link;   /* Keyed by input */
+  char    *input;
+  char    *output;
+  int64_t  size;
+  int64_t  mtime;
+  uint64_t checksum;
+};
+
+static char *manifestpath = 0;
+static struct hashtable manifesttable;
+static int manifestdirty = 0;
+
+static struct manifestentry *findentry (const char *input);
+static struct manifestentry *addentry (const char *input, const char *output,
+				       int64_t size, int64_t mtime, uint64_t checksum);
+static void freeentry (void *entry);
+static int filechecksum (const char *path, uint64_t *checksum);
+
+
+/***************************************************************************
+ * manifest_load:
+ *
+ * Read the manifest from a file, a missing file is an empty manifest.
+ * The same file is written by manifest_save().
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+manifest_load (const char *path)
+{
+  FILE *fp;
+  char line[2200];
+  char *fields[5];
+  char *cp;
+  int nfields;
+  int lineno = 0;
+
+  if ( ! (manifestpath = strdup (path)) )
+    {
+      ms_log (2, "Cannot allocate memory for manifest\n");
+      return -1;
+    }
+
+  if ( ! (fp = fopen (path, "rb")) )
+    {
+      if ( errno == ENOENT )
+	return 0;
+
+      ms_log (2, "Cannot open manifest %s: %s\n", path, strerror(errno));
+      return -1;
+    }
+
+  while ( fgets (line, sizeof(line), fp) )
+    {
+      lineno++;
+
+      if ( (cp = strpbrk (line, "\r\n")) )
+	*cp = '\0';
+
+      if ( *line == '#' || *line == '\0' )
+	continue;
+
+      /* Split the tab separated fields, the input path is last */
+      nfields = 0;
+      for ( cp = line; cp && nfields < 5; nfields++ )
+	{
+	  fields[nfields] = cp;
+	  if ( nfields < 4 && (cp = strchr (cp, '\t')) )
+	    *cp++ = '\0';
+	}
+
+      if ( nfields != 5 || ! cp )
+	{
+	  ms_log (1, "Warning: skipping malformed line %d of manifest %s\n", lineno, path);
+	  continue;
+	}
+
+      if ( ! addentry (fields[4], fields[3],
+		       strtoll (fields[0], NULL, 10), strtoll (fields[1], NULL, 10),
+		       strtoull (fields[2], NULL, 16)) )
+	{
+	  fclose (fp);
+	  return -1;
+	}
+    }
+
+  fclose (fp);
+  manifestdirty = 0;
+
+  return 0;
+}  /* End of manifest_load() */
+
+
+/***************************************************************************
+ * manifest_unchanged:
+ *
+ * Check if an input file is unchanged since it was converted into the
+ * same output.  If the size matches but the modification time differs
+ * the checksum of the contents is compared and the recorded time is
+ * updated when the contents are the same.
+ *
+ * Returns 1 if the input file is unchanged and 0 otherwise.
+ ***************************************************************************/
+int
+manifest_unchanged (const char *input, const char *output)
+{
+  struct manifestentry *entry;
+  struct stat fs;
+  uint64_t checksum;
+
+  if ( ! (entry = findentry (input)) )
+    return 0;
+
+  if ( strcmp (entry->output, output) )
+    return 0;
+
+  if ( stat (input, &fs) || ! S_ISREG(fs.st_mode) )
+    return 0;
+
+  if ( (int64_t) fs.st_size != entry->size )
+    return 0;
+
+  if ( (int64_t) fs.st_mtime == entry->mtime )
+    return 1;
+
+  if ( filechecksum (input, &checksum) || checksum != entry->checksum )
+    return 0;
+
+  entry->mtime = (int64_t) fs.st_mtime;
+  manifestdirty = 1;
+
+  return 1;
+}  /* End of manifest_unchanged() */
+
+
+/***************************************************************************
+ * manifest_update:
+ *
+ * Record the current size, modification time and checksum of an input
+ * file and the output it was converted into.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+manifest_update (const char *input, const char *output)
+{
+  struct stat fs;
+  uint64_t checksum;
+
+  if ( stat (input, &fs) || ! S_ISREG(fs.st_mode) )
+    return -1;
+
+  if ( filechecksum (input, &checksum) )
+    return -1;
+
+  if ( ! addentry (input, output, (int64_t) fs.st_size,
+		   (int64_t) fs.st_mtime, checksum) )
+    return -1;
+
+  manifestdirty = 1;
+
+  return 0;
+}  /* End of manifest_update() */
+
+
+/***************************************************************************
+ * manifest_save:
+ *
+ * Write the manifest if it has changed, replacing the previous file.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+manifest_save (void)
+{
+  struct manifestentry *entry;
+  char tmppath[1100];
+  FILE *fp;
+  size_t idx;
+  int retval = 0;
+
+  if ( ! manifestpath || ! manifestdirty )
+    return 0;
+
+  snprintf (tmppath, sizeof(tmppath), "%s.tmp", manifestpath);
+
+  if ( ! (fp = fopen (tmppath, "wb")) )
+    {
+      ms_log (2, "Cannot open manifest %s: %s\n", tmppath, strerror(errno));
+      return -1;
+    }
+
+  fprintf (fp, "# size\tmtime\tchecksum\toutput\tinput\n");
+
+  for ( idx = 0; idx < manifesttable.size; idx++ )
+    for ( entry = (struct manifestentry *) manifesttable.buckets[idx]; entry;
+	  entry = (struct manifestentry *) entry->link.next )
+      fprintf (fp, "%"PRId64"\t%"PRId64"\t%016llx\t%s\t%s\n",
+	       entry->size, entry->mtime, (unsigned long long) entry->checksum,
+	       entry->output, entry->input);
+
+  if ( ferror (fp) )
+    retval = -1;
+
+  if ( fclose (fp) )
+    retval = -1;
+
+#if defined(LMP_WIN)
+  /* Renaming does not replace an existing file on Windows */
+  if ( retval == 0 )
+    remove (manifestpath);
+#endif
+
+  if ( retval == 0 && rename (tmppath, manifestpath) )
+    retval = -1;
+
+  if ( retval )
+    {
+      ms_log (2, "Cannot write manifest %s: %s\n", manifestpath, strerror(errno));
+      remove (tmppath);
+      return -1;
+    }
+
+  manifestdirty = 0;
+
+  return 0;
+}  /* End of manifest_save() */
+
+
+/***************************************************************************
+ * manifest_free:
+ *
+ * Free the manifest without saving it.
+ ***************************************************************************/
+void
+manifest_free (void)
+{
+  hash_free (&manifesttable, freeentry);
+
+  if ( manifestpath )
+    free (manifestpath);
+
+  manifestpath = 0;
+  manifestdirty = 0;
+}  /* End of manifest_free() */
+
+
+/***************************************************************************
+ * findentry:
+ *
+ * Returns the recorded entry of an input file or NULL if not found.
+ ***************************************************************************/
+static struct manifestentry *
+findentry (const char *input)
+{
+  struct hashlink *link;
+
+  for ( link = hash_bucket (&manifesttable, fnv32_string (FNV32_INIT, input)); link; link = link->next )
+    if ( ! strcmp (((struct manifestentry *) link)->input, input) )
+      return (struct manifestentry *) link;
+
+  return NULL;
+}  /* End of findentry() */
+
+
+/***************************************************************************
+ * addentry:
+ *
+ * Add an entry for an input file, replacing any existing entry.
+ *
+ * Returns the entry on success or NULL on error.
+ ***************************************************************************/
+static struct manifestentry *
+addentry (const char *input, const char *output,
+	  int64_t size, int64_t mtime, uint64_t checksum)
+{
+  struct manifestentry *entry;
+  char *newoutput;
+
+  if ( ! (newoutput = strdup (output)) )
+    {
+      ms_log (2, "Cannot allocate memory for manifest\n");
+      return NULL;
+    }
+
+  if ( (entry = findentry (input)) )
+    {
+      free (entry->output);
+    }
+  else
+    {
+      if ( hash_reserve (&manifesttable, MANIFEST_INITSIZE) )
+	{
+	  free (newoutput);
+	  return NULL;
+	}
+
+      if ( ! (entry = (struct manifestentry *) calloc (1, sizeof(struct manifestentry))) ||
+	   ! (entry->input = strdup (input)) )
+	{
+	  ms_log (2, "Cannot allocate memory for manifest\n");
+	  free (newoutput);
+	  free (entry);
+	  return NULL;
+	}
+
+      hash_add (&manifesttable, &entry->link, fnv32_string (FNV32_INIT, input));
+    }
+
+  entry->output = newoutput;
+  entry->size = size;
+  entry->mtime = mtime;
+  entry->checksum = checksum;
+
+  return entry;
+}  /* End of addentry() */
+
+
+/***************************************************************************
+ * freeentry:
+ *
+ * Free an entry and its strings.
+ ***************************************************************************/
+static void
+freeentry (void *entry)
+{
+  free (((struct manifestentry *) entry)->input);
+  free (((struct manifestentry *) entry)->output);
+  free (entry);
+}  /* End of freeentry() */
+
+
+/***************************************************************************
+ * filechecksum:
+ *
+ * Calculate the 64-bit FNV-1a hash of the contents of a file.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+filechecksum (const char *path, uint64_t *checksum)
+{
+  FILE *fp;
+  uint8_t buffer[65536];
+  uint64_t hash = FNV64_INIT;
+  size_t nread;
+
+  if ( ! (fp = fopen (path, "rb")) )
+    {
+      ms_log (2, "Cannot open %s for checksum: %s\n", path, strerror(errno));
+      return -1;
+    }
+
+  while ( (nread = fread (buffer, 1, sizeof(buffer), fp)) > 0 )
+    hash = fnv64 (hash, buffer, nread);
+
+  if ( ferror (fp) )
+    {
+      ms_log (2, "Cannot read %s for checksum\n", path);
+      fclose (fp);
+      return -1;
+    }
+
+  fclose (fp);
+  *checksum = hash;
+
+  return 0;
+}  /* End of filechecksum() */
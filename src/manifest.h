@@ -0,0 +1,26 @@
+/***************************************************************************
+ * manifest.h
+ *
+ * Interface declarations for the manifest of converted input files.
+ ***************************************************************************/
+
+#ifndef MANIFEST_H
+#define MANIFEST_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  manifest_load (const char *path);
+extern int  manifest_unchanged (const char *input, const char *output);
+extern int  manifest_update (const char *input, const char *output);
+extern int  manifest_save (void);
+extern void manifest_free (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MANIFEST_H */
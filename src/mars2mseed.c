@@ -13,10 +13,31 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <libmseed.h>
 
+#if defined(LMP_WIN)
+  #include <windows.h>
+  #include <sys/timeb.h>
+#else
+  #include <sys/time.h>
+#endif
+
 #include "marsio.h"
+#include "parpack.h"
+#include "bufstore.h"
+#include "watchdir.h"
+#include "archive.h"
+#include "dedup.h"
+#include "reorder.h"
+#include "manifest.h"
+#include "verify.h"
+
+/* Maximum number of archive files kept open */
+#define ARCHIVE_MAXOPEN 256
 
 #define VERSION "1.4"
 #define PACKAGE "mars2mseed"
@@ -36,10 +57,69 @@ struct listnode {
   struct listnode *next;
 };
 
+/* End time of a trace when reading of an input file started */
+struct tracemark {
+  MSTrace *mst;
+  hptime_t endtime;
+  int32_t  streamid;            /* Interned stream ID of the trace */
+  flag     passed;              /* The file had a later block of the stream */
+};
+
+/* Input file being merged, ordered by the time of its current block */
+struct mergeinput {
+  marsStream *hMS;
+  int order;                    /* Position of the file in the input list */
+};
+
+/* Arrival times of the blocks buffered for a trace when following */
+#define MAXARRIVALS 64
+struct arrivals {
+  int64_t added;                /* Count of samples added to the trace */
+  int     head;                 /* Index of the oldest arrival */
+  int     count;                /* Count of arrivals */
+  int64_t end[MAXARRIVALS];     /* Samples added at the end of each block */
+  double  time[MAXARRIVALS];    /* Arrival time of each block */
+};
+
+/* State of a trace, attached to MSTrace.prvtptr unless the buffer store
+   uses it.  The capacity applies while the sample buffer and count are
+   as noted, other code may reallocate the buffer to the exact size. */
+struct tracestate {
+  void    *samples;             /* Sample buffer the capacity applies to */
+  int64_t  numsamples;          /* Sample count when the buffer was noted */
+  int64_t  capacity;            /* Allocated number of samples */
+  struct arrivals arrivals;     /* Arrival times when following */
+};
+
 static void packtraces (flag flush);
-static int mars2group (char *mfile, MSTraceGroup *mstg);
+static int packtrace (MSTrace *mst, int64_t *packedsamples, flag flush);
+static struct tracestate *tracestate (MSTrace *mst, flag create);
+static int32_t *reservesamples (MSTrace *mst, int64_t count);
+static void notesamples (MSTrace *mst);
+static void forgetsamples (MSTrace *mst);
+static void splitdays (MSTraceGroup *mstg);
+static struct tracemark *marktraces (MSTraceGroup *mstg, int *count);
+static void flushstale (MSTraceGroup *mstg, struct tracemark *marks, int count);
+static void markblock (MSRecord *msr);
+static int mars2group (char *mfile, MSTraceGroup *mstg, flag follow);
+static void blockcodes (char *block, MSRecord *msr);
+static int block2group (marsStream *hMS, MSRecord *msr, char *mfile, flag follow);
+static void addrecord (MSRecord *msr, void *handlerdata);
+static void addedsamples (MSTrace *mst, int64_t numsamples, flag follow);
+static int mergefiles (struct listnode *files, int window);
+static int mergebefore (struct mergeinput *a, struct mergeinput *b);
+static void mergesift (struct mergeinput *heap, int count, int idx);
+static void trackarrival (MSTrace *mst, int64_t samples, double now);
+static void flushlatent (double now);
+static int followwait (void);
+static double walltime (void);
+static void term_handler (int sig);
+static int watch_handler (char *mfile, void *handlerdata);
+static char *outputname (char *mfile, char *buffer, size_t size);
+static flag inputsunchanged (void);
 static int parameter_proc (int argcount, char **argvec);
 static char *getoptval (int argcount, char **argvec, int argopt);
+static int64_t getbytesval (char *value);
 static int readlistfile (char *listfile);
 static void addnode (struct listnode **listroot, char *key, char *data);
 static void addmapnode (struct listnode **listroot, char *mapping);
@@ -53,11 +133,28 @@ static int   encoding    = -1;
 static int   byteorder   = -1;
 static int   scaling     = 8;
 static char  bufferall   = 0;
+static char  continuestreams = 0;
+static char  dedupblocks = 0;
+static int   mergewindow = -1;
+static int   reorderblocks = 0;
+static double reorderseconds = 0.0;
+static int   packthreads = 1;
+static int64_t memlimit  = 0;
+static char  compressbuf = 0;
+static char  followmode  = 0;
+static double maxlatency = 0.0;
+static char *watchdir     = 0;
+static char *donedir      = 0;
+static volatile sig_atomic_t stopsignal = 0;
 static char *forcesta    = 0;
 static char *forcenet    = 0;
 static char *forceloc    = 0;
 static int   transchan   = -1;
 static char *outputfile  = 0;
+static char *archivedir  = 0;
+static char  appendmode  = 0;
+static char *manifestfile = 0;
+static char  verifyoutput = 0;
 static FILE *ofp         = 0;
 
 /* A list of input files */
@@ -68,31 +165,76 @@ struct listnode *chanlist = 0;
 
 /* Internal data buffers */
 static MSTraceGroup *mstg = 0;
+static MSRecord *packtemplate = 0;
+static struct tracemark *tracemarks = 0;
+static int ntracemarks = 0;
 
 static int64_t packedtraces  = 0;
 static int64_t packedsamples = 0;
 static int64_t packedrecords = 0;
+static int64_t duplicateblocks = 0;
+static int64_t conflictblocks = 0;
+static int64_t skippedfiles = 0;
 
 int
 main (int argc, char **argv)
 {
   struct listnode *flp;
+  struct stat fs;
+  char outname[1024];
+  flag outputkept = 0;
+  flag follow = 0;
+  int retval = 0;
   
   /* Process given parameters (command line and parameter file) */
   if (parameter_proc (argc, argv) < 0)
     return -1;
   
+  /* Print the per-block messages of -vv and above from a log writer
+     thread, the buffered messages are printed at exit */
+  if ( verbose >= 2 )
+    {
+      if ( ms_logstartwriter (0) )
+	return -1;
+      
+      atexit (ms_logstopwriter);
+    }
+  
   /* Init MSTraceGroup */
   mstg = mst_initgroup (mstg);
   
-  /* Open the output file if specified otherwise stdout */
-  if ( outputfile )
+  /* Set the memory limit and compression for buffered data */
+  bufstore_init (memlimit, compressbuf, verbose);
+  
+  /* Load the manifest of input files converted by earlier runs */
+  if ( manifestfile )
+    {
+      if ( manifest_load (manifestfile) )
+	return -1;
+    }
+  
+  /* Initialize the archive or open the output file if specified */
+  if ( archivedir )
+    {
+      if ( archive_init (archivedir, ARCHIVE_MAXOPEN, packreclen, appendmode,
+                         verifyoutput, verbose) )
+        {
+          ms_log (2, "Cannot initialize archive: %s\n", archivedir);
+          return -1;
+        }
+    }
+  else if ( outputfile )
     {
+      /* With a manifest the output is kept if it holds all input files
+         unchanged, otherwise it is rebuilt from all input files */
+      if ( manifestfile && stat (outputfile, &fs) == 0 )
+        outputkept = inputsunchanged ();
+      
       if ( strcmp (outputfile, "-") == 0 )
         {
           ofp = stdout;
         }
-      else if ( (ofp = fopen (outputfile, "w")) == NULL )
+      else if ( (ofp = fopen (outputfile, ( outputkept ) ? "ab" : "w")) == NULL )
         {
           ms_log (2, "Cannot open output file: %s (%s)\n",
 		  outputfile, strerror(errno));
@@ -100,22 +242,77 @@ main (int argc, char **argv)
         }
     }
   
-  /* Read input MARS files into MSTraceGroup */
-  flp = filelist;
+  /* Verify output records against the MARS samples as they are written */
+  if ( verifyoutput )
+    {
+      if ( verify_init (verbose) )
+	return -1;
+    }
+  
+  /* Stop following or watching input cleanly on termination */
+  if ( followmode || watchdir )
+    {
+      signal (SIGINT, term_handler);
+      signal (SIGTERM, term_handler);
+    }
+  
+  /* Read input MARS files into MSTraceGroup, following the last if requested */
+  if ( mergewindow >= 0 )
+    {
+      /* Merge the blocks of all input files in time order */
+      mergefiles (filelist, mergewindow);
+      flp = 0;
+    }
+  else
+    {
+      flp = filelist;
+    }
   while ( flp != 0 )
     {
+      /* Skip input files unchanged since they were converted into the same output */
+      if ( manifestfile && strcmp (flp->data, "-") )
+	{
+	  outputname (flp->data, outname, sizeof(outname));
+	  
+	  if ( outputkept || (! outputfile && manifest_unchanged (flp->data, outname) &&
+			      stat (outname, &fs) == 0) )
+	    {
+	      if ( verbose )
+		ms_log (1, "Skipping unchanged %s\n", flp->data);
+	      
+	      skippedfiles++;
+	      flp = flp->next;
+	      continue;
+	    }
+	}
+      
       if ( verbose )
 	ms_log (1, "Reading %s\n", flp->data);
 
-      mars2group (flp->data, mstg);
+      if ( mars2group (flp->data, mstg, (followmode && ! flp->next)) == 0 &&
+	   manifestfile && ! parseonly && strcmp (flp->data, "-") )
+	{
+	  if ( manifest_update (flp->data, outname) )
+	    ms_log (1, "Warning: cannot record %s in manifest\n", flp->data);
+	}
       
       flp = flp->next;
     }
   
+  /* Convert new files arriving in the watched directory until terminated */
+  if ( watchdir )
+    {
+      if ( watchdir_run (watchdir, donedir, watch_handler, NULL, &stopsignal, verbose) )
+	return -1;
+    }
+  
   /* Pack any remaining, possibly all data */
   if ( ! parseonly )
     {
-      if ( bufferall )
+      if ( (reorderblocks || reorderseconds > 0.0) && continuestreams )
+	reorder_flush (addrecord, &follow);
+      
+      if ( bufferall || continuestreams || mergewindow >= 0 )
 	{
 	  packtraces (1);
 	  packedtraces += mstg->numtraces;
@@ -124,17 +321,49 @@ main (int argc, char **argv)
       ms_log (1, "Packed %"PRId64" trace(s) of %"PRId64" samples into %"PRId64" records\n",
 	      packedtraces, packedsamples, packedrecords);
       
+      if ( manifestfile )
+	ms_log (1, "Skipped %"PRId64" unchanged input file(s)\n", skippedfiles);
+      
+      if ( dedupblocks )
+	ms_log (1, "Skipped %"PRId64" duplicate block(s), %"PRId64" conflicting block(s) converted\n",
+		duplicateblocks, conflictblocks);
+      
       ms_log (1, "All data samples have been scaled by %d and are now %d nanovolts!\n",
 	      scaling, (scaling)?(1000/scaling):0);
+      
+      if ( verifyoutput && verify_finish () )
+	retval = 1;
     }
   
   /* Make sure everything is cleaned up */
+  if ( dedupblocks )
+    dedup_free ();
+  
+  if ( reorderblocks || reorderseconds > 0.0 )
+    reorder_free ();
+  
+  bufstore_close (mstg);
   mst_freegroup (&mstg);
   
+  if ( packtemplate )
+    msr_free (&packtemplate);
+  
+  ms_freestreamids ();
+  
   if ( ofp )
     fclose (ofp);
   
-  return 0;
+  if ( archivedir )
+    archive_close ();
+  
+  /* Record the converted input files once all output is written */
+  if ( manifestfile )
+    {
+      manifest_save ();
+      manifest_free ();
+    }
+  
+  return retval;
 }  /* End of main() */
 
 
@@ -152,6 +381,60 @@ packtraces (flag flush)
   int64_t trpackedsamples = 0;
   int64_t trpackedrecords = 0;
   
+  /* Records written to an archive may not span days */
+  if ( archivedir )
+    splitdays (mstg);
+  
+  /* Take the last record of archive files back into new traces continuing them */
+  if ( appendmode )
+    {
+      for ( mst = mstg->traces; mst; mst = mst->next )
+        if ( ! mst->ststate && mst->numsamples > 0 )
+          {
+            archive_resume (mst, encoding, byteorder);
+            forgetsamples (mst);
+          }
+    }
+  
+  /* Merge stored data back into traces while packing */
+  if ( flush && bufstore_stored () > 0 )
+    {
+      trpackedrecords = bufstore_pack (mstg, &record_handler, 0, packreclen, encoding,
+                                       byteorder, &trpackedsamples, verbose-2);
+      if ( trpackedrecords < 0 )
+        {
+          ms_log (2, "Cannot pack data\n");
+        }
+      else
+        {
+          packedrecords += trpackedrecords;
+          packedsamples += trpackedsamples;
+        }
+      
+      return;
+    }
+  
+  /* Flush all traces in parallel if requested, output order is retained */
+  if ( flush && packthreads > 1 )
+    {
+      trpackedrecords = parpack_group (mstg, &record_handler, 0, packreclen, encoding,
+                                       byteorder, packthreads, &trpackedsamples, verbose-2);
+      for ( mst = mstg->traces; mst; mst = mst->next )
+        forgetsamples (mst);
+      
+      if ( trpackedrecords < 0 )
+        {
+          ms_log (2, "Cannot pack data\n");
+        }
+      else
+        {
+          packedrecords += trpackedrecords;
+        }
+      packedsamples += trpackedsamples;
+      
+      return;
+    }
+  
   mst = mstg->traces;
   while ( mst )
     {
@@ -161,8 +444,7 @@ packtraces (flag flush)
           continue;
         }
 
-      trpackedrecords = mst_pack (mst, &record_handler, 0, packreclen, encoding, byteorder,
-                                  &trpackedsamples, flush, verbose-2, NULL);
+      trpackedrecords = packtrace (mst, &trpackedsamples, flush);
       if ( trpackedrecords < 0 )
         {
           ms_log (2, "Cannot pack data\n");
@@ -178,6 +460,353 @@ packtraces (flag flush)
 }  /* End of packtraces() */
 
 
+/***************************************************************************
+ * packtrace:
+ *
+ * Pack a trace using a record template that is reused for all traces,
+ * so that its header and blockettes are only allocated once instead of
+ * for every call.  Sequence numbers start at 1 for each call as they
+ * do without a template.
+ *
+ * Returns the number of records packed or -1 on error.
+ ***************************************************************************/
+static int
+packtrace (MSTrace *mst, int64_t *packedsamples, flag flush)
+{
+  int packed;
+  
+  if ( ! packtemplate && ! (packtemplate = msr_init (NULL)) )
+    {
+      ms_log (2, "Cannot initialize packing template\n");
+      return -1;
+    }
+  
+  strcpy (packtemplate->network, mst->network);
+  strcpy (packtemplate->station, mst->station);
+  strcpy (packtemplate->location, mst->location);
+  strcpy (packtemplate->channel, mst->channel);
+  packtemplate->streamid = mst->streamid;
+  packtemplate->dataquality = 'D';
+  packtemplate->sequence_number = 1;
+  
+  packed = mst_pack (mst, &record_handler, 0, packreclen, encoding, byteorder,
+		     packedsamples, flush, verbose-2, packtemplate);
+  
+  /* Packing moves the remaining samples to the start of the buffer */
+  notesamples (mst);
+  
+  return packed;
+}  /* End of packtrace() */
+
+
+/***************************************************************************
+ * tracestate:
+ *
+ * Get the state of a trace, allocating it if it does not exist and
+ * create is set.  The buffer store keeps its own state in the traces.
+ *
+ * Returns a pointer to the state or NULL if none.
+ ***************************************************************************/
+static struct tracestate *
+tracestate (MSTrace *mst, flag create)
+{
+  if ( memlimit || compressbuf )
+    return NULL;
+  
+  if ( ! mst->prvtptr && create )
+    mst->prvtptr = calloc (1, sizeof(struct tracestate));
+  
+  return (struct tracestate *) mst->prvtptr;
+}  /* End of tracestate() */
+
+
+/***************************************************************************
+ * reservesamples:
+ *
+ * Make room for count integer samples at the end of the sample buffer
+ * of a trace.  The buffer grows geometrically so that adding a block
+ * at a time rarely reallocates it.  Samples written to the room are
+ * noted with notesamples() after adding them to the trace.
+ *
+ * Returns a pointer to the room for the samples or NULL on error.
+ ***************************************************************************/
+static int32_t *
+reservesamples (MSTrace *mst, int64_t count)
+{
+  struct tracestate *ts;
+  int64_t capacity;
+  void *samples;
+  
+  if ( ! (ts = tracestate (mst, 1)) )
+    return NULL;
+  
+  /* Unless the buffer is as noted it holds only the samples of the trace */
+  if ( ts->samples && ts->samples == mst->datasamples && ts->numsamples == mst->numsamples )
+    capacity = ts->capacity;
+  else
+    capacity = mst->numsamples;
+  
+  if ( mst->numsamples + count > capacity )
+    {
+      capacity = ( capacity * 2 > mst->numsamples + count ) ? capacity * 2 : mst->numsamples + count;
+      
+      if ( ! (samples = realloc (mst->datasamples, (size_t) capacity * sizeof(int32_t))) )
+	return NULL;
+      
+      mst->datasamples = samples;
+    }
+  
+  ts->samples = mst->datasamples;
+  ts->numsamples = mst->numsamples;
+  ts->capacity = capacity;
+  
+  return (int32_t *) mst->datasamples + mst->numsamples;
+}  /* End of reservesamples() */
+
+
+/***************************************************************************
+ * notesamples:
+ *
+ * Note the sample count of a trace whose buffer has not been
+ * reallocated since reservesamples(), so its capacity still applies.
+ * A buffer that has been freed is forgotten.
+ ***************************************************************************/
+static void
+notesamples (MSTrace *mst)
+{
+  struct tracestate *ts;
+  
+  if ( ! (ts = tracestate (mst, 0)) )
+    return;
+  
+  if ( ts->samples && ts->samples == mst->datasamples )
+    ts->numsamples = mst->numsamples;
+  else
+    forgetsamples (mst);
+}  /* End of notesamples() */
+
+
+/***************************************************************************
+ * forgetsamples:
+ *
+ * Forget the capacity of the sample buffer of a trace, needed whenever
+ * other code reallocates the buffer.
+ ***************************************************************************/
+static void
+forgetsamples (MSTrace *mst)
+{
+  struct tracestate *ts;
+  
+  if ( ! (ts = tracestate (mst, 0)) )
+    return;
+  
+  ts->samples = NULL;
+  ts->numsamples = 0;
+  ts->capacity = 0;
+}  /* End of forgetsamples() */
+
+
+/***************************************************************************
+ * splitdays:
+ *
+ * Split traces that span a day boundary into separate traces for each
+ * day, so that packed records do not cross midnight.  The samples of
+ * the later days are moved into new traces following the original in
+ * the group, later data is added to the trace it is adjacent to.
+ ***************************************************************************/
+static void
+splitdays (MSTraceGroup *mstg)
+{
+  MSTrace *mst;
+  MSTrace *split;
+  BTime btime;
+  hptime_t boundary;
+  int64_t splitsamples;
+  int samplesize;
+  
+  for ( mst = mstg->traces; mst; mst = mst->next )
+    {
+      if ( mst->numsamples <= 1 || mst->samprate <= 0.0 || ! mst->datasamples )
+        continue;
+      
+      /* Start of the day following the trace start */
+      if ( ms_hptime2btime (mst->starttime, &btime) )
+        continue;
+      
+      boundary = ms_time2hptime (btime.year, btime.day, 0, 0, 0, 0) + (hptime_t) 86400 * HPTMODULUS;
+      
+      if ( mst->endtime < boundary )
+        continue;
+      
+      /* Count of samples before the boundary */
+      splitsamples = (int64_t) ((double) (boundary - mst->starttime) / HPTMODULUS * mst->samprate);
+      while ( splitsamples > 0 &&
+              mst->starttime + (hptime_t) (splitsamples / mst->samprate * HPTMODULUS + 0.5) >= boundary )
+        splitsamples--;
+      while ( mst->starttime + (hptime_t) (splitsamples / mst->samprate * HPTMODULUS + 0.5) < boundary )
+        splitsamples++;
+      
+      if ( splitsamples <= 0 || splitsamples >= mst->numsamples )
+        continue;
+      
+      if ( ! (split = mst_init (NULL)) )
+        {
+          ms_log (2, "Cannot allocate trace to split at day boundary\n");
+          return;
+        }
+      
+      samplesize = ms_samplesize (mst->sampletype);
+      
+      strcpy (split->network, mst->network);
+      strcpy (split->station, mst->station);
+      strcpy (split->location, mst->location);
+      strcpy (split->channel, mst->channel);
+      split->streamid = mst->streamid;
+      split->dataquality = mst->dataquality;
+      split->type = mst->type;
+      split->samprate = mst->samprate;
+      split->sampletype = mst->sampletype;
+      split->starttime = mst->starttime + (hptime_t) (splitsamples / mst->samprate * HPTMODULUS + 0.5);
+      split->endtime = mst->endtime;
+      split->numsamples = mst->numsamples - splitsamples;
+      split->samplecnt = split->numsamples;
+      
+      if ( ! (split->datasamples = malloc ((size_t) (split->numsamples * samplesize))) )
+        {
+          ms_log (2, "Cannot allocate trace to split at day boundary\n");
+          mst_free (&split);
+          return;
+        }
+      
+      memcpy (split->datasamples, (char *) mst->datasamples + splitsamples * samplesize,
+              (size_t) (split->numsamples * samplesize));
+      
+      mst->numsamples = splitsamples;
+      mst->samplecnt = splitsamples;
+      mst->endtime = mst->starttime + (hptime_t) ((splitsamples - 1) / mst->samprate * HPTMODULUS + 0.5);
+      mst->datasamples = realloc (mst->datasamples, (size_t) (splitsamples * samplesize));
+      forgetsamples (mst);
+      
+      split->next = mst->next;
+      mst->next = split;
+      mstg->numtraces++;
+    }
+}  /* End of splitdays() */
+
+
+/***************************************************************************
+ * marktraces:
+ *
+ * Note the end times of the traces in a group.
+ *
+ * Returns an allocated array of the trace marks, NULL if there are no
+ * traces or on allocation failure.
+ ***************************************************************************/
+static struct tracemark *
+marktraces (MSTraceGroup *mstg, int *count)
+{
+  struct tracemark *marks;
+  MSTrace *mst;
+  int idx = 0;
+  
+  *count = 0;
+  
+  if ( mstg->numtraces <= 0 )
+    return NULL;
+  
+  if ( ! (marks = (struct tracemark *) malloc (mstg->numtraces * sizeof(struct tracemark))) )
+    {
+      ms_log (2, "Cannot allocate memory for trace marks\n");
+      return NULL;
+    }
+  
+  for ( mst = mstg->traces; mst && idx < mstg->numtraces; mst = mst->next )
+    {
+      marks[idx].mst = mst;
+      marks[idx].endtime = mst->endtime;
+      marks[idx].streamid = mst_streamid (mst);
+      marks[idx].passed = 0;
+      idx++;
+    }
+  
+  *count = idx;
+  
+  return marks;
+}  /* End of marktraces() */
+
+
+/***************************************************************************
+ * flushstale:
+ *
+ * Flush and remove the traces of a group that have not been extended
+ * since they were marked although the input file just read had later
+ * blocks of their stream, i.e. traces followed by a gap.  Continued and
+ * new traces, and traces of streams without new blocks in the file,
+ * such as those of a file holding only duplicate blocks, are kept open.
+ ***************************************************************************/
+static void
+flushstale (MSTraceGroup *mstg, struct tracemark *marks, int count)
+{
+  MSTrace **pmst;
+  MSTrace *mst;
+  int64_t trpackedsamples = 0;
+  int64_t trpackedrecords = 0;
+  int idx;
+  
+  pmst = &mstg->traces;
+  while ( (mst = *pmst) )
+    {
+      for ( idx = 0; idx < count; idx++ )
+        if ( marks[idx].mst == mst )
+          break;
+      
+      if ( idx >= count || ! marks[idx].passed || marks[idx].endtime != mst->endtime )
+        {
+          pmst = &mst->next;
+          continue;
+        }
+      
+      if ( mst->numsamples > 0 )
+        {
+          trpackedrecords = packtrace (mst, &trpackedsamples, 1);
+          if ( trpackedrecords < 0 )
+            {
+              ms_log (2, "Cannot pack data\n");
+            }
+          else
+            {
+              packedrecords += trpackedrecords;
+              packedsamples += trpackedsamples;
+            }
+        }
+      
+      *pmst = mst->next;
+      mst_free (&mst);
+      mstg->numtraces--;
+      packedtraces++;
+    }
+}  /* End of flushstale() */
+
+
+/***************************************************************************
+ * markblock:
+ *
+ * Note a block of the input file being read that is added to the
+ * traces in the marks of the traces of its stream that end before the
+ * block starts.
+ ***************************************************************************/
+static void
+markblock (MSRecord *msr)
+{
+  int idx;
+  
+  for ( idx = 0; idx < ntracemarks; idx++ )
+    if ( msr->streamid && tracemarks[idx].streamid == msr->streamid &&
+         msr->starttime > tracemarks[idx].endtime )
+      tracemarks[idx].passed = 1;
+}  /* End of markblock() */
+
+
 /***************************************************************************
  * mars2group:
  *
@@ -185,20 +814,19 @@ packtraces (flag flush)
  * As the data is read in a MSRecord struct is used as a holder for
  * the input information.
  *
+ * If follow is true, wait for more data at the end of the file until
+ * the program is terminated, forcing records to be flushed if their
+ * oldest sample arrived more than the maximum latency ago.
+ *
  * Returns 0 on success, and -1 on failure
  ***************************************************************************/
 static int
-mars2group (char *mfile, MSTraceGroup *mstg)
+mars2group (char *mfile, MSTraceGroup *mstg, flag follow)
 {
   MSRecord *msr = 0;
-  struct listnode *clp;
   int retval = 0;
-  int truncwarn = 0;
-  char mapped;
   
   marsStream *hMS;
-  int        *hData, *hD, scale;
-  double      gain, totalgain, sample;
   
   /* Open MARS data file */
   if ( ! (hMS = marsStreamOpen(mfile) ) )
@@ -208,7 +836,7 @@ mars2group (char *mfile, MSTraceGroup *mstg)
     }
 
   /* Open .mseed output file if needed */
-  if ( ! ofp && ! parseonly )
+  if ( ! ofp && ! parseonly && ! archivedir )
     {
       char mseedoutputfile[1024];
       snprintf (mseedoutputfile, sizeof(mseedoutputfile), "%s.mseed", mfile);
@@ -217,156 +845,843 @@ mars2group (char *mfile, MSTraceGroup *mstg)
         {
           ms_log (2, "Cannot open output file: %s (%s)\n",
 		  mseedoutputfile, strerror(errno));
+          marsStreamClose ();
           return -1;
         }
     }
   
-  if ( ! (msr = msr_init(msr)) )
-    {
-      ms_log (2, "Cannot initialize MSRecord strcture\n");
-      return -1;
-    }
+  if ( ! (msr = msr_init(msr)) )
+    {
+      ms_log (2, "Cannot initialize MSRecord strcture\n");
+      marsStreamClose ();
+      return -1;
+    }
+  
+  if ( follow )
+    hMS->status |= msStreamFollow;
+  
+  /* Note the traces carried from previous files to detect those not continued */
+  if ( continuestreams && ! parseonly )
+    tracemarks = marktraces (mstg, &ntracemarks);
+  
+  /* Loop over MARS blocks */
+  for (;;)
+    {
+      if ( (hMS = marsStreamGetNextBlock(verbose)) == NULL )
+	{
+	  /* Wait for more data if following the input */
+	  if ( follow && followwait () )
+	    continue;
+	  
+	  break;
+	}
+      
+      block2group (hMS, msr, mfile, follow);
+    }
+  
+  /* Release blocks held for reordering unless streams continue to the next file */
+  if ( (reorderblocks || reorderseconds > 0.0) && ! continuestreams && ! parseonly )
+    reorder_flush (addrecord, &follow);
+  
+  /* Flush data buffers after each file, or only the traces not continued */
+  if ( continuestreams && ! parseonly )
+    {
+      flushstale (mstg, tracemarks, ntracemarks);
+    }
+  else if ( ! bufferall && ! parseonly )
+    {
+      packtraces (1);
+      packedtraces += mstg->numtraces;
+      mst_initgroup (mstg);
+    }
+  
+  if ( tracemarks )
+    free (tracemarks);
+  tracemarks = 0;
+  ntracemarks = 0;
+  
+  if ( ofp  && ! outputfile )
+    {
+      fclose (ofp);
+      ofp = 0;
+    }
+  
+  marsStreamClose ();
+  
+  if ( msr )
+    msr_free (&msr);
+  
+  return retval;
+}  /* End of mars2group() */
+
+/***************************************************************************
+ * mergefiles:
+ *
+ * Read the blocks of multiple MARS data files in time order and add
+ * them to the MSTraceGroup.  The files are read concurrently, the next
+ * block is always taken from the file whose current block has the
+ * earliest time using a min-heap of the open files.  Ties are broken
+ * by channel and then by the order of the input files.
+ *
+ * If window is greater than 0 at most that many files are open at
+ * once, the next file in the list is opened when one is exhausted.
+ * Blocks of files opened later are only ordered with those of the
+ * files open at the same time.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+mergefiles (struct listnode *files, int window)
+{
+  struct mergeinput *heap = 0;
+  marsStream *streams = 0;
+  struct listnode *flp;
+  MSRecord *msr = 0;
+  flag follow = 0;
+  int count = 0;
+  int order = 0;
+  int idx;
+  
+  if ( window <= 0 )
+    for ( flp = files; flp; flp = flp->next )
+      window++;
+  
+  if ( window <= 0 )
+    return 0;
+  
+  if ( ! (heap = (struct mergeinput *) malloc (window * sizeof(struct mergeinput))) ||
+       ! (streams = (marsStream *) calloc (window, sizeof(marsStream))) ||
+       ! (msr = msr_init (NULL)) )
+    {
+      ms_log (2, "Cannot allocate memory for merging input files\n");
+      if ( heap ) free (heap);
+      if ( streams ) free (streams);
+      return -1;
+    }
+  
+  /* Open the first files, each stream slot is used by one open file at a time */
+  flp = files;
+  for ( idx = 0; idx < window && flp; flp = flp->next, order++ )
+    {
+      if ( verbose )
+	ms_log (1, "Reading %s\n", flp->data);
+      
+      if ( ! marsStreamOpen_r (&streams[idx], flp->data) )
+	{
+	  ms_log (2, "Cannot open input file: %s (%s)\n", flp->data, strerror(errno));
+	  continue;
+	}
+      
+      if ( ! marsStreamGetNextBlock_r (&streams[idx], verbose) )
+	{
+	  marsStreamClose_r (&streams[idx]);
+	  continue;
+	}
+      
+      heap[count].hMS = &streams[idx];
+      heap[count].order = order;
+      count++;
+      idx++;
+    }
+  
+  for ( idx = count / 2 - 1; idx >= 0; idx-- )
+    mergesift (heap, count, idx);
+  
+  /* Convert the earliest block and advance its file */
+  while ( count > 0 )
+    {
+      block2group (heap[0].hMS, msr, heap[0].hMS->name, 0);
+      
+      if ( ! marsStreamGetNextBlock_r (heap[0].hMS, verbose) )
+	{
+	  marsStreamClose_r (heap[0].hMS);
+	  
+	  /* Replace the exhausted file with the next file in the list */
+	  while ( flp )
+	    {
+	      if ( verbose )
+		ms_log (1, "Reading %s\n", flp->data);
+	      
+	      heap[0].order = order++;
+	      
+	      if ( ! marsStreamOpen_r (heap[0].hMS, flp->data) )
+		{
+		  ms_log (2, "Cannot open input file: %s (%s)\n", flp->data, strerror(errno));
+		  flp = flp->next;
+		  continue;
+		}
+	      
+	      flp = flp->next;
+	      
+	      if ( marsStreamGetNextBlock_r (heap[0].hMS, verbose) )
+		break;
+	      
+	      marsStreamClose_r (heap[0].hMS);
+	    }
+	  
+	  /* Remove the file from the heap if no replacement was opened */
+	  if ( ! heap[0].hMS->hf )
+	    heap[0] = heap[--count];
+	}
+      
+      mergesift (heap, count, 0);
+    }
+  
+  /* Release blocks held for reordering */
+  if ( (reorderblocks || reorderseconds > 0.0) && ! parseonly )
+    reorder_flush (addrecord, &follow);
+  
+  msr_free (&msr);
+  free (streams);
+  free (heap);
+  
+  return 0;
+}  /* End of mergefiles() */
+
+
+/***************************************************************************
+ * mergebefore:
+ *
+ * Returns 1 if the current block of merge input a is to be read before
+ * that of merge input b and 0 otherwise.
+ ***************************************************************************/
+static int
+mergebefore (struct mergeinput *a, struct mergeinput *b)
+{
+  if ( mbGetTime(a->hMS->block) != mbGetTime(b->hMS->block) )
+    return ( mbGetTime(a->hMS->block) < mbGetTime(b->hMS->block) );
+  
+  if ( mbGetChan(a->hMS->block) != mbGetChan(b->hMS->block) )
+    return ( mbGetChan(a->hMS->block) < mbGetChan(b->hMS->block) );
+  
+  return ( a->order < b->order );
+}  /* End of mergebefore() */
+
+
+/***************************************************************************
+ * mergesift:
+ *
+ * Move a merge input down the min-heap to its place.
+ ***************************************************************************/
+static void
+mergesift (struct mergeinput *heap, int count, int idx)
+{
+  struct mergeinput entry;
+  int child;
+  
+  while ( (child = 2 * idx + 1) < count )
+    {
+      if ( child + 1 < count && mergebefore (&heap[child + 1], &heap[child]) )
+	child++;
+      
+      if ( ! mergebefore (&heap[child], &heap[idx]) )
+	break;
+      
+      entry = heap[idx];
+      heap[idx] = heap[child];
+      heap[child] = entry;
+      idx = child;
+    }
+}  /* End of mergesift() */
+
+
+/***************************************************************************
+ * blockcodes:
+ *
+ * Set the network, station, location and channel codes of a MARS block
+ * in the MSRecord along with the interned stream ID of the codes.  The
+ * codes are resolved once per MARS station and channel number and
+ * reused for later blocks.
+ ***************************************************************************/
+static void
+blockcodes (char *block, MSRecord *msr)
+{
+  static struct {
+    char     marsstation[16];   /* MARS station code of the block */
+    char     network[11];
+    char     station[11];
+    char     location[11];
+    char     channel[11];
+    int32_t  streamid;
+  } chancodes[256];
+  struct listnode *clp;
+  char *marsstation;
+  char mapped;
+  int chan;
+  
+  chan = (int) mbGetChan(block);
+  marsstation = mbGetStationCode(block);
+  
+  if ( chan >= 0 && chan < 256 && chancodes[chan].streamid &&
+       ! strcmp (chancodes[chan].marsstation, marsstation) )
+    {
+      strcpy (msr->network, chancodes[chan].network);
+      strcpy (msr->station, chancodes[chan].station);
+      strcpy (msr->location, chancodes[chan].location);
+      strcpy (msr->channel, chancodes[chan].channel);
+      msr->streamid = chancodes[chan].streamid;
+      return;
+    }
+  
+  ms_strncpclean (msr->network, forcenet, 2);
+  if ( forcesta ) ms_strncpclean (msr->station, forcesta, 5);
+  else ms_strncpclean (msr->station, marsstation, 5);
+  ms_strncpclean (msr->location, forceloc, 2);
+  
+  /* Transmogrify the channel numbers to channel codes first
+     using any custom mappings, then pre-defined mappings and
+     finally just copy. */
+  mapped = 0;
+  if ( chanlist )
+    {
+      clp = chanlist;
+      while ( clp != 0 )
+	{
+	  if ( *(clp->key) == ('0' + chan) )
+	    {
+	      strncpy (msr->channel, clp->data, 10);
+	      mapped = 1;
+	      break;
+	    }
+  
+	  clp = clp->next;
+	}
+    }
+  if ( ! mapped && transchan >= 0 && transchan <= 4 )
+    {
+      snprintf (msr->channel, 10, "%s",
+		transmatrix[transchan][chan]);	      
+      mapped = 1;
+    }
+  if ( ! mapped )
+    {
+      snprintf (msr->channel, 10, "%d", chan);
+    }
+  
+  msr->streamid = 0;
+  
+  if ( chan >= 0 && chan < 256 && strlen (marsstation) < sizeof(chancodes[chan].marsstation) &&
+       msr_streamid (msr) )
+    {
+      strcpy (chancodes[chan].marsstation, marsstation);
+      strcpy (chancodes[chan].network, msr->network);
+      strcpy (chancodes[chan].station, msr->station);
+      strcpy (chancodes[chan].location, msr->location);
+      strcpy (chancodes[chan].channel, msr->channel);
+      chancodes[chan].streamid = msr->streamid;
+    }
+}  /* End of blockcodes() */
+
+
+/***************************************************************************
+ * block2group:
+ *
+ * Decode and scale the samples of a MARS block and add them to the
+ * MSTraceGroup, packing whatever can be packed if not buffering all
+ * data.  When possible the samples are decoded directly into the end
+ * of the trace the block continues, avoiding a copy.  The MSRecord is
+ * used as a holder for the block information and is reset before
+ * returning.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+block2group (marsStream *hMS, MSRecord *msr, char *mfile, flag follow)
+{
+  static int decodebuffer[marsBlockSamples];
+  MSTrace *mst = 0;
+  MSTrace *tmst;
+  flag whence;
+  int dedup;
+  
+  int        *hData, scale;
+  double      gain, totalgain, truncsample;
+  
+  if ( verbose >= 4 )
+    marsStreamDumpBlock (hMS);
+  
+  if ( verbose >= 2 )
+    ms_log (1, "MB sta='%s' chan=%d samprate=%g scale=%d time=%d c2uV=%d maxamp=%d\n",
+	    mbGetStationCode(hMS->block), mbGetChan(hMS->block),
+	    mbGetSampRate(hMS->block), mbGetScale(hMS->block),
+	    mbGetTime(hMS->block),
+	    marsBlockGetScaleFactor(hMS->block), mbGetMaxamp(hMS->block));
+  
+  /* Skip blocks already read from this or an earlier input file */
+  if ( dedupblocks )
+    {
+      dedup = dedup_check (mbGetStationCode(hMS->block), mbGetChan(hMS->block),
+			   mbGetTime(hMS->block), hMS->block, marsBlockSize);
+  
+      if ( dedup == DEDUP_DUPLICATE )
+	{
+	  if ( verbose >= 2 )
+	    ms_log (1, "Skipping duplicate block for sta='%s' chan=%d time=%d\n",
+		    mbGetStationCode(hMS->block), mbGetChan(hMS->block),
+		    mbGetTime(hMS->block));
+	  duplicateblocks++;
+	  return 0;
+	}
+      else if ( dedup == DEDUP_CONFLICT )
+	{
+	  ms_log (1, "Warning: [%s] block for sta='%s' chan=%d time=%d differs from an earlier block\n",
+		  mfile, mbGetStationCode(hMS->block), mbGetChan(hMS->block),
+		  mbGetTime(hMS->block));
+	  conflictblocks++;
+	}
+    }
+  
+  /* Only check that the samples can be decoded if not writing Mini-SEED */
+  if ( parseonly )
+    return ( marsBlockDecodeData (hMS->block, &scale) ) ? 0 : -1;
+  
+  /* Populate a MSRecord with the block information */
+  msr->numsamples = marsBlockSamples;
+  msr->samplecnt = marsBlockSamples;
+  msr->sampletype = 'i';
+  msr->samprate = mbGetSampRate(hMS->block);
+  
+  blockcodes (hMS->block, msr);
+  
+  /* Scale data samples, some potential gain values can result in non-integer samples */
+  gain = marsBlockGetGain(hMS->block);
+  
+  totalgain = gain * scaling;
+  
+  if ( verbose >= 2 )
+    ms_log (1, "Applying gain: %f c/uV and scaling: %d for total: %f\n",
+	    gain, scaling, totalgain);
+  
+  /* Decode directly into the end of the trace this block most likely
+     continues when adding to the MSTraceGroup data buffer directly */
+  if ( ! memlimit && ! compressbuf && ! reorderblocks && reorderseconds <= 0.0 )
+    {
+      for ( tmst = mstg->traces; tmst; tmst = tmst->next )
+	if ( tmst->sampletype == 'i' && tmst->samprate == msr->samprate &&
+	     msr->streamid && mst_streamid (tmst) == msr->streamid &&
+	     ( ! mst || tmst->endtime > mst->endtime ) )
+	  mst = tmst;
+    }
+  
+  if ( mst )
+    {
+      if ( ! (hData = (int *) reservesamples (mst, marsBlockSamples)) )
+	{
+	  ms_log (2, "[%s] Cannot allocate memory for samples\n", mfile);
+	  msr = msr_init (msr);
+	  return -1;
+	}
+    }
+  else
+    {
+      hData = decodebuffer;
+    }
+  
+  /* Decode and apply gain & scaling to data samples */
+  if ( marsBlockDecodeScaled (hMS->block, hData, totalgain, &truncsample) < 0 )
+    {
+      msr = msr_init (msr);
+      return -1;
+    }
+  
+  if ( truncsample != 0.0 )
+    {
+      ms_log (1, "WARNING: sample value truncation occurring, change scaling\n");
+      ms_log (1, "  Sample: %f, scaling: %d, gain: %g, total gain: %f\n",
+	      truncsample, scaling, gain, totalgain);
+    }
+  
+  /* The start time is known after decoding, which corrects MARS-88 block times */
+  msr->starttime = MS_EPOCH2HPTIME (mbGetTime(hMS->block));
+  
+  /* Keep the samples to verify the records packed from them */
+  if ( verifyoutput )
+    verify_block (msr, (int32_t *) hData, mfile, (int64_t) hMS->offset - marsBlockSize);
+  
+  /* If MARS88, check for a valid time lag and warn that it's not applied */
+  if ( mbGetBlockFormat(hMS->block) == DATABLK_FORMAT )
+    if ( ((m88Head *)(hMS->block))->time.delta != NO_WORD )
+      ms_log (1, "Warning: Time lag of %d ms NOT applied to N: '%s', S: '%s', L: '%s', C: '%s'\n",
+	      ((m88Head *)(hMS->block))->time.delta,
+	      msr->network, msr->station,  msr->location, msr->channel);
+  
+  if ( verbose >= 1 )
+    {
+      ms_log (1, "[%s] %d samps @ %.4f Hz for N: '%s', S: '%s', L: '%s', C: '%s'\n",
+	      mfile, msr->numsamples, msr->samprate,
+	      msr->network, msr->station,  msr->location, msr->channel);
+    }
+  
+  if ( mst )
+    {
+      /* Keep the samples decoded in place if the block continues the trace */
+      if ( mst_findadjacent (mstg, &whence, 0, msr->network, msr->station,
+			     msr->location, msr->channel, msr->samprate, -1.0,
+			     msr->starttime, msr_endtime (msr), -1.0) == mst && whence == 1 )
+	{
+	  if ( tracemarks )
+	    markblock (msr);
+  
+	  /* Update the end time and sample count of the trace */
+	  mst->numsamples += marsBlockSamples;
+	  msr->datasamples = 0;
+	  mst_addmsr (mst, msr, 1);
+	  notesamples (mst);
+  
+	  addedsamples (mst, msr->numsamples, follow);
+  
+	  msr = msr_init (msr);
+	  return 0;
+	}
+  
+      /* Otherwise add a copy of the samples */
+      memcpy (decodebuffer, hData, marsBlockSamples * sizeof(int));
+      hData = decodebuffer;
+    }
+  
+  msr->datasamples = hData;
+  
+  /* Add data to MSTraceGroup, holding it for reordering if requested */
+  if ( reorderblocks || reorderseconds > 0.0 )
+    {
+      if ( reorder_add (msr, addrecord, &follow) < 0 )
+	ms_log (2, "[%s] Cannot add samples to reorder buffer\n", mfile);
+    }
+  else
+    {
+      addrecord (msr, &follow);
+    }
+  
+  /* Cleanup and reset MSRecord state */
+  msr->datasamples = 0;
+  msr = msr_init (msr);
+  
+  return 0;
+}  /* End of block2group() */
+
+
+/***************************************************************************
+ * addrecord:
+ *
+ * Add the samples of a record to the MSTraceGroup data buffer, packing
+ * whatever can be packed if not buffering all data.  The handlerdata
+ * points to a flag that is set when following the input.
+ ***************************************************************************/
+static void
+addrecord (MSRecord *msr, void *handlerdata)
+{
+  MSTrace *mst = 0;
+  flag follow = *((flag *) handlerdata);
+  char srcname[50];
+  
+  /* Note the block for the traces carried from previous files, blocks
+     still held for reordering are only noted once they are released */
+  if ( tracemarks )
+    markblock (msr);
+  
+  /* Add data to MSTraceGroup data buffer, limiting or compressing if requested */
+  if ( memlimit || compressbuf )
+    mst = bufstore_addmsr (mstg, msr);
+  else
+    {
+      mst = mst_addmsrtogroup (mstg, msr, 0, -1.0, -1.0);
+      
+      if ( mst )
+	forgetsamples (mst);
+    }
+  
+  if ( ! mst )
+    ms_log (2, "Cannot add samples of %s to MSTraceGroup\n",
+	    msr_srcname (msr, srcname, 0));
+  
+  addedsamples (mst, msr->numsamples, follow);
+}  /* End of addrecord() */
+
+
+/***************************************************************************
+ * addedsamples:
+ *
+ * Track the arrival of samples added to a trace, which may be NULL if
+ * adding failed, and pack whatever can be packed if not buffering all
+ * data.
+ ***************************************************************************/
+static void
+addedsamples (MSTrace *mst, int64_t numsamples, flag follow)
+{
+  /* Track when samples arrived to limit latency */
+  if ( mst && follow && maxlatency > 0.0 )
+    trackarrival (mst, numsamples, walltime());
+  
+  /* Pack whatever can be packed if not buffering all data */
+  if ( ! bufferall )
+    {
+      packtraces (0);
+    }
+  
+  if ( follow && maxlatency > 0.0 )
+    flushlatent (walltime());
+}  /* End of addedsamples() */
+
+
+
+/***************************************************************************
+ * trackarrival:
+ *
+ * Record the arrival time of samples added to a trace.  If the list of
+ * arrivals is full the samples are counted with the newest arrival,
+ * which can only make a forced flush happen sooner.
+ ***************************************************************************/
+static void
+trackarrival (MSTrace *mst, int64_t samples, double now)
+{
+  struct tracestate *ts;
+  struct arrivals *arr;
+  int idx;
+  
+  if ( ! (ts = tracestate (mst, 1)) )
+    return;
+  
+  arr = &ts->arrivals;
+  arr->added += samples;
+  
+  if ( arr->count < MAXARRIVALS )
+    {
+      idx = (arr->head + arr->count) % MAXARRIVALS;
+      arr->time[idx] = now;
+      arr->count++;
+    }
+  else
+    {
+      idx = (arr->head + arr->count - 1) % MAXARRIVALS;
+    }
+  
+  arr->end[idx] = arr->added;
+}  /* End of trackarrival() */
+
+
+/***************************************************************************
+ * flushlatent:
+ *
+ * Flush the traces that have buffered samples which arrived more than
+ * the maximum latency ago, creating partial records.  The compression
+ * history of the traces is retained.
+ ***************************************************************************/
+static void
+flushlatent (double now)
+{
+  struct tracestate *ts;
+  struct arrivals *arr;
+  MSTrace *mst;
+  int64_t packed;
+  int64_t trpackedsamples = 0;
+  int64_t trpackedrecords = 0;
+  
+  if ( archivedir )
+    splitdays (mstg);
   
-  /* Loop over MARS blocks */
-  while ( (hMS = marsStreamGetNextBlock(verbose)) != NULL )
+  for ( mst = mstg->traces; mst; mst = mst->next )
     {
-      if ( verbose >= 4 )
-	marsStreamDumpBlock (hMS);
+      if ( mst->numsamples <= 0 || ! (ts = tracestate (mst, 0)) )
+	continue;
       
-      if ( verbose >= 2 )
-	ms_log (1, "MB sta='%s' chan=%d samprate=%g scale=%d time=%d c2uV=%d maxamp=%d\n",
-		mbGetStationCode(hMS->block), mbGetChan(hMS->block),
-		mbGetSampRate(hMS->block), mbGetScale(hMS->block),
-		mbGetTime(hMS->block),
-		marsBlockGetScaleFactor(hMS->block), mbGetMaxamp(hMS->block));
+      arr = &ts->arrivals;
       
-      hData = marsBlockDecodeData (hMS->block, &scale);
+      /* Drop arrivals that have been completely packed */
+      packed = ( mst->ststate ) ? mst->ststate->packedsamples : 0;
+      while ( arr->count > 0 && arr->end[arr->head] <= packed )
+	{
+	  arr->head = (arr->head + 1) % MAXARRIVALS;
+	  arr->count--;
+	}
       
-      if ( hData && ! parseonly )
+      if ( arr->count == 0 || (now - arr->time[arr->head]) < maxlatency )
+	continue;
+      
+      trpackedrecords = packtrace (mst, &trpackedsamples, 1);
+      if ( trpackedrecords < 0 )
+	{
+	  ms_log (2, "Cannot pack data\n");
+	}
+      else
 	{
-	  /* Scale data samples, some potential gain values can result in non-integer samples */
-	  gain = marsBlockGetGain(hMS->block);
-	  
-	  totalgain = gain * scaling;
-	  
 	  if ( verbose >= 2 )
-	    ms_log (1, "Applying gain: %f c/uV and scaling: %d for total: %f\n",
-		    gain, scaling, totalgain);
-	  
-	  /* Apply gain & scaling to decoded data samples */
-	  truncwarn = 0;
-	  for ( hD=hData; hD < (hData+marsBlockSamples); hD++)
-	    {
-	      sample = (*hD) * totalgain;
-	      
-	      if ( ! truncwarn && ( sample - (int)sample ))
-		{
-		  ms_log (1, "WARNING: sample value truncation occurring, change scaling\n");
-		  ms_log (1, "  Sample: %f, scaling: %d, gain: %g, total gain: %f\n",
-			  sample, scaling, gain, totalgain);
-		  truncwarn = 1;
-		}
-	      
-	      *hD = (int)sample;
-	    }
-	  
-	  /* Populate a MSRecord and add data to MSTraceGroup */
-	  msr->datasamples = hData;
-	  msr->numsamples = marsBlockSamples;
-	  msr->samplecnt = marsBlockSamples;
-	  msr->sampletype = 'i';
-	  msr->samprate = mbGetSampRate(hMS->block);
-	  msr->starttime = MS_EPOCH2HPTIME (mbGetTime(hMS->block));
-	  
-          ms_strncpclean (msr->network, forcenet, 2);
-	  if ( forcesta ) ms_strncpclean (msr->station, forcesta, 5);
-	  else ms_strncpclean (msr->station, mbGetStationCode(hMS->block), 5);
-          ms_strncpclean (msr->location, forceloc, 2);
-	  
-	  /* Transmogrify the channel numbers to channel codes first
-	     using any custom mappings, then pre-defined mappings and
-	     finally just copy. */
-	  mapped = 0;
-	  if ( chanlist )
-	    {
-	      clp = chanlist;
-	      while ( clp != 0 )
-		{
-		  if ( *(clp->key) == ('0' + (int)mbGetChan(hMS->block)) )
-		    {
-		      strncpy (msr->channel, clp->data, 10);
-		      mapped = 1;
-		      break;
-		    }
-		  
-		  clp = clp->next;
-		}
-	    }
-	  if ( ! mapped && transchan >= 0 && transchan <= 4 )
-	    {
-	      snprintf (msr->channel, 10, "%s",
-			transmatrix[transchan][(int)mbGetChan(hMS->block)]);	      
-	      mapped = 1;
-	    }
-	  if ( ! mapped )
-	    {
-	      snprintf (msr->channel, 10, "%d", mbGetChan(hMS->block));
-	    }
-	  
-	  /* If MARS88, check for a valid time lag and warn that it's not applied */
-	  if ( mbGetBlockFormat(hMS->block) == DATABLK_FORMAT )
-	    if ( ((m88Head *)(hMS->block))->time.delta != NO_WORD )
-	      ms_log (1, "Warning: Time lag of %d ms NOT applied to N: '%s', S: '%s', L: '%s', C: '%s'\n",
-		      ((m88Head *)(hMS->block))->time.delta,
-		      msr->network, msr->station,  msr->location, msr->channel);
-	  
-	  if ( verbose >= 1 )
-	    {
-	      ms_log (1, "[%s] %d samps @ %.4f Hz for N: '%s', S: '%s', L: '%s', C: '%s'\n",
-		      mfile, msr->numsamples, msr->samprate,
-		      msr->network, msr->station,  msr->location, msr->channel);
-	    }
+	    ms_log (1, "Flushed %"PRId64" samples after %.1f seconds\n",
+		    trpackedsamples, now - arr->time[arr->head]);
 	  
-	  /* Add data to MSTraceGroup data buffer */
-	  if ( ! mst_addmsrtogroup (mstg, msr, 0, -1.0, -1.0) )
-	    {
-	      ms_log (2, "[%s] Cannot add samples to MSTraceGroup\n", mfile);
-	    }
-	  
-	  /* Pack whatever can be packed if not buffering all data */
-	  if ( ! bufferall )
-	    {
-	      packtraces (0);
-	    }
-	  
-	  /* Cleanup and reset MSRecord state */
-	  msr->datasamples = 0;
-	  msr = msr_init (msr);
+	  packedrecords += trpackedrecords;
+	  packedsamples += trpackedsamples;
 	}
     }
+}  /* End of flushlatent() */
+
+
+/***************************************************************************
+ * followwait:
+ *
+ * Wait for more data to be appended to the input being followed,
+ * flushing records that exceed the maximum latency and the output
+ * stream in the meantime.
+ *
+ * Returns 1 if following should continue and 0 otherwise.
+ ***************************************************************************/
+static int
+followwait (void)
+{
+  marsStream *hMS = marsStreamGetCurrent ();
+  struct stat fs;
+  double interval = 1.0;
   
-  /* Flush data buffers after each file */
-  if ( ! bufferall && ! parseonly )
-    {
-      packtraces (1);
-      packedtraces += mstg->numtraces;
-      mst_initgroup (mstg);
-    }
+  if ( maxlatency > 0.0 )
+    flushlatent (walltime());
   
-  if ( ofp  && ! outputfile )
+  if ( ofp )
+    fflush (ofp);
+  
+  if ( archivedir )
+    archive_flush ();
+  
+  if ( stopsignal )
+    return 0;
+  
+  /* The end of a pipe is the end of the data */
+  if ( msCheckStatus(hMS->status, msStreamPipe) )
+    return 0;
+  
+  if ( fstat (fileno(hMS->hf), &fs) == 0 && fs.st_size < (hMS->offset + (off_t)hMS->fill) )
     {
-      fclose (ofp);
-      ofp = 0;
+      ms_log (1, "Input file %s was truncated, not following further\n", hMS->name);
+      return 0;
     }
   
-  if ( hMS )
-    marsStreamClose();
+  /* Poll often enough to honor the maximum latency */
+  if ( maxlatency > 0.0 && maxlatency < 4.0 )
+    interval = ( maxlatency < 0.2 ) ? 0.05 : maxlatency / 4.0;
   
-  if ( msr )
-    msr_free (&msr);
+  /* Print messages buffered for the log writer before waiting */
+  ms_logflush ();
+  
+#if defined(LMP_WIN)
+  Sleep ((DWORD) (interval * 1000));
+#else
+  {
+    struct timespec ts;
+    ts.tv_sec = (time_t) interval;
+    ts.tv_nsec = (long) ((interval - ts.tv_sec) * 1e9);
+    nanosleep (&ts, NULL);
+  }
+#endif
+  
+  return ( stopsignal ) ? 0 : 1;
+}  /* End of followwait() */
+
+
+/***************************************************************************
+ * walltime:
+ *
+ * Returns the current time in seconds since the epoch.
+ ***************************************************************************/
+static double
+walltime (void)
+{
+#if defined(LMP_WIN)
+  struct _timeb tb;
+  
+  _ftime (&tb);
+  
+  return (double) tb.time + tb.millitm / 1000.0;
+#else
+  struct timeval tv;
+  
+  gettimeofday (&tv, NULL);
+  
+  return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}  /* End of walltime() */
+
+
+/***************************************************************************
+ * term_handler:
+ *
+ * Signal handler to stop following or watching input.
+ ***************************************************************************/
+static void
+term_handler (int sig)
+{
+  stopsignal = 1;
+}  /* End of term_handler() */
+
+
+/***************************************************************************
+ * watch_handler:
+ *
+ * Convert a file that arrived in the watched directory, reusing the
+ * trace group, output stream and packing state of the process.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+watch_handler (char *mfile, void *handlerdata)
+{
+  int retval;
+  
+  if ( verbose )
+    ms_log (1, "Reading %s\n", mfile);
+  
+  retval = mars2group (mfile, mstg, 0);
+  
+  /* Make the output of each file available as soon as it is converted */
+  if ( ofp )
+    fflush (ofp);
+  
+  if ( archivedir )
+    archive_flush ();
   
   return retval;
-}  /* End of mars2group() */
+}  /* End of watch_handler() */
+
+
+/***************************************************************************
+ * outputname:
+ *
+ * Determine the output an input file is converted into: the archive,
+ * the output file or the input file name with a .mseed suffix.
+ *
+ * Returns a pointer to the buffer holding the name.
+ ***************************************************************************/
+static char *
+outputname (char *mfile, char *buffer, size_t size)
+{
+  if ( archivedir )
+    snprintf (buffer, size, "%s", archivedir);
+  else if ( outputfile )
+    snprintf (buffer, size, "%s", outputfile);
+  else
+    snprintf (buffer, size, "%s.mseed", mfile);
+  
+  return buffer;
+}  /* End of outputname() */
+
+
+/***************************************************************************
+ * inputsunchanged:
+ *
+ * Check whether all input files are unchanged since they were
+ * converted into the output file according to the manifest.  Input
+ * from stdin is never unchanged.
+ *
+ * Returns 1 if all input files are unchanged and 0 otherwise.
+ ***************************************************************************/
+static flag
+inputsunchanged (void)
+{
+  struct listnode *flp;
+  
+  for ( flp = filelist; flp; flp = flp->next )
+    if ( ! strcmp (flp->data, "-") || ! manifest_unchanged (flp->data, outputfile) )
+      return 0;
+  
+  return 1;
+}  /* End of inputsunchanged() */
 
 
 /***************************************************************************
@@ -405,6 +1720,79 @@ parameter_proc (int argcount, char **argvec)
 	{
 	  bufferall = 1;
 	}
+      else if (strcmp (argvec[optind], "-C") == 0)
+	{
+	  continuestreams = 1;
+	}
+      else if (strcmp (argvec[optind], "-d") == 0)
+	{
+	  dedupblocks = 1;
+	}
+      else if (strcmp (argvec[optind], "--verify") == 0)
+	{
+	  verifyoutput = 1;
+	}
+      else if (strcmp (argvec[optind], "-m") == 0)
+	{
+	  mergewindow = strtol (getoptval(argcount, argvec, optind++), NULL, 10);
+	}
+      else if (strcmp (argvec[optind], "-I") == 0)
+	{
+	  manifestfile = getoptval(argcount, argvec, optind++);
+	}
+      else if (strcmp (argvec[optind], "-R") == 0)
+	{
+	  char *window = getoptval(argcount, argvec, optind++);
+	  char *endptr = 0;
+	  double value = strtod (window, &endptr);
+	  
+	  if ( endptr != window && (*endptr == 's' || *endptr == 'S') && *(endptr+1) == '\0' )
+	    reorderseconds = value;
+	  else if ( endptr != window && *endptr == '\0' && value == (int) value )
+	    reorderblocks = (int) value;
+	  
+	  if ( reorder_init (reorderblocks, reorderseconds) )
+	    {
+	      ms_log (2, "Cannot parse reorder window, specify blocks or seconds with an s suffix: %s\n", window);
+	      exit (1);
+	    }
+	}
+      else if (strcmp (argvec[optind], "-j") == 0)
+	{
+	  packthreads = strtol (getoptval(argcount, argvec, optind++), NULL, 10);
+	}
+      else if (strcmp (argvec[optind], "-M") == 0)
+	{
+	  memlimit = getbytesval (getoptval(argcount, argvec, optind++));
+	}
+      else if (strcmp (argvec[optind], "-Z") == 0)
+	{
+	  compressbuf = 1;
+	}
+      else if (strcmp (argvec[optind], "-F") == 0)
+	{
+	  followmode = 1;
+	}
+      else if (strcmp (argvec[optind], "-L") == 0)
+	{
+	  maxlatency = strtod (getoptval(argcount, argvec, optind++), NULL);
+	}
+      else if (strcmp (argvec[optind], "-W") == 0)
+	{
+	  watchdir = getoptval(argcount, argvec, optind++);
+	}
+      else if (strcmp (argvec[optind], "-D") == 0)
+	{
+	  donedir = getoptval(argcount, argvec, optind++);
+	}
+      else if (strcmp (argvec[optind], "-A") == 0)
+	{
+	  archivedir = getoptval(argcount, argvec, optind++);
+	}
+      else if (strcmp (argvec[optind], "-a") == 0)
+	{
+	  appendmode = 1;
+	}
       else if (strcmp (argvec[optind], "-s") == 0)
 	{
 	  forcesta = getoptval(argcount, argvec, optind++);
@@ -458,14 +1846,135 @@ parameter_proc (int argcount, char **argvec)
     }
 
   /* Make sure an output file was specified if buffering all input */
-  if ( bufferall && ! outputfile )
+  if ( bufferall && ! outputfile && ! archivedir )
     {
       ms_log (2, "Need to specify output file with -o if using -B\n");
       exit (1);
     }
   
+  /* Continued streams span input files and so need a single output */
+  if ( continuestreams && bufferall )
+    {
+      ms_log (2, "Continuing streams with -C cannot be combined with -B\n");
+      exit (1);
+    }
+  if ( continuestreams && ! outputfile && ! archivedir && ! parseonly )
+    {
+      ms_log (2, "Need to specify output file with -o or -A if using -C\n");
+      exit (1);
+    }
+  
+  /* Merged input files are read together into a single output */
+  if ( mergewindow >= 0 && (followmode || watchdir || continuestreams) )
+    {
+      ms_log (2, "Merging input files with -m cannot be combined with -F, -W or -C\n");
+      exit (1);
+    }
+  if ( mergewindow >= 0 && ! outputfile && ! archivedir && ! parseonly )
+    {
+      ms_log (2, "Need to specify output file with -o or -A if using -m\n");
+      exit (1);
+    }
+  
+  /* The manifest records input files converted one at a time into
+     outputs that can be rebuilt, archive day files are shared */
+  if ( manifestfile && (mergewindow >= 0 || watchdir || archivedir) )
+    {
+      ms_log (2, "A manifest with -I cannot be combined with -m, -W or -A\n");
+      exit (1);
+    }
+  if ( manifestfile && outputfile && ! strcmp (outputfile, "-") )
+    {
+      ms_log (2, "A manifest with -I cannot be combined with output to stdout\n");
+      exit (1);
+    }
+  
+  /* Make sure a memory limit or compression is only used when buffering all input */
+  if ( memlimit < 0 )
+    {
+      ms_log (2, "Cannot parse memory limit, specify bytes with optional K, M or G suffix\n");
+      exit (1);
+    }
+  if ( memlimit && ! bufferall )
+    {
+      ms_log (2, "Memory limit with -M only applies when buffering with -B\n");
+      exit (1);
+    }
+  if ( compressbuf && ! bufferall )
+    {
+      ms_log (2, "Compression with -Z only applies when buffering with -B\n");
+      exit (1);
+    }
+  
+  /* Stored data is merged back into traces while packing serially */
+  if ( memlimit && packthreads > 1 )
+    {
+      ms_log (2, "Memory limit with -M cannot be combined with -j\n");
+      exit (1);
+    }
+  if ( compressbuf && packthreads > 1 )
+    {
+      ms_log (2, "Compression with -Z cannot be combined with -j\n");
+      exit (1);
+    }
+  
+  /* Following input emits records as data arrives, not with buffering */
+  if ( followmode && bufferall )
+    {
+      ms_log (2, "Following input with -F cannot be combined with -B\n");
+      exit (1);
+    }
+  if ( maxlatency < 0.0 || (maxlatency > 0.0 && ! followmode) )
+    {
+      ms_log (2, "Maximum latency with -L must be positive and requires -F\n");
+      exit (1);
+    }
+  
+  /* Watching a directory converts and releases each file as it arrives */
+  if ( watchdir && (bufferall || followmode || parseonly) )
+    {
+      ms_log (2, "Watching a directory with -W cannot be combined with -B, -F or -p\n");
+      exit (1);
+    }
+  if ( donedir && ! watchdir )
+    {
+      ms_log (2, "Moving converted inputs with -D requires -W\n");
+      exit (1);
+    }
+  
+  /* Archive output replaces the output file, stored data is not split by day */
+  if ( archivedir && outputfile )
+    {
+      ms_log (2, "Archive output with -A cannot be combined with -o\n");
+      exit (1);
+    }
+  if ( appendmode && ! archivedir )
+    {
+      ms_log (2, "Appending with -a requires archive output with -A\n");
+      exit (1);
+    }
+  if ( archivedir && (memlimit || compressbuf) )
+    {
+      ms_log (2, "Archive output with -A cannot be combined with -M or -Z\n");
+      exit (1);
+    }
+  
+  /* Verification compares the records written with the MARS samples */
+  if ( verifyoutput && parseonly )
+    {
+      ms_log (2, "Verifying with --verify cannot be combined with -p\n");
+      exit (1);
+    }
+  
+  /* Sanity check the packing thread count */
+  if ( packthreads < 1 )
+    {
+      ms_log (2, "Number of packing threads must be at least 1\n");
+      exit (1);
+    }
+  
   /* Make sure an input files were specified */
-  if ( filelist == 0 )
+  if ( filelist == 0 && ! watchdir )
     {
       ms_log (2, "No input files were specified\n\n");
       ms_log (1, "%s version %s\n\n", PACKAGE, VERSION);
@@ -512,6 +2021,19 @@ parameter_proc (int argcount, char **argvec)
         }
     }
   
+  /* Make sure an output file was specified if reading from stdin */
+  if ( ! outputfile && ! archivedir && ! parseonly )
+    {
+      struct listnode *flp;
+      
+      for ( flp = filelist; flp; flp = flp->next )
+	if ( strcmp (flp->data, "-") == 0 )
+	  {
+	    ms_log (2, "Need to specify output file with -o if reading from stdin\n");
+	    exit (1);
+	  }
+    }
+  
   return 0;
 }  /* End of parameter_proc() */
 
@@ -551,6 +2073,40 @@ getoptval (int argcount, char **argvec, int argopt)
 }  /* End of getoptval() */
 
 
+/***************************************************************************
+ * getbytesval:
+ * Convert a size in bytes with an optional K, M or G suffix (powers
+ * of 1024) to a number of bytes.
+ *
+ * Returns number of bytes on success and -1 on error.
+ ***************************************************************************/
+static int64_t
+getbytesval (char *value)
+{
+  int64_t bytes;
+  char *suffix = NULL;
+
+  bytes = strtoll (value, &suffix, 10);
+
+  if ( suffix == value || bytes < 0 )
+    return -1;
+
+  if ( *suffix == 'K' || *suffix == 'k' )
+    bytes *= 1024;
+  else if ( *suffix == 'M' || *suffix == 'm' )
+    bytes *= 1024 * 1024;
+  else if ( *suffix == 'G' || *suffix == 'g' )
+    bytes *= 1024 * 1024 * 1024;
+  else if ( *suffix != '\0' )
+    return -1;
+
+  if ( *suffix && *(suffix+1) != '\0' )
+    return -1;
+
+  return bytes;
+}  /* End of getbytesval() */
+
+
 /***************************************************************************
  * readlistfile:
  * Read a list of files from a file and add them to the filelist for
@@ -707,11 +2263,21 @@ addmapnode (struct listnode **listroot, char *mapping)
 
 /***************************************************************************
  * record_handler:
- * Saves passed records to the output file.
+ * Saves passed records to the output file, queueing a copy for
+ * verification if requested.
  ***************************************************************************/
 static void
 record_handler (char *record, int reclen, void *handlerdata)
 {
+  if ( verifyoutput )
+    verify_record (record, reclen);
+  
+  if ( archivedir )
+    {
+      archive_write (record, reclen);
+      return;
+    }
+  
   if ( fwrite(record, reclen, 1, ofp) != 1 )
     {
       ms_log (2, "Cannot write to output file\n");
@@ -736,6 +2302,25 @@ usage (void)
 	   " -v             Be more verbose, multiple flags can be used\n"
 	   " -p             Parse MARS data only, do not write Mini-SEED\n"
 	   " -B             Buffer data in memory before packing\n"
+	   " -C             Continue streams across input files, flush only at gaps\n"
+	   " -d             Skip duplicate MARS blocks, report conflicting blocks\n"
+	   " --verify       Unpack written records in a separate thread and compare\n"
+	   "                  them with the MARS samples, report mismatched blocks\n"
+	   " -m window      Merge blocks of input files in time order, reading up to\n"
+	   "                  window files at once, 0 to read all files at once\n"
+	   " -I manifest    Record converted input files in manifest and skip\n"
+	   "                  input files unchanged since an earlier run\n"
+	   " -R window      Reorder blocks arriving out of time order per channel,\n"
+	   "                  window in blocks or seconds with an s suffix\n"
+	   " -j threads     Pack buffered traces in parallel using threads, default: 1\n"
+	   " -M bytes       Limit memory for buffered data, spill to temporary files\n"
+	   "                  bytes may have a K, M or G suffix, e.g. '-M 2G'\n"
+	   " -Z             Keep buffered data compressed in memory\n"
+	   " -F             Follow the last input file, converting data as it is appended\n"
+	   " -L seconds     Maximum latency when following, flush partial records\n"
+	   " -W dir         Watch directory for new input files, convert them as they arrive\n"
+	   " -D dir         Move converted files from the watched directory to dir,\n"
+	   "                  default is to rename them with a .done suffix\n"
 	   " -s stacode     Force the SEED station code, default is from input data\n"
 	   " -n netcode     Force the SEED network code, default is blank\n"
 	   " -l loccode     Force the SEED location code, default is blank\n"
@@ -743,6 +2328,8 @@ usage (void)
 	   " -e encoding    Specify SEED encoding format for packing, default: 11 (Steim2)\n"
 	   " -b byteorder   Specify byte order for packing, MSBF: 1 (default), LSBF: 0\n"
 	   " -o outfile     Specify the output file, default is <inputfile>.mseed\n"
+	   " -A dir         Write records to an SDS archive in dir, split at day boundaries\n"
+	   " -a             Append to archive files, completing their last records\n"
 	   " -g scaling     Specify scaling for output data samples:\n"
 	   "                   1->1000nV, 2->500nV, 4->250nV, 8->125nV (default), 10->100nV\n" 
 	   " -t chanset     Transmogrify channel numbers to common channel codes:\n"
@@ -755,7 +2342,7 @@ usage (void)
 	   " -T #=chan      Specify custom channel number to codes mapping\n"
 	   "                  e.g.: '-T 0=LLZ -T 1=LLN -T 2=LLZ'\n"
 	   "\n"
-	   " file(s)        File(s) of MARS input data\n"
+	   " file(s)        File(s) of MARS input data, '-' reads from standard input\n"
 	   "                  If a file is prefixed with an '@' it is assumed to contain\n"
            "                  a list of data files to be read, one file  per line.\n"
 	   "\n"
@@ -35,9 +35,15 @@ Backup revision
 
 #include <libmseed.h>
 
+#if defined(LMP_WIN)
+  #include <io.h>
+  #include <fcntl.h>
+#endif
+
 #include "marsio.h"
 
 static marsStream MS;
+static char *stdinbuf = NULL;
 static int m88BlockDecodedData[marsBlockSamples];
 static char mbNameBuf[64];
 
@@ -197,7 +203,17 @@ double marsBlockGetGain (char *blk)
 
 int *marsBlockDecodeData (char *block, int *scale)
 {
-  int *data=m88BlockDecodedData;
+  if ( marsBlockDecodeData_r (block, m88BlockDecodedData, scale) < 0 )
+    return NULL;
+  
+  return m88BlockDecodedData;
+}
+
+
+/* Decode the samples of a block into caller provided memory for
+ * marsBlockSamples samples, returns the number of samples or -1 */
+int marsBlockDecodeData_r (char *block, int *data, int *scale)
+{
   m88Block *buf=(m88Block *)block;
   
   int    i;
@@ -316,10 +332,40 @@ int *marsBlockDecodeData (char *block, int *scale)
     
   default:
     ms_log (2, "marsBlockDecodeData(): illegal data format %d\n", data_format);
-    return NULL;
+    return -1;
   }
 
-  return data;
+  return marsBlockSamples;
+}
+
+
+/* Decode the samples of a block into caller provided memory and apply
+ * a total gain, the first sample value truncated to an integer is
+ * returned in truncsample if not NULL, 0 if none.  Returns the number
+ * of samples or -1 */
+int marsBlockDecodeScaled (char *block, int *data, double totalgain, double *truncsample)
+{
+  double sample;
+  int    scale;
+  int    i;
+  
+  if ( truncsample )
+    *truncsample = 0.0;
+  
+  if ( marsBlockDecodeData_r (block, data, &scale) < 0 )
+    return -1;
+  
+  for (i = 0; i < marsBlockSamples; i++)
+    {
+      sample = data[i] * totalgain;
+      
+      if ( truncsample && *truncsample == 0.0 && ( sample - (int)sample ) )
+	*truncsample = sample;
+      
+      data[i] = (int)sample;
+    }
+  
+  return marsBlockSamples;
 }
 
 
@@ -358,31 +404,99 @@ void mlSwapBlock (mlBlock *block)
 
 
 marsStream *marsStreamOpen (char *name)
+{
+  return marsStreamOpen_r (&MS, name);
+}
+
+
+/* Open a stream in caller provided state, allowing several streams to be read */
+marsStream *marsStreamOpen_r (marsStream *hMS, char *name)
 {
   struct stat	fs;
   
-  memset (&MS, 0, sizeof(marsStream));
+  memset (hMS, 0, sizeof(marsStream));
   
-  if ( stat(name,&fs) )
+  /* Standard input, size and time are unknown */
+  if ( strcmp(name,"-") == 0 )
     {
-      ms_log (2, "Cannot stat file \'%s\' - %s\n", name, strerror(errno));
-      return NULL;
+#if defined(LMP_WIN)
+      _setmode (_fileno(stdin), _O_BINARY);
+#endif
+      hMS->hf = stdin;
+      hMS->time = time(NULL);
+      
+      /* A regular file redirected to stdin can be followed */
+      if ( fstat(fileno(stdin),&fs) || ! S_ISREG(fs.st_mode) )
+	hMS->status|=msStreamPipe;
+      
+      /* The buffer for stdin is set once and kept for the life of the stream */
+      if ( stdinbuf == NULL && (stdinbuf = (char *) malloc (marsStreamBufferSize)) != NULL )
+	setvbuf (stdin, stdinbuf, _IOFBF, marsStreamBufferSize);
     }
-  
-  if ( (MS.hf = fopen(name,"rb")) == NULL )
+  else
     {
-      ms_log (2, "Cannot open file \'%s\' - %s\n", name, strerror(errno));
-      return NULL;
+      if ( stat(name,&fs) )
+	{
+	  ms_log (2, "Cannot stat file \'%s\' - %s\n", name, strerror(errno));
+	  return NULL;
+	}
+      
+      if ( (hMS->hf = fopen(name,"rb")) == NULL )
+	{
+	  ms_log (2, "Cannot open file \'%s\' - %s\n", name, strerror(errno));
+	  return NULL;
+	}
+      
+      /* fill marsStream structure */
+      hMS->size=fs.st_size;
+      hMS->time=fs.st_mtime;
+      
+      /* Pipes, FIFOs and devices have no meaningful size */
+      if ( ! S_ISREG(fs.st_mode) )
+	{
+	  hMS->size=0;
+	  hMS->status|=msStreamPipe;
+	}
     }
   
-  /* fill marsStream structure */
-  MS.size=fs.st_size;
-  MS.time=fs.st_mtime;
-  strcpy (MS.name, name);
+  strncpy (hMS->name, name, sizeof(hMS->name) - 1);
   
-  MS.status|=msStreamActive;
+  /* Read in large chunks, the stdio buffer also collects short reads from pipes */
+  if ( hMS->hf != stdin && (hMS->iobuf = (char *) malloc (marsStreamBufferSize)) != NULL )
+    setvbuf (hMS->hf, hMS->iobuf, _IOFBF, marsStreamBufferSize);
   
-  return &MS;
+  hMS->status|=msStreamActive;
+  
+  return hMS;
+}
+
+
+/* Read a complete block, returns 1 on success, 0 at the end of input and -1 on error */
+static int marsStreamReadBlock (marsStream *hMS)
+{
+  size_t nread;
+  
+  while ( hMS->fill < marsBlockSize )
+    {
+      nread = fread (hMS->block + hMS->fill, 1, marsBlockSize - hMS->fill, hMS->hf);
+      
+      if ( nread == 0 )
+	{
+	  if ( ferror(hMS->hf) )
+	    {
+	      ms_log (2, "Cannot read from \'%s\' - %s\n", hMS->name, strerror(errno));
+	      return -1;
+	    }
+	  
+	  return 0;
+	}
+      
+      hMS->fill += nread;
+    }
+  
+  hMS->fill = 0;
+  
+  return 1;
 }
 
 
@@ -423,37 +537,56 @@ int marsStreamDumpBlock (marsStream *hMS)
 
 marsStream *marsStreamGetNextBlock (int verbose)
 {
-  
-  while ( fread(MS.block, marsBlockSize, 1, MS.hf) == 1 )
+  return marsStreamGetNextBlock_r (&MS, verbose);
+}
+
+
+marsStream *marsStreamGetNextBlock_r (marsStream *hMS, int verbose)
+{
+  while ( marsStreamReadBlock(hMS) == 1 )
     {
       /* Byte swap block if necessary (i.e. host is big-endian) */
-      if ( mbGetMagic(MS.block) == LEMAGICbe )
-	switch ( ((leFormat *) &(MS.block))->block_format )
+      if ( mbGetMagic(hMS->block) == LEMAGICbe )
+	switch ( ((leFormat *) &(hMS->block))->block_format )
 	  {
 	  case 1:  /* MARS-88 data block */
 	  case 2:  /* MARS-88 monitor block */
-	    m88SwapBlock ((m88Block *) &(MS.block));
+	    m88SwapBlock ((m88Block *) &(hMS->block));
 	    break;
 	  case 3:  /* MARSlite data block */
 	  case 4:  /* MARSlite monitor block */
-	    mlSwapBlock ((mlBlock *) &(MS.block));
+	    mlSwapBlock ((mlBlock *) &(hMS->block));
 	    break;
 	  }
       
       if ( verbose >= 2 )
 	ms_log (1, "MB 0x%016X : block %d : %s : 0x%04X : %d : %d : chan %d\n",
-		(unsigned int)MS.offset,(int)(MS.offset/marsBlockSize),
-		isMarsDataBlock(MS.block)?"DATA":"MON ",
-		mbGetMagic(MS.block),mbGetBlockFormat(MS.block),mbGetDataFormat(MS.block),
-		mbGetChan(MS.block));
+		(unsigned int)hMS->offset,(int)(hMS->offset/marsBlockSize),
+		isMarsDataBlock(hMS->block)?"DATA":"MON ",
+		mbGetMagic(hMS->block),mbGetBlockFormat(hMS->block),mbGetDataFormat(hMS->block),
+		mbGetChan(hMS->block));
       
-      if ( isMarsDataBlock(MS.block) && mbGetChan(MS.block) < 3 )
+      if ( isMarsDataBlock(hMS->block) && mbGetChan(hMS->block) < 3 )
 	{ /* do checks */
-	  MS.offset += marsBlockSize;
-	  return &MS;
+	  hMS->offset += marsBlockSize;
+	  return hMS;
 	}
       
-      MS.offset += marsBlockSize;
+      hMS->offset += marsBlockSize;
+    }
+  
+  /* When following keep any partial block and allow reading data appended later */
+  if ( msCheckStatus(hMS->status,msStreamFollow) )
+    {
+      clearerr (hMS->hf);
+      return NULL;
+    }
+  
+  if ( hMS->fill > 0 )
+    {
+      ms_log (1, "Warning: ignoring %d bytes of incomplete block at end of \'%s\'\n",
+	      (int)hMS->fill, hMS->name);
+      hMS->fill = 0;
     }
   
   return NULL;
@@ -468,8 +601,17 @@ marsStream *marsStreamGetCurrent (void)
 
 void marsStreamClose (void)
 {
-  if ( MS.hf != NULL )
-    fclose (MS.hf);
+  marsStreamClose_r (&MS);
+}
+
+
+void marsStreamClose_r (marsStream *hMS)
+{
+  if ( hMS->hf != NULL && hMS->hf != stdin )
+    fclose (hMS->hf);
+  
+  if ( hMS->iobuf != NULL )
+    free (hMS->iobuf);
   
-  memset (&MS, 0, sizeof(marsStream));
+  memset (hMS, 0, sizeof(marsStream));
 }
@@ -12,10 +12,14 @@ $Header: /usr/local/cvs/repository/mars2mseed/src/marsio.h,v 1.4 2006-07-27 17:2
  #include "mars.h"
  
  #define msStreamActive       0x00000001 
+ #define msStreamPipe         0x00000002
+ #define msStreamFollow       0x00000004
  #define msLongHeaders        0x00000100
  
  #define msCheckStatus(a,b)   ( (a)&(b) )
  
+ #define marsStreamBufferSize 1048576
+ 
  #define mbHeaderMacros
  #define mbGetMagic(a)	      ((((m88Head *)(a))->format_id).magic)
  #define mbGetBlockFormat(a)  ((((m88Head *)(a))->format_id).block_format)
@@ -33,6 +37,8 @@ $Header: /usr/local/cvs/repository/mars2mseed/src/marsio.h,v 1.4 2006-07-27 17:2
   FILE	*hf;
   off_t	offset;
   char	block[marsBlockSize];
+  size_t  fill;		/* bytes of a partial block read */
+  char   *iobuf;	/* buffer for reading input */
   
   size_t  status;
   
@@ -55,9 +61,15 @@ $Header: /usr/local/cvs/repository/mars2mseed/src/marsio.h,v 1.4 2006-07-27 17:2
  marsStream *marsStreamGetCurrent(void);
  
  void marsStreamClose(void);
+ 
+ marsStream *marsStreamOpen_r(marsStream *hMS, char *name);
+ marsStream *marsStreamGetNextBlock_r(marsStream *hMS, int verbose);
+ void marsStreamClose_r(marsStream *hMS);
  void m88SwapBlock(m88Block *blk);
  
  int *marsBlockDecodeData(char *block,int *scale);
+ int marsBlockDecodeData_r(char *block,int *data,int *scale);
+ int marsBlockDecodeScaled(char *block,int *data,double totalgain,double *truncsample);
  int marsStreamDumpBlock(marsStream *hMS);
 
  double marsBlockGetGain(char *blk);
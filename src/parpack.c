@@ -0,0 +1,982 @@
+/***************************************************************************
+ * parpack.c
+ *
+ * Parallel packing of the traces in a MSTraceGroup.
+ *
+ * Each worker thread takes ownership of one trace at a time and
+ * collects the records packed from it into a private buffer.  The
+ * buffers are handed to the caller's record handler strictly in the
+ * order of the trace chain, so the output is identical to packing the
+ * traces serially with mst_pack().
+ *
+ * A single long trace can also be split into chunks that are Steim
+ * encoded concurrently.  Each chunk is encoded into a chain of Steim
+ * difference words starting at the chunk boundary, using the true
+ * previous sample for compression history.  Greedy Steim word packing
+ * only depends on the upcoming differences, so once the serial word
+ * sequence lands on a word boundary of a chunk the remaining words of
+ * that chunk are exactly what serial packing would produce.  The
+ * chains are stitched on the calling thread, re-encoding the few words
+ * needed to re-synchronize at each chunk seam, and framed into records
+ * at the serial record boundaries with serial sequence numbers and
+ * start times.  The records are identical to those from mst_pack().
+ *
+ * When threads are not available (Windows builds) the traces are
+ * simply packed serially.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#if !defined(LMP_WIN)
+  #include <pthread.h>
+  #define PARPACK_THREADS 1
+#endif
+
+#include "parpack.h"
+
+/* Minimum number of samples per chunk when splitting a single trace */
+#define PARPACK_MINCHUNK 262144
+
+/* Packing job for a single trace */
+struct packjob {
+  MSTrace *mst;
+  flag     split;        /* Flag indicating the trace is split into chunks */
+  char    *buffer;       /* Records packed from this trace */
+  size_t   buflen;       /* Bytes used in buffer */
+  size_t   bufsize;      /* Bytes allocated for buffer */
+  int      reclen;       /* Length of the packed records */
+  int      records;      /* Count of packed records, -1 on error */
+  int64_t  samples;      /* Count of packed samples */
+  flag     nomem;        /* Flag indicating the buffer could not be grown */
+  flag     done;         /* Flag indicating the job is complete */
+};
+
+/* Shared state for a pool of packing workers */
+struct packpool {
+  struct packjob *jobs;
+  int      jobcount;
+  int      nextjob;
+  int      reclen;
+  flag     encoding;
+  flag     byteorder;
+  flag     verbose;
+#if defined(PARPACK_THREADS)
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+#endif
+};
+
+/* Steim difference word, stored in the layout it has in host memory */
+struct steimword {
+  uint32_t word;         /* Encoded differences */
+  uint8_t  nibble;       /* Control nibble for the word */
+  uint8_t  count;        /* Count of differences in the word */
+};
+
+/* Chain of Steim words encoded from one chunk of a trace */
+struct wordchain {
+  const int32_t *samples;      /* All samples of the trace */
+  int64_t  numsamples;   /* Count of samples in the trace */
+  int64_t  start;        /* Sample index of first word */
+  int64_t  end;          /* Words are encoded until they start at or after end */
+  int32_t  diff0;        /* First difference if start is the first sample */
+  flag     encoding;     /* DE_STEIM1 or DE_STEIM2 */
+  struct steimword *words;
+  int64_t  count;        /* Count of words in chain */
+  int64_t  size;         /* Count of words allocated */
+  int      error;        /* Non-zero if the chunk could not be encoded */
+};
+
+/* Serial word sequence assembled from word chains */
+struct wordstitch {
+  struct wordchain *chains;
+  int      chaincount;
+  int      chain;        /* Current chain */
+  int64_t  widx;         /* Next word index in current chain */
+  int64_t  wpos;         /* Sample index at widx in current chain */
+  int64_t  pos;          /* Sample index of the next serial word */
+  flag     resync;       /* Flag indicating words are encoded serially */
+};
+
+static void collect_handler (char *record, int reclen, void *handlerdata);
+static void packjob_run (struct packpool *pool, struct packjob *job);
+#if defined(PARPACK_THREADS)
+static void *packworker (void *arg);
+static void *chainworker (void *arg);
+#endif
+static int splittable (MSTrace *mst, flag encoding, int threads);
+static void chain_encode (struct wordchain *chain);
+static int steim_encodeword (struct wordchain *chain, int64_t pos, struct steimword *sw);
+static int stitch_nextword (struct wordstitch *st, struct steimword *sw);
+static int stitch_frames (struct wordstitch *st, char *dataptr, int maxdatabytes,
+			  flag encoding, flag swapflag);
+
+
+/***************************************************************************
+ * parpack_group:
+ *
+ * Pack and flush all traces in a MSTraceGroup using up to 'threads'
+ * worker threads, one trace per worker at a time.  Traces long enough
+ * to be split are instead packed in chunks with parpack_trace() after
+ * the workers have finished.  Records are passed to record_handler in
+ * trace order from the calling thread.
+ *
+ * The packed samples only include traces packed without error.
+ *
+ * Returns the number of records created on success and -1 if any trace
+ * could not be packed.
+ ***************************************************************************/
+int64_t
+parpack_group (MSTraceGroup *mstg, void (*record_handler) (char *, int, void *),
+	       void *handlerdata, int reclen, flag encoding, flag byteorder,
+	       int threads, int64_t *packedsamples, flag verbose)
+{
+  struct packpool pool;
+  struct packjob *job;
+  MSTrace *mst;
+  int64_t totalrecords = 0;
+  int failed = 0;
+  int workers;
+  int idx;
+  size_t offset;
+#if defined(PARPACK_THREADS)
+  pthread_t *tids = NULL;
+  int created = 0;
+  int joined = 0;
+#endif
+
+  if ( packedsamples )
+    *packedsamples = 0;
+
+  if ( ! mstg )
+    return -1;
+
+  memset (&pool, 0, sizeof(struct packpool));
+  pool.reclen = reclen;
+  pool.encoding = encoding;
+  pool.byteorder = byteorder;
+  pool.verbose = verbose;
+
+  /* Create a job for each trace with data */
+  if ( mstg->numtraces > 0 )
+    {
+      pool.jobs = (struct packjob *) calloc (mstg->numtraces, sizeof(struct packjob));
+
+      if ( ! pool.jobs )
+	{
+	  ms_log (2, "parpack_group(): Cannot allocate memory\n");
+	  return -1;
+	}
+    }
+
+  for ( mst = mstg->traces; mst && pool.jobcount < mstg->numtraces; mst = mst->next )
+    {
+      if ( mst->numsamples > 0 )
+	{
+	  pool.jobs[pool.jobcount].mst = mst;
+	  pool.jobs[pool.jobcount].split = splittable (mst, encoding, threads);
+	  pool.jobcount++;
+	}
+    }
+
+  workers = ( threads > pool.jobcount ) ? pool.jobcount : threads;
+
+#if defined(PARPACK_THREADS)
+  if ( workers > 1 )
+    {
+      pthread_mutex_init (&pool.lock, NULL);
+      pthread_cond_init (&pool.cond, NULL);
+
+      if ( (tids = (pthread_t *) malloc (workers * sizeof(pthread_t))) )
+	{
+	  for ( created = 0; created < workers; created++ )
+	    if ( pthread_create (&tids[created], NULL, packworker, &pool) )
+	      break;
+	}
+
+      if ( created < workers )
+	ms_log (1, "Warning: started %d of %d packing threads\n", created, workers);
+
+      /* Pack in this thread if no workers could be started */
+      if ( created == 0 )
+	packworker (&pool);
+
+      /* Deliver the records of each trace in order as the jobs complete */
+      for ( idx = 0; idx < pool.jobcount; idx++ )
+	{
+	  job = &pool.jobs[idx];
+
+	  pthread_mutex_lock (&pool.lock);
+	  while ( ! job->done )
+	    pthread_cond_wait (&pool.cond, &pool.lock);
+	  pthread_mutex_unlock (&pool.lock);
+
+	  /* Split traces are packed here once the workers have finished, so
+	     that no more than 'threads' threads encode at the same time */
+	  if ( job->split )
+	    {
+	      for ( ; joined < created; joined++ )
+		pthread_join (tids[joined], NULL);
+
+	      job->records = parpack_trace (job->mst, record_handler, handlerdata, reclen,
+					    encoding, byteorder, threads, &job->samples, verbose);
+	    }
+
+	  for ( offset = 0; offset < job->buflen; offset += job->reclen )
+	    record_handler (job->buffer + offset, job->reclen, handlerdata);
+
+	  if ( job->buffer )
+	    free (job->buffer);
+	  job->buffer = NULL;
+
+	  if ( job->records < 0 )
+	    failed++;
+	  else
+	    totalrecords += job->records;
+
+	  if ( packedsamples && job->records >= 0 )
+	    *packedsamples += job->samples;
+	}
+
+      for ( ; joined < created; joined++ )
+	pthread_join (tids[joined], NULL);
+
+      if ( tids )
+	free (tids);
+
+      pthread_cond_destroy (&pool.cond);
+      pthread_mutex_destroy (&pool.lock);
+    }
+  else
+#endif
+    {
+      /* Pack straight to the record handler, splitting long traces */
+      for ( idx = 0; idx < pool.jobcount; idx++ )
+	{
+	  job = &pool.jobs[idx];
+
+	  job->records = parpack_trace (job->mst, record_handler, handlerdata, reclen,
+					encoding, byteorder, threads, &job->samples, verbose);
+
+	  if ( job->records < 0 )
+	    failed++;
+	  else
+	    totalrecords += job->records;
+
+	  if ( packedsamples && job->records >= 0 )
+	    *packedsamples += job->samples;
+	}
+    }
+
+  if ( pool.jobs )
+    free (pool.jobs);
+
+  return ( failed ) ? -1 : totalrecords;
+}  /* End of parpack_group() */
+
+
+/***************************************************************************
+ * packjob_run:
+ *
+ * Pack and flush all data of the trace in a job, collecting the
+ * records in the job's private buffer.
+ ***************************************************************************/
+static void
+packjob_run (struct packpool *pool, struct packjob *job)
+{
+  job->records = mst_pack (job->mst, collect_handler, job, pool->reclen,
+			   pool->encoding, pool->byteorder, &job->samples, 1,
+			   pool->verbose, NULL);
+
+  if ( job->nomem )
+    {
+      ms_log (2, "Cannot allocate memory for packed records\n");
+      job->records = -1;
+    }
+}  /* End of packjob_run() */
+
+
+#if defined(PARPACK_THREADS)
+/***************************************************************************
+ * packworker:
+ *
+ * Worker thread, takes the next unclaimed job until none are left.
+ ***************************************************************************/
+static void *
+packworker (void *arg)
+{
+  struct packpool *pool = (struct packpool *) arg;
+  struct packjob *job;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&pool->lock);
+      job = ( pool->nextjob < pool->jobcount ) ? &pool->jobs[pool->nextjob++] : NULL;
+      pthread_mutex_unlock (&pool->lock);
+
+      if ( ! job )
+	break;
+
+      /* Split traces are packed by the delivering thread */
+      if ( ! job->split )
+	packjob_run (pool, job);
+
+      pthread_mutex_lock (&pool->lock);
+      job->done = 1;
+      pthread_cond_broadcast (&pool->cond);
+      pthread_mutex_unlock (&pool->lock);
+    }
+
+  /* Hand messages buffered by this thread to the log writer */
+  ms_logflush ();
+
+  return NULL;
+}  /* End of packworker() */
+#endif
+
+
+/***************************************************************************
+ * collect_handler:
+ *
+ * Append a packed record to the private buffer of a job.
+ ***************************************************************************/
+static void
+collect_handler (char *record, int reclen, void *handlerdata)
+{
+  struct packjob *job = (struct packjob *) handlerdata;
+  size_t newsize;
+  char *newbuffer;
+
+  if ( job->nomem )
+    return;
+
+  if ( (job->buflen + reclen) > job->bufsize )
+    {
+      newsize = ( job->bufsize ) ? job->bufsize * 2 : (size_t) reclen * 16;
+
+      while ( newsize < (job->buflen + reclen) )
+	newsize *= 2;
+
+      if ( ! (newbuffer = (char *) realloc (job->buffer, newsize)) )
+	{
+	  job->nomem = 1;
+	  return;
+	}
+
+      job->buffer = newbuffer;
+      job->bufsize = newsize;
+    }
+
+  memcpy (job->buffer + job->buflen, record, reclen);
+  job->buflen += reclen;
+  job->reclen = reclen;
+}  /* End of collect_handler() */
+
+
+/***************************************************************************
+ * parpack_trace:
+ *
+ * Pack and flush all data of a trace.  If the trace is long enough and
+ * Steim encoded it is split into chunks that are encoded by up to
+ * 'threads' threads, otherwise it is packed with mst_pack().  Records
+ * are passed to record_handler from the calling thread.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+int64_t
+parpack_trace (MSTrace *mst, void (*record_handler) (char *, int, void *),
+	       void *handlerdata, int reclen, flag encoding, flag byteorder,
+	       int threads, int64_t *packedsamples, flag verbose)
+{
+  struct packjob header;
+  struct wordchain *chains = NULL;
+  struct wordstitch stitch;
+  struct fsdh_s *fsdh;
+  MSRecord *msr = NULL;
+  const int32_t *samples;
+  char *record = NULL;
+  char seqnum[7];
+  char srcname[50];
+  hptime_t hptimems;
+  int8_t usecoffset;
+  flag headerswapflag = 0;
+  flag dataswapflag = 0;
+  uint16_t dataoffset;
+  int64_t numsamples;
+  int64_t first;
+  int64_t records = 0;
+  int32_t diff0;
+  int sequence = 1;
+  int chaincount;
+  int recsamples;
+  int idx;
+#if defined(PARPACK_THREADS)
+  pthread_t *tids = NULL;
+  int created = 0;
+#endif
+
+  if ( ! splittable (mst, encoding, threads) )
+    return mst_pack (mst, record_handler, handlerdata, reclen, encoding, byteorder,
+		     packedsamples, 1, verbose, NULL);
+
+  if ( packedsamples )
+    *packedsamples = 0;
+
+  /* Allocate stream processing state space if needed */
+  if ( ! mst->ststate )
+    {
+      if ( ! (mst->ststate = (StreamState *) calloc (1, sizeof(StreamState))) )
+	{
+	  ms_log (2, "parpack_trace(): Cannot allocate memory\n");
+	  return -1;
+	}
+    }
+
+  /* Pack a single sample record to use as a header template, this also
+   * resolves defaults and any byte order forced by the environment */
+  if ( ! (msr = msr_init (NULL)) )
+    {
+      ms_log (2, "parpack_trace(): Cannot initialize MSRecord\n");
+      return -1;
+    }
+
+  msr->dataquality = 'D';
+  strcpy (msr->network, mst->network);
+  strcpy (msr->station, mst->station);
+  strcpy (msr->location, mst->location);
+  strcpy (msr->channel, mst->channel);
+  msr->reclen = reclen;
+  msr->encoding = encoding;
+  msr->byteorder = byteorder;
+  msr->starttime = mst->starttime;
+  msr->samprate = mst->samprate;
+  msr->datasamples = mst->datasamples;
+  msr->numsamples = 1;
+  msr->sampletype = mst->sampletype;
+
+  memset (&header, 0, sizeof(struct packjob));
+
+  if ( msr_pack (msr, collect_handler, &header, NULL, 1, verbose - 1) != 1 || header.nomem )
+    {
+      ms_log (2, "parpack_trace(): Cannot pack header template\n");
+      msr->datasamples = 0;
+      msr_free (&msr);
+      if ( header.buffer )
+	free (header.buffer);
+      return -1;
+    }
+
+  reclen = msr->reclen;
+  encoding = msr->encoding;
+  byteorder = msr->byteorder;
+
+  msr->datasamples = 0;
+  msr_free (&msr);
+
+  if ( byteorder != ms_bigendianhost () )
+    headerswapflag = dataswapflag = 1;
+
+  if ( packheaderbyteorder >= 0 )
+    headerswapflag = ( byteorder != packheaderbyteorder ) ? 1 : 0;
+
+  if ( packdatabyteorder >= 0 )
+    dataswapflag = ( byteorder != packdatabyteorder ) ? 1 : 0;
+
+  fsdh = (struct fsdh_s *) header.buffer;
+  dataoffset = fsdh->data_offset;
+  if ( headerswapflag )
+    ms_gswap2 (&dataoffset);
+
+  samples = (const int32_t *) mst->datasamples;
+  numsamples = mst->numsamples;
+  diff0 = ( mst->ststate->comphistory ) ? samples[0] - mst->ststate->lastintsample : 0;
+
+  /* Create one word chain per chunk */
+  chaincount = (int) (numsamples / PARPACK_MINCHUNK);
+  if ( chaincount > threads )
+    chaincount = threads;
+
+  if ( ! (chains = (struct wordchain *) calloc (chaincount, sizeof(struct wordchain))) ||
+       ! (record = (char *) malloc (reclen)) )
+    {
+      ms_log (2, "parpack_trace(): Cannot allocate memory\n");
+      free (header.buffer);
+      if ( chains )
+	free (chains);
+      return -1;
+    }
+
+  for ( idx = 0; idx < chaincount; idx++ )
+    {
+      chains[idx].samples = samples;
+      chains[idx].numsamples = numsamples;
+      chains[idx].start = numsamples * idx / chaincount;
+      chains[idx].end = numsamples * (idx + 1) / chaincount;
+      chains[idx].diff0 = diff0;
+      chains[idx].encoding = encoding;
+    }
+
+  /* Encode the chunks, in this thread if no workers could be started */
+#if defined(PARPACK_THREADS)
+  if ( (tids = (pthread_t *) malloc (chaincount * sizeof(pthread_t))) )
+    {
+      for ( created = 0; created < chaincount; created++ )
+	if ( pthread_create (&tids[created], NULL, chainworker, &chains[created]) )
+	  break;
+    }
+
+  for ( idx = created; idx < chaincount; idx++ )
+    chain_encode (&chains[idx]);
+
+  for ( idx = 0; idx < created; idx++ )
+    pthread_join (tids[idx], NULL);
+
+  if ( tids )
+    free (tids);
+#else
+  for ( idx = 0; idx < chaincount; idx++ )
+    chain_encode (&chains[idx]);
+#endif
+
+  for ( idx = 0; idx < chaincount; idx++ )
+    if ( chains[idx].error )
+      {
+	ms_log (2, "parpack_trace(%s): Cannot encode data samples\n",
+		mst_srcname (mst, srcname, 1));
+	records = -1;
+	break;
+      }
+
+  /* Frame the serial word sequence into records */
+  memset (&stitch, 0, sizeof(struct wordstitch));
+  stitch.chains = chains;
+  stitch.chaincount = chaincount;
+
+  while ( records >= 0 && stitch.pos < numsamples )
+    {
+      first = stitch.pos;
+
+      memcpy (record, header.buffer, dataoffset);
+
+      recsamples = stitch_frames (&stitch, record + dataoffset, reclen - dataoffset,
+				  encoding, dataswapflag);
+
+      if ( recsamples <= 0 )
+	{
+	  ms_log (2, "parpack_trace(%s): Error packing data samples\n",
+		  mst_srcname (mst, srcname, 1));
+	  records = -1;
+	  break;
+	}
+
+      /* Update sequence number, start time and sample count */
+      fsdh = (struct fsdh_s *) record;
+
+      snprintf (seqnum, 7, "%06d", sequence);
+      memcpy (fsdh->sequence_number, seqnum, 6);
+
+      ms_hptime2tomsusecoffset (mst->starttime + (hptime_t) (first / mst->samprate * HPTMODULUS + 0.5),
+				&hptimems, &usecoffset);
+      ms_hptime2btime (hptimems, &(fsdh->start_time));
+
+      fsdh->numsamples = (uint16_t) recsamples;
+
+      if ( headerswapflag )
+	{
+	  MS_SWAPBTIME (&fsdh->start_time);
+	  ms_gswap2 (&fsdh->numsamples);
+	}
+
+      record_handler (record, reclen, handlerdata);
+
+      sequence = ( sequence >= 999999 ) ? 1 : sequence + 1;
+      records++;
+    }
+
+  free (header.buffer);
+  free (record);
+  for ( idx = 0; idx < chaincount; idx++ )
+    if ( chains[idx].words )
+      free (chains[idx].words);
+  free (chains);
+
+  if ( records < 0 )
+    return -1;
+
+  if ( verbose > 1 )
+    ms_log (1, "Packed %lld records for %s trace in %d chunks\n",
+	    (long long int) records, mst_srcname (mst, srcname, 1), chaincount);
+
+  /* Update the stream state and release the packed samples as mst_pack() does */
+  mst->ststate->packedrecords += records;
+  mst->ststate->packedsamples += numsamples;
+  mst->ststate->lastintsample = samples[numsamples - 1];
+  mst->ststate->comphistory = 1;
+
+  mst->starttime = mst->starttime + (hptime_t) (numsamples / mst->samprate * HPTMODULUS + 0.5);
+
+  free (mst->datasamples);
+  mst->datasamples = 0;
+  mst->samplecnt -= numsamples;
+  mst->numsamples = 0;
+
+  if ( packedsamples )
+    *packedsamples = numsamples;
+
+  return records;
+}  /* End of parpack_trace() */
+
+
+/***************************************************************************
+ * splittable:
+ *
+ * Determine if a trace should be split into chunks for packing.
+ *
+ * Returns 1 if the trace can be split and 0 otherwise.
+ ***************************************************************************/
+static int
+splittable (MSTrace *mst, flag encoding, int threads)
+{
+  if ( ! mst || threads < 2 )
+    return 0;
+
+  if ( mst->sampletype != 'i' || mst->samprate <= 0.0 )
+    return 0;
+
+  if ( encoding != -1 && encoding != DE_STEIM1 && encoding != DE_STEIM2 )
+    return 0;
+
+  if ( mst->numsamples < 2 * PARPACK_MINCHUNK || mst->samplecnt != mst->numsamples )
+    return 0;
+
+  return 1;
+}  /* End of splittable() */
+
+
+#if defined(PARPACK_THREADS)
+/***************************************************************************
+ * chainworker:
+ *
+ * Worker thread, encodes a single word chain.
+ ***************************************************************************/
+static void *
+chainworker (void *arg)
+{
+  chain_encode ((struct wordchain *) arg);
+
+  return NULL;
+}  /* End of chainworker() */
+#endif
+
+
+/***************************************************************************
+ * chain_encode:
+ *
+ * Encode Steim words starting at the first sample of a chunk until a
+ * word starts at or beyond the end of the chunk.  The last words may
+ * extend into the following chunk.
+ ***************************************************************************/
+static void
+chain_encode (struct wordchain *chain)
+{
+  struct steimword *newwords;
+  int64_t newsize;
+  int64_t pos = chain->start;
+
+  while ( pos < chain->end )
+    {
+      if ( chain->count >= chain->size )
+	{
+	  newsize = ( chain->size ) ? chain->size * 2 : (chain->end - chain->start) / 4 + 16;
+
+	  if ( ! (newwords = (struct steimword *) realloc (chain->words, newsize * sizeof(struct steimword))) )
+	    {
+	      chain->error = 1;
+	      return;
+	    }
+
+	  chain->words = newwords;
+	  chain->size = newsize;
+	}
+
+      if ( steim_encodeword (chain, pos, &chain->words[chain->count]) )
+	{
+	  chain->error = 1;
+	  return;
+	}
+
+      pos += chain->words[chain->count++].count;
+    }
+}  /* End of chain_encode() */
+
+
+/***************************************************************************
+ * steim_encodeword:
+ *
+ * Encode the Steim word starting at sample index 'pos' using the same
+ * greedy rules as msr_encode_steim1() and msr_encode_steim2().  The
+ * word is stored in host byte order except for 4 x 8-bit differences,
+ * which are stored as bytes.
+ *
+ * Returns 0 on success and -1 if a difference cannot be represented.
+ ***************************************************************************/
+static int
+steim_encodeword (struct wordchain *chain, int64_t pos, struct steimword *sw)
+{
+  static const int steim2bits[7] = { 4, 5, 6, 8, 10, 15, 30 };
+  static const uint8_t steim2dnib[7] = { 2, 1, 0, 0, 3, 2, 1 };
+  union {
+    int8_t d8[4];
+    int16_t d16[2];
+    uint32_t u32;
+  } word;
+  int32_t diffs[7];
+  int maxdiffs = ( chain->encoding == DE_STEIM1 ) ? 4 : 7;
+  int diffcount;
+  int fit;
+  int bits;
+  int idx;
+
+  diffcount = ( chain->numsamples - pos < maxdiffs ) ? (int) (chain->numsamples - pos) : maxdiffs;
+
+  for ( idx = 0; idx < diffcount; idx++ )
+    diffs[idx] = ( pos + idx == 0 ) ? chain->diff0 :
+      chain->samples[pos + idx] - chain->samples[pos + idx - 1];
+
+  /* Count of leading differences that fit in 'bits', limited to 'max' */
+#define FITCOUNT(BITS, MAX, RESULT)					\
+  for ( RESULT = 0; RESULT < (MAX) && RESULT < diffcount; RESULT++ )	\
+    if ( diffs[RESULT] < -(1 << ((BITS) - 1)) || diffs[RESULT] > (1 << ((BITS) - 1)) - 1 ) \
+      break;
+
+  if ( chain->encoding == DE_STEIM1 )
+    {
+      FITCOUNT (8, 4, fit);
+      if ( fit == 4 )
+	{
+	  for ( idx = 0; idx < 4; idx++ )
+	    word.d8[idx] = (int8_t) diffs[idx];
+	  sw->nibble = 1;
+	  sw->count = 4;
+	}
+      else
+	{
+	  FITCOUNT (16, 2, fit);
+	  if ( fit == 2 )
+	    {
+	      word.d16[0] = (int16_t) diffs[0];
+	      word.d16[1] = (int16_t) diffs[1];
+	      sw->nibble = 2;
+	      sw->count = 2;
+	    }
+	  else
+	    {
+	      word.u32 = (uint32_t) diffs[0];
+	      sw->nibble = 3;
+	      sw->count = 1;
+	    }
+	}
+
+      sw->word = word.u32;
+      return 0;
+    }
+
+  /* Steim2: 7x4, 6x5, 5x6, 4x8, 3x10, 2x15 then 1x30 bit differences */
+  for ( idx = 0; idx < 7; idx++ )
+    {
+      bits = steim2bits[idx];
+      FITCOUNT (bits, 7 - idx, fit);
+
+      if ( fit == 7 - idx )
+	break;
+    }
+#undef FITCOUNT
+
+  if ( idx == 7 )
+    {
+      ms_log (2, "steim_encodeword(): Unable to represent difference in <= 30 bits\n");
+      return -1;
+    }
+
+  sw->count = (uint8_t) (7 - idx);
+
+  if ( bits == 8 )
+    {
+      for ( idx = 0; idx < 4; idx++ )
+	word.d8[idx] = (int8_t) diffs[idx];
+      sw->word = word.u32;
+      sw->nibble = 1;
+      return 0;
+    }
+
+  sw->word = (uint32_t) steim2dnib[idx] << 30;
+  for ( fit = 0; fit < sw->count; fit++ )
+    sw->word |= ((uint32_t) diffs[fit] & ((1ul << bits) - 1)) << (bits * (sw->count - 1 - fit));
+  sw->nibble = ( sw->count >= 5 ) ? 3 : 2;
+
+  return 0;
+}  /* End of steim_encodeword() */
+
+
+/***************************************************************************
+ * stitch_nextword:
+ *
+ * Return the next word of the serial word sequence.  Words are taken
+ * from the chains when the sequence is aligned with a chain, otherwise
+ * they are encoded here until the sequence lands on a word boundary of
+ * the current chain or passes it entirely.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+stitch_nextword (struct wordstitch *st, struct steimword *sw)
+{
+  struct wordchain *chain;
+
+  for (;;)
+    {
+      chain = &st->chains[st->chain];
+
+      if ( ! st->resync )
+	{
+	  if ( st->widx < chain->count )
+	    {
+	      *sw = chain->words[st->widx++];
+	      st->wpos += sw->count;
+	      st->pos = st->wpos;
+	      return 0;
+	    }
+
+	  /* Chain exhausted, align with the next chain */
+	  if ( st->chain + 1 >= st->chaincount )
+	    return -1;
+
+	  st->chain++;
+	  st->widx = 0;
+	  st->wpos = st->chains[st->chain].start;
+	  st->resync = 1;
+	  continue;
+	}
+
+      /* Advance the chain cursor up to the serial position */
+      while ( st->widx < chain->count && st->wpos < st->pos )
+	st->wpos += chain->words[st->widx++].count;
+
+      if ( st->widx < chain->count && st->wpos == st->pos )
+	{
+	  st->resync = 0;
+	  continue;
+	}
+
+      if ( st->widx >= chain->count && st->chain + 1 < st->chaincount )
+	{
+	  st->chain++;
+	  st->widx = 0;
+	  st->wpos = st->chains[st->chain].start;
+	  continue;
+	}
+
+      if ( st->pos >= chain->numsamples )
+	return -1;
+
+      /* Encode the next word serially */
+      if ( steim_encodeword (chain, st->pos, sw) )
+	return -1;
+
+      st->pos += sw->count;
+      return 0;
+    }
+}  /* End of stitch_nextword() */
+
+
+/***************************************************************************
+ * stitch_frames:
+ *
+ * Fill the data section of a record with Steim frames from the serial
+ * word sequence, setting the integration constants and swapping to
+ * the requested byte order the same as msr_encode_steim1() and
+ * msr_encode_steim2().
+ *
+ * Returns the number of samples in the frames or -1 on error.
+ ***************************************************************************/
+static int
+stitch_frames (struct wordstitch *st, char *dataptr, int maxdatabytes,
+	       flag encoding, flag swapflag)
+{
+  struct steimword sw;
+  uint32_t *frameptr;
+  int32_t *Xnp = NULL;
+  const int32_t *samples = st->chains[0].samples;
+  int64_t numsamples = st->chains[0].numsamples;
+  int64_t first = st->pos;
+  int maxframes = maxdatabytes / 64;
+  int samplecount = 0;
+  int startnibble;
+  int frameidx;
+  int widx;
+
+  for ( frameidx = 0; frameidx < maxframes && st->pos < numsamples; frameidx++ )
+    {
+      frameptr = (uint32_t *) (dataptr + 64 * frameidx);
+
+      memset (frameptr, 0, 64);
+
+      if ( frameidx == 0 )
+	{
+	  frameptr[1] = (uint32_t) samples[first];
+	  if ( swapflag )
+	    ms_gswap4a (&frameptr[1]);
+
+	  Xnp = (int32_t *) &frameptr[2];
+	  startnibble = 3;
+	}
+      else
+	{
+	  startnibble = 1;
+	}
+
+      for ( widx = startnibble; widx < 16 && st->pos < numsamples; widx++ )
+	{
+	  if ( stitch_nextword (st, &sw) )
+	    return -1;
+
+	  frameptr[widx] = sw.word;
+
+	  /* Swap the word the same as the library encoders */
+	  if ( swapflag && sw.nibble != 1 )
+	    {
+	      if ( encoding == DE_STEIM1 && sw.nibble == 2 )
+		{
+		  ms_gswap2a ((int16_t *) &frameptr[widx]);
+		  ms_gswap2a ((int16_t *) &frameptr[widx] + 1);
+		}
+	      else
+		{
+		  ms_gswap4a (&frameptr[widx]);
+		}
+	    }
+
+	  frameptr[0] |= (uint32_t) sw.nibble << (30 - 2 * widx);
+	  samplecount += sw.count;
+	}
+
+      if ( swapflag )
+	ms_gswap4a (&frameptr[0]);
+    }
+
+  if ( Xnp )
+    {
+      *Xnp = samples[first + samplecount - 1];
+      if ( swapflag )
+	ms_gswap4a (Xnp);
+    }
+
+  if ( frameidx * 64 < maxdatabytes )
+    memset (dataptr + frameidx * 64, 0, maxdatabytes - frameidx * 64);
+
+  return samplecount;
+}  /* End of stitch_frames() */
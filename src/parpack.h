@@ -0,0 +1,32 @@
+/***************************************************************************
+ * parpack.h
+ *
+ * Interface declarations for parallel packing of buffered traces.
+ ***************************************************************************/
+
+#ifndef PARPACK_H
+#define PARPACK_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int64_t parpack_group (MSTraceGroup *mstg,
+			      void (*record_handler) (char *, int, void *),
+			      void *handlerdata, int reclen, flag encoding,
+			      flag byteorder, int threads, int64_t *packedsamples,
+			      flag verbose);
+
+extern int64_t parpack_trace (MSTrace *mst,
+			      void (*record_handler) (char *, int, void *),
+			      void *handlerdata, int reclen, flag encoding,
+			      flag byteorder, int threads, int64_t *packedsamples,
+			      flag verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PARPACK_H */
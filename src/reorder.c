@@ -0,0 +1,332 @@
+/***************************************************************************
+ * reorder.c
+ *
+ * Per-channel reorder buffer for slightly out-of-order blocks.
+ *
+ * Records holding the samples of single blocks are copied into a
+ * buffer for their channel, kept sorted by start time, and released
+ * in time order once they fall out of the reorder window.  The window
+ * is either a number of blocks held per channel or a time span between
+ * the earliest and latest blocks held for a channel.  A block that
+ * arrives late but within the window is released in its place, so the
+ * traces built from the released records stay contiguous.  The sample
+ * buffers of released blocks are kept for reuse by later blocks so
+ * that holding a block does not allocate memory once the buffers of
+ * the window exist.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#include "reorder.h"
+
+/* Block held in the buffer */
+struct heldblock {
+  hptime_t starttime;
+  double   samprate;
+  int64_t  numsamples;
+  int64_t  capacity;            /* Allocated number of samples */
+  int32_t *samples;
+};
+
+/* Buffer of held blocks for a channel, sorted by start time */
+struct reorderchan {
+  char     network[11];
+  char     station[11];
+  char     location[11];
+  char     channel[11];
+  int32_t  streamid;            /* Interned stream ID of the codes */
+  int      count;               /* Number of held blocks */
+  int      size;                /* Allocated number of held blocks */
+  struct heldblock *held;
+  struct reorderchan *next;
+};
+
+static int    windowblocks = 0;
+static double windowseconds = 0.0;
+static struct reorderchan *reorderlist = 0;
+static MSRecord *releasemsr = 0;
+static struct heldblock *sparelist = 0;   /* Sample buffers for reuse */
+static int sparecount = 0;
+static int sparesize = 0;
+
+static void release_first (struct reorderchan *rch,
+			   void (*release) (MSRecord *, void *), void *releasedata);
+static int getsamples (struct heldblock *held, int64_t numsamples);
+static void putsamples (struct heldblock *held);
+
+
+/***************************************************************************
+ * reorder_init:
+ *
+ * Set the reorder window, either a number of blocks held per channel
+ * or, if blocks is 0, a time span in seconds.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+reorder_init (int blocks, double seconds)
+{
+  if ( blocks < 0 || seconds < 0.0 || (blocks == 0 && seconds <= 0.0) )
+    return -1;
+
+  windowblocks = blocks;
+  windowseconds = ( blocks ) ? 0.0 : seconds;
+
+  return 0;
+}  /* End of reorder_init() */
+
+
+/***************************************************************************
+ * reorder_add:
+ *
+ * Copy a record of 32-bit integer samples into the buffer of its
+ * channel and release the earliest records of the channel that fall
+ * out of the window by calling release with a record and releasedata.
+ * The released record and its samples are only valid during the call.
+ *
+ * Returns the number of records released or -1 on error.
+ ***************************************************************************/
+int
+reorder_add (MSRecord *msr,
+	     void (*release) (MSRecord *, void *), void *releasedata)
+{
+  struct reorderchan *rch;
+  struct heldblock *held;
+  int32_t streamid;
+  int released = 0;
+  int idx;
+
+  if ( ! msr || msr->sampletype != 'i' || msr->numsamples <= 0 )
+    return -1;
+
+  if ( ! (streamid = msr_streamid (msr)) )
+    return -1;
+
+  for ( rch = reorderlist; rch; rch = rch->next )
+    if ( rch->streamid == streamid )
+      break;
+
+  if ( ! rch )
+    {
+      if ( ! (rch = (struct reorderchan *) calloc (1, sizeof(struct reorderchan))) )
+	{
+	  ms_log (2, "Cannot allocate memory for reorder buffer\n");
+	  return -1;
+	}
+
+      strcpy (rch->network, msr->network);
+      strcpy (rch->station, msr->station);
+      strcpy (rch->location, msr->location);
+      strcpy (rch->channel, msr->channel);
+      rch->streamid = streamid;
+      rch->next = reorderlist;
+      reorderlist = rch;
+    }
+
+  if ( rch->count >= rch->size )
+    {
+      if ( ! (held = (struct heldblock *) realloc (rch->held, (rch->size + 16) * sizeof(struct heldblock))) )
+	{
+	  ms_log (2, "Cannot allocate memory for reorder buffer\n");
+	  return -1;
+	}
+
+      rch->held = held;
+      rch->size += 16;
+    }
+
+  /* Insert in start time order, after any blocks with the same time */
+  for ( idx = rch->count; idx > 0 && rch->held[idx-1].starttime > msr->starttime; idx-- )
+    rch->held[idx] = rch->held[idx-1];
+
+  held = &rch->held[idx];
+
+  if ( getsamples (held, msr->numsamples) )
+    {
+      ms_log (2, "Cannot allocate memory for reorder buffer\n");
+      memmove (&rch->held[idx], &rch->held[idx+1], (rch->count - idx) * sizeof(struct heldblock));
+      return -1;
+    }
+
+  held->starttime = msr->starttime;
+  held->samprate = msr->samprate;
+  held->numsamples = msr->numsamples;
+
+  memcpy (held->samples, msr->datasamples, (size_t) msr->numsamples * sizeof(int32_t));
+  rch->count++;
+
+  /* Release blocks out of the window */
+  while ( rch->count > 0 &&
+	  (( windowblocks && rch->count > windowblocks ) ||
+	   ( windowseconds > 0.0 &&
+	     (rch->held[rch->count-1].starttime - rch->held[0].starttime) > (hptime_t) (windowseconds * HPTMODULUS) )) )
+    {
+      release_first (rch, release, releasedata);
+      released++;
+    }
+
+  return released;
+}  /* End of reorder_add() */
+
+
+/***************************************************************************
+ * reorder_flush:
+ *
+ * Release all held records in time order per channel.
+ *
+ * Returns the number of records released.
+ ***************************************************************************/
+int
+reorder_flush (void (*release) (MSRecord *, void *), void *releasedata)
+{
+  struct reorderchan *rch;
+  int released = 0;
+
+  for ( rch = reorderlist; rch; rch = rch->next )
+    while ( rch->count > 0 )
+      {
+	release_first (rch, release, releasedata);
+	released++;
+      }
+
+  return released;
+}  /* End of reorder_flush() */
+
+
+/***************************************************************************
+ * reorder_free:
+ *
+ * Free the reorder buffers, any held records are discarded.
+ ***************************************************************************/
+void
+reorder_free (void)
+{
+  struct reorderchan *rch;
+  int idx;
+
+  while ( (rch = reorderlist) )
+    {
+      reorderlist = rch->next;
+
+      for ( idx = 0; idx < rch->count; idx++ )
+	free (rch->held[idx].samples);
+
+      if ( rch->held )
+	free (rch->held);
+      free (rch);
+    }
+
+  while ( sparecount > 0 )
+    free (sparelist[--sparecount].samples);
+
+  if ( sparelist )
+    free (sparelist);
+
+  sparelist = 0;
+  sparesize = 0;
+
+  if ( releasemsr )
+    {
+      releasemsr->datasamples = 0;
+      msr_free (&releasemsr);
+    }
+}  /* End of reorder_free() */
+
+
+/***************************************************************************
+ * release_first:
+ *
+ * Release the earliest held record of a channel.
+ ***************************************************************************/
+static void
+release_first (struct reorderchan *rch,
+	       void (*release) (MSRecord *, void *), void *releasedata)
+{
+  struct heldblock held = rch->held[0];
+
+  rch->count--;
+  memmove (&rch->held[0], &rch->held[1], rch->count * sizeof(struct heldblock));
+
+  if ( (releasemsr = msr_init (releasemsr)) )
+    {
+      strcpy (releasemsr->network, rch->network);
+      strcpy (releasemsr->station, rch->station);
+      strcpy (releasemsr->location, rch->location);
+      strcpy (releasemsr->channel, rch->channel);
+      releasemsr->streamid = rch->streamid;
+      releasemsr->starttime = held.starttime;
+      releasemsr->samprate = held.samprate;
+      releasemsr->datasamples = held.samples;
+      releasemsr->numsamples = held.numsamples;
+      releasemsr->samplecnt = held.numsamples;
+      releasemsr->sampletype = 'i';
+
+      release (releasemsr, releasedata);
+
+      releasemsr->datasamples = 0;
+    }
+  else
+    {
+      ms_log (2, "Cannot initialize MSRecord for released block\n");
+    }
+
+  putsamples (&held);
+}  /* End of release_first() */
+
+
+/***************************************************************************
+ * getsamples:
+ *
+ * Set the sample buffer of a held block, reusing a spare buffer if one
+ * is large enough or allocating a new one.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+getsamples (struct heldblock *held, int64_t numsamples)
+{
+  while ( sparecount > 0 )
+    {
+      *held = sparelist[--sparecount];
+
+      if ( held->capacity >= numsamples )
+	return 0;
+
+      free (held->samples);
+    }
+
+  held->capacity = numsamples;
+
+  return ( held->samples = (int32_t *) malloc ((size_t) numsamples * sizeof(int32_t)) ) ? 0 : -1;
+}  /* End of getsamples() */
+
+
+/***************************************************************************
+ * putsamples:
+ *
+ * Keep the sample buffer of a released block for reuse, or free it if
+ * the list of spare buffers cannot be extended.
+ ***************************************************************************/
+static void
+putsamples (struct heldblock *held)
+{
+  struct heldblock *spare;
+
+  if ( sparecount >= sparesize )
+    {
+      if ( ! (spare = (struct heldblock *) realloc (sparelist, (sparesize + 16) * sizeof(struct heldblock))) )
+	{
+	  free (held->samples);
+	  return;
+	}
+
+      sparelist = spare;
+      sparesize += 16;
+    }
+
+  sparelist[sparecount++] = *held;
+}  /* End of putsamples() */
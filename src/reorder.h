@@ -0,0 +1,26 @@
+/***************************************************************************
+ * reorder.h
+ *
+ * Interface declarations for the per-channel block reorder buffer.
+ ***************************************************************************/
+
+#ifndef REORDER_H
+#define REORDER_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  reorder_init (int blocks, double seconds);
+extern int  reorder_add (MSRecord *msr,
+			 void (*release) (MSRecord *, void *), void *releasedata);
+extern int  reorder_flush (void (*release) (MSRecord *, void *), void *releasedata);
+extern void reorder_free (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REORDER_H */
@@ -0,0 +1,656 @@
+/***************************************************************************
+ * verify.c
+ *
+ * Round-trip verification of the Mini-SEED records written.
+ *
+ * The decoded and scaled samples of each MARS block are kept, with the
+ * input file and offset of the block, in a list per stream sorted by
+ * start time.  Copies of the records passed to the record handler are
+ * queued to a verification thread that unpacks them and compares each
+ * sample with the sample of a kept block at the same time.  A block is
+ * released once all of its samples have been found in records, so the
+ * kept samples are mostly those still buffered for packing.  Blocks
+ * with samples never found in a record are reported when verification
+ * finishes.
+ *
+ * When threads are not available (Windows builds) the records are
+ * verified as they are queued.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libmseed.h>
+
+#if !defined(LMP_WIN)
+  #include <pthread.h>
+  #define VERIFY_THREADS 1
+#endif
+
+#include "verify.h"
+
+/* Maximum number of records queued before the record handler waits */
+#define VERIFY_MAXQUEUE 256
+
+/* Maximum number of mismatches and incomplete blocks reported */
+#define VERIFY_MAXREPORT 20
+
+/* Samples of a MARS block kept for verification */
+struct verifyblock {
+  hptime_t starttime;
+  double   samprate;
+  int      numsamples;
+  int      verified;            /* Count of samples found in records */
+  int32_t *samples;             /* Samples, 0 once all are verified */
+  const char *file;             /* Input file of the block */
+  int64_t  offset;              /* Offset of the block in the input file */
+};
+
+/* Kept blocks of a stream, sorted by start time */
+struct verifystream {
+  struct verifyblock *blocks;
+  int      first;               /* Index of the first kept block */
+  int      count;               /* Index after the last kept block */
+  int      size;                /* Allocated number of blocks */
+  hptime_t maxspan;             /* Longest time span of a block */
+};
+
+/* Copy of a record queued for verification */
+struct verifyrecord {
+  int      reclen;
+  char    *record;
+  struct verifyrecord *next;
+};
+
+/* Names of the input files of kept blocks */
+struct verifyfile {
+  char    *name;
+  struct verifyfile *next;
+};
+
+static flag    verifyverbose = 0;
+static struct verifystream **streams = 0;  /* Indexed by stream ID - 1 */
+static int32_t streamcount = 0;
+static struct verifyfile *filelist = 0;
+static MSRecord *inlinemsr = 0;
+
+static struct verifyrecord *queuehead = 0;
+static struct verifyrecord *queuetail = 0;
+static int     queued = 0;
+static flag    stopping = 0;
+
+/* Results, only updated by the verifying thread */
+static int64_t verifiedrecords = 0;
+static int64_t verifiedsamples = 0;
+static int64_t failedrecords = 0;
+static int64_t mismatches = 0;
+static int     reports = 0;
+
+#if defined(VERIFY_THREADS)
+static pthread_t       verifythread;
+static flag            threadstarted = 0;
+static pthread_mutex_t queuelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  queuecond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t storelock = PTHREAD_MUTEX_INITIALIZER;
+#define STORE_LOCK()   pthread_mutex_lock (&storelock)
+#define STORE_UNLOCK() pthread_mutex_unlock (&storelock)
+static void *verifyworker (void *arg);
+#else
+#define STORE_LOCK()
+#define STORE_UNLOCK()
+#endif
+
+static void checkrecord (char *record, int reclen, MSRecord **ppmsr);
+static struct verifyblock *findblock (struct verifystream *vs, hptime_t time,
+				      int32_t value, int *index, flag *match);
+static const char *filename (const char *mfile);
+
+
+/***************************************************************************
+ * verify_init:
+ *
+ * Start the verification thread.  If the thread cannot be started
+ * records are verified by the thread queueing them.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+verify_init (flag verbose)
+{
+  verifyverbose = verbose;
+
+#if defined(VERIFY_THREADS)
+  if ( pthread_create (&verifythread, NULL, verifyworker, NULL) )
+    ms_log (1, "Warning: cannot start verification thread, verifying serially\n");
+  else
+    threadstarted = 1;
+#endif
+
+  if ( verifyverbose )
+    ms_log (1, "Verifying output records against the MARS samples\n");
+
+  return 0;
+}  /* End of verify_init() */
+
+
+/***************************************************************************
+ * verify_block:
+ *
+ * Keep a copy of the decoded and scaled samples of a MARS block to
+ * verify the records packed from them.  The start time, sample rate
+ * and codes are taken from the MSRecord.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+verify_block (MSRecord *msr, int32_t *samples, const char *mfile, int64_t offset)
+{
+  struct verifystream *vs;
+  struct verifystream **newstreams;
+  struct verifyblock *vb;
+  struct verifyblock *newblocks;
+  int32_t streamid;
+  int32_t *copy;
+  hptime_t span;
+  int low, high, mid;
+
+  if ( ! msr || ! samples || msr->numsamples <= 0 || msr->samprate <= 0.0 )
+    return -1;
+
+  if ( ! (streamid = msr_streamid (msr)) )
+    return -1;
+
+  if ( ! (copy = (int32_t *) malloc ((size_t) msr->numsamples * sizeof(int32_t))) )
+    {
+      ms_log (2, "verify_block(): Cannot allocate memory\n");
+      return -1;
+    }
+
+  memcpy (copy, samples, (size_t) msr->numsamples * sizeof(int32_t));
+
+  STORE_LOCK ();
+
+  /* Find or add the stream */
+  if ( streamid > streamcount )
+    {
+      if ( ! (newstreams = (struct verifystream **) realloc (streams, streamid * sizeof(struct verifystream *))) )
+	{
+	  STORE_UNLOCK ();
+	  ms_log (2, "verify_block(): Cannot allocate memory\n");
+	  free (copy);
+	  return -1;
+	}
+
+      memset (newstreams + streamcount, 0, (streamid - streamcount) * sizeof(struct verifystream *));
+      streams = newstreams;
+      streamcount = streamid;
+    }
+
+  if ( ! (vs = streams[streamid - 1]) )
+    {
+      if ( ! (vs = (struct verifystream *) calloc (1, sizeof(struct verifystream))) )
+	{
+	  STORE_UNLOCK ();
+	  ms_log (2, "verify_block(): Cannot allocate memory\n");
+	  free (copy);
+	  return -1;
+	}
+
+      streams[streamid - 1] = vs;
+    }
+
+  /* Drop released blocks from the front of the list */
+  if ( vs->first > 0 && vs->first >= vs->count / 2 )
+    {
+      memmove (vs->blocks, vs->blocks + vs->first,
+	       (vs->count - vs->first) * sizeof(struct verifyblock));
+      vs->count -= vs->first;
+      vs->first = 0;
+    }
+
+  if ( vs->count >= vs->size )
+    {
+      if ( ! (newblocks = (struct verifyblock *) realloc (vs->blocks, (vs->size ? vs->size * 2 : 64) * sizeof(struct verifyblock))) )
+	{
+	  STORE_UNLOCK ();
+	  ms_log (2, "verify_block(): Cannot allocate memory\n");
+	  free (copy);
+	  return -1;
+	}
+
+      vs->blocks = newblocks;
+      vs->size = ( vs->size ) ? vs->size * 2 : 64;
+    }
+
+  /* Insert in start time order, blocks usually arrive in order */
+  low = vs->first;
+  high = vs->count;
+  while ( low < high )
+    {
+      mid = low + (high - low) / 2;
+
+      if ( vs->blocks[mid].starttime <= msr->starttime )
+	low = mid + 1;
+      else
+	high = mid;
+    }
+
+  if ( low < vs->count )
+    memmove (vs->blocks + low + 1, vs->blocks + low,
+	     (vs->count - low) * sizeof(struct verifyblock));
+
+  vb = &vs->blocks[low];
+  vb->starttime = msr->starttime;
+  vb->samprate = msr->samprate;
+  vb->numsamples = (int) msr->numsamples;
+  vb->verified = 0;
+  vb->samples = copy;
+  vb->file = filename (mfile);
+  vb->offset = offset;
+  vs->count++;
+
+  span = (hptime_t) (msr->numsamples * (HPTMODULUS / msr->samprate));
+  if ( span > vs->maxspan )
+    vs->maxspan = span;
+
+  STORE_UNLOCK ();
+
+  return 0;
+}  /* End of verify_block() */
+
+
+/***************************************************************************
+ * verify_record:
+ *
+ * Queue a copy of a record for verification, waiting while the queue
+ * is full.
+ ***************************************************************************/
+void
+verify_record (char *record, int reclen)
+{
+#if defined(VERIFY_THREADS)
+  struct verifyrecord *vr;
+
+  if ( threadstarted )
+    {
+      if ( ! (vr = (struct verifyrecord *) malloc (sizeof(struct verifyrecord) + reclen)) )
+	{
+	  ms_log (2, "verify_record(): Cannot allocate memory\n");
+	  return;
+	}
+
+      vr->reclen = reclen;
+      vr->record = (char *) (vr + 1);
+      vr->next = 0;
+      memcpy (vr->record, record, reclen);
+
+      pthread_mutex_lock (&queuelock);
+
+      while ( queued >= VERIFY_MAXQUEUE )
+	pthread_cond_wait (&queuecond, &queuelock);
+
+      if ( queuetail )
+	queuetail->next = vr;
+      else
+	queuehead = vr;
+
+      queuetail = vr;
+      queued++;
+
+      pthread_cond_broadcast (&queuecond);
+      pthread_mutex_unlock (&queuelock);
+
+      return;
+    }
+#endif
+
+  checkrecord (record, reclen, &inlinemsr);
+}  /* End of verify_record() */
+
+
+/***************************************************************************
+ * verify_finish:
+ *
+ * Wait for all queued records to be verified, report the blocks with
+ * samples not found in any record and a summary, and free all kept
+ * samples.
+ *
+ * Returns the count of mismatched and missing samples plus the count
+ * of records that could not be unpacked, 0 if the output verified.
+ ***************************************************************************/
+int64_t
+verify_finish (void)
+{
+  struct verifystream *vs;
+  struct verifyblock *vb;
+  struct verifyfile *vf;
+  int64_t missing = 0;
+  int32_t streamid;
+  int idx;
+  char srcname[50];
+  char timestr[30];
+
+#if defined(VERIFY_THREADS)
+  if ( threadstarted )
+    {
+      pthread_mutex_lock (&queuelock);
+      stopping = 1;
+      pthread_cond_broadcast (&queuecond);
+      pthread_mutex_unlock (&queuelock);
+
+      pthread_join (verifythread, NULL);
+      threadstarted = 0;
+    }
+#endif
+
+  reports = 0;
+
+  for ( streamid = 1; streamid <= streamcount; streamid++ )
+    {
+      if ( ! (vs = streams[streamid - 1]) )
+	continue;
+
+      for ( idx = vs->first; idx < vs->count; idx++ )
+	{
+	  vb = &vs->blocks[idx];
+
+	  if ( ! vb->samples )
+	    continue;
+
+	  missing += vb->numsamples - vb->verified;
+
+	  if ( reports++ < VERIFY_MAXREPORT )
+	    {
+	      strncpy (srcname, ms_streamid_srcname (streamid), sizeof(srcname) - 1);
+	      srcname[sizeof(srcname) - 1] = '\0';
+	      ms_log (2, "Verify: %d of %d samples of %s block at %s not in output, offset %"PRId64" of %s\n",
+		      vb->numsamples - vb->verified, vb->numsamples, srcname,
+		      ms_hptime2seedtimestr (vb->starttime, timestr, 1),
+		      vb->offset, vb->file);
+	    }
+
+	  free (vb->samples);
+	}
+
+      if ( vs->blocks )
+	free (vs->blocks);
+      free (vs);
+    }
+
+  if ( reports > VERIFY_MAXREPORT )
+    ms_log (2, "Verify: %d more block(s) with samples not in output\n",
+	    reports - VERIFY_MAXREPORT);
+
+  if ( streams )
+    free (streams);
+  streams = 0;
+  streamcount = 0;
+
+  while ( filelist )
+    {
+      vf = filelist;
+      filelist = vf->next;
+      free (vf->name);
+      free (vf);
+    }
+
+  if ( inlinemsr )
+    msr_free (&inlinemsr);
+
+  ms_log ((mismatches || missing || failedrecords) ? 2 : 1,
+	  "Verified %"PRId64" record(s) with %"PRId64" samples, %"PRId64" mismatched, "
+	  "%"PRId64" missing, %"PRId64" record(s) not unpacked\n",
+	  verifiedrecords, verifiedsamples, mismatches, missing, failedrecords);
+
+  return mismatches + missing + failedrecords;
+}  /* End of verify_finish() */
+
+
+#if defined(VERIFY_THREADS)
+/***************************************************************************
+ * verifyworker:
+ *
+ * Verification thread, verifies queued records until stopped and the
+ * queue is empty.
+ ***************************************************************************/
+static void *
+verifyworker (void *arg)
+{
+  struct verifyrecord *vr;
+  MSRecord *msr = 0;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&queuelock);
+
+      while ( ! queuehead && ! stopping )
+	pthread_cond_wait (&queuecond, &queuelock);
+
+      if ( (vr = queuehead) )
+	{
+	  if ( ! (queuehead = vr->next) )
+	    queuetail = 0;
+
+	  queued--;
+	  pthread_cond_broadcast (&queuecond);
+	}
+
+      pthread_mutex_unlock (&queuelock);
+
+      if ( ! vr )
+	break;
+
+      checkrecord (vr->record, vr->reclen, &msr);
+      free (vr);
+    }
+
+  if ( msr )
+    msr_free (&msr);
+
+  /* Hand messages buffered by this thread to the log writer */
+  ms_logflush ();
+
+  return NULL;
+}  /* End of verifyworker() */
+#endif
+
+
+/***************************************************************************
+ * checkrecord:
+ *
+ * Unpack a record and compare its samples with the kept samples,
+ * releasing the kept blocks whose samples have all been found.  The
+ * first mismatch of a record is reported.
+ ***************************************************************************/
+static void
+checkrecord (char *record, int reclen, MSRecord **ppmsr)
+{
+  struct verifystream *vs = 0;
+  struct verifyblock *vb = 0;
+  MSRecord *msr;
+  int32_t *samples;
+  int32_t streamid;
+  hptime_t sampletime;
+  int64_t idx;
+  int64_t recordmismatches = 0;
+  int sampleidx = 0;
+  flag match;
+  char srcname[50];
+  char timestr[30];
+
+  if ( msr_unpack (record, reclen, ppmsr, 1, 0) != MS_NOERROR ||
+       (*ppmsr)->sampletype != 'i' || (*ppmsr)->samprate <= 0.0 )
+    {
+      if ( failedrecords++ < VERIFY_MAXREPORT )
+	ms_log (2, "Verify: cannot unpack integer samples of output record %"PRId64"\n",
+		verifiedrecords + failedrecords);
+      return;
+    }
+
+  msr = *ppmsr;
+  samples = (int32_t *) msr->datasamples;
+  streamid = msr_streamid (msr);
+
+  STORE_LOCK ();
+
+  if ( streamid > 0 && streamid <= streamcount )
+    vs = streams[streamid - 1];
+
+  for ( idx = 0; idx < msr->numsamples; idx++ )
+    {
+      /* Continue in the current block while the samples match */
+      if ( vb && sampleidx < vb->numsamples && vb->samples[sampleidx] == samples[idx] )
+	{
+	  match = 1;
+	}
+      else
+	{
+	  sampletime = msr->starttime + (hptime_t) (idx * (HPTMODULUS / msr->samprate) + 0.5);
+	  match = 0;
+	  vb = ( vs ) ? findblock (vs, sampletime, samples[idx], &sampleidx, &match) : 0;
+	}
+
+      if ( match )
+	{
+	  sampleidx++;
+
+	  /* Release the samples of a block once all are verified */
+	  if ( ++vb->verified >= vb->numsamples )
+	    {
+	      free (vb->samples);
+	      vb->samples = 0;
+	      vb = 0;
+
+	      while ( vs->first < vs->count && ! vs->blocks[vs->first].samples )
+		vs->first++;
+	    }
+
+	  continue;
+	}
+
+      if ( recordmismatches++ == 0 && reports++ < VERIFY_MAXREPORT )
+	{
+	  sampletime = msr->starttime + (hptime_t) (idx * (HPTMODULUS / msr->samprate) + 0.5);
+	  ms_hptime2seedtimestr (sampletime, timestr, 1);
+
+	  if ( vb )
+	    ms_log (2, "Verify: %s sample at %s is %d, expected %d from block at offset %"PRId64" of %s\n",
+		    msr_srcname (msr, srcname, 0), timestr, samples[idx],
+		    vb->samples[sampleidx], vb->offset, vb->file);
+	  else
+	    ms_log (2, "Verify: %s sample at %s is %d, not from any MARS block\n",
+		    msr_srcname (msr, srcname, 0), timestr, samples[idx]);
+	}
+
+      vb = 0;
+    }
+
+  STORE_UNLOCK ();
+
+  verifiedrecords++;
+  verifiedsamples += msr->numsamples;
+  mismatches += recordmismatches;
+}  /* End of checkrecord() */
+
+
+/***************************************************************************
+ * findblock:
+ *
+ * Find a kept block with a sample at the specified time, preferring a
+ * block whose sample has the specified value when blocks overlap.  The
+ * index of the sample in the block is returned in index and match is
+ * set if the sample has the specified value.
+ *
+ * Returns the block or 0 if no kept block has a sample at the time.
+ ***************************************************************************/
+static struct verifyblock *
+findblock (struct verifystream *vs, hptime_t time, int32_t value,
+	   int *index, flag *match)
+{
+  struct verifyblock *found = 0;
+  struct verifyblock *vb;
+  int64_t sampleidx;
+  int low, high, mid;
+
+  *match = 0;
+
+  /* Find the last block starting within half a sample after the time */
+  low = vs->first;
+  high = vs->count;
+  while ( low < high )
+    {
+      mid = low + (high - low) / 2;
+      vb = &vs->blocks[mid];
+
+      if ( vb->starttime <= time + (hptime_t) (HPTMODULUS / vb->samprate / 2) )
+	low = mid + 1;
+      else
+	high = mid;
+    }
+
+  /* Check the blocks that can contain the time, latest first */
+  for ( mid = low - 1; mid >= vs->first; mid-- )
+    {
+      vb = &vs->blocks[mid];
+
+      if ( vb->starttime + vs->maxspan < time )
+	break;
+
+      if ( ! vb->samples )
+	continue;
+
+      sampleidx = (int64_t) floor ((double) (time - vb->starttime) * vb->samprate / HPTMODULUS + 0.5);
+
+      if ( sampleidx < 0 || sampleidx >= vb->numsamples )
+	continue;
+
+      if ( vb->samples[sampleidx] == value )
+	{
+	  *index = (int) sampleidx;
+	  *match = 1;
+	  return vb;
+	}
+
+      if ( ! found )
+	{
+	  found = vb;
+	  *index = (int) sampleidx;
+	}
+    }
+
+  return found;
+}  /* End of findblock() */
+
+
+/***************************************************************************
+ * filename:
+ *
+ * Returns a kept copy of an input file name, each name is kept once.
+ ***************************************************************************/
+static const char *
+filename (const char *mfile)
+{
+  struct verifyfile *vf;
+
+  if ( ! mfile )
+    mfile = "";
+
+  for ( vf = filelist; vf; vf = vf->next )
+    if ( ! strcmp (vf->name, mfile) )
+      return vf->name;
+
+  if ( ! (vf = (struct verifyfile *) malloc (sizeof(struct verifyfile))) ||
+       ! (vf->name = strdup (mfile)) )
+    {
+      if ( vf )
+	free (vf);
+      return "";
+    }
+
+  vf->next = filelist;
+  filelist = vf;
+
+  return vf->name;
+}  /* End of filename() */
@@ -0,0 +1,26 @@
+/***************************************************************************
+ * verify.h
+ *
+ * Interface declarations for round-trip verification of output records.
+ ***************************************************************************/
+
+#ifndef VERIFY_H
+#define VERIFY_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int     verify_init (flag verbose);
+extern int     verify_block (MSRecord *msr, int32_t *samples,
+			     const char *mfile, int64_t offset);
+extern void    verify_record (char *record, int reclen);
+extern int64_t verify_finish (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VERIFY_H */
@@ -0,0 +1,483 @@
+/***************************************************************************
+ * watchdir.c
+ *
+ * Watch a directory for new input files and pass each completed file
+ * to a handler, moving or flagging the file when it has been handled.
+ *
+ * Files already present in the directory when watching starts are
+ * assumed to be complete and are handled first, in name order.  On
+ * Linux new files are detected with inotify when they are closed after
+ * writing or moved into the directory.  On other systems the directory
+ * is scanned periodically and a file is handled once its size and
+ * modification time have not changed between two scans.
+ *
+ * Hidden files (starting with '.') and files ending with ".mseed" or
+ * ".done" are ignored, so output written next to the inputs and inputs
+ * flagged as done are not picked up again.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libmseed.h>
+
+#include "watchdir.h"
+
+#if defined(LMP_WIN)
+  #include <windows.h>
+#else
+  #include <dirent.h>
+  #include <unistd.h>
+  #include <time.h>
+#endif
+
+#if defined(__linux__)
+  #include <poll.h>
+  #include <sys/inotify.h>
+#endif
+
+/* Interval in milliseconds for checking the stop flag and scanning */
+#define WATCHDIR_POLLMS 1000
+
+/* File seen during periodic scans but not yet handled */
+struct pending {
+  char   *name;
+  off_t   size;
+  time_t  mtime;
+  int     seen;          /* Set when found in the current scan */
+  int     failed;        /* Set when the handler failed for this file */
+  struct pending *next;
+};
+
+static int isinput (const char *name);
+static int handlefile (const char *dirname, const char *name, const char *donedir,
+		       int (*file_handler) (char *, void *), void *handlerdata,
+		       flag verbose);
+
+#if !defined(LMP_WIN)
+static int nameselect (const struct dirent *entry);
+static int handleexisting (const char *dirname, const char *donedir,
+			   int (*file_handler) (char *, void *), void *handlerdata,
+			   volatile sig_atomic_t *stop, flag verbose);
+#endif
+#if !defined(LMP_WIN) && !defined(__linux__)
+static int scanpending (const char *dirname, const char *donedir,
+			int (*file_handler) (char *, void *), void *handlerdata,
+			struct pending **pendlist, volatile sig_atomic_t *stop,
+			flag verbose);
+#endif
+
+
+/***************************************************************************
+ * watchdir_run:
+ *
+ * Watch the directory dirname for new input files and call file_handler
+ * with the path of each file and handlerdata.  After a file has been
+ * handled successfully it is moved to donedir if specified, otherwise
+ * it is renamed with a ".done" suffix.  Files the handler fails on are
+ * left in place and reported.
+ *
+ * Watching continues until the value pointed to by stop is set, which
+ * is checked between files and at least every second.
+ *
+ * Returns 0 when stopped and -1 if the directory cannot be watched.
+ ***************************************************************************/
+int
+watchdir_run (const char *dirname, const char *donedir,
+	      int (*file_handler) (char *, void *),
+	      void *handlerdata, volatile sig_atomic_t *stop,
+	      flag verbose)
+{
+#if defined(LMP_WIN)
+  ms_log (2, "Watching a directory is not supported on this platform\n");
+  return -1;
+#else
+  struct stat st;
+
+  if ( ! dirname || ! file_handler || ! stop )
+    return -1;
+
+  if ( stat (dirname, &st) || ! S_ISDIR(st.st_mode) )
+    {
+      ms_log (2, "Cannot watch %s, not a directory\n", dirname);
+      return -1;
+    }
+
+  if ( donedir && (stat (donedir, &st) || ! S_ISDIR(st.st_mode)) )
+    {
+      ms_log (2, "Cannot move inputs to %s, not a directory\n", donedir);
+      return -1;
+    }
+
+  if ( verbose )
+    ms_log (1, "Watching %s for new input files\n", dirname);
+
+#if defined(__linux__)
+  {
+    union {
+      struct inotify_event event;
+      char buf[8192];
+    } events;
+    struct inotify_event *event;
+    struct pollfd pfd;
+    ssize_t length;
+    char *ptr;
+    int fd;
+
+    /* Add the watch before handling existing files so none are missed */
+    if ( (fd = inotify_init ()) < 0 )
+      {
+	ms_log (2, "Cannot initialize inotify: %s\n", strerror(errno));
+	return -1;
+      }
+
+    if ( inotify_add_watch (fd, dirname, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 )
+      {
+	ms_log (2, "Cannot watch %s: %s\n", dirname, strerror(errno));
+	close (fd);
+	return -1;
+      }
+
+    handleexisting (dirname, donedir, file_handler, handlerdata, stop, verbose);
+
+    while ( ! *stop )
+      {
+	/* Print messages buffered for the log writer before waiting */
+	ms_logflush ();
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	if ( poll (&pfd, 1, WATCHDIR_POLLMS) <= 0 )
+	  continue;
+
+	if ( (length = read (fd, events.buf, sizeof(events.buf))) <= 0 )
+	  {
+	    if ( length < 0 && errno != EINTR && errno != EAGAIN )
+	      {
+		ms_log (2, "Cannot read inotify events: %s\n", strerror(errno));
+		break;
+	      }
+	    continue;
+	  }
+
+	for ( ptr = events.buf; ptr < events.buf + length && ! *stop;
+	      ptr += sizeof(struct inotify_event) + event->len )
+	  {
+	    event = (struct inotify_event *) ptr;
+
+	    /* Events were lost, handle whatever is in the directory */
+	    if ( event->mask & IN_Q_OVERFLOW )
+	      {
+		ms_log (1, "Warning: inotify event queue overflowed, rescanning %s\n", dirname);
+		handleexisting (dirname, donedir, file_handler, handlerdata, stop, verbose);
+		continue;
+	      }
+
+	    if ( event->len == 0 || (event->mask & IN_ISDIR) || ! isinput (event->name) )
+	      continue;
+
+	    handlefile (dirname, event->name, donedir, file_handler, handlerdata, verbose);
+	  }
+      }
+
+    close (fd);
+  }
+#else
+  {
+    struct pending *pendlist = 0;
+    struct pending *pend;
+    struct timespec ts;
+
+    handleexisting (dirname, donedir, file_handler, handlerdata, stop, verbose);
+
+    while ( ! *stop )
+      {
+	/* Print messages buffered for the log writer before waiting */
+	ms_logflush ();
+
+	ts.tv_sec = WATCHDIR_POLLMS / 1000;
+	ts.tv_nsec = (WATCHDIR_POLLMS % 1000) * 1000000L;
+	nanosleep (&ts, NULL);
+
+	if ( *stop )
+	  break;
+
+	scanpending (dirname, donedir, file_handler, handlerdata, &pendlist, stop, verbose);
+      }
+
+    while ( pendlist )
+      {
+	pend = pendlist->next;
+	free (pendlist->name);
+	free (pendlist);
+	pendlist = pend;
+      }
+  }
+#endif
+
+  if ( verbose )
+    ms_log (1, "Stopped watching %s\n", dirname);
+
+  return 0;
+#endif
+}  /* End of watchdir_run() */
+
+
+/***************************************************************************
+ * isinput:
+ *
+ * Returns 1 if the file name should be handled as an input file and 0
+ * if it should be ignored.
+ ***************************************************************************/
+static int
+isinput (const char *name)
+{
+  size_t length;
+
+  if ( ! name || *name == '.' || *name == '\0' )
+    return 0;
+
+  length = strlen (name);
+
+  if ( length >= 6 && strcmp (name + length - 6, ".mseed") == 0 )
+    return 0;
+
+  if ( length >= 5 && strcmp (name + length - 5, ".done") == 0 )
+    return 0;
+
+  return 1;
+}  /* End of isinput() */
+
+
+/***************************************************************************
+ * handlefile:
+ *
+ * Call the handler for a file in the watched directory and move or
+ * flag the file when done.  Files that no longer exist, for example
+ * because they were already handled, and non-regular files are
+ * skipped.
+ *
+ * Returns 1 if the file was handled, 0 if skipped and -1 if the
+ * handler failed.
+ ***************************************************************************/
+static int
+handlefile (const char *dirname, const char *name, const char *donedir,
+	    int (*file_handler) (char *, void *), void *handlerdata,
+	    flag verbose)
+{
+  char path[1024];
+  char donepath[1024];
+  struct stat st;
+  int length;
+
+  if ( snprintf (path, sizeof(path), "%s/%s", dirname, name) >= (int) sizeof(path) )
+    {
+      ms_log (2, "Path of %s in %s is too long, skipping it\n", name, dirname);
+      return 0;
+    }
+
+  if ( stat (path, &st) || ! S_ISREG(st.st_mode) )
+    return 0;
+
+  if ( verbose )
+    ms_log (1, "Converting new input file %s\n", path);
+
+  if ( file_handler (path, handlerdata) < 0 )
+    {
+      ms_log (2, "Cannot convert %s, leaving it in place\n", path);
+      return -1;
+    }
+
+  if ( donedir )
+    length = snprintf (donepath, sizeof(donepath), "%s/%s", donedir, name);
+  else
+    length = snprintf (donepath, sizeof(donepath), "%s.done", path);
+
+  if ( length < 0 || length >= (int) sizeof(donepath) )
+    ms_log (2, "Cannot move %s, the new path is too long\n", path);
+  else if ( rename (path, donepath) )
+    ms_log (2, "Cannot move %s to %s: %s\n", path, donepath, strerror(errno));
+  else if ( verbose >= 2 )
+    ms_log (1, "Moved %s to %s\n", path, donepath);
+
+  return 1;
+}  /* End of handlefile() */
+
+
+#if !defined(LMP_WIN)
+/***************************************************************************
+ * nameselect:
+ *
+ * Selection function for scandir() to list input files.
+ ***************************************************************************/
+static int
+nameselect (const struct dirent *entry)
+{
+  return isinput (entry->d_name);
+}  /* End of nameselect() */
+
+
+/***************************************************************************
+ * handleexisting:
+ *
+ * Handle all input files in the watched directory in name order.
+ *
+ * Returns the number of files handled or -1 on error.
+ ***************************************************************************/
+static int
+handleexisting (const char *dirname, const char *donedir,
+		int (*file_handler) (char *, void *), void *handlerdata,
+		volatile sig_atomic_t *stop, flag verbose)
+{
+  struct dirent **namelist = 0;
+  int handled = 0;
+  int count;
+  int idx;
+
+  if ( (count = scandir (dirname, &namelist, nameselect, alphasort)) < 0 )
+    {
+      ms_log (2, "Cannot read directory %s: %s\n", dirname, strerror(errno));
+      return -1;
+    }
+
+  for ( idx = 0; idx < count; idx++ )
+    {
+      if ( ! *stop &&
+	   handlefile (dirname, namelist[idx]->d_name, donedir,
+		       file_handler, handlerdata, verbose) > 0 )
+	handled++;
+
+      free (namelist[idx]);
+    }
+
+  free (namelist);
+
+  return handled;
+}  /* End of handleexisting() */
+#endif
+
+
+#if !defined(LMP_WIN) && !defined(__linux__)
+
+/***************************************************************************
+ * scanpending:
+ *
+ * Scan the watched directory and handle the input files whose size and
+ * modification time are unchanged since the previous scan.  The list
+ * of pending files is updated, files no longer in the directory are
+ * removed from it.  Files the handler failed on are remembered and not
+ * retried until they change.
+ *
+ * Returns the number of files handled or -1 on error.
+ ***************************************************************************/
+static int
+scanpending (const char *dirname, const char *donedir,
+	     int (*file_handler) (char *, void *), void *handlerdata,
+	     struct pending **pendlist, volatile sig_atomic_t *stop,
+	     flag verbose)
+{
+  struct dirent **namelist = 0;
+  struct pending *pend;
+  struct pending **pprev;
+  struct stat st;
+  char path[1024];
+  int handled = 0;
+  int count;
+  int idx;
+  int rv;
+
+  if ( (count = scandir (dirname, &namelist, nameselect, alphasort)) < 0 )
+    {
+      ms_log (2, "Cannot read directory %s: %s\n", dirname, strerror(errno));
+      return -1;
+    }
+
+  for ( pend = *pendlist; pend; pend = pend->next )
+    pend->seen = 0;
+
+  for ( idx = 0; idx < count; idx++ )
+    {
+      snprintf (path, sizeof(path), "%s/%s", dirname, namelist[idx]->d_name);
+
+      if ( *stop || stat (path, &st) || ! S_ISREG(st.st_mode) )
+	{
+	  free (namelist[idx]);
+	  continue;
+	}
+
+      for ( pend = *pendlist; pend; pend = pend->next )
+	if ( ! strcmp (pend->name, namelist[idx]->d_name) )
+	  break;
+
+      if ( ! pend )
+	{
+	  /* New file, handle it when unchanged in the next scan */
+	  if ( (pend = (struct pending *) calloc (1, sizeof(struct pending))) &&
+	       (pend->name = strdup (namelist[idx]->d_name)) )
+	    {
+	      pend->size = st.st_size;
+	      pend->mtime = st.st_mtime;
+	      pend->seen = 1;
+	      pend->next = *pendlist;
+	      *pendlist = pend;
+	    }
+	  else
+	    {
+	      ms_log (2, "Cannot allocate memory for pending file\n");
+	      free (pend);
+	    }
+	}
+      else if ( pend->size != st.st_size || pend->mtime != st.st_mtime )
+	{
+	  /* Still being written or changed after a failure */
+	  pend->size = st.st_size;
+	  pend->mtime = st.st_mtime;
+	  pend->failed = 0;
+	  pend->seen = 1;
+	}
+      else if ( ! pend->failed )
+	{
+	  rv = handlefile (dirname, pend->name, donedir, file_handler, handlerdata, verbose);
+
+	  if ( rv > 0 )
+	    handled++;
+	  else if ( rv < 0 )
+	    pend->failed = 1;
+
+	  /* Handled files are removed from the list as they are no longer seen */
+	  pend->seen = ( rv < 0 );
+	}
+      else
+	{
+	  pend->seen = 1;
+	}
+
+      free (namelist[idx]);
+    }
+
+  free (namelist);
+
+  /* Remove files no longer pending from the list */
+  pprev = pendlist;
+  while ( (pend = *pprev) )
+    {
+      if ( pend->seen )
+	{
+	  pprev = &pend->next;
+	  continue;
+	}
+
+      *pprev = pend->next;
+      free (pend->name);
+      free (pend);
+    }
+
+  return handled;
+}  /* End of scanpending() */
+#endif
@@ -0,0 +1,26 @@
+/***************************************************************************
+ * watchdir.h
+ *
+ * Interface declarations for watching a directory for new input files.
+ ***************************************************************************/
+
+#ifndef WATCHDIR_H
+#define WATCHDIR_H 1
+
+#include <signal.h>
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int watchdir_run (const char *dirname, const char *donedir,
+			 int (*file_handler) (char *, void *),
+			 void *handlerdata, volatile sig_atomic_t *stop,
+			 flag verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WATCHDIR_H */
@@ -0,0 +1,127 @@
+/***************************************************************************
+ * marsblocks.c
+ *
+ * A helper for the mars2mseed tests that copies a range of MARS blocks
+ * from one file to another, optionally swapping the order of blocks.
+ *
+ * With -s each pair of consecutive blocks of the same channel is
+ * swapped in place, so every channel arrives one block out of order
+ * while the order of the channels among each other is kept.  Pairs
+ * are formed within the copied range only.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of MARS blocks and offset of the channel number in the header */
+#define BLOCKSIZE 1024
+#define CHANOFFSET 16
+
+static void usage (void);
+
+int
+main (int argc, char **argv)
+{
+  FILE *ifp;
+  FILE *ofp;
+  char *blocks;
+  char swap[BLOCKSIZE];
+  long pending[256];
+  long first;
+  long count;
+  long idx;
+  int chan;
+  int swapblocks = 0;
+  int argidx = 1;
+
+  if ( argc > 1 && ! strcmp (argv[1], "-s") )
+    {
+      swapblocks = 1;
+      argidx++;
+    }
+
+  if ( argc - argidx != 4 )
+    {
+      usage ();
+      return 1;
+    }
+
+  first = strtol (argv[argidx + 2], NULL, 10);
+  count = strtol (argv[argidx + 3], NULL, 10);
+
+  if ( first < 0 || count < 1 )
+    {
+      usage ();
+      return 1;
+    }
+
+  if ( ! (ifp = fopen (argv[argidx], "rb")) )
+    {
+      fprintf (stderr, "Cannot open %s\n", argv[argidx]);
+      return 1;
+    }
+
+  if ( ! (blocks = (char *) malloc ((size_t) count * BLOCKSIZE)) )
+    {
+      fprintf (stderr, "Cannot allocate memory for %ld blocks\n", count);
+      return 1;
+    }
+
+  /* Read the blocks of the range that exist */
+  if ( fseek (ifp, first * BLOCKSIZE, SEEK_SET) )
+    count = 0;
+  else
+    count = (long) fread (blocks, BLOCKSIZE, count, ifp);
+
+  fclose (ifp);
+
+  if ( swapblocks )
+    {
+      for ( chan = 0; chan < 256; chan++ )
+	pending[chan] = -1;
+
+      for ( idx = 0; idx < count; idx++ )
+	{
+	  chan = (unsigned char) blocks[idx * BLOCKSIZE + CHANOFFSET];
+
+	  if ( pending[chan] < 0 )
+	    {
+	      pending[chan] = idx;
+	      continue;
+	    }
+
+	  memcpy (swap, blocks + pending[chan] * BLOCKSIZE, BLOCKSIZE);
+	  memcpy (blocks + pending[chan] * BLOCKSIZE, blocks + idx * BLOCKSIZE, BLOCKSIZE);
+	  memcpy (blocks + idx * BLOCKSIZE, swap, BLOCKSIZE);
+	  pending[chan] = -1;
+	}
+    }
+
+  if ( ! (ofp = fopen (argv[argidx + 1], "wb")) ||
+       (count > 0 && fwrite (blocks, BLOCKSIZE, count, ofp) != (size_t) count) )
+    {
+      fprintf (stderr, "Cannot write %s\n", argv[argidx + 1]);
+      return 1;
+    }
+
+  fclose (ofp);
+  free (blocks);
+
+  return 0;
+}  /* End of main() */
+
+
+/***************************************************************************
+ * usage:
+ *
+ * Print the usage message.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "Usage: marsblocks [-s] infile outfile first count\n\n");
+  fprintf (stderr, " -s    Swap consecutive blocks of each channel\n");
+  fprintf (stderr, " first Index of the first block to copy\n");
+  fprintf (stderr, " count Number of blocks to copy\n");
+}  /* End of usage() */
@@ -0,0 +1,133 @@
+/***************************************************************************
+ * marstrace.c
+ *
+ * A helper for the mars2mseed tests that builds a long continuous
+ * trace from a single MARS data block.
+ *
+ * The block is written count times, each copy starting where the
+ * previous one ends.  The samples of each copy are rotated by a
+ * different amount so that consecutive copies are not identical.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of MARS blocks, their samples and offsets in the header */
+#define BLOCKSIZE 1024
+#define SAMPLES 500
+#define DATAOFFSET 24
+#define FORMATOFFSET 3
+#define RATEOFFSET 17
+#define M88TIMEOFFSET 8
+#define LITETIMEOFFSET 12
+
+static void usage (void);
+
+int
+main (int argc, char **argv)
+{
+  FILE *ifp;
+  FILE *ofp;
+  unsigned char block[BLOCKSIZE];
+  unsigned char copy[BLOCKSIZE];
+  unsigned long start;
+  unsigned long time;
+  long index;
+  long count;
+  long idx;
+  int timeoffset;
+  int interval;
+  int shift;
+
+  if ( argc != 5 )
+    {
+      usage ();
+      return 1;
+    }
+
+  index = strtol (argv[3], NULL, 10);
+  count = strtol (argv[4], NULL, 10);
+
+  if ( index < 0 || count < 1 )
+    {
+      usage ();
+      return 1;
+    }
+
+  if ( ! (ifp = fopen (argv[1], "rb")) )
+    {
+      fprintf (stderr, "Cannot open %s\n", argv[1]);
+      return 1;
+    }
+
+  if ( fseek (ifp, index * BLOCKSIZE, SEEK_SET) || fread (block, BLOCKSIZE, 1, ifp) != 1 )
+    {
+      fprintf (stderr, "Cannot read block %ld of %s\n", index, argv[1]);
+      return 1;
+    }
+
+  fclose (ifp);
+
+  /* The header is little-endian, MARS-88 data formats are below 3 */
+  timeoffset = ( block[FORMATOFFSET] < 3 ) ? M88TIMEOFFSET : LITETIMEOFFSET;
+  start = (unsigned long) block[timeoffset] | (unsigned long) block[timeoffset + 1] << 8 |
+    (unsigned long) block[timeoffset + 2] << 16 | (unsigned long) block[timeoffset + 3] << 24;
+
+  /* Sample interval of 2^N ms, a block must span whole seconds */
+  interval = SAMPLES * (1 << block[RATEOFFSET]);
+
+  if ( interval % 1000 )
+    {
+      fprintf (stderr, "Block %ld of %s does not span whole seconds\n", index, argv[1]);
+      return 1;
+    }
+
+  if ( ! (ofp = fopen (argv[2], "wb")) )
+    {
+      fprintf (stderr, "Cannot write %s\n", argv[2]);
+      return 1;
+    }
+
+  for ( idx = 0; idx < count; idx++ )
+    {
+      memcpy (copy, block, DATAOFFSET);
+
+      /* Rotate the 16-bit samples */
+      shift = (int) ((idx * 37) % SAMPLES);
+      memcpy (copy + DATAOFFSET, block + DATAOFFSET + shift * 2, (SAMPLES - shift) * 2);
+      memcpy (copy + DATAOFFSET + (SAMPLES - shift) * 2, block + DATAOFFSET, shift * 2);
+      memcpy (copy + DATAOFFSET + SAMPLES * 2, block + DATAOFFSET + SAMPLES * 2,
+	      BLOCKSIZE - DATAOFFSET - SAMPLES * 2);
+
+      time = start + (unsigned long) idx * (interval / 1000);
+      copy[timeoffset] = time & 0xff;
+      copy[timeoffset + 1] = (time >> 8) & 0xff;
+      copy[timeoffset + 2] = (time >> 16) & 0xff;
+      copy[timeoffset + 3] = (time >> 24) & 0xff;
+
+      if ( fwrite (copy, BLOCKSIZE, 1, ofp) != 1 )
+	{
+	  fprintf (stderr, "Cannot write %s\n", argv[2]);
+	  return 1;
+	}
+    }
+
+  fclose (ofp);
+
+  return 0;
+}  /* End of main() */
+
+
+/***************************************************************************
+ * usage:
+ *
+ * Print the usage message.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "Usage: marstrace infile outfile block count\n\n");
+  fprintf (stderr, " block Index of the data block to repeat\n");
+  fprintf (stderr, " count Number of copies to write\n");
+}  /* End of usage() */